@@ -0,0 +1,190 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "igt_audio.h"
+
+/*
+ * Throughput of audio_signal_fill(), in millions of samples (frames times
+ * channels) per second, against filling the buffer one frequency, frame and
+ * channel at a time as igt_audio used to.
+ */
+
+#define FREQS_MAX 8
+
+static const int freqs[FREQS_MAX] = {
+	300, 600, 1200, 10000, 80, 4000, 7000, 15000,
+};
+
+struct old_freq {
+	short *period;
+	int frames;
+	int offset;
+};
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static void old_synthesize(struct old_freq *f, int count, int rate)
+{
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		int freq = rate / (rate / freqs[i]);
+
+		f[i].frames = rate / freq;
+		f[i].offset = 0;
+		f[i].period = calloc(f[i].frames, sizeof(short));
+		for (j = 0; j < f[i].frames; j++)
+			f[i].period[j] = sin(2.0 * M_PI * freq / rate * j) *
+					 SHRT_MAX / count;
+	}
+}
+
+static void old_fill(struct old_freq *f, int count, int channels,
+		     short *buffer, int frames)
+{
+	int total, n, i, j, k;
+
+	memset(buffer, 0, sizeof(short) * channels * frames);
+
+	for (i = 0; i < count; i++) {
+		for (total = 0; total < frames; total += n) {
+			short *src = f[i].period + f[i].offset;
+			short *dst = buffer + total * channels;
+
+			n = f[i].frames - f[i].offset;
+			if (n > frames - total)
+				n = frames - total;
+
+			f[i].offset = (f[i].offset + n) % f[i].frames;
+
+			for (j = 0; j < n; j++)
+				for (k = 0; k < channels; k++)
+					dst[j * channels + k] += src[j];
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int rate = 192000, channels = 2, count = 4, period = 1024;
+	unsigned int reps = 5, i, j, calls;
+	struct old_freq old[FREQS_MAX];
+	struct audio_signal *signal;
+	double best[2] = {};
+	short *buffer;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:c:f:p:r:")) != -1) {
+		switch (c) {
+		case 's':
+			rate = atoi(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 'f':
+			count = atoi(optarg);
+			break;
+		case 'p':
+			/* Frames per call, like an ALSA period */
+			period = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-s sampling rate] [-c channels] [-f frequencies] [-p period] [-r reps]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (count < 1 || count > FREQS_MAX || channels < 1 || period < 1 ||
+	    rate < 2 * freqs[FREQS_MAX - 1]) {
+		fprintf(stderr, "Invalid parameters\n");
+		return 1;
+	}
+	if (reps < 1)
+		reps = 1;
+
+	/* About a second of audio per rep */
+	calls = rate / period + 1;
+
+	buffer = malloc(sizeof(short) * channels * period);
+
+	signal = audio_signal_init(channels, rate);
+	for (i = 0; i < count; i++)
+		audio_signal_add_frequency(signal, freqs[i]);
+	audio_signal_synthesize(signal);
+
+	old_synthesize(old, count, rate);
+
+	for (i = 0; i < reps; i++) {
+		struct timespec start, end;
+		double msamples;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < calls; j++)
+			old_fill(old, count, channels, buffer, period);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		msamples = (double)calls * period * channels /
+			   elapsed(&start, &end) / 1e6;
+		if (msamples > best[0])
+			best[0] = msamples;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < calls; j++)
+			audio_signal_fill(signal, buffer, period);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		msamples = (double)calls * period * channels /
+			   elapsed(&start, &end) / 1e6;
+		if (msamples > best[1])
+			best[1] = msamples;
+	}
+
+	printf("%-24s %8.1f Msamples/s\n", "per sample", best[0]);
+	printf("%-24s %8.1f Msamples/s\n", "audio_signal_fill", best[1]);
+
+	for (i = 0; i < count; i++)
+		free(old[i].period);
+	audio_signal_clean(signal);
+	free(signal);
+	free(buffer);
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <unistd.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "igt_chamelium_crc.h"
+#include "igt_kernels.h"
+#include "igt_rand.h"
+
+/*
+ * Throughput of the reference frame CRC of the Chamelium, in millions of
+ * pixels per second, against hashing the frame once per CRC word as
+ * igt_chamelium used to.
+ */
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static uint32_t xrgb_hash16_multipass(const unsigned char *buffer, int width,
+				      int height, int k, int m)
+{
+	uint64_t sum = 0, count = 0;
+	int i;
+
+	for (i = 0; i < width * height; i++) {
+		const unsigned char *p = buffer + i * 4;
+
+		if ((i % m) != k)
+			continue;
+
+		sum += ++count * (p[2] | p[1] << 8 | p[0] << 16);
+	}
+
+	return ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+}
+
+static void multipass(uint32_t *hash, const unsigned char *buffer,
+		      int width, int height)
+{
+	int k;
+
+	for (k = 0; k < CHAMELIUM_CRC_WORDS; k++)
+		hash[k] = xrgb_hash16_multipass(buffer, width, height,
+						k, CHAMELIUM_CRC_WORDS);
+}
+
+/* Best time of @reps, the multi-pass hashing if @k is NULL */
+static double time_hash(const struct chamelium_crc_kernels *k, int threads,
+			const unsigned char *buffer, int width, int height,
+			int reps)
+{
+	uint32_t hash[CHAMELIUM_CRC_WORDS];
+	double best = HUGE_VAL;
+	int i;
+
+	for (i = 0; i < reps; i++) {
+		struct timespec start, end;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (!k)
+			multipass(hash, buffer, width, height);
+		else if (!threads)
+			chamelium_xrgb_hash16(hash, buffer, width, height);
+		else
+			chamelium_xrgb_hash16_with(k, hash, buffer,
+						   width, height, threads);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		if (elapsed(&start, &end) < best)
+			best = elapsed(&start, &end);
+	}
+
+	return best;
+}
+
+static void report(const char *name, double best, int width, int height)
+{
+	printf("%-24s %8.1f MPix/s\n", name, (double)width * height / best / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	int width = 3840, height = 2160, reps = 5, threads = 0;
+	unsigned char *buffer;
+	uint32_t seed = 0;
+	int c, i, f;
+
+	while ((c = getopt(argc, argv, "w:h:r:t:")) != -1) {
+		switch (c) {
+		case 'w':
+			width = atoi(optarg);
+			break;
+		case 'h':
+			height = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-w width] [-h height] [-r reps] [-t threads]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (width < 1)
+		width = 1;
+	if (height < 1)
+		height = 1;
+	if (reps < 1)
+		reps = 1;
+
+	buffer = malloc((size_t)width * height * 4);
+	if (!buffer)
+		return 1;
+	for (i = 0; i < width * height * 4; i++)
+		buffer[i] = hars_petruska_f54_1_random(&seed);
+
+	report("multi-pass",
+	       time_hash(NULL, 1, buffer, width, height, reps),
+	       width, height);
+
+	/* Each implementation on a single thread */
+	for (f = 0; f < igt_kernels_num_features; f++) {
+		unsigned features = igt_kernels_features[f].features;
+		const struct chamelium_crc_kernels *k =
+			chamelium_crc_kernels(features);
+
+		if ((igt_x86_features() & features) != features ||
+		    k->features != features)
+			continue;
+
+		report(k->name, time_hash(k, 1, buffer, width, height, reps),
+		       width, height);
+	}
+
+	report(threads ? "threads" : "default",
+	       time_hash(chamelium_crc_kernels(igt_x86_features()), threads,
+			 buffer, width, height, reps),
+	       width, height);
+
+	free(buffer);
+
+	return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "igt_chamelium.h"
+#include "igt_chamelium_mock.h"
+
+/*
+ * Throughput of the Chamelium client code, XML-RPC transfer and decoding
+ * included, against a local mock Chamelium.
+ */
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/* Stands in for rendering the reference frame and comparing */
+static void verify(int verify_us)
+{
+	double end = now() + verify_us * 1e-6;
+
+	while (now() < end)
+		;
+}
+
+int main(int argc, char **argv)
+{
+	struct chamelium_mock_params params = {
+		.num_ports = 1,
+		.width = 1920,
+		.height = 1080,
+	};
+	struct chamelium_port **ports;
+	struct chamelium_mock *mock;
+	struct chamelium *chamelium;
+	struct chamelium_capture_queue *queue;
+	int reps = 20, frames = 10, verify_us = 10000;
+	double start, t;
+	size_t bytes;
+	int c, i, n;
+
+	while ((c = getopt(argc, argv, "w:h:l:r:f:v:")) != -1) {
+		switch (c) {
+		case 'w':
+			params.width = atoi(optarg);
+			break;
+		case 'h':
+			params.height = atoi(optarg);
+			break;
+		case 'l':
+			/* Latency of each call (microseconds) */
+			params.latency_us = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 'f':
+			/* Frames per capture */
+			frames = atoi(optarg);
+			break;
+		case 'v':
+			/* Time to verify each frame (microseconds) */
+			verify_us = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-w width] [-h height] [-l latency_us] [-r reps] [-f frames] [-v verify_us]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (reps < 1)
+		reps = 1;
+	if (frames < 1)
+		frames = 1;
+	params.frame_limit = frames;
+
+	mock = chamelium_mock_start(&params);
+	if (!mock)
+		return 1;
+
+	chamelium = chamelium_init_url(chamelium_mock_get_url(mock));
+	if (!chamelium)
+		return 1;
+
+	ports = chamelium_get_ports(chamelium, &n);
+	chamelium_plug(chamelium, ports[0]);
+
+	start = now();
+	for (i = 0; i < reps; i++)
+		chamelium_is_plugged(chamelium, ports[0]);
+	t = now() - start;
+	printf("%-24s %8.1f us/call\n", "call", t / reps * 1e6);
+
+	bytes = 0;
+	start = now();
+	for (i = 0; i < reps; i++) {
+		struct chamelium_frame_dump *dump =
+			chamelium_port_dump_pixels(chamelium, ports[0],
+						   0, 0, 0, 0);
+
+		bytes += (size_t)params.width * params.height * 3;
+		chamelium_destroy_frame_dump(dump);
+	}
+	t = now() - start;
+	printf("%-24s %8.1f frames/s %8.1f MB/s\n", "dump pixels",
+	       reps / t, bytes / t / 1e6);
+
+	chamelium_capture(chamelium, ports[0], 0, 0, 0, 0, frames);
+
+	start = now();
+	for (i = 0; i < reps; i++)
+		free(chamelium_read_captured_crcs(chamelium, &n));
+	t = now() - start;
+	printf("%-24s %8.1f CRCs/s\n", "read captured crcs",
+	       (double)reps * frames / t);
+
+	bytes = 0;
+	start = now();
+	for (i = 0; i < reps; i++) {
+		struct chamelium_frame_dump *dump =
+			chamelium_read_captured_frame(chamelium, i % frames);
+
+		bytes += (size_t)params.width * params.height * 3;
+		chamelium_destroy_frame_dump(dump);
+	}
+	t = now() - start;
+	printf("%-24s %8.1f frames/s %8.1f MB/s\n", "read captured frame",
+	       reps / t, bytes / t / 1e6);
+
+	start = now();
+	for (i = 0; i < reps; i++) {
+		struct chamelium_frame_dump *dump =
+			chamelium_read_captured_frame(chamelium, i % frames);
+
+		verify(verify_us);
+		chamelium_destroy_frame_dump(dump);
+	}
+	t = now() - start;
+	printf("%-24s %8.1f frames/s\n", "read and verify", reps / t);
+
+	queue = chamelium_capture_queue_create(chamelium, 1);
+	start = now();
+	for (i = 0; i < reps; i++)
+		chamelium_capture_queue_read_captured_frame(queue, i % frames);
+	for (i = 0; i < reps; i++) {
+		struct chamelium_frame_dump *dump =
+			chamelium_capture_queue_wait(queue);
+
+		verify(verify_us);
+		chamelium_destroy_frame_dump(dump);
+	}
+	t = now() - start;
+	chamelium_capture_queue_destroy(queue);
+	printf("%-24s %8.1f frames/s\n", "pipelined read and verify",
+	       reps / t);
+
+	printf("%lu calls\n", chamelium_mock_get_call_count(mock));
+
+	free(ports);
+	chamelium_deinit(chamelium);
+	chamelium_mock_stop(mock);
+
+	return 0;
+}
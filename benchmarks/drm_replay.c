@@ -0,0 +1,917 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Records the DRM ioctls of a program along with what the kernel answered,
+ * and answers them again from the recording without any device, so the
+ * userspace side of tests and library code can be run and profiled on
+ * machines without a GPU:
+ *
+ *   IGT_DRM_RECORD=kms.rec LD_PRELOAD=drm_replay.so kms_plane --run-subtest ...
+ *   IGT_DRM_REPLAY=kms.rec LD_PRELOAD=drm_replay.so perf record kms_plane ...
+ *
+ * Replay matches each ioctl to a recorded one with the same request on the
+ * same device, in recorded order, and for the KMS, core and i915 getters
+ * also with the same object id, copying back the arrays the kernel filled
+ * in. Opening a recorded /dev/dri node gives a /dev/null fd, whose mmaps
+ * are anonymous memory. Forked children aren't recorded, and only what the
+ * program got from the recording is meaningful: this measures the CPU
+ * overhead of the program, not the behaviour of the kernel.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <drm.h>
+#include <drm_mode.h>
+#include <i915_drm.h>
+
+#define DRM_MAJOR 226
+
+static int (*libc_open)(const char *path, int flags, ...);
+static int (*libc_open64)(const char *path, int flags, ...);
+static int (*libc_close)(int fd);
+static int (*libc_ioctl)(int fd, unsigned long request, ...);
+static void *(*libc_mmap)(void *addr, size_t len, int prot, int flags,
+			  int fd, off_t offset);
+static void *(*libc_mmap64)(void *addr, size_t len, int prot, int flags,
+			    int fd, off64_t offset);
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static enum { PASSTHROUGH, RECORD, REPLAY } mode;
+
+/* The fds of the DRM devices, and the fd they had in the recording */
+struct drm_fd {
+	int fd;
+	int recorded_fd;
+	struct drm_fd *next;
+};
+
+static struct drm_fd *drm_fds;
+
+/* File format */
+
+static const char magic[8] = "IGTDRMRR";
+#define VERSION 1
+
+enum {
+	OPEN = 0,
+	IOCTL,
+};
+
+/*
+ * Followed by the argument as given to the kernel, the argument as
+ * returned by the kernel, and @data_size bytes of data. For OPEN the
+ * request is the st_rdev of the device and the data is the path. For
+ * IOCTL the data is, for each of the arrays the kernel filled, a 32 bit
+ * count of elements and the elements.
+ */
+struct drm_replay_record {
+	uint32_t type;
+	int32_t fd;
+	uint64_t request;
+	int32_t ret;
+	int32_t err;
+	uint32_t arg_size;
+	uint32_t data_size;
+};
+
+/*
+ * The ioctls returning data through pointers in their argument, and the
+ * field identifying the object they query, if any.
+ */
+struct ioctl_array {
+	unsigned int ptr, ptr_size;
+	unsigned int count, count_size; /* one element if count_size is 0 */
+	unsigned int elem_size;
+};
+
+struct ioctl_desc {
+	unsigned long request;
+	unsigned int key, key_size;
+	struct ioctl_array arrays[4];
+};
+
+#define KEY(T, f) offsetof(T, f), sizeof(((T *)0)->f)
+#define ARRAY(T, ptr, count, elem_size) \
+	{ KEY(T, ptr), KEY(T, count), elem_size }
+#define ONE(T, ptr, elem_size) \
+	{ KEY(T, ptr), 0, 0, elem_size }
+
+static const struct ioctl_desc ioctl_descs[] = {
+	{ DRM_IOCTL_VERSION, 0, 0, {
+		ARRAY(struct drm_version, name, name_len, 1),
+		ARRAY(struct drm_version, date, date_len, 1),
+		ARRAY(struct drm_version, desc, desc_len, 1),
+	} },
+	{ DRM_IOCTL_GET_CAP, KEY(struct drm_get_cap, capability) },
+	{ DRM_IOCTL_MODE_GETRESOURCES, 0, 0, {
+		ARRAY(struct drm_mode_card_res, fb_id_ptr, count_fbs, 4),
+		ARRAY(struct drm_mode_card_res, crtc_id_ptr, count_crtcs, 4),
+		ARRAY(struct drm_mode_card_res, connector_id_ptr, count_connectors, 4),
+		ARRAY(struct drm_mode_card_res, encoder_id_ptr, count_encoders, 4),
+	} },
+	{ DRM_IOCTL_MODE_GETPLANERESOURCES, 0, 0, {
+		ARRAY(struct drm_mode_get_plane_res, plane_id_ptr, count_planes, 4),
+	} },
+	{ DRM_IOCTL_MODE_GETCRTC, KEY(struct drm_mode_crtc, crtc_id) },
+	{ DRM_IOCTL_MODE_GETENCODER, KEY(struct drm_mode_get_encoder, encoder_id) },
+	{ DRM_IOCTL_MODE_GETFB, KEY(struct drm_mode_fb_cmd, fb_id) },
+	{ DRM_IOCTL_MODE_GETCONNECTOR, KEY(struct drm_mode_get_connector, connector_id), {
+		ARRAY(struct drm_mode_get_connector, encoders_ptr, count_encoders, 4),
+		ARRAY(struct drm_mode_get_connector, modes_ptr, count_modes,
+		      sizeof(struct drm_mode_modeinfo)),
+		ARRAY(struct drm_mode_get_connector, props_ptr, count_props, 4),
+		ARRAY(struct drm_mode_get_connector, prop_values_ptr, count_props, 8),
+	} },
+	{ DRM_IOCTL_MODE_GETPLANE, KEY(struct drm_mode_get_plane, plane_id), {
+		ARRAY(struct drm_mode_get_plane, format_type_ptr, count_format_types, 4),
+	} },
+	{ DRM_IOCTL_MODE_GETPROPERTY, KEY(struct drm_mode_get_property, prop_id), {
+		ARRAY(struct drm_mode_get_property, values_ptr, count_values, 8),
+		ARRAY(struct drm_mode_get_property, enum_blob_ptr, count_enum_blobs,
+		      sizeof(struct drm_mode_property_enum)),
+	} },
+	{ DRM_IOCTL_MODE_OBJ_GETPROPERTIES, KEY(struct drm_mode_obj_get_properties, obj_id), {
+		ARRAY(struct drm_mode_obj_get_properties, props_ptr, count_props, 4),
+		ARRAY(struct drm_mode_obj_get_properties, prop_values_ptr, count_props, 8),
+	} },
+	{ DRM_IOCTL_MODE_GETPROPBLOB, KEY(struct drm_mode_get_blob, blob_id), {
+		ARRAY(struct drm_mode_get_blob, data, length, 1),
+	} },
+	{ DRM_IOCTL_MODE_GETGAMMA, KEY(struct drm_mode_crtc_lut, crtc_id), {
+		ARRAY(struct drm_mode_crtc_lut, red, gamma_size, 2),
+		ARRAY(struct drm_mode_crtc_lut, green, gamma_size, 2),
+		ARRAY(struct drm_mode_crtc_lut, blue, gamma_size, 2),
+	} },
+	{ DRM_IOCTL_I915_GETPARAM, KEY(struct drm_i915_getparam, param), {
+		ONE(struct drm_i915_getparam, value, 4),
+	} },
+};
+
+static void __attribute__ ((format(__printf__, 2, 3)))
+fail_if(int cond, const char *format, ...)
+{
+	va_list args;
+
+	if (!cond)
+		return;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+
+	abort();
+}
+
+static const struct ioctl_desc *find_desc(unsigned long request)
+{
+	int i;
+
+	for (i = 0; i < sizeof(ioctl_descs) / sizeof(ioctl_descs[0]); i++)
+		if (ioctl_descs[i].request == request)
+			return &ioctl_descs[i];
+
+	return NULL;
+}
+
+static uint64_t get_field(const void *arg, unsigned int offset,
+			  unsigned int size)
+{
+	const uint8_t *p = (const uint8_t *)arg + offset;
+	uint32_t v32;
+	uint64_t v64;
+
+	if (size == sizeof(v32)) {
+		memcpy(&v32, p, sizeof(v32));
+		return v32;
+	}
+
+	memcpy(&v64, p, sizeof(v64));
+	return v64;
+}
+
+/* How many elements of the array are there in @arg */
+static uint64_t array_count(const struct ioctl_array *a, const void *arg)
+{
+	if (!a->count_size)
+		return 1;
+
+	return get_field(arg, a->count, a->count_size);
+}
+
+static struct drm_fd *find_fd(int fd)
+{
+	struct drm_fd *f;
+
+	for (f = drm_fds; f; f = f->next)
+		if (f->fd == fd)
+			return f;
+
+	return NULL;
+}
+
+static void add_fd(int fd, int recorded_fd)
+{
+	struct drm_fd *f = malloc(sizeof(*f));
+
+	fail_if(!f, "out of memory\n");
+	f->fd = fd;
+	f->recorded_fd = recorded_fd;
+	f->next = drm_fds;
+	drm_fds = f;
+}
+
+static void remove_fd(int fd)
+{
+	struct drm_fd *f, **p;
+
+	for (p = &drm_fds; (f = *p); p = &f->next) {
+		if (f->fd == fd) {
+			*p = f->next;
+			free(f);
+			break;
+		}
+	}
+}
+
+/* Recording */
+
+static int record_fd = -1;
+static uint8_t record_buf[64 << 10];
+static size_t record_len;
+
+static void record_flush(void)
+{
+	size_t done = 0;
+
+	while (done < record_len) {
+		ssize_t ret = write(record_fd, record_buf + done,
+				    record_len - done);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		fail_if(ret <= 0, "failed to write the recording: %m\n");
+		done += ret;
+	}
+
+	record_len = 0;
+}
+
+static void record_write(const void *data, size_t size)
+{
+	while (size) {
+		size_t len = sizeof(record_buf) - record_len;
+
+		if (!len) {
+			record_flush();
+			continue;
+		}
+
+		if (len > size)
+			len = size;
+
+		memcpy(record_buf + record_len, data, len);
+		record_len += len;
+		data = (const uint8_t *)data + len;
+		size -= len;
+	}
+}
+
+static void record_open(int fd, const char *path)
+{
+	struct drm_replay_record r = { .type = OPEN, .fd = fd };
+	struct stat st;
+
+	if (fstat(fd, &st) || !S_ISCHR(st.st_mode) ||
+	    major(st.st_rdev) != DRM_MAJOR)
+		return;
+
+	r.request = st.st_rdev;
+	r.data_size = strlen(path) + 1;
+
+	pthread_mutex_lock(&mutex);
+	if (record_fd != -1) {
+		remove_fd(fd);
+		add_fd(fd, fd);
+		record_write(&r, sizeof(r));
+		record_write(path, r.data_size);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+static int record_ioctl(int fd, unsigned long request, void *argp)
+{
+	const struct ioctl_desc *desc = find_desc(request);
+	struct drm_replay_record r = {
+		.type = IOCTL,
+		.fd = fd,
+		.request = request,
+	};
+	uint32_t counts[4] = {};
+	void *in = NULL;
+	int i;
+
+	if (argp)
+		r.arg_size = _IOC_SIZE(request);
+
+	if (r.arg_size) {
+		in = malloc(r.arg_size);
+		fail_if(!in, "out of memory\n");
+		memcpy(in, argp, r.arg_size);
+	}
+
+	r.ret = libc_ioctl(fd, request, argp);
+	r.err = r.ret ? errno : 0;
+
+	/* What the kernel copied, at most what both sides had room for */
+	if (desc && r.arg_size && r.ret == 0) {
+		for (i = 0; i < 4 && desc->arrays[i].elem_size; i++) {
+			const struct ioctl_array *a = &desc->arrays[i];
+			uint64_t count = array_count(a, in);
+
+			if (array_count(a, argp) < count)
+				count = array_count(a, argp);
+			if (!get_field(in, a->ptr, a->ptr_size))
+				count = 0;
+
+			counts[i] = count;
+			r.data_size += sizeof(counts[i]) +
+				       counts[i] * a->elem_size;
+		}
+	}
+
+	pthread_mutex_lock(&mutex);
+	if (record_fd != -1) {
+		record_write(&r, sizeof(r));
+		record_write(in, r.arg_size);
+		record_write(argp, r.arg_size);
+
+		for (i = 0; r.data_size && i < 4 && desc->arrays[i].elem_size; i++) {
+			const struct ioctl_array *a = &desc->arrays[i];
+			uintptr_t ptr = get_field(in, a->ptr, a->ptr_size);
+
+			record_write(&counts[i], sizeof(counts[i]));
+			record_write((void *)ptr, counts[i] * a->elem_size);
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+
+	free(in);
+
+	errno = r.err;
+	return r.ret;
+}
+
+static void record_prepare_fork(void)
+{
+	pthread_mutex_lock(&mutex);
+}
+
+static void record_parent_fork(void)
+{
+	pthread_mutex_unlock(&mutex);
+}
+
+/* What's buffered is the parent's to write */
+static void record_child_fork(void)
+{
+	libc_close(record_fd);
+	record_fd = -1;
+	record_len = 0;
+	pthread_mutex_unlock(&mutex);
+}
+
+static void record_init(const char *path)
+{
+	static const uint32_t version = VERSION;
+
+	record_fd = libc_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+			      0644);
+	fail_if(record_fd < 0, "failed to create %s: %m\n", path);
+
+	record_write(magic, sizeof(magic));
+	record_write(&version, sizeof(version));
+
+	pthread_atfork(record_prepare_fork, record_parent_fork,
+		       record_child_fork);
+}
+
+/* Replay */
+
+/* The header is copied out as records aren't aligned in the file */
+struct record {
+	struct drm_replay_record r;
+	const uint8_t *in, *out, *data;
+};
+
+/* The ioctls of a recorded fd with a given request, in recorded order */
+struct bucket {
+	int fd;
+	unsigned long request;
+	struct record *records;
+	unsigned int count, cursor;
+	struct bucket *next;
+};
+
+#define NUM_BUCKETS 1024
+
+static struct bucket *buckets[NUM_BUCKETS];
+static struct record *opens;
+static unsigned int num_opens, open_cursor;
+static unsigned long replayed, missed;
+
+static unsigned int bucket_hash(int fd, unsigned long request)
+{
+	return (request * 0x9e3779b1u + fd) % NUM_BUCKETS;
+}
+
+static struct bucket *find_bucket(int fd, unsigned long request, bool create)
+{
+	unsigned int hash = bucket_hash(fd, request);
+	struct bucket *b;
+
+	for (b = buckets[hash]; b; b = b->next)
+		if (b->fd == fd && b->request == request)
+			return b;
+
+	if (!create)
+		return NULL;
+
+	b = calloc(1, sizeof(*b));
+	fail_if(!b, "out of memory\n");
+	b->fd = fd;
+	b->request = request;
+	b->next = buckets[hash];
+	buckets[hash] = b;
+
+	return b;
+}
+
+static void add_record(struct record **records, unsigned int *count,
+		       const struct record *rec)
+{
+	/* Grown in powers of two */
+	if ((*count & (*count - 1)) == 0) {
+		*records = realloc(*records,
+				   (*count ? 2 * *count : 1) * sizeof(**records));
+		fail_if(!*records, "out of memory\n");
+	}
+
+	(*records)[(*count)++] = *rec;
+}
+
+static void replay_init(const char *path)
+{
+	struct stat st;
+	uint8_t *buf, *end, *p;
+	uint32_t version;
+	int fd;
+
+	fd = libc_open(path, O_RDONLY | O_CLOEXEC);
+	fail_if(fd < 0 || fstat(fd, &st), "failed to open %s: %m\n", path);
+
+	/* Kept for the lifetime of the process */
+	buf = libc_mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	fail_if(buf == MAP_FAILED, "failed to map %s: %m\n", path);
+	libc_close(fd);
+
+	end = buf + st.st_size;
+	fail_if(st.st_size < sizeof(magic) + sizeof(version) ||
+		memcmp(buf, magic, sizeof(magic)),
+		"%s is not a DRM recording\n", path);
+	memcpy(&version, buf + sizeof(magic), sizeof(version));
+	fail_if(version != VERSION, "%s: unsupported version %u\n",
+		path, version);
+
+	p = buf + sizeof(magic) + sizeof(version);
+	while (p < end) {
+		size_t offset = p - buf;
+		struct record rec;
+
+		fail_if(end - p < sizeof(rec.r),
+			"%s: truncated at offset %zu\n", path, offset);
+		memcpy(&rec.r, p, sizeof(rec.r));
+		fail_if(end - p - sizeof(rec.r) <
+			2 * (uint64_t)rec.r.arg_size + rec.r.data_size,
+			"%s: truncated at offset %zu\n", path, offset);
+
+		rec.in = p + sizeof(rec.r);
+		rec.out = rec.in + rec.r.arg_size;
+		rec.data = rec.out + rec.r.arg_size;
+		p = (uint8_t *)rec.data + rec.r.data_size;
+
+		if (rec.r.type == OPEN) {
+			fail_if(!rec.r.data_size ||
+				rec.data[rec.r.data_size - 1],
+				"%s: bad path at offset %zu\n", path, offset);
+			add_record(&opens, &num_opens, &rec);
+		} else {
+			struct bucket *b = find_bucket(rec.r.fd,
+						       rec.r.request, true);
+
+			add_record(&b->records, &b->count, &rec);
+		}
+	}
+}
+
+static int replay_open(const char *path, int flags)
+{
+	unsigned int i;
+	int fd;
+
+	for (i = 0; i < num_opens; i++) {
+		const struct record *rec = &opens[(open_cursor + i) % num_opens];
+
+		if (strcmp((const char *)rec->data, path))
+			continue;
+
+		fd = libc_open("/dev/null", O_RDWR | (flags & O_CLOEXEC));
+		if (fd < 0)
+			return fd;
+
+		open_cursor = (open_cursor + i + 1) % num_opens;
+		add_fd(fd, rec->r.fd);
+		return fd;
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
+static bool replay_key_matches(const struct ioctl_desc *desc,
+			       const struct record *rec, const void *argp)
+{
+	return !desc || !desc->key_size ||
+		memcmp(rec->in + desc->key, (const uint8_t *)argp + desc->key,
+		       desc->key_size) == 0;
+}
+
+/*
+ * The count-then-fill pairs of calls are recorded as two ioctls with the
+ * same key, prefer the one with as many elements as the caller wants.
+ */
+static bool replay_has_arrays(const struct ioctl_desc *desc,
+			      const struct record *rec, const void *argp)
+{
+	const uint8_t *data = rec->data;
+	int i;
+
+	if (!desc)
+		return true;
+
+	for (i = 0; i < 4 && desc->arrays[i].elem_size; i++) {
+		const struct ioctl_array *a = &desc->arrays[i];
+		uint64_t wanted = array_count(a, argp);
+		uint32_t count = 0;
+
+		if (rec->r.data_size) {
+			memcpy(&count, data, sizeof(count));
+			data += sizeof(count) + count * a->elem_size;
+		}
+
+		if (!get_field(argp, a->ptr, a->ptr_size))
+			continue;
+
+		if (array_count(a, rec->out) < wanted)
+			wanted = array_count(a, rec->out);
+
+		if (count < wanted)
+			return false;
+	}
+
+	return true;
+}
+
+static void replay_arrays(const struct ioctl_desc *desc,
+			  const struct record *rec, void *argp,
+			  const void *caller)
+{
+	const uint8_t *data = rec->data;
+	int i;
+
+	for (i = 0; i < 4 && desc->arrays[i].elem_size; i++) {
+		const struct ioctl_array *a = &desc->arrays[i];
+		uintptr_t ptr = get_field(caller, a->ptr, a->ptr_size);
+		uint64_t count = array_count(a, caller);
+		uint32_t recorded = 0;
+
+		/* The pointers are the caller's, not the recorded ones */
+		memcpy((uint8_t *)argp + a->ptr, (const uint8_t *)caller + a->ptr,
+		       a->ptr_size);
+
+		if (rec->r.data_size) {
+			memcpy(&recorded, data, sizeof(recorded));
+			data += sizeof(recorded);
+		}
+
+		if (recorded < count)
+			count = recorded;
+		if (ptr && count)
+			memcpy((void *)ptr, data, count * a->elem_size);
+
+		data += recorded * a->elem_size;
+	}
+}
+
+static int replay_ioctl(int recorded_fd, unsigned long request, void *argp)
+{
+	const struct ioctl_desc *desc = find_desc(request);
+	const struct record *rec = NULL;
+	unsigned int size = argp ? _IOC_SIZE(request) : 0;
+	struct bucket *b;
+	unsigned int i, n, start;
+
+	pthread_mutex_lock(&mutex);
+
+	b = find_bucket(recorded_fd, request, false);
+	start = b ? b->cursor : 0;
+	for (i = 0; b && i < b->count; i++) {
+		const struct record *r;
+		bool complete;
+
+		n = (start + i) % b->count;
+		r = &b->records[n];
+		if (r->r.arg_size != size ||
+		    !replay_key_matches(desc, r, argp))
+			continue;
+
+		complete = replay_has_arrays(desc, r, argp);
+		if (!rec || complete) {
+			rec = r;
+			b->cursor = (n + 1) % b->count;
+		}
+
+		if (complete)
+			break;
+	}
+
+	if (!rec) {
+		missed++;
+		pthread_mutex_unlock(&mutex);
+
+		errno = ENOTTY;
+		return -1;
+	}
+
+	replayed++;
+	pthread_mutex_unlock(&mutex);
+
+	if (desc && size) {
+		uint8_t *caller = malloc(size);
+
+		fail_if(!caller, "out of memory\n");
+		memcpy(caller, argp, size);
+		memcpy(argp, rec->out, size);
+		replay_arrays(desc, rec, argp, caller);
+		free(caller);
+	} else {
+		/* Only what the kernel changed, to leave pointers alone */
+		for (i = 0; i < size; i++)
+			if (rec->in[i] != rec->out[i])
+				((uint8_t *)argp)[i] = rec->out[i];
+	}
+
+	if (request == DRM_IOCTL_I915_GEM_MMAP && rec->r.ret == 0) {
+		struct drm_i915_gem_mmap *arg = argp;
+		void *ptr;
+
+		ptr = libc_mmap(NULL, arg->size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+			return -1;
+
+		arg->addr_ptr = (uintptr_t)ptr;
+	}
+
+	errno = rec->r.err;
+	return rec->r.ret;
+}
+
+static bool is_replayed(int fd)
+{
+	bool ret;
+
+	if (mode != REPLAY)
+		return false;
+
+	pthread_mutex_lock(&mutex);
+	ret = find_fd(fd);
+	pthread_mutex_unlock(&mutex);
+
+	return ret;
+}
+
+static void init(void)
+{
+	const char *path;
+
+	libc_open = dlsym(RTLD_NEXT, "open");
+	libc_open64 = dlsym(RTLD_NEXT, "open64");
+	libc_close = dlsym(RTLD_NEXT, "close");
+	libc_ioctl = dlsym(RTLD_NEXT, "ioctl");
+	libc_mmap = dlsym(RTLD_NEXT, "mmap");
+	libc_mmap64 = dlsym(RTLD_NEXT, "mmap64");
+	fail_if(!libc_open || !libc_open64 || !libc_close || !libc_ioctl ||
+		!libc_mmap || !libc_mmap64,
+		"failed to get libc open, close, ioctl or mmap\n");
+
+	if ((path = getenv("IGT_DRM_REPLAY"))) {
+		replay_init(path);
+		mode = REPLAY;
+	} else if ((path = getenv("IGT_DRM_RECORD"))) {
+		record_init(path);
+		mode = RECORD;
+	}
+}
+
+static bool is_drm_path(const char *path)
+{
+	return strncmp(path, "/dev/dri/", 9) == 0;
+}
+
+static int drm_open(int (*libc)(const char *path, int flags, ...),
+		    const char *path, int flags, mode_t mode_bits)
+{
+	int fd;
+
+	if (mode == REPLAY && is_drm_path(path)) {
+		pthread_mutex_lock(&mutex);
+		fd = replay_open(path, flags);
+		pthread_mutex_unlock(&mutex);
+
+		return fd;
+	}
+
+	fd = libc(path, flags, mode_bits);
+	if (mode == RECORD && fd >= 0 && is_drm_path(path)) {
+		int err = errno;
+
+		record_open(fd, path);
+		errno = err;
+	}
+
+	return fd;
+}
+
+int
+open(const char *path, int flags, ...)
+{
+	mode_t mode_bits = 0;
+	va_list args;
+
+	pthread_once(&once, init);
+
+	va_start(args, flags);
+	if (flags & O_CREAT || (flags & O_TMPFILE) == O_TMPFILE)
+		mode_bits = va_arg(args, mode_t);
+	va_end(args);
+
+	return drm_open(libc_open, path, flags, mode_bits);
+}
+
+int
+open64(const char *path, int flags, ...)
+{
+	mode_t mode_bits = 0;
+	va_list args;
+
+	pthread_once(&once, init);
+
+	va_start(args, flags);
+	if (flags & O_CREAT || (flags & O_TMPFILE) == O_TMPFILE)
+		mode_bits = va_arg(args, mode_t);
+	va_end(args);
+
+	return drm_open(libc_open64, path, flags, mode_bits);
+}
+
+int
+close(int fd)
+{
+	pthread_once(&once, init);
+
+	if (mode != PASSTHROUGH) {
+		pthread_mutex_lock(&mutex);
+		remove_fd(fd);
+		pthread_mutex_unlock(&mutex);
+	}
+
+	return libc_close(fd);
+}
+
+int
+ioctl(int fd, unsigned long request, ...)
+{
+	struct drm_fd *f = NULL;
+	int recorded_fd = -1;
+	va_list args;
+	void *argp;
+
+	pthread_once(&once, init);
+
+	va_start(args, request);
+	argp = va_arg(args, void *);
+	va_end(args);
+
+	if (mode != PASSTHROUGH) {
+		pthread_mutex_lock(&mutex);
+		f = find_fd(fd);
+		if (f)
+			recorded_fd = f->recorded_fd;
+		pthread_mutex_unlock(&mutex);
+	}
+
+	if (!f)
+		return libc_ioctl(fd, request, argp);
+
+	if (mode == REPLAY)
+		return replay_ioctl(recorded_fd, request, argp);
+
+	return record_ioctl(fd, request, argp);
+}
+
+/* Objects of replayed devices are backed by anonymous memory */
+void *
+mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+	pthread_once(&once, init);
+
+	if (is_replayed(fd))
+		return libc_mmap(addr, len, prot,
+				 (flags & MAP_FIXED) | MAP_PRIVATE | MAP_ANONYMOUS,
+				 -1, 0);
+
+	return libc_mmap(addr, len, prot, flags, fd, offset);
+}
+
+void *
+mmap64(void *addr, size_t len, int prot, int flags, int fd, off64_t offset)
+{
+	pthread_once(&once, init);
+
+	if (is_replayed(fd))
+		return libc_mmap64(addr, len, prot,
+				   (flags & MAP_FIXED) | MAP_PRIVATE | MAP_ANONYMOUS,
+				   -1, 0);
+
+	return libc_mmap64(addr, len, prot, flags, fd, offset);
+}
+
+static void __attribute__ ((constructor))
+drm_replay_init(void)
+{
+	pthread_once(&once, init);
+}
+
+static void __attribute__ ((destructor))
+drm_replay_fini(void)
+{
+	if (mode == RECORD) {
+		pthread_mutex_lock(&mutex);
+		if (record_fd != -1)
+			record_flush();
+		pthread_mutex_unlock(&mutex);
+	}
+
+	if (mode == REPLAY && (replayed || missed))
+		fprintf(stderr, "drm_replay: %lu ioctls replayed, %lu not in the recording\n",
+			replayed, missed);
+}
@@ -60,6 +60,7 @@ struct gem_busyspin {
 struct sys_wait {
 	pthread_t thread;
 	struct igt_mean mean;
+	struct igt_stats_collector *latency;
 };
 
 static void force_low_latency(void)
@@ -160,6 +161,11 @@ static double elapsed(const struct timespec *a, const struct timespec *b)
 	return 1e9*(b->tv_sec - a->tv_sec) + (b->tv_nsec - a ->tv_nsec);
 }
 
+static uint64_t elapsed_ns(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000000000ull + b->tv_nsec - a->tv_nsec;
+}
+
 static void *sys_wait(void *arg)
 {
 	struct sys_wait *w = arg;
@@ -167,6 +173,7 @@ static void *sys_wait(void *arg)
 	timer_t timer;
 	sigset_t mask;
 	struct timespec now;
+	struct igt_stats_local *latency = igt_stats_collector_local(w->latency);
 #define SIG SIGRTMIN
 
 	sigemptyset(&mask);
@@ -196,6 +203,7 @@ static void *sys_wait(void *arg)
 		sigwait(&mask, &sigs);
 		clock_gettime(CLOCK_MONOTONIC, &now);
 		igt_mean_add(&w->mean, elapsed(&its.it_value, &now));
+		igt_stats_local_push(latency, elapsed_ns(&its.it_value, &now));
 	}
 
 	sigprocmask(SIG_UNBLOCK, &mask, NULL);
@@ -208,6 +216,7 @@ static void *sys_wait(void *arg)
 static void *sys_thp_alloc(void *arg)
 {
 	struct sys_wait *w = arg;
+	struct igt_stats_local *latency = igt_stats_collector_local(w->latency);
 	struct timespec now;
 
 	clock_gettime(CLOCK_MONOTONIC, &now);
@@ -227,6 +236,7 @@ static void *sys_thp_alloc(void *arg)
 
 		clock_gettime(CLOCK_MONOTONIC, &now);
 		igt_mean_add(&w->mean, elapsed(&start, &now));
+		igt_stats_local_push(latency, elapsed_ns(&start, &now));
 	}
 
 	return NULL;
@@ -359,7 +369,8 @@ int main(int argc, char **argv)
 	pthread_attr_t attr;
 	pthread_t bg_fs = 0;
 	int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
-	igt_stats_t cycles, mean, max;
+	struct igt_stats_collector latency;
+	igt_stats_t cycles, mean, max, all;
 	double min;
 	int time = 10;
 	int field = -1;
@@ -430,11 +441,14 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* Each thread keeps its own samples, not to perturb the others */
+	igt_stats_collector_init_streaming(&latency, 8);
 	wait = calloc(ncpus, sizeof(*wait));
 	pthread_attr_init(&attr);
 	rtprio(&attr, 99);
 	for (n = 0; n < ncpus; n++) {
 		igt_mean_init(&wait[n].mean);
+		wait[n].latency = &latency;
 		bind_cpu(&attr, n);
 		pthread_create(&wait[n].thread, &attr, sys_fn, &wait[n]);
 	}
@@ -457,6 +471,8 @@ int main(int argc, char **argv)
 		igt_stats_push_float(&mean, wait[n].mean.mean);
 		igt_stats_push_float(&max, wait[n].mean.max);
 	}
+	igt_stats_init_streaming(&all, 8);
+	igt_stats_collector_merge(&latency, &all);
 	if (bg_fs) {
 		pthread_cancel(bg_fs);
 		pthread_join(bg_fs, NULL);
@@ -464,10 +480,11 @@ int main(int argc, char **argv)
 
 	switch (field) {
 	default:
-		printf("gem_syslatency: cycles=%.0f, latency mean=%.3fus max=%.0fus\n",
+		printf("gem_syslatency: cycles=%.0f, latency mean=%.3fus max=%.0fus p99=%.0fus\n",
 		       igt_stats_get_mean(&cycles),
 		       (igt_stats_get_mean(&mean) - min)/ 1000,
-		       (l_estimate(&max) - min) / 1000);
+		       (l_estimate(&max) - min) / 1000,
+		       (igt_stats_get_percentile(&all, 99) - min) / 1000);
 		break;
 	case 0:
 		printf("%.0f\n", igt_stats_get_mean(&cycles));
@@ -478,8 +495,18 @@ int main(int argc, char **argv)
 	case 2:
 		printf("%.0f\n", (l_estimate(&max) - min) / 1000);
 		break;
+	case 3:
+		printf("%.0f\n",
+		       (igt_stats_get_percentile(&all, 99) - min) / 1000);
+		break;
 	}
 
+	igt_stats_fini(&all);
+	igt_stats_fini(&max);
+	igt_stats_fini(&mean);
+	igt_stats_fini(&cycles);
+	igt_stats_collector_fini(&latency);
+
 	return 0;
 
 }
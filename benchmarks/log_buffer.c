@@ -0,0 +1,178 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "igt_core.h"
+
+/*
+ * Rate of igt_debug() calls which only end up in the log buffer, from a
+ * number of threads, against the mutex protected ring of allocated lines
+ * igt_core used to keep.
+ */
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static struct {
+	char *entries[256];
+	uint8_t start, end;
+} old_buffer;
+static pthread_mutex_t old_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void old_append(char *line)
+{
+	pthread_mutex_lock(&old_buffer_mutex);
+
+	free(old_buffer.entries[old_buffer.end]);
+	old_buffer.entries[old_buffer.end] = line;
+	old_buffer.end++;
+	if (old_buffer.end == old_buffer.start)
+		old_buffer.start++;
+
+	pthread_mutex_unlock(&old_buffer_mutex);
+}
+
+/* igt_vlog() as it was, for a line below the log level */
+static void old_log(const char *format, ...)
+{
+	char *line, *formatted_line;
+	va_list args;
+	int ret;
+
+	va_start(args, format);
+	ret = vasprintf(&line, format, args);
+	va_end(args);
+	if (ret == -1)
+		return;
+
+	if (asprintf(&formatted_line, "(%s:%d) %s%s%s: %s",
+		     program_invocation_short_name, getpid(), "", "",
+		     "DEBUG", line) != -1)
+		old_append(formatted_line);
+
+	free(line);
+}
+
+static unsigned long calls;
+static bool old;
+
+static void *log_thread(void *arg)
+{
+	long thread = (long)arg;
+	unsigned long i;
+
+	for (i = 0; i < calls; i++) {
+		if (old)
+			old_log("thread %ld, line %lu: %s\n",
+				thread, i, "a few more words");
+		else
+			igt_debug("thread %ld, line %lu: %s\n",
+				  thread, i, "a few more words");
+	}
+
+	return NULL;
+}
+
+static double run(int num_threads)
+{
+	pthread_t *threads = calloc(num_threads, sizeof(*threads));
+	struct timespec start, end;
+	long i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < num_threads; i++)
+		pthread_create(&threads[i], NULL, log_thread, (void *)i);
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(threads);
+
+	return num_threads * calls / elapsed(&start, &end);
+}
+
+int main(int argc, char **argv)
+{
+	int num_threads = 16, reps = 3;
+	int c, i;
+
+	calls = 100000;
+
+	while ((c = getopt(argc, argv, "t:n:r:")) != -1) {
+		switch (c) {
+		case 't':
+			num_threads = atoi(optarg);
+			if (num_threads < 1)
+				num_threads = 1;
+			break;
+		case 'n':
+			calls = strtoul(optarg, NULL, 0);
+			if (calls < 1)
+				calls = 1;
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t threads] [-n calls per thread] [-r reps]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	for (c = 0; c < 2; c++) {
+		double best = 0;
+
+		old = c == 0;
+		for (i = 0; i < reps; i++) {
+			double rate = run(num_threads);
+
+			if (rate > best)
+				best = rate;
+		}
+
+		printf("%-24s %8.2f Mcalls/s (%d threads)\n",
+		       old ? "mutex, asprintf" : "igt_debug",
+		       best / 1e6, num_threads);
+	}
+
+	return 0;
+}
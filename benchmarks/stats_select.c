@@ -0,0 +1,174 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "igt_rand.h"
+#include "igt_stats.h"
+
+/*
+ * Throughput of the igt_stats order statistics, in millions of samples per
+ * second, against sorting the samples with qsort() as igt_stats used to.
+ */
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static int cmp_u64(const void *pa, const void *pb)
+{
+	const uint64_t *a = pa, *b = pb;
+
+	return *a < *b ? -1 : *a > *b;
+}
+
+static int cmp_f(const void *pa, const void *pb)
+{
+	const double *a = pa, *b = pb;
+
+	return *a < *b ? -1 : *a > *b;
+}
+
+static const double tail[] = { 50, 90, 99, 99.9 };
+static const double all[] = { 1, 5, 10, 25, 50, 75, 90, 95, 99, 99.9 };
+
+enum op { QSORT, MEDIAN, QUARTILES, TAIL, SORT, IQM };
+
+static const char *op_names[] = {
+	[QSORT] = "qsort",
+	[MEDIAN] = "median",
+	[QUARTILES] = "quartiles",
+	[TAIL] = "p50/p90/p99/p99.9",
+	[SORT] = "10 percentiles (sort)",
+	[IQM] = "iqm",
+};
+
+static void run(igt_stats_t *stats, enum op op)
+{
+	double q1, q2, q3, values[10];
+	size_t size = sizeof(*stats->values_u64) * stats->n_values;
+	void *copy;
+
+	switch (op) {
+	case QSORT:
+		copy = malloc(size);
+		memcpy(copy, stats->values_u64, size);
+		qsort(copy, stats->n_values, sizeof(*stats->values_u64),
+		      stats->is_float ? cmp_f : cmp_u64);
+		free(copy);
+		break;
+	case MEDIAN:
+		igt_stats_get_median(stats);
+		break;
+	case QUARTILES:
+		igt_stats_get_quartiles(stats, &q1, &q2, &q3);
+		break;
+	case TAIL:
+		igt_stats_get_percentiles(stats, tail, values, 4);
+		break;
+	case SORT:
+		igt_stats_get_percentiles(stats, all, values, 10);
+		break;
+	case IQM:
+		igt_stats_get_iqm(stats);
+		break;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int n = 10000000, reps = 3, i;
+	bool is_float = false;
+	uint32_t seed = 0;
+	igt_stats_t stats;
+	enum op op;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:r:f")) != -1) {
+		switch (c) {
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			if (n < 1)
+				n = 1;
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+		case 'f':
+			is_float = true;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n samples] [-r reps] [-f]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	igt_stats_init_with_size(&stats, n + reps * 6);
+	for (i = 0; i < n; i++) {
+		/* Latency like, mostly small with a long tail */
+		uint32_t r = hars_petruska_f54_1_random(&seed);
+		uint64_t v = (r & 0xffff) << (r >> 28);
+
+		if (is_float)
+			igt_stats_push_float(&stats, v / 1000.);
+		else
+			igt_stats_push(&stats, v);
+	}
+
+	for (op = QSORT; op <= IQM; op++) {
+		double best = 0;
+
+		for (i = 0; i < reps; i++) {
+			struct timespec start, end;
+			double rate;
+
+			/* Drop any sorted copy from the previous query */
+			igt_stats_push(&stats, i);
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			run(&stats, op);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+
+			rate = stats.n_values / elapsed(&start, &end) / 1e6;
+			if (rate > best)
+				best = rate;
+		}
+
+		printf("%-24s %8.1f Msamples/s\n", op_names[op], best);
+	}
+
+	igt_stats_fini(&stats);
+
+	return 0;
+}
@@ -39,8 +39,10 @@
 #include "igt_audio.h"
 #include "igt_gt.h"
 #include "igt_kms.h"
+#include "igt_kms_cache.h"
 #include "igt_pm.h"
 #include "igt_stats.h"
+#include "igt_trace.h"
 #ifdef HAVE_CHAMELIUM
 #include "igt_chamelium.h"
 #endif
@@ -26,14 +26,22 @@
 
 #include "config.h"
 
+#include <inttypes.h>
+#include <limits.h>
 #include <math.h>
 #include <gsl/gsl_fft_real.h>
 
+#include "drmtest.h"
 #include "igt_audio.h"
 #include "igt_core.h"
+#include "igt_aux.h"
+#include "igt_kernels.h"
 
 #define FREQS_MAX	8
 
+/* Frames mixed at once by audio_signal_fill(), on the stack */
+#define FILL_BLOCK	256
+
 /**
  * SECTION:igt_audio
  * @short_description: Library for audio-related tests
@@ -42,8 +50,17 @@
  *
  * This library contains helpers for audio-related tests. More specifically,
  * it allows generating additions of sine signals as well as detecting them.
+ *
+ * Long captures are best checked with an #audio_signal_detector, which
+ * analyzes the input as it comes in overlapping windows, reusing its FFT
+ * plan and buffers, and reports which windows lack the expected signal.
  */
 
+/*
+ * The period table holds FILL_BLOCK more frames than a period, wrapping
+ * around, so that any block of frames can be read from it contiguously
+ * starting at any offset.
+ */
 struct audio_signal_freq {
 	int freq;
 
@@ -52,14 +69,146 @@ struct audio_signal_freq {
 	int offset;
 };
 
+struct audio_fill_kernels {
+	unsigned features;
+	/* dst[i] = src[i] or dst[i] += src[i], for @n frames */
+	void (*copy)(short *dst, const short *src, int n);
+	void (*add)(short *dst, const short *src, int n);
+	/* Stores each of the @n frames of @src in both channels of @dst */
+	void (*store_stereo)(short *dst, const short *src, int n);
+};
+
 struct audio_signal {
 	int channels;
 	int sampling_rate;
 
 	struct audio_signal_freq freqs[FREQS_MAX];
 	int freqs_count;
+
+	const struct audio_fill_kernels *kernels;
 };
 
+struct audio_signal_detector {
+	struct audio_signal *signal;
+	int channels;
+	int sampling_rate;
+
+	/* Frames per window, and between the starts of two windows */
+	int window;
+	int step;
+
+	gsl_fft_real_wavetable *wavetable;
+	gsl_fft_real_workspace *workspace;
+	double *data;
+	double *amplitude;
+
+	/* Interleaved input not analyzed yet */
+	short *pending;
+	int pending_frames;
+
+	bool *results;
+	int results_size;
+	int windows;
+	int failed;
+};
+
+static void copy_generic(short *dst, const short *src, int n)
+{
+	memcpy(dst, src, n * sizeof(*dst));
+}
+
+static void add_generic(short *dst, const short *src, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		dst[i] += src[i];
+}
+
+static void store_stereo_generic(short *dst, const short *src, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		dst[2 * i] = src[i];
+		dst[2 * i + 1] = src[i];
+	}
+}
+
+#if defined(__x86_64__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+#include <emmintrin.h>
+
+static void add_sse2(short *dst, const short *src, int n)
+{
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi16(d, v));
+	}
+
+	add_generic(dst + i, src + i, n - i);
+}
+
+static void store_stereo_sse2(short *dst, const short *src, int n)
+{
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+
+		_mm_storeu_si128((__m128i *)(dst + 2 * i),
+				 _mm_unpacklo_epi16(v, v));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i + 8),
+				 _mm_unpackhi_epi16(v, v));
+	}
+
+	store_stereo_generic(dst + 2 * i, src + i, n - i);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <immintrin.h>
+
+static void add_avx2(short *dst, const short *src, int n)
+{
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+
+		_mm256_storeu_si256((__m256i *)(dst + i),
+				    _mm256_add_epi16(d, v));
+	}
+
+	add_generic(dst + i, src + i, n - i);
+}
+
+#pragma GCC pop_options
+#endif
+
+static const struct audio_fill_kernels fill_kernels[] = {
+#if defined(__x86_64__) && !defined(__clang__)
+	{ AVX2 | SSE2, copy_generic, add_avx2, store_stereo_sse2 },
+	{ SSE2, copy_generic, add_sse2, store_stereo_sse2 },
+#endif
+	{ 0, copy_generic, add_generic, store_stereo_generic },
+};
+
+static const struct audio_fill_kernels *audio_fill_kernels(void)
+{
+	return igt_kernels_select(fill_kernels, igt_x86_features());
+}
+
 /**
  * audio_signal_init:
  * @channels: The number of channels to use for the signal
@@ -141,7 +290,7 @@ void audio_signal_synthesize(struct audio_signal *signal)
 		freq = signal->freqs[i].freq;
 		frames = signal->sampling_rate / freq;
 
-		period = calloc(1, frames * sizeof(short));
+		period = calloc(1, (frames + FILL_BLOCK) * sizeof(short));
 
 		for (j = 0; j < frames; j++) {
 			value = 2.0 * M_PI * freq / signal->sampling_rate * j;
@@ -150,9 +299,14 @@ void audio_signal_synthesize(struct audio_signal *signal)
 			period[j] = (short) value;
 		}
 
+		for (j = frames; j < frames + FILL_BLOCK; j++)
+			period[j] = period[j % frames];
+
 		signal->freqs[i].period = period;
 		signal->freqs[i].frames = frames;
 	}
+
+	signal->kernels = audio_fill_kernels();
 }
 
 /**
@@ -188,138 +342,328 @@ void audio_signal_clean(struct audio_signal *signal)
  */
 void audio_signal_fill(struct audio_signal *signal, short *buffer, int frames)
 {
-	short *destination;
-	short *source;
-	int total;
-	int freq_frames;
-	int freq_offset;
+	const struct audio_fill_kernels *k = signal->kernels;
+	struct audio_signal_freq *freq;
+	short mix[FILL_BLOCK];
+	int channels = signal->channels;
 	int count;
-	int i, j, k;
+	int i, j;
 
-	memset(buffer, 0, sizeof(short) * signal->channels * frames);
+	if (signal->freqs_count == 0) {
+		memset(buffer, 0, sizeof(short) * channels * frames);
+		return;
+	}
 
-	for (i = 0; i < signal->freqs_count; i++) {
-		total = 0;
+	/*
+	 * The frequencies are mixed a block of frames at a time, then the
+	 * block is written to each channel.
+	 */
+	while (frames) {
+		count = min(frames, FILL_BLOCK);
 
-		while (total < frames) {
-			freq_frames = signal->freqs[i].frames;
-			freq_offset = signal->freqs[i].offset;
+		for (i = 0; i < signal->freqs_count; i++) {
+			freq = &signal->freqs[i];
 
-			source = signal->freqs[i].period + freq_offset;
-			destination = buffer + total * signal->channels;
+			if (i == 0)
+				k->copy(mix, freq->period + freq->offset, count);
+			else
+				k->add(mix, freq->period + freq->offset, count);
 
-			count = freq_frames - freq_offset;
-			if (count > (frames - total))
-				count = frames - total;
+			freq->offset = (freq->offset + count) % freq->frames;
+		}
 
-			freq_offset += count;
-			freq_offset %= freq_frames;
+		if (channels == 2) {
+			k->store_stereo(buffer, mix, count);
+		} else {
+			for (i = 0; i < count; i++)
+				for (j = 0; j < channels; j++)
+					buffer[i * channels + j] = mix[i];
+		}
+
+		buffer += count * channels;
+		frames -= count;
+	}
+}
+
+/*
+ * Checks that the peaks of the amplitude spectrum of a window are the
+ * frequencies of the signal, and only those.
+ */
+static bool detect_peaks(struct audio_signal_detector *det)
+{
+	struct audio_signal *signal = det->signal;
+	double *amplitude = det->amplitude;
+	int frames = det->window;
+	bool detected[FREQS_MAX];
+	double threshold, max;
+	bool above;
+	int error;
+	int freq = 0;
+	int i, j;
 
-			signal->freqs[i].offset = freq_offset;
+	/* Allowed error in Hz due to FFT step. */
+	error = det->sampling_rate / frames;
+
+	max = 0;
+	for (i = 0; i < frames / 2; i++)
+		if (amplitude[i] > max)
+			max = amplitude[i];
+
+	for (i = 0; i < signal->freqs_count; i++)
+		detected[i] = false;
+
+	threshold = max / 2;
+	above = false;
+	max = 0;
+
+	for (i = 0; i < frames / 2; i++) {
+		if (amplitude[i] > threshold)
+			above = true;
+
+		if (above) {
+			if (amplitude[i] < threshold) {
+				above = false;
+				max = 0;
+
+				for (j = 0; j < signal->freqs_count; j++) {
+					if (signal->freqs[j].freq >
+					    freq - error &&
+					    signal->freqs[j].freq <
+					    freq + error) {
+						detected[j] = true;
+						break;
+					}
+				}
 
-			for (j = 0; j < count; j++) {
-				for (k = 0; k < signal->channels; k++) {
-					destination[j * signal->channels + k] += source[j];
+				/* Detected frequency was not generated. */
+				if (j == signal->freqs_count) {
+					igt_debug("Detected additional frequency: %d\n",
+						  freq);
+					return false;
 				}
 			}
 
-			total += count;
+			if (amplitude[i] > max) {
+				max = amplitude[i];
+				freq = (int64_t)det->sampling_rate * i / frames;
+			}
+		}
+	}
+
+	for (i = 0; i < signal->freqs_count; i++) {
+		if (!detected[i]) {
+			igt_debug("Missing frequency: %d\n",
+				  signal->freqs[i].freq);
+			return false;
 		}
 	}
+
+	return true;
+}
+
+/* Analyzes the window at the start of the pending frames, on all channels */
+static bool detect_window(struct audio_signal_detector *det)
+{
+	int frames = det->window;
+	double *data = det->data;
+	int c, i;
+
+	for (c = 0; c < det->channels; c++) {
+		for (i = 0; i < frames; i++)
+			data[i] = det->pending[i * det->channels + c];
+
+		gsl_fft_real_transform(data, 1, frames, det->wavetable,
+				       det->workspace);
+
+		/*
+		 * The result is in half-complex form: the real DC term then
+		 * the real and imaginary parts of each positive frequency.
+		 */
+		det->amplitude[0] = fabs(data[0]);
+		for (i = 1; i < frames / 2; i++)
+			det->amplitude[i] = hypot(data[2 * i - 1], data[2 * i]);
+
+		if (!detect_peaks(det))
+			return false;
+	}
+
+	return true;
 }
 
 /**
- * audio_signal_detect:
- * @signal: The target signal structure
+ * audio_signal_detector_init:
+ * @signal: The signal to detect
  * @channels: The input data's number of channels
  * @sampling_rate: The input data's sampling rate
- * @buffer: The input data's buffer
- * @frames: The input data's number of frames
+ * @window: The number of frames analyzed at once, of any size
  *
- * Detect that the frequencies specified in @signal, and only those, are
- * present in the input data. The input data's format is required to be S16_LE.
+ * Allocate a detector checking that the frequencies of @signal, and only
+ * those, are present in input passed to audio_signal_detector_process(). The
+ * input is analyzed in windows of @window frames, each starting half a window
+ * after the previous one. Larger windows resolve frequencies more finely,
+ * smaller ones locate dropouts more precisely.
  *
- * Returns: A boolean indicating whether the detection was successful
+ * Returns: A newly-allocated detector, to be freed with
+ * audio_signal_detector_fini()
  */
-bool audio_signal_detect(struct audio_signal *signal, int channels,
-			 int sampling_rate, short *buffer, int frames)
+struct audio_signal_detector *
+audio_signal_detector_init(struct audio_signal *signal, int channels,
+			   int sampling_rate, int window)
 {
-	double data[frames];
-	int amplitude[frames / 2];
-	bool detected[signal->freqs_count];
-	int threshold;
-	bool above;
-	int error;
-	int freq;
-	int max;
-	int c, i, j;
-
-	/* Allowed error in Hz due to FFT step. */
-	error = sampling_rate / frames;
+	struct audio_signal_detector *det;
 
-	for (c = 0; c < channels; c++) {
-		for (i = 0; i < frames; i++)
-			data[i] = (double) buffer[i * channels + c];
+	igt_assert(channels > 0 && window > 1);
 
-		gsl_fft_real_radix2_transform(data, 1, frames);
+	det = calloc(1, sizeof(*det));
+	igt_assert(det);
 
-		max = 0;
+	det->signal = signal;
+	det->channels = channels;
+	det->sampling_rate = sampling_rate;
+	det->window = window;
+	det->step = (window + 1) / 2;
 
-		for (i = 0; i < frames / 2; i++) {
-			amplitude[i] = hypot(data[i], data[frames - i]);
-			if (amplitude[i] > max)
-				max = amplitude[i];
-		}
+	det->wavetable = gsl_fft_real_wavetable_alloc(window);
+	det->workspace = gsl_fft_real_workspace_alloc(window);
+	det->data = malloc(window * sizeof(*det->data));
+	det->amplitude = malloc(window / 2 * sizeof(*det->amplitude));
+	det->pending = malloc(window * channels * sizeof(*det->pending));
+	igt_assert(det->wavetable && det->workspace && det->data &&
+		   det->amplitude && det->pending);
 
-		for (i = 0; i < signal->freqs_count; i++)
-			detected[i] = false;
-
-		threshold = max / 2;
-		above = false;
-		max = 0;
-
-		for (i = 0; i < frames / 2; i++) {
-			if (amplitude[i] > threshold)
-				above = true;
-
-			if (above) {
-				if (amplitude[i] < threshold) {
-					above = false;
-					max = 0;
-
-					for (j = 0; j < signal->freqs_count; j++) {
-						if (signal->freqs[j].freq >
-						    freq - error &&
-						    signal->freqs[j].freq <
-						    freq + error) {
-							detected[j] = true;
-							break;
-						}
-					}
+	return det;
+}
 
-					/* Detected frequency was not generated. */
-					if (j == signal->freqs_count) {
-						igt_debug("Detected additional frequency: %d\n",
-							  freq);
-						return false;
-					}
-				}
+/**
+ * audio_signal_detector_process:
+ * @det: The target detector
+ * @buffer: The input data's buffer, in interleaved S16_LE format
+ * @frames: The input data's number of frames
+ *
+ * Add @frames frames of input to @det, and analyze the windows they complete.
+ * The input doesn't need to be aligned to windows, the frames left over are
+ * kept for the next call.
+ *
+ * Returns: The number of windows completed by this call in which the signal
+ * wasn't detected
+ */
+int audio_signal_detector_process(struct audio_signal_detector *det,
+				  const short *buffer, int frames)
+{
+	int channels = det->channels;
+	int failed = 0;
+	int count;
 
-				if (amplitude[i] > max) {
-					max = amplitude[i];
-					freq = sampling_rate * i / frames;
-				}
-			}
+	while (frames) {
+		count = min(frames, det->window - det->pending_frames);
+		memcpy(det->pending + det->pending_frames * channels, buffer,
+		       count * channels * sizeof(*buffer));
+		det->pending_frames += count;
+		buffer += count * channels;
+		frames -= count;
+
+		if (det->pending_frames < det->window)
+			break;
+
+		if (det->windows == det->results_size) {
+			det->results_size = max(2 * det->results_size, 64);
+			det->results = realloc(det->results, det->results_size *
+					       sizeof(*det->results));
+			igt_assert(det->results);
 		}
 
-		for (i = 0; i < signal->freqs_count; i++) {
-			if (!detected[i]) {
-				igt_debug("Missing frequency: %d\n",
-					  signal->freqs[i].freq);
-				return false;
-			}
+		det->results[det->windows] = detect_window(det);
+		if (!det->results[det->windows]) {
+			igt_debug("Signal not detected from frame %"PRId64"\n",
+				  (int64_t)det->windows * det->step);
+			failed++;
 		}
+		det->windows++;
+
+		/* Keep the overlap with the next window */
+		det->pending_frames -= det->step;
+		memmove(det->pending, det->pending + det->step * channels,
+			det->pending_frames * channels * sizeof(*det->pending));
 	}
 
-	return true;
+	det->failed += failed;
+
+	return failed;
+}
+
+/**
+ * audio_signal_detector_get_results:
+ * @det: The target detector
+ * @windows: Where to store the number of windows analyzed so far
+ *
+ * Get the detection result of each window analyzed so far. Window i starts
+ * at frame i * ceil(window / 2) of the input.
+ *
+ * Returns: An array of @windows booleans, true where the signal was detected,
+ * valid until the next call to audio_signal_detector_process()
+ */
+const bool *audio_signal_detector_get_results(struct audio_signal_detector *det,
+					      int *windows)
+{
+	*windows = det->windows;
+
+	return det->results;
+}
+
+/**
+ * audio_signal_detector_get_failed:
+ * @det: The target detector
+ *
+ * Returns: The number of windows analyzed so far in which the signal wasn't
+ * detected
+ */
+int audio_signal_detector_get_failed(struct audio_signal_detector *det)
+{
+	return det->failed;
+}
+
+/**
+ * audio_signal_detector_fini:
+ * @det: The detector to free
+ *
+ * Free the resources allocated by audio_signal_detector_init().
+ */
+void audio_signal_detector_fini(struct audio_signal_detector *det)
+{
+	gsl_fft_real_wavetable_free(det->wavetable);
+	gsl_fft_real_workspace_free(det->workspace);
+	free(det->data);
+	free(det->amplitude);
+	free(det->pending);
+	free(det->results);
+	free(det);
+}
+
+/**
+ * audio_signal_detect:
+ * @signal: The target signal structure
+ * @channels: The input data's number of channels
+ * @sampling_rate: The input data's sampling rate
+ * @buffer: The input data's buffer
+ * @frames: The input data's number of frames
+ *
+ * Detect that the frequencies specified in @signal, and only those, are
+ * present in the input data. The input data's format is required to be S16_LE.
+ * The input is analyzed as a single window, see #audio_signal_detector to
+ * check long inputs.
+ *
+ * Returns: A boolean indicating whether the detection was successful
+ */
+bool audio_signal_detect(struct audio_signal *signal, int channels,
+			 int sampling_rate, short *buffer, int frames)
+{
+	struct audio_signal_detector *det;
+	bool detected;
+
+	det = audio_signal_detector_init(signal, channels, sampling_rate,
+					 frames);
+	detected = audio_signal_detector_process(det, buffer, frames) == 0;
+	audio_signal_detector_fini(det);
+
+	return detected;
 }
@@ -32,12 +32,22 @@
 #include <stdbool.h>
 
 struct audio_signal;
+struct audio_signal_detector;
 
 struct audio_signal *audio_signal_init(int channels, int sampling_rate);
 int audio_signal_add_frequency(struct audio_signal *signal, int frequency);
 void audio_signal_synthesize(struct audio_signal *signal);
 void audio_signal_clean(struct audio_signal *signal);
 void audio_signal_fill(struct audio_signal *signal, short *buffer, int frames);
+struct audio_signal_detector *
+audio_signal_detector_init(struct audio_signal *signal, int channels,
+			   int sampling_rate, int window);
+int audio_signal_detector_process(struct audio_signal_detector *det,
+				  const short *buffer, int frames);
+const bool *audio_signal_detector_get_results(struct audio_signal_detector *det,
+					      int *windows);
+int audio_signal_detector_get_failed(struct audio_signal_detector *det);
+void audio_signal_detector_fini(struct audio_signal_detector *det);
 bool audio_signal_detect(struct audio_signal *signal, int channels,
 			 int sampling_rate, short *buffer, int frames);
 
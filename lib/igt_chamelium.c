@@ -36,6 +36,7 @@
 #include <cairo.h>
 
 #include "igt_chamelium.h"
+#include "igt_chamelium_crc.h"
 #include "igt_core.h"
 #include "igt_aux.h"
 #include "igt_frame.h"
@@ -107,6 +108,42 @@ struct chamelium_fb_crc_async_data {
 	igt_crc_t *ret;
 };
 
+struct chamelium_capture_request {
+	bool dump_pixels;
+	struct chamelium_port *port;
+	int index;
+	int x, y, w, h;
+
+	struct chamelium_frame_dump *frame;
+	char *error;
+};
+
+struct chamelium_capture_queue {
+	struct chamelium *chamelium;
+
+	/* Only used by the worker, the client isn't thread safe */
+	xmlrpc_env env;
+	xmlrpc_client *client;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/*
+	 * Requests are numbered in submission order, the worker has completed
+	 * the first @processed and the first @returned were handed back. The
+	 * ones handed back are dropped from the array when it's full, which
+	 * renumbers the others.
+	 */
+	struct chamelium_capture_request *requests;
+	unsigned int size;
+	unsigned int submitted;
+	unsigned int processed;
+	unsigned int returned;
+	unsigned int depth;
+	bool stop;
+};
+
 struct chamelium {
 	xmlrpc_env env;
 	xmlrpc_client *client;
@@ -266,6 +303,8 @@ static xmlrpc_value *chamelium_rpc(struct chamelium *chamelium,
 	va_list va_args;
 	struct fsm_monitor_args monitor_args;
 	pthread_t fsm_thread_id;
+	/* Without a DRM device, there are no connectors to reprobe */
+	bool monitor_fsm = fsm_port && chamelium->drm_fd >= 0;
 
 	/* Cleanup the last error, if any */
 	if (chamelium->env.fault_occurred) {
@@ -279,7 +318,7 @@ static xmlrpc_value *chamelium_rpc(struct chamelium *chamelium,
 	 * to handle the chamelium attempting FSM, we have to fork into another
 	 * thread and have that handle hotplugging displays
 	 */
-	if (fsm_port) {
+	if (monitor_fsm) {
 		monitor_args.chamelium = chamelium;
 		monitor_args.port = fsm_port;
 		monitor_args.mon = igt_watch_hotplug();
@@ -293,7 +332,7 @@ static xmlrpc_value *chamelium_rpc(struct chamelium *chamelium,
 				va_args);
 	va_end(va_args);
 
-	if (fsm_port) {
+	if (monitor_fsm) {
 		pthread_cancel(fsm_thread_id);
 		igt_cleanup_hotplug(monitor_args.mon);
 	}
@@ -921,6 +960,292 @@ int chamelium_get_captured_frame_count(struct chamelium *chamelium)
 	return ret;
 }
 
+static xmlrpc_value *capture_queue_rpc(struct chamelium_capture_queue *queue,
+					const char *method_name,
+					const char *format_str, ...)
+{
+	xmlrpc_value *res;
+	va_list va_args;
+
+	va_start(va_args, format_str);
+	xmlrpc_client_call2f_va(&queue->env, queue->client,
+				queue->chamelium->url, method_name,
+				format_str, &res, va_args);
+	va_end(va_args);
+
+	return queue->env.fault_occurred ? NULL : res;
+}
+
+static void capture_queue_do_request(struct chamelium_capture_queue *queue,
+				     struct chamelium_capture_request *r)
+{
+	struct chamelium_frame_dump *frame;
+	xmlrpc_value *res, *res_w, *res_h;
+
+	xmlrpc_env_clean(&queue->env);
+	xmlrpc_env_init(&queue->env);
+
+	if (r->dump_pixels)
+		res = capture_queue_rpc(queue, "DumpPixels",
+					(r->w && r->h) ? "(iiiii)" : "(innnn)",
+					r->port->id, r->x, r->y, r->w, r->h);
+	else
+		res = capture_queue_rpc(queue, "ReadCapturedFrame", "(i)",
+					r->index);
+	if (!res)
+		goto err;
+
+	frame = calloc(1, sizeof(*frame));
+	frame->port = r->port;
+	xmlrpc_read_base64(&queue->env, res, &frame->size,
+			   (void *)&frame->bgr);
+	xmlrpc_DECREF(res);
+	r->frame = frame;
+	if (queue->env.fault_occurred)
+		goto err;
+
+	res = capture_queue_rpc(queue, "GetCapturedResolution", "()");
+	if (!res)
+		goto err;
+
+	xmlrpc_array_read_item(&queue->env, res, 0, &res_w);
+	xmlrpc_array_read_item(&queue->env, res, 1, &res_h);
+	xmlrpc_read_int(&queue->env, res_w, &frame->width);
+	xmlrpc_read_int(&queue->env, res_h, &frame->height);
+	xmlrpc_DECREF(res_w);
+	xmlrpc_DECREF(res_h);
+	xmlrpc_DECREF(res);
+	if (queue->env.fault_occurred)
+		goto err;
+
+	return;
+
+err:
+	if (r->frame) {
+		chamelium_destroy_frame_dump(r->frame);
+		r->frame = NULL;
+	}
+	r->error = strdup(queue->env.fault_string);
+}
+
+static void *capture_queue_worker(void *data)
+{
+	struct chamelium_capture_queue *queue = data;
+	struct chamelium_capture_request r;
+
+	pthread_mutex_lock(&queue->lock);
+	for (;;) {
+		/* Don't get more than @depth frames ahead of the caller */
+		while (!queue->stop &&
+		       (queue->processed == queue->submitted ||
+			queue->processed - queue->returned >= queue->depth))
+			pthread_cond_wait(&queue->cond, &queue->lock);
+		if (queue->stop)
+			break;
+
+		/* The array may be reallocated while the RPC is in flight */
+		r = queue->requests[queue->processed];
+		pthread_mutex_unlock(&queue->lock);
+
+		capture_queue_do_request(queue, &r);
+
+		pthread_mutex_lock(&queue->lock);
+		queue->requests[queue->processed++] = r;
+		pthread_cond_broadcast(&queue->cond);
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return NULL;
+}
+
+/**
+ * chamelium_capture_queue_create:
+ * @chamelium: The Chamelium instance to use
+ * @depth: The number of frames to transfer ahead of the one handed back last
+ *
+ * Creates a queue transferring frames from the Chamelium on its own thread and
+ * connection, so that the transfer of the next frames overlaps with whatever
+ * the caller does with the current one, typically rendering the reference and
+ * comparing. Frames are requested with #chamelium_capture_queue_dump_pixels
+ * and #chamelium_capture_queue_read_captured_frame, and handed back in the
+ * same order by #chamelium_capture_queue_wait.
+ *
+ * At most @depth transferred frames are kept waiting for the caller, which
+ * bounds the memory used; 1 is enough to hide the transfer time when
+ * verifying a frame takes about as long as transferring it.
+ *
+ * Unlike #chamelium_port_dump_pixels, the queue doesn't handle the Chamelium
+ * asking for FSM, so the caller should wait for the input to be stable with
+ * #chamelium_port_wait_video_input_stable first. The captured frames must
+ * also not be replaced while reads of them are still queued.
+ *
+ * Returns: a new queue, to be destroyed with #chamelium_capture_queue_destroy
+ */
+struct chamelium_capture_queue *
+chamelium_capture_queue_create(struct chamelium *chamelium, int depth)
+{
+	struct chamelium_capture_queue *queue;
+
+	igt_assert(depth > 0);
+
+	queue = calloc(1, sizeof(*queue));
+	igt_assert(queue);
+
+	queue->chamelium = chamelium;
+	queue->depth = depth;
+
+	xmlrpc_env_init(&queue->env);
+	xmlrpc_client_create(&queue->env, XMLRPC_CLIENT_NO_FLAGS, PACKAGE,
+			     PACKAGE_VERSION, NULL, 0, &queue->client);
+	igt_assert_f(!queue->env.fault_occurred,
+		     "Failed to init xmlrpc: %s\n", queue->env.fault_string);
+
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->cond, NULL);
+	igt_assert(pthread_create(&queue->thread, NULL,
+				  capture_queue_worker, queue) == 0);
+
+	return queue;
+}
+
+static void capture_queue_submit(struct chamelium_capture_queue *queue,
+				 const struct chamelium_capture_request *r)
+{
+	pthread_mutex_lock(&queue->lock);
+
+	/* Drop the requests handed back, so the array only grows with depth */
+	if (queue->submitted == queue->size && queue->returned) {
+		memmove(queue->requests, queue->requests + queue->returned,
+			(queue->submitted - queue->returned) * sizeof(*r));
+		queue->submitted -= queue->returned;
+		queue->processed -= queue->returned;
+		queue->returned = 0;
+	}
+
+	if (queue->submitted == queue->size) {
+		queue->size = queue->size ? 2 * queue->size : 16;
+		queue->requests = realloc(queue->requests,
+					  queue->size * sizeof(*r));
+		igt_assert(queue->requests);
+	}
+
+	queue->requests[queue->submitted++] = *r;
+	pthread_cond_broadcast(&queue->cond);
+
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * chamelium_capture_queue_dump_pixels:
+ * @queue: The queue to use
+ * @port: The port to perform the video capture on
+ * @x: The X coordinate to crop the screen capture to
+ * @y: The Y coordinate to crop the screen capture to
+ * @w: The width of the area to crop the screen capture to, or 0 for the whole
+ * screen
+ * @h: The height of the area to crop the screen capture to, or 0 for the whole
+ * screen
+ *
+ * Queues a #chamelium_port_dump_pixels, without waiting for it.
+ */
+void chamelium_capture_queue_dump_pixels(struct chamelium_capture_queue *queue,
+					 struct chamelium_port *port,
+					 int x, int y, int w, int h)
+{
+	struct chamelium_capture_request r = {
+		.dump_pixels = true,
+		.port = port,
+		.x = x, .y = y, .w = w, .h = h,
+	};
+
+	capture_queue_submit(queue, &r);
+	queue->chamelium->capturing_port = port;
+}
+
+/**
+ * chamelium_capture_queue_read_captured_frame:
+ * @queue: The queue to use
+ * @index: The index of the captured frame we want to get
+ *
+ * Queues a #chamelium_read_captured_frame, without waiting for it.
+ */
+void chamelium_capture_queue_read_captured_frame(struct chamelium_capture_queue *queue,
+						 unsigned int index)
+{
+	struct chamelium_capture_request r = {
+		.port = queue->chamelium->capturing_port,
+		.index = index,
+	};
+
+	capture_queue_submit(queue, &r);
+}
+
+/**
+ * chamelium_capture_queue_wait:
+ * @queue: The queue to use
+ *
+ * Waits for the oldest frame requested on @queue which wasn't handed back yet,
+ * and lets the worker start on the next one. Fails the current test if its
+ * transfer failed.
+ *
+ * Returns: a chamelium_frame_dump struct, to be freed with
+ * #chamelium_destroy_frame_dump
+ */
+struct chamelium_frame_dump *
+chamelium_capture_queue_wait(struct chamelium_capture_queue *queue)
+{
+	struct chamelium_capture_request r;
+
+	pthread_mutex_lock(&queue->lock);
+
+	igt_assert(queue->returned < queue->submitted);
+	while (queue->processed <= queue->returned)
+		pthread_cond_wait(&queue->cond, &queue->lock);
+
+	r = queue->requests[queue->returned++];
+	pthread_cond_broadcast(&queue->cond);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	igt_assert_f(!r.error, "Chamelium RPC call failed: %s\n", r.error);
+
+	return r.frame;
+}
+
+/**
+ * chamelium_capture_queue_destroy:
+ * @queue: The queue to destroy
+ *
+ * Waits for the transfer in progress if any, and frees @queue along with the
+ * frames which weren't handed back.
+ */
+void chamelium_capture_queue_destroy(struct chamelium_capture_queue *queue)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&queue->lock);
+	queue->stop = true;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+
+	pthread_join(queue->thread, NULL);
+
+	for (i = queue->returned; i < queue->processed; i++) {
+		if (queue->requests[i].frame)
+			chamelium_destroy_frame_dump(queue->requests[i].frame);
+		free(queue->requests[i].error);
+	}
+
+	pthread_cond_destroy(&queue->cond);
+	pthread_mutex_destroy(&queue->lock);
+
+	xmlrpc_client_destroy(queue->client);
+	xmlrpc_env_clean(&queue->env);
+
+	free(queue->requests);
+	free(queue);
+}
+
 static pixman_image_t *convert_frame_format(pixman_image_t *src,
 					    int format)
 {
@@ -1246,54 +1571,20 @@ int chamelium_get_frame_limit(struct chamelium *chamelium,
 	return ret;
 }
 
-static uint32_t chamelium_xrgb_hash16(const unsigned char *buffer, int width,
-				      int height, int k, int m)
+static void chamelium_do_calculate_fb_crc(cairo_surface_t *fb_surface,
+					  igt_crc_t *out)
 {
-	unsigned char r, g, b;
-	uint64_t sum = 0;
-	uint64_t count = 0;
-	uint64_t value;
-	uint32_t hash;
-	int index;
+	uint32_t hash[CHAMELIUM_CRC_WORDS];
 	int i;
 
-	for (i=0; i < width * height; i++) {
-		if ((i % m) != k)
-			continue;
-
-		index = i * 4;
-
-		r = buffer[index + 2];
-		g = buffer[index + 1];
-		b = buffer[index + 0];
-
-		value = r | (g << 8) | (b << 16);
-		sum += ++count * value;
-	}
-
-	hash = ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
-
-	return hash;
-}
+	chamelium_xrgb_hash16(hash, cairo_image_surface_get_data(fb_surface),
+			      cairo_image_surface_get_width(fb_surface),
+			      cairo_image_surface_get_height(fb_surface));
 
-static void chamelium_do_calculate_fb_crc(cairo_surface_t *fb_surface,
-					  igt_crc_t *out)
-{
-	unsigned char *buffer;
-	int n = 4;
-	int w, h;
-	int i, j;
-
-	buffer = cairo_image_surface_get_data(fb_surface);
-	w = cairo_image_surface_get_width(fb_surface);
-	h = cairo_image_surface_get_height(fb_surface);
-
-	for (i = 0; i < n; i++) {
-		j = n - i - 1;
-		out->crc[i] = chamelium_xrgb_hash16(buffer, w, h, j, n);
-	}
+	for (i = 0; i < CHAMELIUM_CRC_WORDS; i++)
+		out->crc[i] = hash[CHAMELIUM_CRC_WORDS - i - 1];
 
-	out->n_words = n;
+	out->n_words = CHAMELIUM_CRC_WORDS;
 }
 
 /**
@@ -1503,6 +1794,35 @@ out:
 	return ret;
 }
 
+static bool chamelium_read_supported_ports(struct chamelium *chamelium)
+{
+	xmlrpc_value *res, *id;
+	int i;
+
+	res = chamelium_rpc(chamelium, NULL, "GetSupportedInputs", "()");
+
+	chamelium->port_count = xmlrpc_array_size(&chamelium->env, res);
+	chamelium->ports = calloc(sizeof(struct chamelium_port),
+				  chamelium->port_count);
+
+	for (i = 0; i < chamelium->port_count; i++) {
+		struct chamelium_port *port = &chamelium->ports[i];
+
+		xmlrpc_array_read_item(&chamelium->env, res, i, &id);
+		xmlrpc_read_int(&chamelium->env, id, &port->id);
+		xmlrpc_DECREF(id);
+
+		port->type = chamelium_get_port_type(chamelium, port);
+		igt_assert(asprintf(&port->name, "%s-%d",
+				    kmstest_connector_type_str(port->type),
+				    port->id) > 0);
+	}
+
+	xmlrpc_DECREF(res);
+
+	return chamelium->port_count > 0;
+}
+
 static bool chamelium_read_config(struct chamelium *chamelium, int drm_fd)
 {
 	GError *error = NULL;
@@ -1544,21 +1864,7 @@ static void chamelium_exit_handler(int sig)
 		chamelium_deinit(cleanup_instance);
 }
 
-/**
- * chamelium_init:
- * @chamelium: The Chamelium instance to use
- * @drm_fd: a display initialized with #igt_display_init
- *
- * Sets up a connection with a chamelium, using the URL specified in the
- * Chamelium configuration. This must be called first before trying to use the
- * chamelium.
- *
- * If we fail to establish a connection with the chamelium, fail to find a
- * configured connector, etc. we fail the current test.
- *
- * Returns: A newly initialized chamelium struct, or NULL on error
- */
-struct chamelium *chamelium_init(int drm_fd)
+static struct chamelium *chamelium_create(int drm_fd)
 {
 	struct chamelium *chamelium = malloc(sizeof(struct chamelium));
 
@@ -1582,9 +1888,35 @@ struct chamelium *chamelium_init(int drm_fd)
 	if (chamelium->env.fault_occurred) {
 		igt_debug("Failed to init xmlrpc: %s\n",
 			  chamelium->env.fault_string);
-		goto error;
+		xmlrpc_env_clean(&chamelium->env);
+		free(chamelium);
+		return NULL;
 	}
 
+	return chamelium;
+}
+
+/**
+ * chamelium_init:
+ * @chamelium: The Chamelium instance to use
+ * @drm_fd: a display initialized with #igt_display_init
+ *
+ * Sets up a connection with a chamelium, using the URL specified in the
+ * Chamelium configuration. This must be called first before trying to use the
+ * chamelium.
+ *
+ * If we fail to establish a connection with the chamelium, fail to find a
+ * configured connector, etc. we fail the current test.
+ *
+ * Returns: A newly initialized chamelium struct, or NULL on error
+ */
+struct chamelium *chamelium_init(int drm_fd)
+{
+	struct chamelium *chamelium = chamelium_create(drm_fd);
+
+	if (!chamelium)
+		return NULL;
+
 	if (!chamelium_read_config(chamelium, drm_fd))
 		goto error;
 
@@ -1594,7 +1926,48 @@ struct chamelium *chamelium_init(int drm_fd)
 	return chamelium;
 
 error:
+	xmlrpc_client_destroy(chamelium->client);
+	xmlrpc_env_clean(&chamelium->env);
+	free(chamelium);
+
+	return NULL;
+}
+
+/**
+ * chamelium_init_url:
+ * @url: The URL of the Chamelium's XML-RPC server
+ *
+ * Like chamelium_init() for a Chamelium which isn't connected to any DRM
+ * device, such as the one started by chamelium_mock_start(). Its ports are
+ * the ones the Chamelium reports rather than the configured ones, and as
+ * they aren't mapped to any connector chamelium_port_get_connector() can't
+ * be used. Meant to test and profile the Chamelium support itself.
+ *
+ * Returns: A newly initialized chamelium struct, or NULL on error
+ */
+struct chamelium *chamelium_init_url(const char *url)
+{
+	struct chamelium *chamelium = chamelium_create(-1);
+
+	if (!chamelium)
+		return NULL;
+
+	chamelium->url = strdup(url);
+	if (!chamelium_read_supported_ports(chamelium)) {
+		igt_warn("No ports found on the Chamelium at %s\n", url);
+		goto error;
+	}
+
+	cleanup_instance = chamelium;
+	igt_install_exit_handler(chamelium_exit_handler);
+
+	return chamelium;
+
+error:
+	xmlrpc_client_destroy(chamelium->client);
 	xmlrpc_env_clean(&chamelium->env);
+	free(chamelium->ports);
+	free(chamelium->url);
 	free(chamelium);
 
 	return NULL;
@@ -1615,6 +1988,10 @@ void chamelium_deinit(struct chamelium *chamelium)
 	int i;
 	struct chamelium_edid *pos, *tmp;
 
+	/* Not to be deinitialized again by the exit handler */
+	if (cleanup_instance == chamelium)
+		cleanup_instance = NULL;
+
 	/* We want to make sure we leave all of the ports plugged in, since
 	 * testing setups requiring multiple monitors are probably using the
 	 * chamelium to provide said monitors
@@ -1624,9 +2001,11 @@ void chamelium_deinit(struct chamelium *chamelium)
 		chamelium_plug(chamelium, &chamelium->ports[i]);
 
 	/* Destroy any EDIDs we created to make sure we don't leak them */
-	igt_list_for_each_safe(pos, tmp, &chamelium->edids->link, link) {
-		chamelium_destroy_edid(chamelium, pos->id);
-		free(pos);
+	if (chamelium->edids) {
+		igt_list_for_each_safe(pos, tmp, &chamelium->edids->link, link) {
+			chamelium_destroy_edid(chamelium, pos->id);
+			free(pos);
+		}
 	}
 
 	xmlrpc_client_destroy(chamelium->client);
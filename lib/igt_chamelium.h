@@ -39,8 +39,10 @@ struct chamelium;
 struct chamelium_port;
 struct chamelium_frame_dump;
 struct chamelium_fb_crc_async_data;
+struct chamelium_capture_queue;
 
 struct chamelium *chamelium_init(int drm_fd);
+struct chamelium *chamelium_init_url(const char *url);
 void chamelium_deinit(struct chamelium *chamelium);
 void chamelium_reset(struct chamelium *chamelium);
 
@@ -95,6 +97,16 @@ struct chamelium_frame_dump *chamelium_port_dump_pixels(struct chamelium *chamel
 							struct chamelium_port *port,
 							int x, int y,
 							int w, int h);
+struct chamelium_capture_queue *
+chamelium_capture_queue_create(struct chamelium *chamelium, int depth);
+void chamelium_capture_queue_dump_pixels(struct chamelium_capture_queue *queue,
+					 struct chamelium_port *port,
+					 int x, int y, int w, int h);
+void chamelium_capture_queue_read_captured_frame(struct chamelium_capture_queue *queue,
+						 unsigned int index);
+struct chamelium_frame_dump *
+chamelium_capture_queue_wait(struct chamelium_capture_queue *queue);
+void chamelium_capture_queue_destroy(struct chamelium_capture_queue *queue);
 igt_crc_t *chamelium_calculate_fb_crc(int fd, struct igt_fb *fb);
 struct chamelium_fb_crc_async_data *chamelium_calculate_fb_crc_async_start(int fd,
 									   struct igt_fb *fb);
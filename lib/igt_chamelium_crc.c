@@ -0,0 +1,269 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "igt_chamelium_crc.h"
+#include "igt_kernels.h"
+
+/*
+ * Hash k is the sum over the pixels of index k + j * CHAMELIUM_CRC_WORDS
+ * of (j + 1) * v[j], with v[j] the RGB value of the pixel, folded to 16
+ * bits. It is computed in a single pass for all the hashes, as the sum
+ * S = sum(v[j]) and the weighted sum W = sum((n - j) * v[j]) of the n
+ * groups of pixels seen so far, accumulated with two additions per pixel
+ * as S += v[j], W += S. Then sum((j + 1) * v[j]) = (n + 1) * S - W, and
+ * the range of groups [g, g + n) contributes (g + n + 1) * S - W, so the
+ * frame can be split in bands summed independently.
+ */
+
+static inline uint64_t rgb(const unsigned char *pixel)
+{
+	return pixel[2] | pixel[1] << 8 | pixel[0] << 16;
+}
+
+static void sums_generic_continue(const unsigned char *pixels, size_t groups,
+				  uint64_t sum[CHAMELIUM_CRC_WORDS],
+				  uint64_t weighted[CHAMELIUM_CRC_WORDS])
+{
+	size_t j;
+	int k;
+
+	for (j = 0; j < groups; j++) {
+		for (k = 0; k < CHAMELIUM_CRC_WORDS; k++) {
+			sum[k] += rgb(pixels + 4 * k);
+			weighted[k] += sum[k];
+		}
+
+		pixels += 4 * CHAMELIUM_CRC_WORDS;
+	}
+}
+
+static void sums_generic(const unsigned char *pixels, size_t groups,
+			 uint64_t sum[CHAMELIUM_CRC_WORDS],
+			 uint64_t weighted[CHAMELIUM_CRC_WORDS])
+{
+	memset(sum, 0, CHAMELIUM_CRC_WORDS * sizeof(*sum));
+	memset(weighted, 0, CHAMELIUM_CRC_WORDS * sizeof(*weighted));
+
+	sums_generic_continue(pixels, groups, sum, weighted);
+}
+
+#if defined(__x86_64__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+#include <emmintrin.h>
+
+/* XRGB8888 to the R | G << 8 | B << 16 the Chamelium hashes */
+static inline __m128i rgb_sse2(__m128i px)
+{
+	const __m128i byte = _mm_set1_epi32(0xff);
+
+	return _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(px, 16), byte),
+					 _mm_and_si128(px, _mm_set1_epi32(0xff00))),
+			    _mm_slli_epi32(_mm_and_si128(px, byte), 16));
+}
+
+static void sums_sse2(const unsigned char *pixels, size_t groups,
+		      uint64_t sum[CHAMELIUM_CRC_WORDS],
+		      uint64_t weighted[CHAMELIUM_CRC_WORDS])
+{
+	const __m128i zero = _mm_setzero_si128();
+	/* 64 bit lanes for pixels 0 and 1, and 2 and 3, of each group */
+	__m128i s0 = zero, s1 = zero, w0 = zero, w1 = zero;
+	size_t j;
+
+	for (j = 0; j < groups; j++) {
+		__m128i v = rgb_sse2(_mm_loadu_si128((const __m128i *)pixels));
+
+		s0 = _mm_add_epi64(s0, _mm_unpacklo_epi32(v, zero));
+		s1 = _mm_add_epi64(s1, _mm_unpackhi_epi32(v, zero));
+		w0 = _mm_add_epi64(w0, s0);
+		w1 = _mm_add_epi64(w1, s1);
+
+		pixels += 16;
+	}
+
+	_mm_storeu_si128((__m128i *)&sum[0], s0);
+	_mm_storeu_si128((__m128i *)&sum[2], s1);
+	_mm_storeu_si128((__m128i *)&weighted[0], w0);
+	_mm_storeu_si128((__m128i *)&weighted[2], w1);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <immintrin.h>
+
+static inline __m256i rgb_avx2(__m256i px)
+{
+	const __m256i byte = _mm256_set1_epi32(0xff);
+
+	return _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(px, 16), byte),
+					       _mm256_and_si256(px, _mm256_set1_epi32(0xff00))),
+			       _mm256_slli_epi32(_mm256_and_si256(px, byte), 16));
+}
+
+static void sums_avx2(const unsigned char *pixels, size_t groups,
+		      uint64_t sum[CHAMELIUM_CRC_WORDS],
+		      uint64_t weighted[CHAMELIUM_CRC_WORDS])
+{
+	/* A 64 bit lane for each pixel of a group */
+	__m256i s = _mm256_setzero_si256(), w = _mm256_setzero_si256();
+	size_t j;
+
+	/* Two groups at a time */
+	for (j = 0; j + 2 <= groups; j += 2) {
+		__m256i v = rgb_avx2(_mm256_loadu_si256((const __m256i *)pixels));
+
+		s = _mm256_add_epi64(s, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+		w = _mm256_add_epi64(w, s);
+		s = _mm256_add_epi64(s, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+		w = _mm256_add_epi64(w, s);
+
+		pixels += 32;
+	}
+
+	_mm256_storeu_si256((__m256i *)sum, s);
+	_mm256_storeu_si256((__m256i *)weighted, w);
+
+	sums_generic_continue(pixels, groups - j, sum, weighted);
+}
+
+#pragma GCC pop_options
+#endif
+
+static const struct chamelium_crc_kernels crc_kernels[] = {
+#if defined(__x86_64__) && !defined(__clang__)
+	{ "avx2", AVX2, sums_avx2 },
+	{ "sse2", SSE2, sums_sse2 },
+#endif
+	{ "generic", 0, sums_generic },
+};
+
+/**
+ * chamelium_crc_kernels:
+ * @features: igt_x86_features() the implementation is allowed to use
+ *
+ * Returns: the fastest implementation only using @features, the generic C
+ * implementation if @features is 0.
+ */
+const struct chamelium_crc_kernels *chamelium_crc_kernels(unsigned features)
+{
+	return igt_kernels_select(crc_kernels, features);
+}
+
+struct crc_bands {
+	const struct chamelium_crc_kernels *k;
+	const unsigned char *buffer;
+	struct crc_band {
+		/* Groups up to the end of the band */
+		size_t end;
+		uint64_t sum[CHAMELIUM_CRC_WORDS];
+		uint64_t weighted[CHAMELIUM_CRC_WORDS];
+	} *bands;
+};
+
+static void crc_band(void *data, int band, int64_t start, int64_t end)
+{
+	struct crc_bands *c = data;
+	struct crc_band *b = &c->bands[band];
+
+	c->k->sums(c->buffer + start * 4 * CHAMELIUM_CRC_WORDS, end - start,
+		   b->sum, b->weighted);
+	b->end = end;
+}
+
+/**
+ * chamelium_xrgb_hash16_with:
+ * @k: the implementation to use
+ * @hash: the computed hashes
+ * @buffer: the XRGB8888 frame, without any padding between rows
+ * @width: width of the frame
+ * @height: height of the frame
+ * @num_threads: number of threads to split the frame across
+ *
+ * Like chamelium_xrgb_hash16() with the given implementation and number of
+ * threads.
+ */
+void chamelium_xrgb_hash16_with(const struct chamelium_crc_kernels *k,
+				uint32_t hash[CHAMELIUM_CRC_WORDS],
+				const unsigned char *buffer,
+				int width, int height, int num_threads)
+{
+	size_t pixels = (size_t)width * height;
+	size_t groups = pixels / CHAMELIUM_CRC_WORDS;
+	uint64_t total[CHAMELIUM_CRC_WORDS] = {};
+	struct crc_bands c = { .k = k, .buffer = buffer };
+	int i, j;
+
+	if (num_threads < 1 || groups < num_threads)
+		num_threads = 1;
+
+	c.bands = calloc(num_threads, sizeof(*c.bands));
+	igt_assert(c.bands);
+
+	igt_kernels_run_bands(crc_band, &c, num_threads, groups);
+
+	for (i = 0; i < num_threads; i++) {
+		struct crc_band *b = &c.bands[i];
+
+		for (j = 0; j < CHAMELIUM_CRC_WORDS; j++)
+			total[j] += (b->end + 1) * b->sum[j] - b->weighted[j];
+	}
+
+	/* The last, incomplete, group */
+	for (j = 0; j < pixels % CHAMELIUM_CRC_WORDS; j++)
+		total[j] += (groups + 1) *
+			rgb(buffer + (groups * CHAMELIUM_CRC_WORDS + j) * 4);
+
+	for (j = 0; j < CHAMELIUM_CRC_WORDS; j++)
+		hash[j] = ((total[j] >> 0) ^ (total[j] >> 16) ^
+			   (total[j] >> 32) ^ (total[j] >> 48)) & 0xffff;
+
+	free(c.bands);
+}
+
+/**
+ * chamelium_xrgb_hash16:
+ * @hash: the computed hashes
+ * @buffer: the XRGB8888 frame, without any padding between rows
+ * @width: width of the frame
+ * @height: height of the frame
+ *
+ * Computes the hashes the Chamelium's CRC of a frame is made of, in a
+ * single pass over the frame, split across a few threads for large frames.
+ */
+void chamelium_xrgb_hash16(uint32_t hash[CHAMELIUM_CRC_WORDS],
+			   const unsigned char *buffer, int width, int height)
+{
+	int64_t pixels = (int64_t)width * height;
+
+	chamelium_xrgb_hash16_with(chamelium_crc_kernels(igt_x86_features()),
+				   hash, buffer, width, height,
+				   igt_kernels_num_bands(pixels,
+							 pixels / CHAMELIUM_CRC_WORDS));
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_CHAMELIUM_CRC_H__
+#define __IGT_CHAMELIUM_CRC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The Chamelium's frame CRC, computed from an XRGB8888 framebuffer to
+ * compare with the ones it captures. It is made of CHAMELIUM_CRC_WORDS
+ * 16 bit hashes, hash k covering the pixels whose index in the frame is k
+ * modulo CHAMELIUM_CRC_WORDS.
+ */
+
+#define CHAMELIUM_CRC_WORDS 4
+
+/**
+ * chamelium_crc_kernels:
+ * @name: name of the implementation
+ * @features: the igt_x86_features() the implementation requires
+ * @sums: for the @groups groups of CHAMELIUM_CRC_WORDS pixels at @pixels,
+ *        computes for each pixel k of a group the sum of the RGB values
+ *        v[j] of that pixel in each group j in @sum, and the sum of
+ *        (@groups - j) * v[j] in @weighted, all modulo 2^64
+ *
+ * All implementations give identical results.
+ */
+struct chamelium_crc_kernels {
+	const char *name;
+	unsigned features;
+	void (*sums)(const unsigned char *pixels, size_t groups,
+		     uint64_t sum[CHAMELIUM_CRC_WORDS],
+		     uint64_t weighted[CHAMELIUM_CRC_WORDS]);
+};
+
+const struct chamelium_crc_kernels *chamelium_crc_kernels(unsigned features);
+
+void chamelium_xrgb_hash16_with(const struct chamelium_crc_kernels *k,
+				uint32_t hash[CHAMELIUM_CRC_WORDS],
+				const unsigned char *buffer,
+				int width, int height, int num_threads);
+void chamelium_xrgb_hash16(uint32_t hash[CHAMELIUM_CRC_WORDS],
+			   const unsigned char *buffer, int width, int height);
+
+#endif /* __IGT_CHAMELIUM_CRC_H__ */
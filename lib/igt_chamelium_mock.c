@@ -0,0 +1,695 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_chamelium_mock.h"
+
+/**
+ * SECTION:igt_chamelium_mock
+ * @short_description: A mock Chamelium for offline testing
+ * @title: Chamelium mock
+ * @include: igt_chamelium_mock.h
+ *
+ * A local XML-RPC server answering the calls igt_chamelium makes, with
+ * just enough state to be consistent: plugged ports, EDIDs, captures of
+ * a configurable number of frames of a configurable size. Each call can be
+ * made to take some time, like the requests to a real board do.
+ *
+ * It serves HTTP/1.1 on 127.0.0.1, one thread per connection, and only
+ * understands the subset of XML-RPC the client sends: the integer and
+ * boolean parameters are read, the others are skipped.
+ *
+ * |[
+ *	struct chamelium_mock_params params = {
+ *		.num_ports = 2, .width = 1920, .height = 1080,
+ *	};
+ *	struct chamelium_mock *mock = chamelium_mock_start(&params);
+ *	struct chamelium *chamelium =
+ *		chamelium_init_url(chamelium_mock_get_url(mock));
+ *
+ *	...
+ *
+ *	chamelium_deinit(chamelium);
+ *	chamelium_mock_stop(mock);
+ * ]|
+ */
+
+#define MAX_PARAMS 8
+
+/* Larger requests are taken as garbage and their connection dropped */
+#define MAX_REQUEST_LEN (64 << 20)
+
+struct mock_connection {
+	struct mock_connection *next;
+	struct chamelium_mock *mock;
+	pthread_t thread;
+	int fd;
+	/* Set under the lock once the thread is done with the connection */
+	bool done;
+};
+
+struct chamelium_mock {
+	struct chamelium_mock_params params;
+	char url[64];
+	int listen_fd;
+	pthread_t thread;
+
+	pthread_mutex_t lock;
+	struct mock_connection *connections;
+	unsigned long calls;
+
+	/* The state of the board, under the lock */
+	bool *plugged;
+	bool *ddc_enabled;
+	int next_edid;
+	int captured_frames;
+
+	/* Every frame is the same, only encoded once */
+	char *frame;
+	size_t frame_len;
+};
+
+struct buf {
+	char *data;
+	size_t len, size;
+};
+
+__attribute__((format(printf, 2, 3)))
+static void buf_printf(struct buf *b, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	for (;;) {
+		va_start(ap, fmt);
+		len = vsnprintf(b->data + b->len, b->size - b->len, fmt, ap);
+		va_end(ap);
+		igt_assert(len >= 0);
+
+		if (b->len + len < b->size)
+			break;
+
+		b->size = 2 * (b->len + len + 1);
+		b->data = realloc(b->data, b->size);
+		igt_assert(b->data);
+	}
+
+	b->len += len;
+}
+
+static char *base64_encode(const unsigned char *data, size_t len,
+			   size_t *out_len)
+{
+	static const char table[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char *out = malloc((len + 2) / 3 * 4 + 1), *p = out;
+	size_t i;
+
+	igt_assert(out);
+
+	for (i = 0; i + 3 <= len; i += 3) {
+		uint32_t v = data[i] << 16 | data[i + 1] << 8 | data[i + 2];
+
+		*p++ = table[v >> 18];
+		*p++ = table[v >> 12 & 63];
+		*p++ = table[v >> 6 & 63];
+		*p++ = table[v & 63];
+	}
+
+	if (i < len) {
+		uint32_t v = data[i] << 16 | (i + 1 < len ? data[i + 1] << 8 : 0);
+
+		*p++ = table[v >> 18];
+		*p++ = table[v >> 12 & 63];
+		*p++ = i + 1 < len ? table[v >> 6 & 63] : '=';
+		*p++ = '=';
+	}
+
+	*p = '\0';
+	*out_len = p - out;
+
+	return out;
+}
+
+/* A gradient, in the packed 24 bit RGB the Chamelium dumps */
+static void make_frame(struct chamelium_mock *mock)
+{
+	int w = mock->params.width, h = mock->params.height;
+	size_t len = (size_t)w * h * 3;
+	unsigned char *rgb = malloc(len);
+	int x, y;
+
+	igt_assert(rgb);
+
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			unsigned char *p = rgb + ((size_t)y * w + x) * 3;
+
+			p[0] = x * 255 / w;
+			p[1] = y * 255 / h;
+			p[2] = (x + y) & 0xff;
+		}
+	}
+
+	mock->frame = base64_encode(rgb, len, &mock->frame_len);
+	free(rgb);
+}
+
+static const char *port_type(int id)
+{
+	static const char *types[] = { "DP", "HDMI", "VGA" };
+
+	return types[(id - 1) % 3];
+}
+
+/* The first int, i4 or boolean of each of the parameters */
+static int parse_params(const char *body, long *params)
+{
+	const char *p = body;
+	int n = 0;
+
+	while (n < MAX_PARAMS && (p = strstr(p, "<param>"))) {
+		const char *end = strstr(p, "</param>");
+		const char *v;
+
+		params[n] = 0;
+		p += strlen("<param>");
+
+		v = strchr(p, '<');
+		while (v && (!end || v < end) &&
+		       (!strncmp(v, "<value>", 7) || !strncmp(v, "<value ", 7)))
+			v = strchr(v + 1, '<');
+
+		if (v && (!end || v < end)) {
+			if (!strncmp(v, "<int>", 5))
+				params[n] = strtol(v + 5, NULL, 10);
+			else if (!strncmp(v, "<i4>", 4))
+				params[n] = strtol(v + 4, NULL, 10);
+			else if (!strncmp(v, "<boolean>", 9))
+				params[n] = strtol(v + 9, NULL, 10);
+		}
+
+		n++;
+		if (end)
+			p = end;
+	}
+
+	return n;
+}
+
+static bool valid_port(struct chamelium_mock *mock, long id)
+{
+	return id >= 1 && id <= mock->params.num_ports;
+}
+
+static void crc_value(struct buf *b, int frame)
+{
+	int i;
+
+	buf_printf(b, "<array><data>");
+	for (i = 0; i < 4; i++)
+		buf_printf(b, "<value><int>%d</int></value>",
+			   (frame * 0x9e37 + i * 0x79b9) & 0xffff);
+	buf_printf(b, "</data></array>");
+}
+
+/*
+ * Writes the value returned by @method to @value, which is followed by the
+ * encoded frame if @frame is set. Returns an error message for a fault.
+ */
+static const char *handle_call(struct chamelium_mock *mock, const char *method,
+			       const long *params, int num_params,
+			       struct buf *value, bool *frame)
+{
+	const char *error = NULL;
+	long port = num_params ? params[0] : 0;
+	int i;
+
+	*frame = false;
+
+	pthread_mutex_lock(&mock->lock);
+	mock->calls++;
+
+	if (!strcmp(method, "Reset")) {
+		for (i = 0; i < mock->params.num_ports; i++)
+			mock->plugged[i] = false;
+		buf_printf(value, "<nil/>");
+	} else if (!strcmp(method, "GetSupportedInputs")) {
+		buf_printf(value, "<array><data>");
+		for (i = 1; i <= mock->params.num_ports; i++)
+			buf_printf(value, "<value><int>%d</int></value>", i);
+		buf_printf(value, "</data></array>");
+	} else if (!strcmp(method, "CreateEdid")) {
+		buf_printf(value, "<int>%d</int>", mock->next_edid++);
+	} else if (!strcmp(method, "DestroyEdid")) {
+		buf_printf(value, "<nil/>");
+	} else if (!strcmp(method, "StopCapturingVideo")) {
+		if (port > 0)
+			mock->captured_frames = port;
+		buf_printf(value, "<nil/>");
+	} else if (!strcmp(method, "GetCapturedResolution")) {
+		buf_printf(value,
+			   "<array><data><value><int>%d</int></value><value><int>%d</int></value></data></array>",
+			   mock->params.width, mock->params.height);
+	} else if (!strcmp(method, "GetCapturedFrameCount")) {
+		buf_printf(value, "<int>%d</int>", mock->captured_frames);
+	} else if (!strcmp(method, "GetCapturedChecksums")) {
+		buf_printf(value, "<array><data>");
+		for (i = 0; i < mock->captured_frames; i++) {
+			buf_printf(value, "<value>");
+			crc_value(value, i);
+			buf_printf(value, "</value>");
+		}
+		buf_printf(value, "</data></array>");
+	} else if (!strcmp(method, "ReadCapturedFrame")) {
+		if (port < 0 || port >= mock->captured_frames)
+			error = "No such captured frame";
+		else
+			*frame = true;
+	} else if (!valid_port(mock, port)) {
+		/* Everything else takes a port */
+		error = "Unknown method or port";
+	} else if (!strcmp(method, "GetConnectorType")) {
+		buf_printf(value, "<string>%s</string>", port_type(port));
+	} else if (!strcmp(method, "Plug") || !strcmp(method, "Unplug")) {
+		mock->plugged[port - 1] = !strcmp(method, "Plug");
+		buf_printf(value, "<nil/>");
+	} else if (!strcmp(method, "IsPlugged") ||
+		   !strcmp(method, "WaitVideoInputStable")) {
+		buf_printf(value, "<boolean>%d</boolean>",
+			   mock->plugged[port - 1]);
+	} else if (!strcmp(method, "SetDdcState")) {
+		mock->ddc_enabled[port - 1] = num_params > 1 && params[1];
+		buf_printf(value, "<nil/>");
+	} else if (!strcmp(method, "IsDdcEnabled")) {
+		buf_printf(value, "<boolean>%d</boolean>",
+			   mock->ddc_enabled[port - 1]);
+	} else if (!strcmp(method, "ApplyEdid") ||
+		   !strcmp(method, "FireMixedHpdPulses") ||
+		   !strcmp(method, "ScheduleHpdToggle") ||
+		   !strcmp(method, "StartCapturingVideo")) {
+		buf_printf(value, "<nil/>");
+	} else if (!strcmp(method, "CaptureVideo")) {
+		mock->captured_frames = num_params > 1 ? params[1] : 0;
+		if (mock->captured_frames > mock->params.frame_limit)
+			error = "Too many frames";
+		else
+			buf_printf(value, "<nil/>");
+	} else if (!strcmp(method, "DetectResolution")) {
+		buf_printf(value,
+			   "<array><data><value><int>%d</int></value><value><int>%d</int></value></data></array>",
+			   mock->params.width, mock->params.height);
+	} else if (!strcmp(method, "DumpPixels")) {
+		*frame = true;
+	} else if (!strcmp(method, "ComputePixelChecksum")) {
+		crc_value(value, 0);
+	} else if (!strcmp(method, "GetMaxFrameLimit")) {
+		buf_printf(value, "<int>%d</int>", mock->params.frame_limit);
+	} else {
+		error = "Unknown method";
+	}
+
+	pthread_mutex_unlock(&mock->lock);
+
+	return error;
+}
+
+static bool write_all(int fd, struct iovec *iov, int count)
+{
+	while (count) {
+		ssize_t ret = writev(fd, iov, count);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		while (count && ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return true;
+}
+
+static bool reply(struct mock_connection *conn, const char *body)
+{
+	struct chamelium_mock *mock = conn->mock;
+	struct buf header = {}, head = {}, tail = {}, value = {};
+	char method[64] = "";
+	long params[MAX_PARAMS];
+	int num_params;
+	const char *error, *p;
+	struct iovec iov[4];
+	bool frame, ret;
+
+	p = strstr(body, "<methodName>");
+	if (p)
+		sscanf(p + strlen("<methodName>"), "%63[^<]", method);
+	num_params = parse_params(body, params);
+
+	if (mock->params.latency_us)
+		usleep(mock->params.latency_us);
+
+	error = handle_call(mock, method, params, num_params, &value, &frame);
+
+	buf_printf(&head, "<?xml version=\"1.0\"?>\r\n<methodResponse>");
+	if (error) {
+		buf_printf(&head,
+			   "<fault><value><struct>"
+			   "<member><name>faultCode</name><value><int>1</int></value></member>"
+			   "<member><name>faultString</name><value><string>%s: %s</string></value></member>"
+			   "</struct></value></fault>",
+			   error, method);
+		frame = false;
+	} else {
+		buf_printf(&head, "<params><param><value>%s%s",
+			   value.data ?: "", frame ? "<base64>" : "");
+		buf_printf(&tail, "%s</value></param></params>",
+			   frame ? "</base64>" : "");
+	}
+	buf_printf(&tail, "</methodResponse>\r\n");
+
+	buf_printf(&header,
+		   "HTTP/1.1 200 OK\r\n"
+		   "Content-Type: text/xml\r\n"
+		   "Content-Length: %zu\r\n"
+		   "\r\n",
+		   head.len + (frame ? mock->frame_len : 0) + tail.len);
+
+	iov[0] = (struct iovec) { header.data, header.len };
+	iov[1] = (struct iovec) { head.data, head.len };
+	iov[2] = (struct iovec) { frame ? mock->frame : NULL,
+				  frame ? mock->frame_len : 0 };
+	iov[3] = (struct iovec) { tail.data, tail.len };
+	ret = write_all(conn->fd, iov, 4);
+
+	free(header.data);
+	free(head.data);
+	free(tail.data);
+	free(value.data);
+
+	return ret;
+}
+
+static void *connection_thread(void *data)
+{
+	struct mock_connection *conn = data;
+	struct buf in = {};
+
+	for (;;) {
+		char *end = NULL, *p;
+		size_t length = 0, request;
+		ssize_t ret;
+
+		/* The headers, then the body */
+		for (;;) {
+			if (in.data) {
+				in.data[in.len] = '\0';
+				end = strstr(in.data, "\r\n\r\n");
+			}
+			if (end) {
+				request = end + 4 - in.data;
+				/* end starts with a CRLF, so each line ends before it */
+				for (p = in.data; p < end; p = strstr(p, "\r\n") + 2) {
+					if (!strncasecmp(p, "Content-Length:", 15))
+						length = strtoul(p + 15, NULL, 10);
+					if (length > MAX_REQUEST_LEN)
+						goto out;
+					if (!strncasecmp(p, "Expect: 100-continue", 20) &&
+					    in.len == request) {
+						static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+						struct iovec iov = { (void *)cont, sizeof(cont) - 1 };
+
+						if (!write_all(conn->fd, &iov, 1))
+							goto out;
+					}
+				}
+				if (in.len >= request + length)
+					break;
+			}
+
+			if (in.size - in.len < 4096 + 1) {
+				in.size = 2 * in.size + 4096 + 1;
+				in.data = realloc(in.data, in.size);
+				igt_assert(in.data);
+			}
+
+			ret = read(conn->fd, in.data + in.len, in.size - in.len - 1);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret <= 0)
+				goto out;
+			in.len += ret;
+		}
+
+		p = strndup(in.data + request, length);
+		igt_assert(p);
+		ret = reply(conn, p);
+		free(p);
+		if (!ret)
+			break;
+
+		/* Keep anything pipelined after this request */
+		memmove(in.data, in.data + request + length,
+			in.len - request - length);
+		in.len -= request + length;
+	}
+
+out:
+	free(in.data);
+	shutdown(conn->fd, SHUT_RDWR);
+
+	pthread_mutex_lock(&conn->mock->lock);
+	conn->done = true;
+	pthread_mutex_unlock(&conn->mock->lock);
+
+	return NULL;
+}
+
+static void free_connection(struct mock_connection *conn)
+{
+	pthread_join(conn->thread, NULL);
+	close(conn->fd);
+	free(conn);
+}
+
+/* Frees the connections the client closed, called with the lock held */
+static void reap_connections(struct chamelium_mock *mock)
+{
+	struct mock_connection **prev = &mock->connections, *conn;
+
+	while ((conn = *prev)) {
+		if (conn->done) {
+			*prev = conn->next;
+			free_connection(conn);
+		} else {
+			prev = &conn->next;
+		}
+	}
+}
+
+static void *accept_thread(void *data)
+{
+	struct chamelium_mock *mock = data;
+
+	for (;;) {
+		struct mock_connection *conn;
+		int fd;
+
+		fd = accept(mock->listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+
+		conn = calloc(1, sizeof(*conn));
+		igt_assert(conn);
+		conn->mock = mock;
+		conn->fd = fd;
+
+		pthread_mutex_lock(&mock->lock);
+		reap_connections(mock);
+		conn->next = mock->connections;
+		mock->connections = conn;
+		pthread_mutex_unlock(&mock->lock);
+
+		igt_assert(pthread_create(&conn->thread, NULL,
+					  connection_thread, conn) == 0);
+	}
+
+	return NULL;
+}
+
+/**
+ * chamelium_mock_start:
+ * @params: the configuration of the mock Chamelium
+ *
+ * Starts serving a mock Chamelium from a thread of the calling process,
+ * with all its ports unplugged. Unset parameters get defaults: 3 ports,
+ * 1920x1080 frames, no latency and a limit of 100 frames.
+ *
+ * Returns: the mock Chamelium, or NULL if the server couldn't be started
+ */
+struct chamelium_mock *chamelium_mock_start(const struct chamelium_mock_params *params)
+{
+	struct chamelium_mock *mock = calloc(1, sizeof(*mock));
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+
+	igt_assert(mock);
+
+	mock->params = *params;
+	if (mock->params.num_ports <= 0)
+		mock->params.num_ports = 3;
+	if (mock->params.width <= 0 || mock->params.height <= 0) {
+		mock->params.width = 1920;
+		mock->params.height = 1080;
+	}
+	if (mock->params.frame_limit <= 0)
+		mock->params.frame_limit = 100;
+
+	mock->plugged = calloc(mock->params.num_ports, sizeof(bool));
+	mock->ddc_enabled = calloc(mock->params.num_ports, sizeof(bool));
+	igt_assert(mock->plugged && mock->ddc_enabled);
+	memset(mock->ddc_enabled, true,
+	       mock->params.num_ports * sizeof(bool));
+	mock->next_edid = 1;
+	pthread_mutex_init(&mock->lock, NULL);
+
+	make_frame(mock);
+
+	mock->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (mock->listen_fd < 0)
+		goto err;
+	if (bind(mock->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(mock->listen_fd, 16) ||
+	    getsockname(mock->listen_fd, (struct sockaddr *)&addr, &len))
+		goto err_close;
+
+	snprintf(mock->url, sizeof(mock->url), "http://127.0.0.1:%d/RPC2",
+		 ntohs(addr.sin_port));
+
+	if (pthread_create(&mock->thread, NULL, accept_thread, mock))
+		goto err_close;
+
+	igt_debug("Mock Chamelium serving on %s\n", mock->url);
+
+	return mock;
+
+err_close:
+	close(mock->listen_fd);
+err:
+	igt_debug("Failed to start the mock Chamelium: %m\n");
+	free(mock->frame);
+	free(mock->plugged);
+	free(mock->ddc_enabled);
+	free(mock);
+
+	return NULL;
+}
+
+/**
+ * chamelium_mock_get_url:
+ * @mock: a mock Chamelium
+ *
+ * Returns: the URL to give to chamelium_init_url()
+ */
+const char *chamelium_mock_get_url(struct chamelium_mock *mock)
+{
+	return mock->url;
+}
+
+/**
+ * chamelium_mock_get_call_count:
+ * @mock: a mock Chamelium
+ *
+ * Returns: the number of calls @mock answered
+ */
+unsigned long chamelium_mock_get_call_count(struct chamelium_mock *mock)
+{
+	unsigned long calls;
+
+	pthread_mutex_lock(&mock->lock);
+	calls = mock->calls;
+	pthread_mutex_unlock(&mock->lock);
+
+	return calls;
+}
+
+/**
+ * chamelium_mock_stop:
+ * @mock: a mock Chamelium
+ *
+ * Closes all the connections to @mock and frees it.
+ */
+void chamelium_mock_stop(struct chamelium_mock *mock)
+{
+	struct mock_connection *conn, *next;
+
+	/* Wakes up accept() */
+	shutdown(mock->listen_fd, SHUT_RDWR);
+	pthread_join(mock->thread, NULL);
+	close(mock->listen_fd);
+
+	pthread_mutex_lock(&mock->lock);
+	for (conn = mock->connections; conn; conn = conn->next)
+		shutdown(conn->fd, SHUT_RDWR);
+	pthread_mutex_unlock(&mock->lock);
+
+	for (conn = mock->connections; conn; conn = next) {
+		next = conn->next;
+		free_connection(conn);
+	}
+
+	pthread_mutex_destroy(&mock->lock);
+	free(mock->frame);
+	free(mock->plugged);
+	free(mock->ddc_enabled);
+	free(mock);
+}
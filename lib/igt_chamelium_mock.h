@@ -0,0 +1,57 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_CHAMELIUM_MOCK_H__
+#define __IGT_CHAMELIUM_MOCK_H__
+
+/*
+ * A stand-in for a Chamelium, answering the XML-RPC calls igt_chamelium
+ * makes from a local HTTP server, to exercise and profile the client code
+ * without the hardware. See chamelium_init_url().
+ */
+
+struct chamelium_mock;
+
+/**
+ * chamelium_mock_params:
+ * @num_ports: number of ports, with ids 1 to @num_ports, alternately DP,
+ *             HDMI and VGA
+ * @width: width of the captured frames
+ * @height: height of the captured frames
+ * @latency_us: time each call takes before its reply is sent
+ * @frame_limit: the number of frames that can be captured at once
+ */
+struct chamelium_mock_params {
+	int num_ports;
+	int width;
+	int height;
+	int latency_us;
+	int frame_limit;
+};
+
+struct chamelium_mock *chamelium_mock_start(const struct chamelium_mock_params *params);
+const char *chamelium_mock_get_url(struct chamelium_mock *mock);
+unsigned long chamelium_mock_get_call_count(struct chamelium_mock *mock);
+void chamelium_mock_stop(struct chamelium_mock *mock);
+
+#endif /* __IGT_CHAMELIUM_MOCK_H__ */
@@ -47,6 +47,7 @@
 #include <sys/syscall.h>
 #endif
 #include <pthread.h>
+#include <sched.h>
 #include <sys/utsname.h>
 #include <termios.h>
 #include <errno.h>
@@ -70,6 +71,7 @@
 #include "igt_sysfs.h"
 #include "igt_sysrq.h"
 #include "igt_rc.h"
+#include "igt_trace.h"
 
 #define UNW_LOCAL_ONLY
 #include <libunwind.h>
@@ -292,9 +294,28 @@ static int igt_exitcode = IGT_EXIT_SUCCESS;
 static const char *command_str;
 
 static char* igt_log_domain_filter;
+
+/*
+ * The last LOG_BUFFER_RECORDS lines logged, for dumping on failure, in a ring
+ * of preformatted records. Each line takes a ticket, which selects the record
+ * and tells the readers whether it's the line they expect. A record's seq is
+ * odd while its line is written and 2 * (ticket + 1) once complete, so that
+ * loggers never wait on each other nor allocate memory, and readers skip the
+ * records overwritten under them.
+ */
+#define LOG_BUFFER_RECORDS 256
+#define LOG_RECORD_SIZE 1024
+
+struct log_record {
+	uint64_t seq;
+	char line[LOG_RECORD_SIZE];
+};
+
 static struct {
-	char *entries[256];
-	uint8_t start, end;
+	struct log_record records[LOG_BUFFER_RECORDS];
+	/* The next ticket, and the first one which wasn't reset */
+	uint64_t head;
+	uint64_t start;
 } log_buffer;
 static pthread_mutex_t log_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -309,56 +330,114 @@ const char *igt_test_name(void)
 	return command_str;
 }
 
-static void _igt_log_buffer_append(char *line)
+/* Takes a record for a new line, NULL if it was already overwritten */
+static struct log_record *_igt_log_buffer_get(uint64_t *ticket)
 {
-	pthread_mutex_lock(&log_buffer_mutex);
+	uint64_t t = __sync_fetch_and_add(&log_buffer.head, 1);
+	struct log_record *rec = &log_buffer.records[t % LOG_BUFFER_RECORDS];
+	uint64_t seq;
 
-	free(log_buffer.entries[log_buffer.end]);
-	log_buffer.entries[log_buffer.end] = line;
-	log_buffer.end++;
-	if (log_buffer.end == log_buffer.start)
-		log_buffer.start++;
+	for (;;) {
+		seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+		if (seq > 2 * t)
+			return NULL;
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+		/* Only when wrapping around onto a line still being written */
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+
+		if (__sync_bool_compare_and_swap(&rec->seq, seq, 2 * t + 1))
+			break;
+	}
+
+	*ticket = t;
+	return rec;
+}
+
+static void _igt_log_buffer_put(struct log_record *rec, uint64_t ticket)
+{
+	__atomic_store_n(&rec->seq, 2 * ticket + 2, __ATOMIC_RELEASE);
 }
 
 static void _igt_log_buffer_reset(void)
 {
-	pthread_mutex_lock(&log_buffer_mutex);
+	__atomic_store_n(&log_buffer.start,
+			 __atomic_load_n(&log_buffer.head, __ATOMIC_ACQUIRE),
+			 __ATOMIC_RELEASE);
+}
+
+/*
+ * Calls @fn with each complete line of the log buffer in order, until it
+ * returns true. Returns whether there was any line.
+ */
+static bool _igt_log_buffer_for_each(bool (*fn)(const char *line, void *data),
+				     void *data)
+{
+	char line[LOG_RECORD_SIZE];
+	uint64_t head, t;
+	bool found = false;
 
-	log_buffer.start = log_buffer.end = 0;
+	head = __atomic_load_n(&log_buffer.head, __ATOMIC_ACQUIRE);
+	t = __atomic_load_n(&log_buffer.start, __ATOMIC_ACQUIRE);
+	if (head - t > LOG_BUFFER_RECORDS)
+		t = head - LOG_BUFFER_RECORDS;
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+	for (; t < head; t++) {
+		struct log_record *rec = &log_buffer.records[t % LOG_BUFFER_RECORDS];
+		uint64_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+
+		if (seq != 2 * t + 2)
+			continue;
+
+		memcpy(line, rec->line, sizeof(line));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+
+		line[sizeof(line) - 1] = '\0';
+		found = true;
+		if (fn(line, data))
+			break;
+	}
+
+	return found;
+}
+
+static bool _igt_log_buffer_print(const char *line, void *data)
+{
+	if (!*(bool *)data) {
+		fprintf(stderr, "**** DEBUG ****\n");
+		*(bool *)data = true;
+	}
+
+	fprintf(stderr, "%s", line);
+
+	return false;
 }
 
 static void _igt_log_buffer_dump(void)
 {
-	uint8_t i;
+	bool printed = false;
 
 	if (in_subtest)
 		fprintf(stderr, "Subtest %s failed.\n", in_subtest);
 	else
 		fprintf(stderr, "Test %s failed.\n", command_str);
 
-	if (log_buffer.start == log_buffer.end) {
-		fprintf(stderr, "No log.\n");
-		return;
-	}
-
+	/* Only serializes the dumps, loggers don't wait */
 	pthread_mutex_lock(&log_buffer_mutex);
-	fprintf(stderr, "**** DEBUG ****\n");
 
-	i = log_buffer.start;
-	do {
-		char *last_line = log_buffer.entries[i];
-		fprintf(stderr, "%s", last_line);
-		i++;
-	} while (i != log_buffer.start && i != log_buffer.end);
+	if (!_igt_log_buffer_for_each(_igt_log_buffer_print, &printed)) {
+		fprintf(stderr, "No log.\n");
+	} else {
+		/* reset the buffer */
+		_igt_log_buffer_reset();
 
-	/* reset the buffer */
-	log_buffer.start = log_buffer.end = 0;
+		fprintf(stderr, "****  END  ****\n");
+	}
 
-	fprintf(stderr, "****  END  ****\n");
 	pthread_mutex_unlock(&log_buffer_mutex);
 }
 
@@ -370,20 +449,13 @@ static void _igt_log_buffer_dump(void)
  *         the log buffer. The handler should return true to stop
  *         inspecting the rest of the buffer.
  * @data: passed as a user argument to the inspection function.
+ *
+ * Lines longer than about 1KiB are truncated in the log buffer, and lines
+ * which are still being logged by other threads are skipped.
  */
 void igt_log_buffer_inspect(igt_buffer_log_handler_t check, void *data)
 {
-	uint8_t i;
-	pthread_mutex_lock(&log_buffer_mutex);
-
-	i = log_buffer.start;
-	do {
-		if (check(log_buffer.entries[i], data))
-			break;
-		i++;
-	} while (i != log_buffer.start && i != log_buffer.end);
-
-	pthread_mutex_unlock(&log_buffer_mutex);
+	_igt_log_buffer_for_each(check, data);
 }
 
 void igt_kmsg(const char *format, ...)
@@ -1710,6 +1782,7 @@ bool __igt_fork(void)
 	/* ensure any buffers are flushed before fork */
 	fflush(NULL);
 
+	igt_trace_begin("igt_fork");
 	switch (test_children[num_test_children++] = fork()) {
 	case -1:
 		igt_assert(0);
@@ -1721,6 +1794,8 @@ bool __igt_fork(void)
 
 		return true;
 	default:
+		igt_trace_end("igt_fork");
+		igt_trace_counter("children", num_test_children);
 		return false;
 	}
 
@@ -1759,6 +1834,8 @@ int __igt_waitchildren(void)
 
 	assert(!test_child);
 
+	igt_trace_begin("igt_waitchildren");
+
 	count = 0;
 	while (count < num_test_children) {
 		int status = -1;
@@ -1798,6 +1875,9 @@ int __igt_waitchildren(void)
 	}
 
 	num_test_children = 0;
+	igt_trace_end("igt_waitchildren");
+	igt_trace_counter("children", 0);
+
 	return err;
 }
 
@@ -2121,7 +2201,8 @@ void igt_log(const char *domain, enum igt_log_level level, const char *format, .
 void igt_vlog(const char *domain, enum igt_log_level level, const char *format, va_list args)
 {
 	FILE *file;
-	char *line, *formatted_line;
+	struct log_record *rec;
+	char *line, *long_line = NULL;
 	const char *program_name;
 	const char *igt_log_level_str[] = {
 		"DEBUG",
@@ -2131,6 +2212,10 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 		"NONE"
 	};
 	static bool line_continuation = false;
+	char buf[LOG_RECORD_SIZE];
+	uint64_t ticket;
+	va_list args_copy;
+	int prefix, len;
 
 	assert(format);
 
@@ -2143,23 +2228,42 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 	if (list_subtests && level <= IGT_LOG_WARN)
 		return;
 
-	if (vasprintf(&line, format, args) == -1)
+	/* Formatted on the stack, only overlong lines are allocated */
+	if (line_continuation)
+		prefix = 0;
+	else
+		prefix = snprintf(buf, sizeof(buf),
+				  "(%s:%d) %s%s%s: ", program_name,
+				  getpid(), (domain) ? domain : "",
+				  (domain) ? "-" : "", igt_log_level_str[level]);
+	if (prefix < 0)
+		return;
+	if (prefix >= sizeof(buf))
+		prefix = sizeof(buf) - 1;
+
+	va_copy(args_copy, args);
+	len = vsnprintf(buf + prefix, sizeof(buf) - prefix, format, args_copy);
+	va_end(args_copy);
+	if (len < 0)
 		return;
 
-	if (line_continuation) {
-		formatted_line = strdup(line);
-		if (!formatted_line)
-			goto out;
-	} else if (asprintf(&formatted_line, "(%s:%d) %s%s%s: %s", program_name,
-		     getpid(), (domain) ? domain : "", (domain) ? "-" : "",
-		     igt_log_level_str[level], line) == -1) {
-		goto out;
+	line = buf + prefix;
+	if (len >= sizeof(buf) - prefix) {
+		/* Truncated in the log buffer, but printed whole */
+		if (vasprintf(&long_line, format, args) == -1)
+			return;
+		line = long_line;
+		buf[sizeof(buf) - 2] = '\n';
 	}
 
-	line_continuation = line[strlen(line) - 1] != '\n';
+	line_continuation = len == 0 || line[len - 1] != '\n';
 
 	/* append log buffer */
-	_igt_log_buffer_append(formatted_line);
+	rec = _igt_log_buffer_get(&ticket);
+	if (rec) {
+		memcpy(rec->line, buf, min(prefix + len + 1, LOG_RECORD_SIZE));
+		_igt_log_buffer_put(rec, ticket);
+	}
 
 	/* check print log level */
 	if (igt_log_level > level)
@@ -2186,13 +2290,11 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 	/* prepend all except information messages with process, domain and log
 	 * level information */
 	if (level != IGT_LOG_INFO)
-		fwrite(formatted_line, sizeof(char), strlen(formatted_line),
-		       file);
-	else
-		fwrite(line, sizeof(char), strlen(line), file);
+		fwrite(buf, sizeof(char), prefix, file);
+	fwrite(line, sizeof(char), len, file);
 
 out:
-	free(line);
+	free(long_line);
 }
 
 static const char *timeout_op;
@@ -70,15 +70,18 @@ typedef struct _igt_pipe_crc igt_pipe_crc_t;
  * @frame: frame number of the capture CRC
  * @n_words: internal field, don't access
  * @crc: internal field, don't access
+ * @timestamp: CLOCK_MONOTONIC time in nanoseconds at which the CRC was read
+ *             from the kernel, 0 if it doesn't come from a pipe CRC object
  *
- * Pipe CRC value. All other members than @frame are private and should not be
- * inspected by testcases.
+ * Pipe CRC value. All other members than @frame and @timestamp are private
+ * and should not be inspected by testcases.
  */
 typedef struct {
 	uint32_t frame;
 	bool has_valid_frame;
 	int n_words;
 	uint32_t crc[DRM_MAX_CRC_NR];
+	uint64_t timestamp;
 } igt_crc_t;
 
 /**
@@ -125,12 +128,19 @@ igt_pipe_crc_t *
 igt_pipe_crc_new(int fd, enum pipe pipe, enum intel_pipe_crc_source source);
 igt_pipe_crc_t *
 igt_pipe_crc_new_nonblock(int fd, enum pipe pipe, enum intel_pipe_crc_source source);
+igt_pipe_crc_t *
+__igt_pipe_crc_new(int debugfs, enum pipe pipe,
+		   enum intel_pipe_crc_source source, int flags);
 void igt_pipe_crc_free(igt_pipe_crc_t *pipe_crc);
 void igt_pipe_crc_start(igt_pipe_crc_t *pipe_crc);
+void igt_pipe_crc_start_reader(igt_pipe_crc_t *pipe_crc);
 void igt_pipe_crc_stop(igt_pipe_crc_t *pipe_crc);
 __attribute__((warn_unused_result))
 int igt_pipe_crc_get_crcs(igt_pipe_crc_t *pipe_crc, int n_crcs,
 			  igt_crc_t **out_crcs);
+int igt_pipe_crc_get_queued(igt_pipe_crc_t *pipe_crc, igt_crc_t *crcs,
+			    int max_crcs);
+int igt_pipe_crc_wait_reader(igt_pipe_crc_t *pipe_crc);
 void igt_pipe_crc_drain(igt_pipe_crc_t *pipe_crc);
 void igt_pipe_crc_get_single(igt_pipe_crc_t *pipe_crc, igt_crc_t *out_crc);
 void igt_pipe_crc_get_current(int drm_fd, igt_pipe_crc_t *pipe_crc, igt_crc_t *crc);
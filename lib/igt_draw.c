@@ -31,6 +31,7 @@
 #include "intel_chipset.h"
 #include "igt_core.h"
 #include "igt_fb.h"
+#include "igt_tiling.h"
 #include "ioctl_wrappers.h"
 #include "i830_reg.h"
 
@@ -131,32 +132,6 @@ static int swizzle_addr(unsigned long addr, int swizzle)
 	}
 }
 
-static int tile(int x, int y, uint32_t x_tile_size, uint32_t y_tile_size,
-		uint32_t line_size, bool xmajor)
-{
-	int tile_size, tiles_per_line, x_tile_n, y_tile_n, tile_off, pos;
-	int tile_n, x_tile_off, y_tile_off;
-
-	tiles_per_line = line_size / x_tile_size;
-	tile_size = x_tile_size * y_tile_size;
-
-	x_tile_n = x / x_tile_size;
-	y_tile_n = y / y_tile_size;
-	tile_n = y_tile_n * tiles_per_line + x_tile_n;
-
-	x_tile_off = x % x_tile_size;
-	y_tile_off = y % y_tile_size;
-
-	if (xmajor)
-		tile_off = y_tile_off * x_tile_size + x_tile_off;
-	else
-		tile_off = x_tile_off * y_tile_size + y_tile_off;
-
-	pos = tile_n * tile_size + tile_off;
-
-	return pos;
-}
-
 static void untile(int tiled_pos, int x_tile_size, int y_tile_size,
 		   uint32_t line_size, bool xmajor, int *x, int *y)
 {
@@ -186,36 +161,6 @@ static void untile(int tiled_pos, int x_tile_size, int y_tile_size,
 	*y = y_tile_n * y_tile_size + y_tile_off;
 }
 
-static int linear_x_y_to_xtiled_pos(int x, int y, uint32_t stride, int swizzle,
-				    int bpp)
-{
-	int pos;
-	int pixel_size = bpp / 8;
-
-	x *= pixel_size;
-	pos = tile(x, y, 512, 8, stride, true);
-	pos = swizzle_addr(pos, swizzle);
-	return pos / pixel_size;
-}
-
-static int linear_x_y_to_ytiled_pos(int x, int y, uint32_t stride, int swizzle,
-				    int bpp)
-{
-	int ow_tile_n, pos;
-	int ow_size = 16;
-	int pixel_size = bpp / 8;
-
-	/* We have an Y tiling of OWords, so use the tile() function to get the
-	 * OW number, then adjust to the fact that the OW may have more than one
-	 * pixel. */
-	x *= pixel_size;
-	ow_tile_n = tile(x / ow_size, y, 128 / ow_size, 32,
-			 stride / ow_size, false);
-	pos = ow_tile_n * ow_size + (x % ow_size);
-	pos = swizzle_addr(pos, swizzle);
-	return pos / pixel_size;
-}
-
 static void xtiled_pos_to_x_y_linear(int tiled_pos, uint32_t stride,
 				     int swizzle, int bpp, int *x, int *y)
 {
@@ -301,25 +246,25 @@ static void draw_rect_ptr_tiled(void *ptr, uint32_t stride, uint32_t tiling,
 				int swizzle, struct rect *rect, uint32_t color,
 				int bpp)
 {
-	int x, y, pos;
+	int pixel_size = bpp / 8;
+	void *row;
+	int x;
 
-	for (y = rect->y; y < rect->y + rect->h; y++) {
-		for (x = rect->x; x < rect->x + rect->w; x++) {
-			switch (tiling) {
-			case I915_TILING_X:
-				pos = linear_x_y_to_xtiled_pos(x, y, stride,
-							       swizzle, bpp);
-				break;
-			case I915_TILING_Y:
-				pos = linear_x_y_to_ytiled_pos(x, y, stride,
-							       swizzle, bpp);
-				break;
-			default:
-				igt_assert(false);
-			}
-			set_pixel(ptr, pos, color, bpp);
-		}
-	}
+	/* If we hit this case, we need to implement support for the
+	 * appropriate swizzling method. */
+	igt_require(igt_tiling_supported(tiling, swizzle));
+
+	/* Tile a single row of the color to all the rows of the rect */
+	row = malloc(rect->w * pixel_size);
+	igt_assert(row);
+	for (x = 0; x < rect->w; x++)
+		set_pixel(row, x, color, bpp);
+
+	igt_tiling_from_linear(ptr, stride, tiling, swizzle,
+			       rect->x * pixel_size, rect->y,
+			       rect->w * pixel_size, rect->h, row, 0);
+
+	free(row);
 }
 
 static void draw_rect_mmap_cpu(int fd, struct buf_data *buf, struct rect *rect,
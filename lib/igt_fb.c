@@ -36,8 +36,10 @@
 #include "igt_color_encoding.h"
 #include "igt_fb.h"
 #include "igt_kms.h"
-#include "igt_matrix.h"
+#include "igt_tiling.h"
+#include "igt_trace.h"
 #include "igt_x86.h"
+#include "igt_yuv.h"
 #include "ioctl_wrappers.h"
 #include "intel_batchbuffer.h"
 #include "intel_chipset.h"
@@ -915,6 +917,8 @@ igt_create_fb_with_bo_size(int fd, int width, int height,
 	enum igt_color_range color_range = IGT_COLOR_YCBCR_LIMITED_RANGE;
 	uint32_t flags = 0;
 
+	igt_trace_begin(__func__);
+
 	fb_init(fb, fd, width, height, format, tiling,
 		color_encoding, color_range);
 
@@ -941,6 +945,8 @@ igt_create_fb_with_bo_size(int fd, int width, int height,
 			      fb->strides, fb->offsets, fb->num_planes, flags,
 			      &fb->fb_id));
 
+	igt_trace_end(__func__);
+
 	return fb->fb_id;
 }
 
@@ -1261,6 +1267,10 @@ static cairo_format_t drm_format_to_cairo(uint32_t drm_format)
 struct fb_blit_linear {
 	struct igt_fb fb;
 	uint8_t *map;
+
+	/* CPU mapping of the fb, when (de)tiled by the CPU instead */
+	uint8_t *tiled;
+	uint32_t swizzle;
 };
 
 struct fb_blit_upload {
@@ -1296,12 +1306,46 @@ static void blitcopy(const struct igt_fb *dst_fb,
 	}
 }
 
+static void linear_mapping_copy(struct igt_fb *fb,
+				struct fb_blit_linear *linear, bool to_tiled)
+{
+	for (int i = 0; i < fb->num_planes; i++) {
+		int width = fb->plane_width[i] * fb->plane_bpp[i] / 8;
+
+		if (to_tiled)
+			igt_tiling_from_linear(linear->tiled + fb->offsets[i],
+					       fb->strides[i], I915_TILING_Y,
+					       linear->swizzle, 0, 0, width,
+					       fb->plane_height[i],
+					       linear->map + fb->offsets[i],
+					       fb->strides[i]);
+		else
+			igt_tiling_to_linear(linear->map + fb->offsets[i],
+					     fb->strides[i],
+					     linear->tiled + fb->offsets[i],
+					     fb->strides[i], I915_TILING_Y,
+					     linear->swizzle, 0, 0, width,
+					     fb->plane_height[i]);
+	}
+}
+
 static void free_linear_mapping(struct fb_blit_upload *blit)
 {
 	int fd = blit->fd;
 	struct igt_fb *fb = blit->fb;
 	struct fb_blit_linear *linear = &blit->linear;
 
+	if (linear->tiled) {
+		gem_set_domain(fd, fb->gem_handle,
+			       I915_GEM_DOMAIN_CPU, I915_GEM_DOMAIN_CPU);
+		linear_mapping_copy(fb, linear, true);
+		gem_sw_finish(fd, fb->gem_handle);
+
+		gem_munmap(linear->tiled, fb->size);
+		free(linear->map);
+		return;
+	}
+
 	gem_munmap(linear->map, linear->fb.size);
 	gem_set_domain(fd, linear->fb.gem_handle,
 		       I915_GEM_DOMAIN_GTT, 0);
@@ -1323,8 +1367,45 @@ static void destroy_cairo_surface__blit(void *arg)
 	free(blit);
 }
 
+/*
+ * Y tiled buffers can be detiled by the CPU when the swizzling doesn't
+ * depend on the physical address, which is cheaper than blitting to and from
+ * a linear copy. The linear copy keeps the strides and offsets of the fb.
+ */
+static bool setup_cpu_linear_mapping(int fd, struct igt_fb *fb,
+				     struct fb_blit_linear *linear)
+{
+	uint32_t tiling, swizzle;
+
+	if (fb->tiling != LOCAL_I915_FORMAT_MOD_Y_TILED)
+		return false;
+
+	if (!gem_get_tiling(fd, fb->gem_handle, &tiling, &swizzle) ||
+	    tiling != I915_TILING_Y || !igt_tiling_supported(tiling, swizzle))
+		return false;
+
+	linear->fb = *fb;
+	linear->fb.tiling = LOCAL_DRM_FORMAT_MOD_NONE;
+	linear->fb.gem_handle = 0;
+	linear->swizzle = swizzle;
+
+	linear->map = malloc(fb->size);
+	igt_assert(linear->map);
+
+	gem_set_domain(fd, fb->gem_handle, I915_GEM_DOMAIN_CPU, 0);
+	linear->tiled = gem_mmap__cpu(fd, fb->gem_handle, 0, fb->size,
+				      PROT_READ | PROT_WRITE);
+	linear_mapping_copy(fb, linear, false);
+
+	return true;
+}
+
 static void setup_linear_mapping(int fd, struct igt_fb *fb, struct fb_blit_linear *linear)
 {
+	linear->tiled = NULL;
+	if (setup_cpu_linear_mapping(fd, fb, linear))
+		return;
+
 	/*
 	 * We create a linear BO that we'll map for the CPU to write to (using
 	 * cairo). This linear bo will be then blitted to its final
@@ -1483,26 +1564,6 @@ static void igt_fb_destroy_cairo_shadow_buffer(struct igt_fb *shadow,
 	munmap(ptr, shadow->size);
 }
 
-static uint8_t clamprgb(float val)
-{
-	return clamp((int)(val + 0.5f), 0, 255);
-}
-
-static void read_rgb(struct igt_vec4 *rgb, const uint8_t *rgb24)
-{
-	rgb->d[0] = rgb24[2];
-	rgb->d[1] = rgb24[1];
-	rgb->d[2] = rgb24[0];
-	rgb->d[3] = 1.0f;
-}
-
-static void write_rgb(uint8_t *rgb24, const struct igt_vec4 *rgb)
-{
-	rgb24[2] = clamprgb(rgb->d[0]);
-	rgb24[1] = clamprgb(rgb->d[1]);
-	rgb24[0] = clamprgb(rgb->d[2]);
-}
-
 struct fb_convert_buf {
 	void			*ptr;
 	struct igt_fb		*fb;
@@ -1515,14 +1576,21 @@ struct fb_convert {
 
 static void convert_nv12_to_rgb24(struct fb_convert *cvt)
 {
+	const struct igt_yuv_kernels *k = igt_yuv_kernels(igt_x86_features());
 	int i, j;
 	const uint8_t *y, *uv;
 	uint8_t *rgb24 = cvt->dst.ptr;
 	unsigned int rgb24_stride = cvt->dst.fb->strides[0];
-	unsigned int planar_stride = cvt->src.fb->strides[0];
+	unsigned int y_stride = cvt->src.fb->strides[0];
+	unsigned int uv_stride = cvt->src.fb->strides[1];
+	unsigned int chroma_width = (cvt->dst.fb->width + 1) / 2;
 	uint8_t *buf = malloc(cvt->src.fb->size);
-	struct igt_mat4 m = igt_ycbcr_to_rgb_matrix(cvt->src.fb->color_encoding,
-						    cvt->src.fb->color_range);
+	uint8_t *cb = malloc(2 * chroma_width);
+	uint8_t *cr = cb + chroma_width;
+	struct igt_yuv_coeffs c;
+
+	igt_ycbcr_to_rgb_coeffs(&c, cvt->src.fb->color_encoding,
+				cvt->src.fb->color_range);
 
 	/*
 	 * Reading from the BO is awfully slow because of lack of read caching,
@@ -1530,203 +1598,82 @@ static void convert_nv12_to_rgb24(struct fb_convert *cvt)
 	 * from there.
 	 */
 	igt_memcpy_from_wc(buf, cvt->src.ptr, cvt->src.fb->size);
-	y = cvt->src.ptr + cvt->src.fb->offsets[0];
-	uv = cvt->src.ptr + cvt->src.fb->offsets[1];
-
-	for (i = 0; i < cvt->dst.fb->height / 2; i++) {
-		for (j = 0; j < cvt->dst.fb->width / 2; j++) {
-			/* Convert 2x2 pixel blocks */
-			struct igt_vec4 yuv[4];
-			struct igt_vec4 rgb[4];
-
-			yuv[0].d[0] = y[j * 2 + 0];
-			yuv[1].d[0] = y[j * 2 + 1];
-			yuv[2].d[0] = y[j * 2 + 0 + planar_stride];
-			yuv[3].d[0] = y[j * 2 + 1 + planar_stride];
-
-			yuv[0].d[1] = yuv[1].d[1] = yuv[2].d[1] = yuv[3].d[1] = uv[j * 2 + 0];
-			yuv[0].d[2] = yuv[1].d[2] = yuv[2].d[2] = yuv[3].d[2] = uv[j * 2 + 1];
-			yuv[0].d[3] = yuv[1].d[3] = yuv[2].d[3] = yuv[3].d[3] = 1.0f;
-
-			rgb[0] = igt_matrix_transform(&m, &yuv[0]);
-			rgb[1] = igt_matrix_transform(&m, &yuv[1]);
-			rgb[2] = igt_matrix_transform(&m, &yuv[2]);
-			rgb[3] = igt_matrix_transform(&m, &yuv[3]);
-
-			write_rgb(&rgb24[j * 8 + 0], &rgb[0]);
-			write_rgb(&rgb24[j * 8 + 4], &rgb[1]);
-			write_rgb(&rgb24[j * 8 + 0 + rgb24_stride], &rgb[2]);
-			write_rgb(&rgb24[j * 8 + 4 + rgb24_stride], &rgb[3]);
-		}
-
-		if (cvt->dst.fb->width & 1) {
-			/* Convert 1x2 pixel block */
-			struct igt_vec4 yuv[2];
-			struct igt_vec4 rgb[2];
+	y = buf + cvt->src.fb->offsets[0];
+	uv = buf + cvt->src.fb->offsets[1];
 
-			yuv[0].d[0] = y[j * 2 + 0];
-			yuv[1].d[0] = y[j * 2 + 0 + planar_stride];
-
-			yuv[0].d[1] = yuv[1].d[1] = uv[j * 2 + 0];
-			yuv[0].d[2] = yuv[1].d[2] = uv[j * 2 + 1];
-			yuv[0].d[3] = yuv[1].d[3] = 1.0f;
-
-			rgb[0] = igt_matrix_transform(&m, &yuv[0]);
-			rgb[1] = igt_matrix_transform(&m, &yuv[1]);
-
-			write_rgb(&rgb24[j * 8 + 0], &rgb[0]);
-			write_rgb(&rgb24[j * 8 + 0 + rgb24_stride], &rgb[1]);
-		}
-
-		rgb24 += 2 * rgb24_stride;
-		y += 2 * planar_stride;
-		uv += planar_stride;
-	}
-
-	if (cvt->dst.fb->height & 1) {
-		/* Convert last row */
-		for (j = 0; j < cvt->dst.fb->width / 2; j++) {
-			/* Convert 2x1 pixel blocks */
-			struct igt_vec4 yuv[2];
-			struct igt_vec4 rgb[2];
-
-			yuv[0].d[0] = y[j * 2 + 0];
-			yuv[1].d[0] = y[j * 2 + 1];
-			yuv[0].d[1] = yuv[1].d[1] = uv[j * 2 + 0];
-			yuv[0].d[2] = yuv[1].d[2] = uv[j * 2 + 1];
-			yuv[0].d[3] = yuv[1].d[3] = 1.0f;
-
-			rgb[0] = igt_matrix_transform(&m, &yuv[0]);
-			rgb[1] = igt_matrix_transform(&m, &yuv[1]);
-
-			write_rgb(&rgb24[j * 8 + 0], &rgb[0]);
-			write_rgb(&rgb24[j * 8 + 4], &rgb[0]);
+	for (i = 0; i < cvt->dst.fb->height; i++) {
+		/* Each chroma row is shared by two luma rows */
+		if ((i & 1) == 0) {
+			for (j = 0; j < chroma_width; j++) {
+				cb[j] = uv[j * 2 + 0];
+				cr[j] = uv[j * 2 + 1];
+			}
+			uv += uv_stride;
 		}
 
-		if (cvt->dst.fb->width & 1) {
-			/* Convert single pixel */
-			struct igt_vec4 yuv;
-			struct igt_vec4 rgb;
+		k->ycbcr_to_rgb(&c, rgb24, y, cb, cr, cvt->dst.fb->width);
 
-			yuv.d[0] = y[j * 2 + 0];
-			yuv.d[1] = uv[j * 2 + 0];
-			yuv.d[2] = uv[j * 2 + 1];
-			yuv.d[3] = 1.0f;
-
-			rgb = igt_matrix_transform(&m, &yuv);
-
-			write_rgb(&rgb24[j * 8 + 0], &rgb);
-		}
+		rgb24 += rgb24_stride;
+		y += y_stride;
 	}
 
+	free(cb);
 	free(buf);
 }
 
 static void convert_rgb24_to_nv12(struct fb_convert *cvt)
 {
+	const struct igt_yuv_kernels *k = igt_yuv_kernels(igt_x86_features());
 	int i, j;
 	uint8_t *y = cvt->dst.ptr + cvt->dst.fb->offsets[0];
 	uint8_t *uv = cvt->dst.ptr + cvt->dst.fb->offsets[1];
 	const uint8_t *rgb24 = cvt->src.ptr;
+	unsigned int width = cvt->dst.fb->width;
 	unsigned rgb24_stride = cvt->src.fb->strides[0];
-	unsigned planar_stride = cvt->dst.fb->strides[0];
-	struct igt_mat4 m = igt_rgb_to_ycbcr_matrix(cvt->dst.fb->color_encoding,
-						    cvt->dst.fb->color_range);
+	unsigned y_stride = cvt->dst.fb->strides[0];
+	unsigned uv_stride = cvt->dst.fb->strides[1];
+	int32_t *chroma = malloc(4 * width * sizeof(*chroma));
+	int32_t *cb[2] = { chroma, chroma + width };
+	int32_t *cr[2] = { chroma + 2 * width, chroma + 3 * width };
+	struct igt_yuv_coeffs c;
 
 	igt_assert_f(cvt->dst.fb->drm_format == DRM_FORMAT_NV12,
 		     "Conversion not implemented for !NV12 planar formats\n");
 
-	for (i = 0; i < cvt->dst.fb->height / 2; i++) {
-		for (j = 0; j < cvt->dst.fb->width / 2; j++) {
-			/* Convert 2x2 pixel blocks */
-			struct igt_vec4 rgb[4];
-			struct igt_vec4 yuv[4];
-
-			read_rgb(&rgb[0], &rgb24[j * 8 + 0]);
-			read_rgb(&rgb[1], &rgb24[j * 8 + 4]);
-			read_rgb(&rgb[2], &rgb24[j * 8 + 0 + rgb24_stride]);
-			read_rgb(&rgb[3], &rgb24[j * 8 + 4 + rgb24_stride]);
-
-			yuv[0] = igt_matrix_transform(&m, &rgb[0]);
-			yuv[1] = igt_matrix_transform(&m, &rgb[1]);
-			yuv[2] = igt_matrix_transform(&m, &rgb[2]);
-			yuv[3] = igt_matrix_transform(&m, &rgb[3]);
-
-			y[j * 2 + 0] = yuv[0].d[0];
-			y[j * 2 + 1] = yuv[1].d[0];
-			y[j * 2 + 0 + planar_stride] = yuv[2].d[0];
-			y[j * 2 + 1 + planar_stride] = yuv[3].d[0];
-
-			/*
-			 * We assume the MPEG2 chroma siting convention, where
-			 * pixel center for Cb'Cr' is between the left top and
-			 * bottom pixel in a 2x2 block, so take the average.
-			 */
-			uv[j * 2 + 0] = (yuv[0].d[1] + yuv[2].d[1]) / 2.0f;
-			uv[j * 2 + 1] = (yuv[0].d[2] + yuv[2].d[2]) / 2.0f;
-		}
+	igt_rgb_to_ycbcr_coeffs(&c, cvt->dst.fb->color_encoding,
+				cvt->dst.fb->color_range);
 
-		if (cvt->dst.fb->width & 1) {
-			/* Convert 1x2 pixel block */
-			struct igt_vec4 rgb[2];
-			struct igt_vec4 yuv[2];
-
-			read_rgb(&rgb[0], &rgb24[j * 8 + 0]);
-			read_rgb(&rgb[2], &rgb24[j * 8 + 0 + rgb24_stride]);
-
-			yuv[0] = igt_matrix_transform(&m, &rgb[0]);
-			yuv[1] = igt_matrix_transform(&m, &rgb[1]);
-
-			y[j * 2 + 0] = yuv[0].d[0];
-			y[j * 2 + 0 + planar_stride] = yuv[1].d[0];
-
-			/*
-			 * We assume the MPEG2 chroma siting convention, where
-			 * pixel center for Cb'Cr' is between the left top and
-			 * bottom pixel in a 2x2 block, so take the average.
-			 */
-			uv[j * 2 + 0] = (yuv[0].d[1] + yuv[1].d[1]) / 2.0f;
-			uv[j * 2 + 1] = (yuv[0].d[2] + yuv[1].d[2]) / 2.0f;
+	for (i = 0; i < cvt->dst.fb->height / 2; i++) {
+		k->rgb_to_ycbcr(&c, y, cb[0], cr[0], rgb24, width);
+		k->rgb_to_ycbcr(&c, y + y_stride, cb[1], cr[1],
+				rgb24 + rgb24_stride, width);
+
+		/*
+		 * We assume the MPEG2 chroma siting convention, where
+		 * pixel center for Cb'Cr' is between the left top and
+		 * bottom pixel in a 2x2 block, so take the average.
+		 */
+		for (j = 0; j < (width + 1) / 2; j++) {
+			uv[j * 2 + 0] = igt_yuv_chroma2(cb[0][j * 2], cb[1][j * 2]);
+			uv[j * 2 + 1] = igt_yuv_chroma2(cr[0][j * 2], cr[1][j * 2]);
 		}
 
 		rgb24 += 2 * rgb24_stride;
-		y += 2 * planar_stride;
-		uv += planar_stride;
+		y += 2 * y_stride;
+		uv += uv_stride;
 	}
 
 	/* Last row cannot be interpolated between 2 pixels, take the single value */
 	if (cvt->dst.fb->height & 1) {
-		for (j = 0; j < cvt->dst.fb->width / 2; j++) {
-			/* Convert 2x1 pixel blocks */
-			struct igt_vec4 rgb[2];
-			struct igt_vec4 yuv[2];
-
-			read_rgb(&rgb[0], &rgb24[j * 8 + 0]);
-			read_rgb(&rgb[1], &rgb24[j * 8 + 4]);
-
-			yuv[0] = igt_matrix_transform(&m, &rgb[0]);
-			yuv[1] = igt_matrix_transform(&m, &rgb[1]);
+		k->rgb_to_ycbcr(&c, y, cb[0], cr[0], rgb24, width);
 
-			y[j * 2 + 0] = yuv[0].d[0];
-			y[j * 2 + 1] = yuv[1].d[0];
-			uv[j * 2 + 0] = yuv[0].d[1];
-			uv[j * 2 + 1] = yuv[0].d[2];
-		}
-
-		if (cvt->dst.fb->width & 1) {
-			/* Convert single pixel */
-			struct igt_vec4 rgb;
-			struct igt_vec4 yuv;
-
-			read_rgb(&rgb, &rgb24[j * 8 + 0]);
-
-			yuv = igt_matrix_transform(&m, &rgb);
-
-			y[j * 2 + 0] = yuv.d[0];
-			uv[j * 2 + 0] = yuv.d[1];
-			uv[j * 2 + 1] = yuv.d[2];
+		for (j = 0; j < (width + 1) / 2; j++) {
+			uv[j * 2 + 0] = igt_yuv_chroma(cb[0][j * 2]);
+			uv[j * 2 + 1] = igt_yuv_chroma(cr[0][j * 2]);
 		}
 	}
+
+	free(chroma);
 }
 
 /* { Y0, U, Y1, V } */
@@ -1752,15 +1699,23 @@ static const unsigned char *yuyv_swizzle(uint32_t format)
 
 static void convert_yuyv_to_rgb24(struct fb_convert *cvt)
 {
+	const struct igt_yuv_kernels *k = igt_yuv_kernels(igt_x86_features());
 	int i, j;
 	const uint8_t *yuyv;
 	uint8_t *rgb24 = cvt->dst.ptr;
+	unsigned int width = cvt->dst.fb->width;
+	unsigned int chroma_width = (width + 1) / 2;
 	unsigned int rgb24_stride = cvt->dst.fb->strides[0];
 	unsigned int yuyv_stride = cvt->src.fb->strides[0];
 	uint8_t *buf = malloc(cvt->src.fb->size);
-	struct igt_mat4 m = igt_ycbcr_to_rgb_matrix(cvt->src.fb->color_encoding,
-						    cvt->src.fb->color_range);
+	uint8_t *y = malloc(width + 2 * chroma_width);
+	uint8_t *cb = y + width;
+	uint8_t *cr = cb + chroma_width;
 	const unsigned char *swz = yuyv_swizzle(cvt->src.fb->drm_format);
+	struct igt_yuv_coeffs c;
+
+	igt_ycbcr_to_rgb_coeffs(&c, cvt->src.fb->color_encoding,
+				cvt->src.fb->color_range);
 
 	/*
 	 * Reading from the BO is awfully slow because of lack of read caching,
@@ -1771,55 +1726,43 @@ static void convert_yuyv_to_rgb24(struct fb_convert *cvt)
 	yuyv = buf;
 
 	for (i = 0; i < cvt->dst.fb->height; i++) {
-		for (j = 0; j < cvt->dst.fb->width / 2; j++) {
-			/* Convert 2x1 pixel blocks */
-			struct igt_vec4 yuv[2];
-			struct igt_vec4 rgb[2];
-
-			yuv[0].d[0] = yuyv[j * 4 + swz[0]];
-			yuv[1].d[0] = yuyv[j * 4 + swz[2]];
-			yuv[0].d[1] = yuv[1].d[1] = yuyv[j * 4 + swz[1]];
-			yuv[0].d[2] = yuv[1].d[2] = yuyv[j * 4 + swz[3]];
-			yuv[0].d[3] = yuv[1].d[3] = 1.0f;
-
-			rgb[0] = igt_matrix_transform(&m, &yuv[0]);
-			rgb[1] = igt_matrix_transform(&m, &yuv[1]);
-
-			write_rgb(&rgb24[j * 8 + 0], &rgb[0]);
-			write_rgb(&rgb24[j * 8 + 4], &rgb[1]);
+		for (j = 0; j < width / 2; j++) {
+			y[j * 2 + 0] = yuyv[j * 4 + swz[0]];
+			y[j * 2 + 1] = yuyv[j * 4 + swz[2]];
+			cb[j] = yuyv[j * 4 + swz[1]];
+			cr[j] = yuyv[j * 4 + swz[3]];
 		}
 
-		if (cvt->dst.fb->width & 1) {
-			struct igt_vec4 yuv;
-			struct igt_vec4 rgb;
-
-			yuv.d[0] = yuyv[j * 4 + swz[0]];
-			yuv.d[1] = yuyv[j * 4 + swz[1]];
-			yuv.d[2] = yuyv[j * 4 + swz[3]];
-			yuv.d[3] = 1.0f;
-
-			rgb = igt_matrix_transform(&m, &yuv);
-
-			write_rgb(&rgb24[j * 8 + 0], &rgb);
+		if (width & 1) {
+			y[j * 2 + 0] = yuyv[j * 4 + swz[0]];
+			cb[j] = yuyv[j * 4 + swz[1]];
+			cr[j] = yuyv[j * 4 + swz[3]];
 		}
 
+		k->ycbcr_to_rgb(&c, rgb24, y, cb, cr, width);
+
 		rgb24 += rgb24_stride;
 		yuyv += yuyv_stride;
 	}
 
+	free(y);
 	free(buf);
 }
 
 static void convert_rgb24_to_yuyv(struct fb_convert *cvt)
 {
+	const struct igt_yuv_kernels *k = igt_yuv_kernels(igt_x86_features());
 	int i, j;
 	uint8_t *yuyv = cvt->dst.ptr;
 	const uint8_t *rgb24 = cvt->src.ptr;
+	unsigned int width = cvt->dst.fb->width;
 	unsigned rgb24_stride = cvt->src.fb->strides[0];
 	unsigned yuyv_stride = cvt->dst.fb->strides[0];
-	struct igt_mat4 m = igt_rgb_to_ycbcr_matrix(cvt->dst.fb->color_encoding,
-						    cvt->dst.fb->color_range);
+	uint8_t *y = malloc(width);
+	int32_t *cb = malloc(2 * width * sizeof(*cb));
+	int32_t *cr = cb + width;
 	const unsigned char *swz = yuyv_swizzle(cvt->dst.fb->drm_format);
+	struct igt_yuv_coeffs c;
 
 	igt_assert_f(cvt->dst.fb->drm_format == DRM_FORMAT_YUYV ||
 		     cvt->dst.fb->drm_format == DRM_FORMAT_YVYU ||
@@ -1827,40 +1770,31 @@ static void convert_rgb24_to_yuyv(struct fb_convert *cvt)
 		     cvt->dst.fb->drm_format == DRM_FORMAT_VYUY,
 		     "Conversion not implemented for !YUYV planar formats\n");
 
-	for (i = 0; i < cvt->dst.fb->height; i++) {
-		for (j = 0; j < cvt->dst.fb->width / 2; j++) {
-			/* Convert 2x1 pixel blocks */
-			struct igt_vec4 rgb[2];
-			struct igt_vec4 yuv[2];
-
-			read_rgb(&rgb[0], &rgb24[j * 8 + 0]);
-			read_rgb(&rgb[1], &rgb24[j * 8 + 4]);
+	igt_rgb_to_ycbcr_coeffs(&c, cvt->dst.fb->color_encoding,
+				cvt->dst.fb->color_range);
 
-			yuv[0] = igt_matrix_transform(&m, &rgb[0]);
-			yuv[1] = igt_matrix_transform(&m, &rgb[1]);
+	for (i = 0; i < cvt->dst.fb->height; i++) {
+		k->rgb_to_ycbcr(&c, y, cb, cr, rgb24, width);
 
-			yuyv[j * 4 + swz[0]] = yuv[0].d[0];
-			yuyv[j * 4 + swz[2]] = yuv[1].d[0];
-			yuyv[j * 4 + swz[1]] = (yuv[0].d[1] + yuv[1].d[1]) / 2.0f;
-			yuyv[j * 4 + swz[3]] = (yuv[0].d[2] + yuv[1].d[2]) / 2.0f;
+		for (j = 0; j < width / 2; j++) {
+			yuyv[j * 4 + swz[0]] = y[j * 2 + 0];
+			yuyv[j * 4 + swz[2]] = y[j * 2 + 1];
+			yuyv[j * 4 + swz[1]] = igt_yuv_chroma2(cb[j * 2], cb[j * 2 + 1]);
+			yuyv[j * 4 + swz[3]] = igt_yuv_chroma2(cr[j * 2], cr[j * 2 + 1]);
 		}
 
-		if (cvt->dst.fb->width & 1) {
-			struct igt_vec4 rgb;
-			struct igt_vec4 yuv;
-
-			read_rgb(&rgb, &rgb24[j * 8 + 0]);
-
-			yuv = igt_matrix_transform(&m, &rgb);
-
-			yuyv[j * 4 + swz[0]] = yuv.d[0];
-			yuyv[j * 4 + swz[1]] = yuv.d[1];
-			yuyv[j * 4 + swz[3]] = yuv.d[2];
+		if (width & 1) {
+			yuyv[j * 4 + swz[0]] = y[j * 2 + 0];
+			yuyv[j * 4 + swz[1]] = igt_yuv_chroma(cb[j * 2]);
+			yuyv[j * 4 + swz[3]] = igt_yuv_chroma(cr[j * 2]);
 		}
 
 		rgb24 += rgb24_stride;
 		yuyv += yuyv_stride;
 	}
+
+	free(cb);
+	free(y);
 }
 
 static void convert_pixman(struct fb_convert *cvt)
@@ -1949,7 +1883,7 @@ static void destroy_cairo_surface__convert(void *arg)
 	fb_convert(&cvt);
 	igt_fb_destroy_cairo_shadow_buffer(&blit->shadow_fb, blit->shadow_ptr);
 
-	if (blit->base.linear.fb.gem_handle)
+	if (blit->base.linear.fb.gem_handle || blit->base.linear.tiled)
 		free_linear_mapping(&blit->base);
 	else
 		unmap_bo(fb, blit->base.linear.map);
@@ -1979,6 +1913,7 @@ static void create_cairo_surface__convert(int fd, struct igt_fb *fb)
 		setup_linear_mapping(fd, fb, &blit->base.linear);
 	} else {
 		blit->base.linear.fb.gem_handle = 0;
+		blit->base.linear.tiled = NULL;
 		blit->base.linear.map = map_bo(fd, fb);
 		igt_assert(blit->base.linear.map);
 		blit->base.linear.fb.size = fb->size;
@@ -27,12 +27,14 @@
 #include "config.h"
 
 #include <fcntl.h>
-#include <pixman.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <cairo.h>
 #include <gsl/gsl_statistics_double.h>
 #include <gsl/gsl_fit.h>
 
 #include "igt_frame.h"
+#include "igt_frame_error.h"
 #include "igt_core.h"
 
 /**
@@ -169,60 +171,35 @@ void igt_write_compared_frames_to_png(cairo_surface_t *reference,
 bool igt_check_analog_frame_match(cairo_surface_t *reference,
 				  cairo_surface_t *capture)
 {
-	pixman_image_t *reference_src, *capture_src;
+	struct igt_frame_error *e;
 	int w, h;
-	int error_count[3][256][2] = { 0 };
 	double error_average[4][250];
 	double error_trend[250];
 	double c0, c1, cov00, cov01, cov11, sumsq;
 	double correlation;
-	unsigned char *reference_pixels, *capture_pixels;
-	unsigned char *p;
-	unsigned char *q;
 	bool match = true;
-	int diff;
-	int x, y;
 	int i, j;
 
 	w = cairo_image_surface_get_width(reference);
 	h = cairo_image_surface_get_height(reference);
 
-	reference_src = pixman_image_create_bits(
-	    PIXMAN_x8r8g8b8, w, h,
-	    (void*)cairo_image_surface_get_data(reference),
-	    cairo_image_surface_get_stride(reference));
-	reference_pixels = (unsigned char *) pixman_image_get_data(reference_src);
-
-	capture_src = pixman_image_create_bits(
-	    PIXMAN_x8r8g8b8, w, h,
-	    (void*)cairo_image_surface_get_data(capture),
-	    cairo_image_surface_get_stride(capture));
-	capture_pixels = (unsigned char *) pixman_image_get_data(capture_src);
-
 	/* Collect the absolute error for each color value */
-	for (x = 0; x < w; x++) {
-		for (y = 0; y < h; y++) {
-			p = &capture_pixels[(x + y * w) * 4];
-			q = &reference_pixels[(x + y * w) * 4];
-
-			for (i = 0; i < 3; i++) {
-				diff = (int) p[i] - q[i];
-				if (diff < 0)
-					diff = -diff;
-
-				error_count[i][q[i]][0] += diff;
-				error_count[i][q[i]][1]++;
-			}
-		}
-	}
+	e = malloc(sizeof(*e));
+	igt_assert(e);
+	igt_frame_error_compute(e,
+				cairo_image_surface_get_data(reference),
+				cairo_image_surface_get_stride(reference),
+				cairo_image_surface_get_data(capture),
+				cairo_image_surface_get_stride(capture),
+				w, h);
 
 	/* Calculate the average absolute error for each color value */
 	for (i = 0; i < 250; i++) {
 		error_average[0][i] = i;
 
 		for (j = 1; j < 4; j++) {
-			error_average[j][i] = (double) error_count[j-1][i][0] /
-					      error_count[j-1][i][1];
+			error_average[j][i] = (double) e->sum[j-1][i] /
+					      e->count[j-1][i];
 
 			if (error_average[j][i] > 60) {
 				igt_warn("Error average too high (%f)\n",
@@ -262,8 +239,7 @@ bool igt_check_analog_frame_match(cairo_surface_t *reference,
 	}
 
 complete:
-	pixman_image_unref(reference_src);
-	pixman_image_unref(capture_src);
+	free(e);
 
 	return match;
 }
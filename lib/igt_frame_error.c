@@ -0,0 +1,295 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "igt_frame_error.h"
+#include "igt_kernels.h"
+
+/* Bytes of a row handled at once, the differences are kept on the stack */
+#define CHUNK 1024
+
+/*
+ * The histogram is accumulated with the pixel count in the upper 32 bits
+ * and the sum of the errors in the lower 32 bits, a single add per channel
+ * and pixel. The sums can't overflow before 2^32 / 255 pixels.
+ */
+#define PACKED_ONE (1ull << 32)
+#define PACKED_MAX_PIXELS (1 << 24)
+
+/*
+ * Consecutive pixels are spread over two histograms, so that runs of the
+ * same color don't wait on the previous update of the same counter.
+ */
+struct packed_error {
+	uint64_t v[2][3][256];
+};
+
+static void absdiff_generic(uint8_t *diff, const uint8_t *a, const uint8_t *b,
+			    int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		diff[i] = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+}
+
+#if defined(__x86_64__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+#include <emmintrin.h>
+
+static void absdiff_sse2(uint8_t *diff, const uint8_t *a, const uint8_t *b,
+			 int len)
+{
+	int i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+
+		/* One of the saturated differences is always 0 */
+		_mm_storeu_si128((__m128i *)(diff + i),
+				 _mm_or_si128(_mm_subs_epu8(va, vb),
+					      _mm_subs_epu8(vb, va)));
+	}
+
+	absdiff_generic(diff + i, a + i, b + i, len - i);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <immintrin.h>
+
+static void absdiff_avx2(uint8_t *diff, const uint8_t *a, const uint8_t *b,
+			 int len)
+{
+	int i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+
+		_mm256_storeu_si256((__m256i *)(diff + i),
+				    _mm256_or_si256(_mm256_subs_epu8(va, vb),
+						    _mm256_subs_epu8(vb, va)));
+	}
+
+	absdiff_generic(diff + i, a + i, b + i, len - i);
+}
+
+#pragma GCC pop_options
+#endif
+
+static const struct igt_frame_error_kernels frame_error_kernels[] = {
+#if defined(__x86_64__) && !defined(__clang__)
+	{ "avx2", AVX2, absdiff_avx2 },
+	{ "sse2", SSE2, absdiff_sse2 },
+#endif
+	{ "generic", 0, absdiff_generic },
+};
+
+/**
+ * igt_frame_error_kernels:
+ * @features: igt_x86_features() the implementation is allowed to use
+ *
+ * Returns: the fastest implementation only using @features, the generic C
+ * implementation if @features is 0.
+ */
+const struct igt_frame_error_kernels *igt_frame_error_kernels(unsigned features)
+{
+	return igt_kernels_select(frame_error_kernels, features);
+}
+
+static void add_pixels(struct packed_error *p, const uint8_t *reference,
+		       const uint8_t *diff, int width)
+{
+	int x, i;
+
+	for (x = 0; x + 2 <= width; x += 2) {
+		for (i = 0; i < 3; i++) {
+			p->v[0][i][reference[i]] += PACKED_ONE | diff[i];
+			p->v[1][i][reference[i + 4]] += PACKED_ONE | diff[i + 4];
+		}
+
+		reference += 8;
+		diff += 8;
+	}
+
+	if (x < width)
+		for (i = 0; i < 3; i++)
+			p->v[0][i][reference[i]] += PACKED_ONE | diff[i];
+}
+
+static void flush_packed(struct igt_frame_error *e, struct packed_error *p)
+{
+	int i, j, v;
+
+	for (j = 0; j < 2; j++) {
+		for (i = 0; i < 3; i++) {
+			for (v = 0; v < 256; v++) {
+				e->sum[i][v] += (uint32_t)p->v[j][i][v];
+				e->count[i][v] += p->v[j][i][v] >> 32;
+			}
+		}
+	}
+
+	memset(p, 0, sizeof(*p));
+}
+
+/**
+ * igt_frame_error_add_rows:
+ * @e: the error to add to
+ * @k: the implementation to use
+ * @reference: the first reference pixel, XRGB8888
+ * @reference_stride: stride of @reference in bytes
+ * @capture: the first captured pixel, XRGB8888
+ * @capture_stride: stride of @capture in bytes
+ * @width: width in pixels
+ * @height: number of rows
+ *
+ * Adds the error of @height rows of @capture against @reference to @e, on
+ * the calling thread.
+ */
+void igt_frame_error_add_rows(struct igt_frame_error *e,
+			      const struct igt_frame_error_kernels *k,
+			      const uint8_t *reference, int reference_stride,
+			      const uint8_t *capture, int capture_stride,
+			      int width, int height)
+{
+	struct packed_error *p;
+	uint8_t diff[CHUNK];
+	int pixels = 0;
+	int x, y;
+
+	igt_assert(width <= PACKED_MAX_PIXELS);
+
+	p = calloc(1, sizeof(*p));
+	igt_assert(p);
+
+	for (y = 0; y < height; y++) {
+		const uint8_t *ref = reference + y * reference_stride;
+		const uint8_t *cap = capture + y * capture_stride;
+
+		if (pixels + width > PACKED_MAX_PIXELS) {
+			flush_packed(e, p);
+			pixels = 0;
+		}
+
+		/* Row major, in chunks of pixels which stay in cache */
+		for (x = 0; x < width; x += CHUNK / 4) {
+			int n = min(width - x, CHUNK / 4);
+
+			k->absdiff(diff, ref + x * 4, cap + x * 4, n * 4);
+			add_pixels(p, ref + x * 4, diff, n);
+		}
+
+		pixels += width;
+	}
+
+	flush_packed(e, p);
+	free(p);
+}
+
+struct frame_error_bands {
+	const struct igt_frame_error_kernels *k;
+	const uint8_t *reference, *capture;
+	int reference_stride, capture_stride;
+	int width;
+	/* The error of each band */
+	struct igt_frame_error *e;
+};
+
+static void frame_error_band(void *data, int band, int64_t start, int64_t end)
+{
+	struct frame_error_bands *f = data;
+
+	igt_frame_error_add_rows(&f->e[band], f->k,
+				 f->reference + start * f->reference_stride,
+				 f->reference_stride,
+				 f->capture + start * f->capture_stride,
+				 f->capture_stride,
+				 f->width, end - start);
+}
+
+/**
+ * igt_frame_error_compute:
+ * @e: the error to compute
+ * @reference: the first reference pixel, XRGB8888
+ * @reference_stride: stride of @reference in bytes
+ * @capture: the first captured pixel, XRGB8888
+ * @capture_stride: stride of @capture in bytes
+ * @width: width in pixels
+ * @height: height in pixels
+ *
+ * Computes the error of @capture against @reference, with the fastest
+ * implementation the CPU supports and split across a few threads for large
+ * frames.
+ */
+void igt_frame_error_compute(struct igt_frame_error *e,
+			     const uint8_t *reference, int reference_stride,
+			     const uint8_t *capture, int capture_stride,
+			     int width, int height)
+{
+	struct frame_error_bands f = {
+		.k = igt_frame_error_kernels(igt_x86_features()),
+		.reference = reference,
+		.reference_stride = reference_stride,
+		.capture = capture,
+		.capture_stride = capture_stride,
+		.width = width,
+	};
+	int num_bands = igt_kernels_num_bands((int64_t)width * height, height);
+	int i, j, v;
+
+	memset(e, 0, sizeof(*e));
+
+	if (num_bands <= 1) {
+		igt_frame_error_add_rows(e, f.k, reference, reference_stride,
+					 capture, capture_stride,
+					 width, height);
+		return;
+	}
+
+	f.e = calloc(num_bands, sizeof(*f.e));
+	igt_assert(f.e);
+
+	igt_kernels_run_bands(frame_error_band, &f, num_bands, height);
+
+	for (i = 0; i < num_bands; i++) {
+		for (j = 0; j < 3; j++) {
+			for (v = 0; v < 256; v++) {
+				e->sum[j][v] += f.e[i].sum[j][v];
+				e->count[j][v] += f.e[i].count[j][v];
+			}
+		}
+	}
+
+	free(f.e);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_FRAME_ERROR_H__
+#define __IGT_FRAME_ERROR_H__
+
+#include <stdint.h>
+
+/*
+ * Absolute error of a captured XRGB8888 frame against its reference, per
+ * color channel and per reference value, used by
+ * igt_check_analog_frame_match().
+ */
+
+/**
+ * igt_frame_error:
+ * @sum: for each channel, in B, G, R order, and each value of the channel
+ *       in the reference, the sum of the absolute differences between the
+ *       capture and the reference
+ * @count: the number of pixels summed in @sum
+ */
+struct igt_frame_error {
+	uint64_t sum[3][256];
+	uint64_t count[3][256];
+};
+
+/**
+ * igt_frame_error_kernels:
+ * @name: name of the implementation
+ * @features: the igt_x86_features() the implementation requires
+ * @absdiff: stores |@a[i] - @b[i]| in @diff[i] for the @len bytes
+ *
+ * All implementations give identical results.
+ */
+struct igt_frame_error_kernels {
+	const char *name;
+	unsigned features;
+	void (*absdiff)(uint8_t *diff, const uint8_t *a, const uint8_t *b,
+			int len);
+};
+
+const struct igt_frame_error_kernels *igt_frame_error_kernels(unsigned features);
+
+void igt_frame_error_add_rows(struct igt_frame_error *e,
+			      const struct igt_frame_error_kernels *k,
+			      const uint8_t *reference, int reference_stride,
+			      const uint8_t *capture, int capture_stride,
+			      int width, int height);
+void igt_frame_error_compute(struct igt_frame_error *e,
+			     const uint8_t *reference, int reference_stride,
+			     const uint8_t *capture, int capture_stride,
+			     int width, int height);
+
+#endif /* __IGT_FRAME_ERROR_H__ */
@@ -0,0 +1,153 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "igt_kernels.h"
+
+const struct igt_kernels_features igt_kernels_features[] = {
+	{ "generic", 0 },
+	{ "sse2", SSE2 },
+	{ "sse4_1", SSE4_1 },
+	{ "avx2", AVX2 },
+};
+const int igt_kernels_num_features = ARRAY_SIZE(igt_kernels_features);
+
+int __igt_kernels_select(const unsigned *features, size_t stride, int count,
+			 unsigned allowed)
+{
+	int i;
+
+	for (i = 0; i < count - 1; i++) {
+		unsigned f = *(const unsigned *)((const char *)features +
+						 i * stride);
+
+		if ((f & allowed) == f)
+			break;
+	}
+
+	return i;
+}
+
+/**
+ * igt_kernels_num_bands:
+ * @pixels: size of the frame
+ * @max_bands: most bands the frame can be split in
+ *
+ * Returns: the number of bands to split a frame of @pixels in, 1 for small
+ * frames, else up to one per CPU.
+ */
+int igt_kernels_num_bands(int64_t pixels, int64_t max_bands)
+{
+	long num_bands;
+
+	if (pixels < IGT_KERNELS_BAND_MIN_PIXELS)
+		return 1;
+
+	num_bands = sysconf(_SC_NPROCESSORS_ONLN);
+	num_bands = min(num_bands, IGT_KERNELS_MAX_BANDS);
+	num_bands = min(num_bands, max_bands);
+
+	return max(num_bands, 1L);
+}
+
+struct band {
+	pthread_t thread;
+	bool started;
+	void (*func)(void *data, int band, int64_t start, int64_t end);
+	void *data;
+	int index;
+	int64_t start, end;
+};
+
+static void *run_band(void *arg)
+{
+	struct band *b = arg;
+
+	b->func(b->data, b->index, b->start, b->end);
+
+	return NULL;
+}
+
+/**
+ * igt_kernels_run_bands:
+ * @func: function handling the band @band, of the items [@start, @end)
+ * @data: passed to @func
+ * @num_bands: number of bands
+ * @count: number of items, rows or pixels, to split
+ *
+ * Splits @count items in @num_bands bands of about the same size, and runs
+ * @func on each of them, on a thread each. The calling thread takes the
+ * first band, and any band whose thread can't be started. All the bands
+ * are done when this returns.
+ */
+void igt_kernels_run_bands(void (*func)(void *data, int band,
+					int64_t start, int64_t end),
+			   void *data, int num_bands, int64_t count)
+{
+	struct band *bands;
+	int64_t start = 0;
+	int i;
+
+	igt_assert(num_bands >= 1);
+
+	if (num_bands == 1) {
+		func(data, 0, 0, count);
+		return;
+	}
+
+	bands = calloc(num_bands, sizeof(*bands));
+	igt_assert(bands);
+
+	for (i = 0; i < num_bands; i++) {
+		struct band *b = &bands[i];
+
+		b->func = func;
+		b->data = data;
+		b->index = i;
+		b->start = start;
+		b->end = count * (i + 1) / num_bands;
+		start = b->end;
+
+		if (i)
+			b->started = pthread_create(&b->thread, NULL,
+						    run_band, b) == 0;
+	}
+
+	run_band(&bands[0]);
+
+	for (i = 1; i < num_bands; i++) {
+		struct band *b = &bands[i];
+
+		if (b->started)
+			pthread_join(b->thread, NULL);
+		else
+			run_band(b);
+	}
+
+	free(bands);
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_KERNELS_H__
+#define __IGT_KERNELS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "igt_core.h"
+#include "igt_x86.h"
+
+/*
+ * Helpers for the pixel and sample loops implemented for several CPU
+ * feature sets, picking the fastest one the CPU supports, and splitting
+ * large frames in bands, each handled by a thread.
+ *
+ * An implementation table is an array of structs with an
+ * "unsigned features" member, the igt_x86_features() each entry requires,
+ * ordered from the fastest to the generic C one, which requires none and
+ * comes last.
+ */
+
+/* Frames smaller than that aren't worth splitting */
+#define IGT_KERNELS_BAND_MIN_PIXELS (1 << 20)
+#define IGT_KERNELS_MAX_BANDS 8
+
+int __igt_kernels_select(const unsigned *features, size_t stride, int count,
+			 unsigned allowed);
+
+/**
+ * igt_kernels_select:
+ * @table: an implementation table
+ * @allowed: igt_x86_features() the implementation is allowed to use
+ *
+ * Returns: the entry of @table for the fastest implementation only using
+ * @allowed, the generic C implementation if @allowed is 0.
+ */
+#define igt_kernels_select(table, allowed) \
+	(&(table)[__igt_kernels_select(&(table)[0].features, \
+				       sizeof((table)[0]), \
+				       sizeof(table) / sizeof((table)[0]), \
+				       (allowed))])
+
+int igt_kernels_num_bands(int64_t pixels, int64_t max_bands);
+void igt_kernels_run_bands(void (*func)(void *data, int band,
+					int64_t start, int64_t end),
+			   void *data, int num_bands, int64_t count);
+
+/**
+ * igt_kernels_features:
+ * @name: subtest name for the implementation
+ * @features: igt_x86_features() the implementation requires
+ *
+ * The feature sets implementations are written for, see
+ * igt_subtest_kernels().
+ */
+struct igt_kernels_features {
+	const char *name;
+	unsigned features;
+};
+
+extern const struct igt_kernels_features igt_kernels_features[];
+extern const int igt_kernels_num_features;
+
+/**
+ * igt_subtest_kernels:
+ * @select: function returning the implementation for a set of features,
+ *          like igt_kernels_select()
+ * @check: function checking the implementation it is passed
+ *
+ * Adds a subtest for each implementation @select knows of, named after
+ * its feature set, running @check on it. The subtests skip on CPUs
+ * without the features.
+ */
+#define igt_subtest_kernels(select, check) \
+	for (int __k = 0; __k < igt_kernels_num_features; __k++) \
+		if (select(igt_kernels_features[__k].features)->features == \
+		    igt_kernels_features[__k].features) \
+			igt_subtest(igt_kernels_features[__k].name) { \
+				unsigned __f = igt_kernels_features[__k].features; \
+				igt_require((igt_x86_features() & __f) == __f); \
+				check(select(__f)); \
+			}
+
+#endif /* __IGT_KERNELS_H__ */
@@ -49,6 +49,7 @@
 
 #include "drmtest.h"
 #include "igt_kms.h"
+#include "igt_kms_cache.h"
 #include "igt_aux.h"
 #include "intel_chipset.h"
 #include "igt_debugfs.h"
@@ -206,30 +207,13 @@ static void
 igt_fill_plane_props(igt_display_t *display, igt_plane_t *plane,
 		     int num_props, const char * const prop_names[])
 {
-	drmModeObjectPropertiesPtr props;
-	int i, j, fd;
-
-	fd = display->drm_fd;
-
-	props = drmModeObjectGetProperties(fd, plane->drm_plane->plane_id, DRM_MODE_OBJECT_PLANE);
-	igt_assert(props);
-
-	for (i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
-
-		for (j = 0; j < num_props; j++) {
-			if (strcmp(prop->name, prop_names[j]) != 0)
-				continue;
-
-			plane->props[j] = props->props[i];
-			break;
-		}
-
-		drmModeFreeProperty(prop);
-	}
+	int ret;
 
-	drmModeFreeObjectProperties(props);
+	ret = igt_kms_cache_find_properties(display->drm_fd,
+					    plane->drm_plane->plane_id,
+					    DRM_MODE_OBJECT_PLANE,
+					    num_props, prop_names, plane->props);
+	igt_assert_lte(0, ret);
 }
 
 /*
@@ -240,60 +224,27 @@ static void
 igt_atomic_fill_connector_props(igt_display_t *display, igt_output_t *output,
 			int num_connector_props, const char * const conn_prop_names[])
 {
-	drmModeObjectPropertiesPtr props;
-	int i, j, fd;
-
-	fd = display->drm_fd;
-
-	props = drmModeObjectGetProperties(fd, output->config.connector->connector_id, DRM_MODE_OBJECT_CONNECTOR);
-	igt_assert(props);
-
-	for (i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
-
-		for (j = 0; j < num_connector_props; j++) {
-			if (strcmp(prop->name, conn_prop_names[j]) != 0)
-				continue;
-
-			output->props[j] = props->props[i];
-			break;
-		}
-
-		drmModeFreeProperty(prop);
-	}
+	int ret;
 
-	drmModeFreeObjectProperties(props);
+	ret = igt_kms_cache_find_properties(display->drm_fd,
+					    output->config.connector->connector_id,
+					    DRM_MODE_OBJECT_CONNECTOR,
+					    num_connector_props, conn_prop_names,
+					    output->props);
+	igt_assert_lte(0, ret);
 }
 
 static void
 igt_fill_pipe_props(igt_display_t *display, igt_pipe_t *pipe,
 		    int num_crtc_props, const char * const crtc_prop_names[])
 {
-	drmModeObjectPropertiesPtr props;
-	int i, j, fd;
-
-	fd = display->drm_fd;
-
-	props = drmModeObjectGetProperties(fd, pipe->crtc_id, DRM_MODE_OBJECT_CRTC);
-	igt_assert(props);
-
-	for (i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
-
-		for (j = 0; j < num_crtc_props; j++) {
-			if (strcmp(prop->name, crtc_prop_names[j]) != 0)
-				continue;
-
-			pipe->props[j] = props->props[i];
-			break;
-		}
-
-		drmModeFreeProperty(prop);
-	}
+	int ret;
 
-	drmModeFreeObjectProperties(props);
+	ret = igt_kms_cache_find_properties(display->drm_fd, pipe->crtc_id,
+					    DRM_MODE_OBJECT_CRTC,
+					    num_crtc_props, crtc_prop_names,
+					    pipe->props);
+	igt_assert_lte(0, ret);
 }
 
 /**
@@ -1159,6 +1110,30 @@ void kmstest_set_connector_dpms(int fd, drmModeConnector *connector, int mode)
 					       dpms, mode) == 0);
 }
 
+static bool get_property_value(int drm_fd, uint32_t object_id,
+			       uint32_t object_type, uint32_t prop_id,
+			       uint64_t *value)
+{
+	drmModeObjectPropertiesPtr proplist;
+	bool found = false;
+	int i;
+
+	proplist = drmModeObjectGetProperties(drm_fd, object_id, object_type);
+	igt_assert(proplist);
+
+	for (i = 0; i < proplist->count_props; i++) {
+		if (proplist->props[i] == prop_id) {
+			*value = proplist->prop_values[i];
+			found = true;
+			break;
+		}
+	}
+
+	drmModeFreeObjectProperties(proplist);
+
+	return found;
+}
+
 /**
  * kmstest_get_property:
  * @drm_fd: drm file descriptor
@@ -1180,35 +1155,35 @@ kmstest_get_property(int drm_fd, uint32_t object_id, uint32_t object_type,
 		     uint64_t *value /* out */,
 		     drmModePropertyPtr *prop /* out */)
 {
-	drmModeObjectPropertiesPtr proplist;
-	drmModePropertyPtr _prop;
-	bool found = false;
-	int i;
-
-	proplist = drmModeObjectGetProperties(drm_fd, object_id, object_type);
-	for (i = 0; i < proplist->count_props; i++) {
-		_prop = drmModeGetProperty(drm_fd, proplist->props[i]);
-		if (!_prop)
-			continue;
+	uint32_t id;
 
-		if (strcmp(_prop->name, name) == 0) {
-			found = true;
-			if (prop_id)
-				*prop_id = proplist->props[i];
-			if (value)
-				*value = proplist->prop_values[i];
-			if (prop)
-				*prop = _prop;
-			else
-				drmModeFreeProperty(_prop);
+	/* Only the values aren't cached */
+	id = igt_kms_cache_find_property(drm_fd, object_id, object_type, name);
+	if (!id)
+		return false;
 
-			break;
-		}
-		drmModeFreeProperty(_prop);
+	/*
+	 * A property the object doesn't list anymore means the cache is
+	 * stale, the fd having been reopened or its caps changed behind its
+	 * back.
+	 */
+	if (value && !get_property_value(drm_fd, object_id, object_type,
+					 id, value)) {
+		igt_kms_cache_invalidate(drm_fd);
+
+		id = igt_kms_cache_find_property(drm_fd, object_id,
+						 object_type, name);
+		if (!id || !get_property_value(drm_fd, object_id, object_type,
+					       id, value))
+			return false;
 	}
 
-	drmModeFreeObjectProperties(proplist);
-	return found;
+	if (prop_id)
+		*prop_id = id;
+	if (prop)
+		*prop = drmModeGetProperty(drm_fd, id);
+
+	return true;
 }
 
 struct edid_block {
@@ -1873,6 +1848,7 @@ bool igt_display_init(igt_display_t *display, int drm_fd)
 {
 	drmModeRes *resources;
 	drmModePlaneRes *plane_resources;
+	uint32_t *possible_crtcs;
 	int i;
 
 	memset(display, 0, sizeof(igt_display_t));
@@ -1893,13 +1869,29 @@ bool igt_display_init(igt_display_t *display, int drm_fd)
 	display->pipes = calloc(sizeof(igt_pipe_t), display->n_pipes);
 	igt_assert_f(display->pipes, "Failed to allocate memory for %d pipes\n", display->n_pipes);
 
-	drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
-	if (drmSetClientCap(drm_fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0)
+	/* The atomic properties are only listed with the atomic cap */
+	igt_kms_cache_set_client_cap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+	if (igt_kms_cache_set_client_cap(drm_fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0)
 		display->is_atomic = 1;
 
 	plane_resources = drmModeGetPlaneResources(display->drm_fd);
 	igt_assert(plane_resources);
 
+	/* Each plane is only looked up again for the pipes it can be used on */
+	possible_crtcs = calloc(plane_resources->count_planes,
+				sizeof(*possible_crtcs));
+	igt_assert(plane_resources->count_planes == 0 || possible_crtcs);
+	for (i = 0; i < plane_resources->count_planes; i++) {
+		drmModePlane *drm_plane;
+
+		drm_plane = drmModeGetPlane(display->drm_fd,
+					    plane_resources->planes[i]);
+		igt_assert(drm_plane);
+
+		possible_crtcs[i] = drm_plane->possible_crtcs;
+		drmModeFreePlane(drm_plane);
+	}
+
 	for_each_pipe(display, i) {
 		igt_pipe_t *pipe = &display->pipes[i];
 		igt_plane_t *plane;
@@ -1917,19 +1909,10 @@ bool igt_display_init(igt_display_t *display, int drm_fd)
 		igt_fill_pipe_props(display, pipe, IGT_NUM_CRTC_PROPS, igt_crtc_prop_names);
 
 		/* count number of valid planes */
-		for (j = 0; j < plane_resources->count_planes; j++) {
-			drmModePlane *drm_plane;
-
-			drm_plane = drmModeGetPlane(display->drm_fd,
-						    plane_resources->planes[j]);
-			igt_assert(drm_plane);
-
-			if (drm_plane->possible_crtcs & (1 << i))
+		for (j = 0; j < plane_resources->count_planes; j++)
+			if (possible_crtcs[j] & (1 << i))
 				n_planes++;
 
-			drmModeFreePlane(drm_plane);
-		}
-
 		igt_assert_lte(0, n_planes);
 		pipe->planes = calloc(sizeof(igt_plane_t), n_planes);
 		igt_assert_f(pipe->planes, "Failed to allocate memory for %d planes\n", n_planes);
@@ -1939,15 +1922,13 @@ bool igt_display_init(igt_display_t *display, int drm_fd)
 		for (j = 0; j < plane_resources->count_planes; j++) {
 			drmModePlane *drm_plane;
 
+			if (!(possible_crtcs[j] & (1 << i)))
+				continue;
+
 			drm_plane = drmModeGetPlane(display->drm_fd,
 						    plane_resources->planes[j]);
 			igt_assert(drm_plane);
 
-			if (!(drm_plane->possible_crtcs & (1 << i))) {
-				drmModeFreePlane(drm_plane);
-				continue;
-			}
-
 			type = get_drm_plane_type(display->drm_fd,
 						  plane_resources->planes[j]);
 
@@ -1991,6 +1972,8 @@ bool igt_display_init(igt_display_t *display, int drm_fd)
 		pipe->n_planes = n_planes;
 	}
 
+	free(possible_crtcs);
+
 	igt_fill_display_format_mod(display);
 
 	/*
@@ -2870,16 +2853,16 @@ uint64_t igt_plane_get_prop(igt_plane_t *plane, enum igt_atomic_plane_properties
 
 static bool igt_mode_object_get_prop_enum_value(int drm_fd, uint32_t id, const char *str, uint64_t *val)
 {
-	drmModePropertyPtr prop = drmModeGetProperty(drm_fd, id);
+	const drmModePropertyRes *prop;
 	int i;
 
 	igt_assert(id);
+	prop = igt_kms_cache_get_property(drm_fd, id);
 	igt_assert(prop);
 
 	for (i = 0; i < prop->count_enums; i++)
 		if (!strcmp(str, prop->enums[i].name)) {
 			*val = prop->enums[i].value;
-			drmModeFreeProperty(prop);
 			return true;
 		}
 
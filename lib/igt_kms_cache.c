@@ -0,0 +1,508 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libudev.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <xf86drm.h>
+
+#include "igt_core.h"
+#include "igt_kms_cache.h"
+
+/**
+ * SECTION:igt_kms_cache
+ * @short_description: Cache of the KMS property definitions
+ * @title: KMS property cache
+ * @include: igt_kms_cache.h
+ *
+ * Finding a property by name means getting the property list of the object,
+ * then each property to compare its name, two ioctls each. igt_kms does
+ * that for every plane, pipe and output on every display init and output
+ * refresh, thousands of ioctls on machines with many pipes.
+ *
+ * This caches, for each drm fd, the property definitions and the list of
+ * properties of each object, which don't change while the device is there.
+ * Property values aren't cached. The cache of a fd is kept across
+ * igt_display_init() and igt_display_fini(), and dropped when a hotplug
+ * uevent is seen for its device, since connectors may come and go, or when
+ * the fd now refers to another device. To keep warm lookups free of
+ * syscalls, both are only checked at most once a second, and whenever
+ * igt_kms_cache_check() or igt_kms_cache_set_client_cap() is called.
+ *
+ * The property lists also depend on the client caps of the fd, the kernel
+ * only lists the atomic properties once DRM_CLIENT_CAP_ATOMIC is set. The
+ * kernel can't be asked for the caps of a fd, so they have to be set with
+ * igt_kms_cache_set_client_cap(), as igt_display_init() does, which drops
+ * the cache only when a cap actually changes. Whoever sets them with
+ * drmSetClientCap() instead has to call igt_kms_cache_invalidate().
+ */
+
+struct kms_cache_object {
+	bool cached;
+	uint32_t type;
+	uint32_t count;
+	uint32_t *props;
+};
+
+/* More than the DRM_CLIENT_CAP_* there are, any other one clears the cache */
+#define MAX_CLIENT_CAPS 8
+
+/* How often the device of a fd and the hotplug events are checked */
+#define CHECK_INTERVAL_NS 1000000000ull
+
+/* Properties and objects are indexed by their mode object id */
+struct kms_cache {
+	dev_t rdev;
+	struct udev *udev;
+	struct udev_monitor *mon;
+	uint64_t last_check;
+	/* The client caps set through the cache, as a mask of known ones */
+	unsigned int known_caps;
+	uint64_t caps[MAX_CLIENT_CAPS];
+	uint32_t size;
+	drmModePropertyPtr *props;
+	struct kms_cache_object *objects;
+};
+
+static const struct igt_kms_backend libdrm_backend = {
+	.get_object_properties = drmModeObjectGetProperties,
+	.get_property = drmModeGetProperty,
+	.set_client_cap = drmSetClientCap,
+};
+
+static const struct igt_kms_backend *backend = &libdrm_backend;
+
+/* Indexed by fd */
+static struct kms_cache **caches;
+static int num_caches;
+
+static void kms_cache_clear(struct kms_cache *cache)
+{
+	uint32_t i;
+
+	for (i = 0; i < cache->size; i++) {
+		drmModeFreeProperty(cache->props[i]);
+		free(cache->objects[i].props);
+	}
+
+	free(cache->props);
+	free(cache->objects);
+	cache->props = NULL;
+	cache->objects = NULL;
+	cache->size = 0;
+}
+
+static void kms_cache_free(struct kms_cache *cache)
+{
+	kms_cache_clear(cache);
+
+	if (cache->mon)
+		udev_monitor_unref(cache->mon);
+	if (cache->udev)
+		udev_unref(cache->udev);
+
+	free(cache);
+}
+
+/* Like igt_watch_hotplug(), but without failing without udev */
+static void kms_cache_watch(struct kms_cache *cache)
+{
+	int fd, flags;
+
+	cache->udev = udev_new();
+	if (!cache->udev)
+		return;
+
+	cache->mon = udev_monitor_new_from_netlink(cache->udev, "udev");
+	if (!cache->mon)
+		return;
+
+	if (udev_monitor_filter_add_match_subsystem_devtype(cache->mon, "drm",
+							    "drm_minor") ||
+	    udev_monitor_filter_update(cache->mon) ||
+	    udev_monitor_enable_receiving(cache->mon))
+		goto err;
+
+	fd = udev_monitor_get_fd(cache->mon);
+	flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		goto err;
+
+	return;
+
+err:
+	udev_monitor_unref(cache->mon);
+	cache->mon = NULL;
+}
+
+static bool kms_cache_hotplugged(struct kms_cache *cache)
+{
+	struct udev_device *dev;
+	bool hotplugged = false;
+
+	if (!cache->mon)
+		return false;
+
+	/* Drains all the pending events */
+	while ((dev = udev_monitor_receive_device(cache->mon))) {
+		const char *hotplug;
+
+		hotplug = udev_device_get_property_value(dev, "HOTPLUG");
+		if (hotplug && atoi(hotplug) == 1 &&
+		    udev_device_get_devnum(dev) == cache->rdev)
+			hotplugged = true;
+
+		udev_device_unref(dev);
+	}
+
+	return hotplugged;
+}
+
+static uint64_t kms_cache_now(void)
+{
+	struct timespec ts;
+
+	/* Read from the vDSO, without a syscall */
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct kms_cache *kms_cache_get_checked(int fd, bool force)
+{
+	struct kms_cache *cache;
+	struct stat st;
+	uint64_t now;
+
+	if (fd < 0)
+		return NULL;
+
+	if (fd >= num_caches) {
+		caches = realloc(caches, (fd + 1) * sizeof(*caches));
+		igt_assert(caches);
+		memset(caches + num_caches, 0,
+		       (fd + 1 - num_caches) * sizeof(*caches));
+		num_caches = fd + 1;
+	}
+
+	cache = caches[fd];
+	now = kms_cache_now();
+
+	if (cache && !force && now - cache->last_check < CHECK_INTERVAL_NS)
+		return cache;
+
+	if (fstat(fd, &st))
+		return NULL;
+
+	/* The fd was closed and reused for another device */
+	if (cache && cache->rdev != st.st_rdev) {
+		kms_cache_free(cache);
+		cache = caches[fd] = NULL;
+	}
+
+	if (!cache) {
+		cache = calloc(1, sizeof(*cache));
+		igt_assert(cache);
+		cache->rdev = st.st_rdev;
+		kms_cache_watch(cache);
+		caches[fd] = cache;
+	} else if (kms_cache_hotplugged(cache)) {
+		kms_cache_clear(cache);
+	}
+
+	cache->last_check = now;
+
+	return cache;
+}
+
+static struct kms_cache *kms_cache_get(int fd)
+{
+	return kms_cache_get_checked(fd, false);
+}
+
+static void kms_cache_reserve(struct kms_cache *cache, uint32_t id)
+{
+	uint32_t size = cache->size ? cache->size : 256;
+
+	if (id < cache->size)
+		return;
+
+	while (size <= id)
+		size *= 2;
+
+	cache->props = realloc(cache->props, size * sizeof(*cache->props));
+	cache->objects = realloc(cache->objects,
+				 size * sizeof(*cache->objects));
+	igt_assert(cache->props && cache->objects);
+
+	memset(cache->props + cache->size, 0,
+	       (size - cache->size) * sizeof(*cache->props));
+	memset(cache->objects + cache->size, 0,
+	       (size - cache->size) * sizeof(*cache->objects));
+	cache->size = size;
+}
+
+/**
+ * igt_kms_cache_set_backend:
+ * @kms_backend: the backend, NULL for libdrm
+ *
+ * Makes the KMS property cache call @kms_backend instead of libdrm, and
+ * drops what was cached for all fds.
+ */
+void igt_kms_cache_set_backend(const struct igt_kms_backend *kms_backend)
+{
+	int fd;
+
+	for (fd = 0; fd < num_caches; fd++)
+		igt_kms_cache_invalidate(fd);
+
+	backend = kms_backend ? kms_backend : &libdrm_backend;
+}
+
+static const drmModePropertyRes *
+kms_cache_property(struct kms_cache *cache, int fd, uint32_t prop_id)
+{
+	kms_cache_reserve(cache, prop_id);
+	if (!cache->props[prop_id])
+		cache->props[prop_id] = backend->get_property(fd, prop_id);
+
+	return cache->props[prop_id];
+}
+
+static int kms_cache_object_props(struct kms_cache *cache, int fd,
+				  uint32_t object_id, uint32_t object_type,
+				  const uint32_t **prop_ids)
+{
+	struct kms_cache_object *obj;
+
+	kms_cache_reserve(cache, object_id);
+	obj = &cache->objects[object_id];
+
+	if (!obj->cached || obj->type != object_type) {
+		drmModeObjectPropertiesPtr props;
+
+		props = backend->get_object_properties(fd, object_id,
+						       object_type);
+		if (!props)
+			return errno ? -errno : -ENOENT;
+
+		free(obj->props);
+		obj->props = malloc(props->count_props * sizeof(*obj->props) + 1);
+		igt_assert(obj->props);
+		memcpy(obj->props, props->props,
+		       props->count_props * sizeof(*obj->props));
+		obj->count = props->count_props;
+		obj->type = object_type;
+		obj->cached = true;
+
+		drmModeFreeObjectProperties(props);
+	}
+
+	*prop_ids = obj->props;
+	return obj->count;
+}
+
+/**
+ * igt_kms_cache_get_property:
+ * @fd: drm file descriptor
+ * @prop_id: the property id
+ *
+ * Returns: the definition of the property, NULL if it couldn't be found.
+ * It must not be freed, and is only valid until the next call to the cache.
+ */
+const drmModePropertyRes *igt_kms_cache_get_property(int fd, uint32_t prop_id)
+{
+	struct kms_cache *cache = kms_cache_get(fd);
+
+	if (!cache)
+		return NULL;
+
+	return kms_cache_property(cache, fd, prop_id);
+}
+
+/**
+ * igt_kms_cache_get_object_props:
+ * @fd: drm file descriptor
+ * @object_id: the mode object id
+ * @object_type: the type of the object (DRM_MODE_OBJECT_*)
+ * @prop_ids: returns the ids of the properties of the object, which must
+ *            not be freed, and are only valid until the next call to the
+ *            cache
+ *
+ * Returns: the number of properties of the object, or a negative error code.
+ */
+int igt_kms_cache_get_object_props(int fd,
+				   uint32_t object_id, uint32_t object_type,
+				   const uint32_t **prop_ids)
+{
+	struct kms_cache *cache = kms_cache_get(fd);
+
+	if (!cache)
+		return -errno;
+
+	return kms_cache_object_props(cache, fd, object_id, object_type,
+				      prop_ids);
+}
+
+/**
+ * igt_kms_cache_find_properties:
+ * @fd: drm file descriptor
+ * @object_id: the mode object id
+ * @object_type: the type of the object (DRM_MODE_OBJECT_*)
+ * @num_props: the number of properties to find
+ * @prop_names: the names of the properties to find
+ * @prop_ids: returns the ids of the properties found, the entries of
+ *            properties the object doesn't have are left alone
+ *
+ * Returns: the number of properties found, or a negative error code.
+ */
+int igt_kms_cache_find_properties(int fd,
+				  uint32_t object_id, uint32_t object_type,
+				  int num_props, const char * const prop_names[],
+				  uint32_t *prop_ids)
+{
+	struct kms_cache *cache = kms_cache_get(fd);
+	const uint32_t *ids;
+	int count, found = 0;
+	int i, j;
+
+	if (!cache)
+		return -errno;
+
+	count = kms_cache_object_props(cache, fd, object_id, object_type, &ids);
+
+	for (i = 0; i < count; i++) {
+		const drmModePropertyRes *prop =
+			kms_cache_property(cache, fd, ids[i]);
+
+		if (!prop)
+			continue;
+
+		for (j = 0; j < num_props; j++) {
+			if (strcmp(prop->name, prop_names[j]) != 0)
+				continue;
+
+			prop_ids[j] = ids[i];
+			found++;
+			break;
+		}
+	}
+
+	return count < 0 ? count : found;
+}
+
+/**
+ * igt_kms_cache_find_property:
+ * @fd: drm file descriptor
+ * @object_id: the mode object id
+ * @object_type: the type of the object (DRM_MODE_OBJECT_*)
+ * @name: the name of the property
+ *
+ * Returns: the id of the property called @name of the object, 0 if it has
+ * none.
+ */
+uint32_t igt_kms_cache_find_property(int fd,
+				     uint32_t object_id, uint32_t object_type,
+				     const char *name)
+{
+	uint32_t prop_id = 0;
+
+	igt_kms_cache_find_properties(fd, object_id, object_type,
+				      1, &name, &prop_id);
+
+	return prop_id;
+}
+
+/**
+ * igt_kms_cache_check:
+ * @fd: drm file descriptor
+ *
+ * Drops what was cached for @fd if it now refers to another device, or if
+ * a hotplug uevent was seen for its device, right away instead of at the
+ * next periodic check.
+ */
+void igt_kms_cache_check(int fd)
+{
+	kms_cache_get_checked(fd, true);
+}
+
+/**
+ * igt_kms_cache_set_client_cap:
+ * @fd: drm file descriptor
+ * @capability: the DRM_CLIENT_CAP_* to set
+ * @value: the value to set it to
+ *
+ * Sets a client cap of @fd like drmSetClientCap(), and drops what was
+ * cached for @fd if that changed its caps, or if they weren't known.
+ *
+ * Returns: 0 on success, what drmSetClientCap() returns otherwise.
+ */
+int igt_kms_cache_set_client_cap(int fd, uint64_t capability, uint64_t value)
+{
+	struct kms_cache *cache;
+	int ret;
+
+	ret = backend->set_client_cap(fd, capability, value);
+	if (ret)
+		return ret;
+
+	cache = kms_cache_get_checked(fd, true);
+	if (!cache)
+		return 0;
+
+	if (capability >= MAX_CLIENT_CAPS) {
+		kms_cache_clear(cache);
+		return 0;
+	}
+
+	if (!(cache->known_caps & (1u << capability)) ||
+	    cache->caps[capability] != value) {
+		kms_cache_clear(cache);
+		cache->known_caps |= 1u << capability;
+		cache->caps[capability] = value;
+	}
+
+	return 0;
+}
+
+/**
+ * igt_kms_cache_invalidate:
+ * @fd: drm file descriptor
+ *
+ * Drops what was cached for @fd, for instance after a change the cache
+ * can't see such as setting a client cap with drmSetClientCap(), or to
+ * count the ioctls of a cold start.
+ */
+void igt_kms_cache_invalidate(int fd)
+{
+	if (fd < 0 || fd >= num_caches || !caches[fd])
+		return;
+
+	kms_cache_free(caches[fd]);
+	caches[fd] = NULL;
+}
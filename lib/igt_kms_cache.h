@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_KMS_CACHE_H__
+#define __IGT_KMS_CACHE_H__
+
+#include <stdint.h>
+#include <xf86drmMode.h>
+
+/**
+ * igt_kms_backend:
+ * @get_object_properties: drmModeObjectGetProperties()
+ * @get_property: drmModeGetProperty()
+ * @set_client_cap: drmSetClientCap()
+ *
+ * The libdrm calls the KMS property cache is filled with, which can be
+ * replaced with igt_kms_cache_set_backend() to run against a snapshot of
+ * the KMS objects instead of a device. What they return is freed with
+ * drmModeFreeObjectProperties() and drmModeFreeProperty().
+ */
+struct igt_kms_backend {
+	drmModeObjectPropertiesPtr (*get_object_properties)(int fd,
+							    uint32_t object_id,
+							    uint32_t object_type);
+	drmModePropertyPtr (*get_property)(int fd, uint32_t prop_id);
+	int (*set_client_cap)(int fd, uint64_t capability, uint64_t value);
+};
+
+void igt_kms_cache_set_backend(const struct igt_kms_backend *backend);
+
+const drmModePropertyRes *igt_kms_cache_get_property(int fd, uint32_t prop_id);
+int igt_kms_cache_get_object_props(int fd,
+				   uint32_t object_id, uint32_t object_type,
+				   const uint32_t **prop_ids);
+int igt_kms_cache_find_properties(int fd,
+				  uint32_t object_id, uint32_t object_type,
+				  int num_props, const char * const prop_names[],
+				  uint32_t *prop_ids);
+uint32_t igt_kms_cache_find_property(int fd,
+				     uint32_t object_id, uint32_t object_type,
+				     const char *name);
+void igt_kms_cache_check(int fd);
+int igt_kms_cache_set_client_cap(int fd, uint64_t capability, uint64_t value);
+void igt_kms_cache_invalidate(int fd);
+
+#endif /* __IGT_KMS_CACHE_H__ */
@@ -22,6 +22,7 @@
  *
  */
 
+#include <inttypes.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,7 +32,8 @@
 
 #define U64_MAX         ((uint64_t)~0ULL)
 
-#define sorted_value(stats, i) (stats->is_float ? stats->sorted_f[i] : stats->sorted_u64[i])
+#define sorted_value(stats, i) (stats->is_streaming ? streaming_value(stats, i) : \
+				stats->is_float ? stats->sorted_f[i] : stats->sorted_u64[i])
 #define unsorted_value(stats, i) (stats->is_float ? stats->values_f[i] : stats->values_u64[i])
 
 /**
@@ -64,6 +66,14 @@
  *
  *	igt_stats_fini(&stats);
  * ]|
+ *
+ * For long running measurements, igt_stats_init_streaming() gives an
+ * #igt_stats_t using a fixed amount of memory, at the cost of approximate
+ * medians and quartiles.
+ *
+ * Samples measured by several threads are best gathered with an
+ * #igt_stats_collector, each thread pushing to its own set of samples
+ * without any synchronization, merged with igt_stats_merge() at the end.
  */
 
 static unsigned int get_new_capacity(int need)
@@ -97,6 +107,264 @@ static void igt_stats_ensure_capacity(igt_stats_t *stats,
 	stats->sorted_u64 = NULL;
 }
 
+/*
+ * Streaming mode. Values are counted in the buckets of a log-linear
+ * histogram (as in HdrHistogram) with 2^precision buckets per power of two,
+ * so each bucket is at most 2^-precision wide relative to its values.
+ *
+ * Integers below 2^precision have a bucket of their own, larger ones are
+ * bucketed on their most significant precision + 1 bits. Floats are
+ * bucketed on their exponent and the top precision bits of their mantissa,
+ * the positive and negative ones in a histogram each and the zeros in a
+ * counter of their own, so that the histograms only span the range of the
+ * magnitudes actually pushed.
+ */
+#define STREAMING_MAX_BUCKETS (1u << 22)
+
+static uint64_t streaming_key_u64(unsigned int precision, uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < (1ull << precision))
+		return value;
+
+	shift = 63 - __builtin_clzll(value) - precision;
+	return ((uint64_t)shift << precision) + (value >> shift);
+}
+
+static double streaming_value_u64(unsigned int precision, uint64_t key)
+{
+	unsigned int shift;
+	uint64_t lower;
+
+	if (key < (2ull << precision))
+		return key;
+
+	shift = (key >> precision) - 1;
+	lower = (key - ((uint64_t)shift << precision)) << shift;
+	return lower + ((1ull << shift) - 1) / 2.;
+}
+
+static uint64_t double_to_ordered(double value)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return bits >> 63 ? ~bits : bits | 1ull << 63;
+}
+
+static double ordered_to_double(uint64_t bits)
+{
+	double value;
+
+	bits = bits >> 63 ? bits & ~(1ull << 63) : ~bits;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/* The bits of a positive double are in the same order as its value */
+static uint64_t streaming_key_f(unsigned int precision, double magnitude)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &magnitude, sizeof(bits));
+	return bits >> (52 - precision);
+}
+
+static double streaming_value_f(unsigned int precision, uint64_t key)
+{
+	unsigned int shift = 52 - precision;
+	uint64_t bits[2] = { key << shift, ((key + 1) << shift) - 1 };
+	double value[2];
+
+	memcpy(value, bits, sizeof(value));
+	return (value[0] + value[1]) / 2.;
+}
+
+static void streaming_add(igt_stats_t *stats, unsigned int sign,
+			  uint64_t key, uint32_t count)
+{
+	struct igt_stats_hist *hist = &stats->hist[sign];
+	uint64_t first = hist->first_bucket;
+	uint64_t end = first + hist->n_buckets;
+
+	if (!hist->buckets || key < first || key >= end) {
+		uint64_t new_first, new_end, size;
+		uint32_t *buckets;
+
+		if (!hist->buckets)
+			first = end = key;
+
+		new_first = key < first ? key : first;
+		new_end = key >= end ? key + 1 : end;
+
+		size = new_end - new_first;
+		igt_assert_f(size <= STREAMING_MAX_BUCKETS,
+			     "streaming stats span %"PRIu64" buckets, more than %u, "
+			     "lower the precision (%u)\n",
+			     size, STREAMING_MAX_BUCKETS, stats->precision);
+
+		/* Grow geometrically, in the direction we needed to grow */
+		if (size < 2 * hist->n_buckets)
+			size = 2 * hist->n_buckets;
+		if (size < 64)
+			size = 64;
+		if (size > STREAMING_MAX_BUCKETS)
+			size = STREAMING_MAX_BUCKETS;
+		if (key < first)
+			new_first = new_end > size ? new_end - size : 0;
+		new_end = new_first + size;
+
+		buckets = calloc(size, sizeof(*buckets));
+		igt_assert(buckets);
+		if (hist->buckets)
+			memcpy(buckets + (first - new_first), hist->buckets,
+			       hist->n_buckets * sizeof(*buckets));
+		free(hist->buckets);
+
+		hist->buckets = buckets;
+		hist->first_bucket = new_first;
+		hist->n_buckets = size;
+	}
+
+	hist->buckets[key - hist->first_bucket] += count;
+}
+
+static void streaming_add_f(igt_stats_t *stats, double value, uint32_t count)
+{
+	if (value == 0.) {
+		stats->n_zeros += count;
+		return;
+	}
+
+	streaming_add(stats, signbit(value) ? 1 : 0,
+		      streaming_key_f(stats->precision, fabs(value)), count);
+}
+
+static void streaming_push(igt_stats_t *stats, double value)
+{
+	double delta = value - stats->mean;
+
+	/* Welford's online mean and variance */
+	stats->n_values++;
+	stats->mean += delta / stats->n_values;
+	stats->m2 += delta * (value - stats->mean);
+}
+
+/*
+ * The buckets in value order: the negative histogram from its largest
+ * magnitude down, the zeros, then the positive histogram.
+ */
+static unsigned int streaming_n_slots(igt_stats_t *stats)
+{
+	return stats->hist[1].n_buckets + 1 + stats->hist[0].n_buckets;
+}
+
+static uint32_t streaming_slot_count(igt_stats_t *stats, unsigned int slot)
+{
+	unsigned int n_neg = stats->hist[1].n_buckets;
+
+	if (slot < n_neg)
+		return stats->hist[1].buckets[n_neg - 1 - slot];
+	if (slot == n_neg)
+		return stats->n_zeros;
+	return stats->hist[0].buckets[slot - n_neg - 1];
+}
+
+static double streaming_slot_value(igt_stats_t *stats, unsigned int slot)
+{
+	unsigned int n_neg = stats->hist[1].n_buckets;
+	double value, lo, hi;
+
+	if (slot == n_neg)
+		return 0.;
+
+	if (stats->is_float) {
+		if (slot < n_neg)
+			value = -streaming_value_f(stats->precision,
+						   stats->hist[1].first_bucket +
+						   n_neg - 1 - slot);
+		else
+			value = streaming_value_f(stats->precision,
+						  stats->hist[0].first_bucket +
+						  slot - n_neg - 1);
+		lo = stats->range[0];
+		hi = stats->range[1];
+	} else {
+		value = streaming_value_u64(stats->precision,
+					    stats->hist[0].first_bucket +
+					    slot - n_neg - 1);
+		lo = stats->min;
+		hi = stats->max;
+	}
+
+	return value < lo ? lo : value > hi ? hi : value;
+}
+
+/* The value of rank @idx, as if the values were sorted */
+static double streaming_value(igt_stats_t *stats, unsigned int idx)
+{
+	unsigned int i, n = streaming_n_slots(stats);
+	uint64_t seen = 0;
+
+	for (i = 0; i < n; i++) {
+		seen += streaming_slot_count(stats, i);
+		if (seen > idx)
+			return streaming_slot_value(stats, i);
+	}
+
+	igt_assert(!"rank out of range");
+	return 0.;
+}
+
+/* Mean of the values of ranks @start to @end inclusive */
+static double streaming_mean(igt_stats_t *stats,
+			     unsigned int start, unsigned int end)
+{
+	unsigned int i, n = streaming_n_slots(stats);
+	uint64_t seen = 0;
+	double sum = 0.;
+
+	for (i = 0; i < n && seen <= end; i++) {
+		uint64_t lo = seen, hi = seen + streaming_slot_count(stats, i);
+
+		seen = hi;
+		if (lo < start)
+			lo = start;
+		if (hi > end + 1)
+			hi = end + 1;
+		if (hi > lo)
+			sum += (hi - lo) * streaming_slot_value(stats, i);
+	}
+
+	return sum / (end - start + 1);
+}
+
+static void streaming_convert_to_float(igt_stats_t *stats)
+{
+	uint32_t *buckets = stats->hist[0].buckets;
+	uint64_t first = stats->hist[0].first_bucket;
+	unsigned int i, n = stats->hist[0].n_buckets;
+
+	if (stats->n_values) {
+		stats->range[0] = stats->min;
+		stats->range[1] = stats->max;
+	}
+	stats->is_float = true;
+
+	stats->hist[0].buckets = NULL;
+	stats->hist[0].n_buckets = 0;
+	for (i = 0; i < n; i++) {
+		if (!buckets[i])
+			continue;
+
+		streaming_add_f(stats,
+				streaming_value_u64(stats->precision, first + i),
+				buckets[i]);
+	}
+	free(buckets);
+}
+
 /**
  * igt_stats_init:
  * @stats: An #igt_stats_t instance
@@ -137,6 +405,50 @@ void igt_stats_init_with_size(igt_stats_t *stats, unsigned int capacity)
 	stats->range[1] = -HUGE_VAL;
 }
 
+/**
+ * igt_stats_init_streaming:
+ * @stats: An #igt_stats_t instance
+ * @precision: Number of significant bits kept for each value, 1 to 16
+ *
+ * Like igt_stats_init() but the values pushed to @stats aren't kept, they
+ * are only counted in a histogram, with a memory use bounded by
+ * @precision and the range of the values rather than by their number.
+ * The histogram has 2^@precision 4 byte buckets per power of two spanned by
+ * the values, for example with 8 bits of precision, 25KiB cover any set of
+ * integers below 2^32 and 60KiB any set of floats between 1e-9 and 1e9.
+ * Zeros are only counted and negative floats have a histogram of their own
+ * over their magnitudes, so a set between -1e9 and 1e9 with no magnitude
+ * smaller than 1e-9 takes twice that. The histograms are grown as needed,
+ * doubling their size, up to 2^22 buckets each: pushing values spanning
+ * more fails the test, a lower @precision then has to be used.
+ *
+ * The mean, variance, minimum and maximum are exact. The median, the
+ * quartiles and the other order statistics use the same definitions as in
+ * the default mode but each value they are computed from is replaced by
+ * the middle of its histogram bucket, so they have a relative error of at
+ * most 2^-(@precision + 1). Integers smaller than 2^@precision are exact,
+ * so are integers smaller than 2^(@precision + 1) as each one has a bucket
+ * of its own. Derived values have the corresponding bounds, for instance
+ * the error of igt_stats_get_iqr() is at most 2^-(@precision + 1) times
+ * |q1| + |q3|.
+ *
+ * igt_stats_fini() must be called once finished with @stats.
+ */
+void igt_stats_init_streaming(igt_stats_t *stats, unsigned int precision)
+{
+	igt_assert(precision >= 1 && precision <= 16);
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->is_streaming = true;
+	stats->precision = precision;
+
+	stats->min = U64_MAX;
+	stats->max = 0;
+	stats->range[0] = HUGE_VAL;
+	stats->range[1] = -HUGE_VAL;
+}
+
 /**
  * igt_stats_fini:
  * @stats: An #igt_stats_t instance
@@ -147,6 +459,8 @@ void igt_stats_fini(igt_stats_t *stats)
 {
 	free(stats->values_u64);
 	free(stats->sorted_u64);
+	free(stats->hist[0].buckets);
+	free(stats->hist[1].buckets);
 }
 
 
@@ -212,9 +526,14 @@ void igt_stats_push(igt_stats_t *stats, uint64_t value)
 		return;
 	}
 
-	igt_stats_ensure_capacity(stats, 1);
-
-	stats->values_u64[stats->n_values++] = value;
+	if (stats->is_streaming) {
+		streaming_add(stats, 0,
+			      streaming_key_u64(stats->precision, value), 1);
+		streaming_push(stats, value);
+	} else {
+		igt_stats_ensure_capacity(stats, 1);
+		stats->values_u64[stats->n_values++] = value;
+	}
 
 	stats->mean_variance_valid = false;
 	stats->sorted_array_valid = false;
@@ -235,6 +554,15 @@ void igt_stats_push(igt_stats_t *stats, uint64_t value)
  */
 void igt_stats_push_float(igt_stats_t *stats, double value)
 {
+	if (stats->is_streaming) {
+		if (!stats->is_float)
+			streaming_convert_to_float(stats);
+
+		streaming_add_f(stats, value, 1);
+		streaming_push(stats, value);
+		goto out;
+	}
+
 	igt_stats_ensure_capacity(stats, 1);
 
 	if (!stats->is_float) {
@@ -248,6 +576,7 @@ void igt_stats_push_float(igt_stats_t *stats, double value)
 
 	stats->values_f[stats->n_values++] = value;
 
+out:
 	stats->mean_variance_valid = false;
 	stats->sorted_array_valid = false;
 
@@ -270,12 +599,118 @@ void igt_stats_push_array(igt_stats_t *stats,
 {
 	unsigned int i;
 
-	igt_stats_ensure_capacity(stats, n_values);
+	if (!stats->is_streaming)
+		igt_stats_ensure_capacity(stats, n_values);
 
 	for (i = 0; i < n_values; i++)
 		igt_stats_push(stats, values[i]);
 }
 
+static void streaming_merge(igt_stats_t *stats, igt_stats_t *other)
+{
+	uint64_t n = stats->n_values + other->n_values;
+	double delta = other->mean - stats->mean;
+	unsigned int sign, i;
+
+	if (other->is_float && !stats->is_float)
+		streaming_convert_to_float(stats);
+
+	stats->n_zeros += other->n_zeros;
+	for (sign = 0; sign < 2; sign++) {
+		const struct igt_stats_hist *hist = &other->hist[sign];
+
+		for (i = 0; i < hist->n_buckets; i++) {
+			uint64_t key = hist->first_bucket + i;
+			double value;
+
+			if (!hist->buckets[i])
+				continue;
+
+			if (stats->precision == other->precision &&
+			    stats->is_float == other->is_float) {
+				streaming_add(stats, sign, key, hist->buckets[i]);
+				continue;
+			}
+
+			if (!stats->is_float) {
+				value = streaming_value_u64(other->precision, key);
+				streaming_add(stats, 0,
+					      streaming_key_u64(stats->precision, value),
+					      hist->buckets[i]);
+				continue;
+			}
+
+			value = other->is_float ?
+				streaming_value_f(other->precision, key) :
+				streaming_value_u64(other->precision, key);
+			streaming_add_f(stats, sign ? -value : value,
+					hist->buckets[i]);
+		}
+	}
+
+	/* Chan et al.'s parallel variant of Welford's algorithm */
+	stats->m2 += other->m2 +
+		delta * delta * stats->n_values * other->n_values / n;
+	stats->mean += delta * other->n_values / n;
+	stats->n_values = n;
+
+	if (other->is_float) {
+		if (other->range[0] < stats->range[0])
+			stats->range[0] = other->range[0];
+		if (other->range[1] > stats->range[1])
+			stats->range[1] = other->range[1];
+	} else if (stats->is_float) {
+		if (other->min < stats->range[0])
+			stats->range[0] = other->min;
+		if (other->max > stats->range[1])
+			stats->range[1] = other->max;
+	} else {
+		if (other->min < stats->min)
+			stats->min = other->min;
+		if (other->max > stats->max)
+			stats->max = other->max;
+	}
+
+	stats->mean_variance_valid = false;
+	stats->sorted_array_valid = false;
+}
+
+/**
+ * igt_stats_merge:
+ * @stats: An #igt_stats_t instance
+ * @other: An #igt_stats_t instance to add to @stats
+ *
+ * Adds all the values of @other to @stats, which gives the same results as
+ * if they had been pushed to @stats directly. @other is left unchanged.
+ *
+ * Both can be in streaming mode, see igt_stats_init_streaming(), in which
+ * case the histograms are added together. With different precisions, each
+ * value of @other is taken at the middle of its histogram bucket, adding
+ * the error of both. An @stats not in streaming mode can't take the values
+ * of an @other in streaming mode as they are not kept.
+ */
+void igt_stats_merge(igt_stats_t *stats, igt_stats_t *other)
+{
+	unsigned int i;
+
+	if (!other->n_values)
+		return;
+
+	if (other->is_streaming) {
+		igt_assert(stats->is_streaming);
+		streaming_merge(stats, other);
+		return;
+	}
+
+	if (other->is_float) {
+		for (i = 0; i < other->n_values; i++)
+			igt_stats_push_float(stats, other->values_f[i]);
+	} else {
+		igt_stats_push_array(stats,
+				     other->values_u64, other->n_values);
+	}
+}
+
 /**
  * igt_stats_get_min:
  * @stats: An #igt_stats_t instance
@@ -327,21 +762,137 @@ static int cmp_u64(const void *pa, const void *pb)
 	return 0;
 }
 
-static int cmp_f(const void *pa, const void *pb)
+/*
+ * The values are sorted and selected as integers, doubles being mapped to
+ * integers of the same order with double_to_ordered().
+ */
+static void insertion_sort_u64(uint64_t *v, unsigned int n)
 {
-	const double *a = pa, *b = pb;
+	unsigned int i, j;
 
-	if (*a < *b)
-		return -1;
-	if (*a > *b)
-		return 1;
-	return 0;
+	for (i = 1; i < n; i++) {
+		uint64_t x = v[i];
+
+		for (j = i; j > 0 && v[j - 1] > x; j--)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
 }
 
-static void igt_stats_ensure_sorted_values(igt_stats_t *stats)
+/* LSD radix sort on bytes, skipping the bytes all values share */
+static void radix_sort_u64(uint64_t *v, unsigned int n)
 {
-	if (stats->sorted_array_valid)
+	unsigned int count[8][256] = {};
+	uint64_t *tmp, *src = v, *dst;
+	unsigned int i, b;
+
+	if (n < 64) {
+		insertion_sort_u64(v, n);
 		return;
+	}
+
+	tmp = malloc(sizeof(*tmp) * n);
+	if (!tmp) {
+		qsort(v, n, sizeof(*v), cmp_u64);
+		return;
+	}
+	dst = tmp;
+
+	for (i = 0; i < n; i++)
+		for (b = 0; b < 8; b++)
+			count[b][(v[i] >> (8 * b)) & 0xff]++;
+
+	for (b = 0; b < 8; b++) {
+		unsigned int offset = 0, *c = count[b];
+		uint64_t *swap;
+
+		if (c[(v[0] >> (8 * b)) & 0xff] == n)
+			continue;
+
+		for (i = 0; i < 256; i++) {
+			unsigned int tmp_count = c[i];
+
+			c[i] = offset;
+			offset += tmp_count;
+		}
+
+		for (i = 0; i < n; i++)
+			dst[c[(src[i] >> (8 * b)) & 0xff]++] = src[i];
+
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if (src != v)
+		memcpy(v, src, sizeof(*v) * n);
+	free(tmp);
+}
+
+/*
+ * Moves the values of the given (sorted) ranks of v[lo, hi) in place,
+ * with smaller values before and larger ones after each of them, using
+ * quickselect with a three way partition around a median of three. Past
+ * a depth of about 2 log2(n) we give up on partitioning and sort.
+ */
+static void multi_select_u64(uint64_t *v, unsigned int lo, unsigned int hi,
+			     const unsigned int *ranks, unsigned int n_ranks,
+			     unsigned int depth)
+{
+	while (n_ranks) {
+		unsigned int lt, gt, i, n_lower;
+		uint64_t a, b, c, pivot;
+
+		if (hi - lo <= 16) {
+			insertion_sort_u64(v + lo, hi - lo);
+			return;
+		}
+
+		if (depth-- == 0) {
+			radix_sort_u64(v + lo, hi - lo);
+			return;
+		}
+
+		a = v[lo];
+		b = v[lo + (hi - lo) / 2];
+		c = v[hi - 1];
+		pivot = a < b ? (b < c ? b : a < c ? c : a) :
+				(a < c ? a : b < c ? c : b);
+
+		/* [lo, lt) < pivot, [lt, i) == pivot, [gt, hi) > pivot */
+		lt = i = lo;
+		gt = hi;
+		while (i < gt) {
+			uint64_t x = v[i];
+
+			if (x < pivot) {
+				v[i++] = v[lt];
+				v[lt++] = x;
+			} else if (x > pivot) {
+				v[i] = v[--gt];
+				v[gt] = x;
+			} else {
+				i++;
+			}
+		}
+
+		for (n_lower = 0; n_lower < n_ranks && ranks[n_lower] < lt; n_lower++)
+			;
+		multi_select_u64(v, lo, lt, ranks, n_lower, depth);
+
+		ranks += n_lower;
+		n_ranks -= n_lower;
+		while (n_ranks && ranks[0] < gt) {
+			ranks++;
+			n_ranks--;
+		}
+		lo = gt;
+	}
+}
+
+static void copy_to_sorted(igt_stats_t *stats)
+{
+	unsigned int i;
 
 	if (!stats->sorted_u64) {
 		/*
@@ -355,15 +906,96 @@ static void igt_stats_ensure_sorted_values(igt_stats_t *stats)
 		igt_assert(stats->sorted_u64);
 	}
 
-	memcpy(stats->sorted_u64, stats->values_u64,
-	       sizeof(*stats->values_u64) * stats->n_values);
+	if (stats->is_float) {
+		for (i = 0; i < stats->n_values; i++)
+			stats->sorted_u64[i] = double_to_ordered(stats->values_f[i]);
+	} else {
+		memcpy(stats->sorted_u64, stats->values_u64,
+		       sizeof(*stats->values_u64) * stats->n_values);
+	}
+}
+
+static void sorted_from_ordered(igt_stats_t *stats,
+				unsigned int start, unsigned int end)
+{
+	unsigned int i;
+
+	if (stats->is_float)
+		for (i = start; i < end; i++)
+			stats->sorted_f[i] = ordered_to_double(stats->sorted_u64[i]);
+}
+
+static void igt_stats_ensure_sorted_values(igt_stats_t *stats)
+{
+	if (stats->sorted_array_valid || stats->is_streaming)
+		return;
 
-	qsort(stats->sorted_u64, stats->n_values, sizeof(*stats->values_u64),
-	      stats->is_float ? cmp_f : cmp_u64);
+	copy_to_sorted(stats);
+	radix_sort_u64(stats->sorted_u64, stats->n_values);
+	sorted_from_ordered(stats, 0, stats->n_values);
 
 	stats->sorted_array_valid = true;
 }
 
+static int cmp_rank(const void *pa, const void *pb)
+{
+	const unsigned int *a = pa, *b = pb;
+
+	return *a < *b ? -1 : *a > *b;
+}
+
+/*
+ * Makes sorted_value() valid for the given ranks, and the ranks from
+ * @sort_start to @sort_end exclusive, with a selection rather than sorting
+ * everything unless the values are already sorted. Sorts @ranks.
+ */
+static void igt_stats_select_range(igt_stats_t *stats,
+				   unsigned int *ranks, unsigned int n_ranks,
+				   unsigned int sort_start, unsigned int sort_end)
+{
+	unsigned int i, depth;
+
+	if (stats->sorted_array_valid || stats->is_streaming)
+		return;
+
+	/* Beyond a few ranks, sorting once is cheaper and helps later queries */
+	if (n_ranks > 16) {
+		igt_stats_ensure_sorted_values(stats);
+		return;
+	}
+
+	qsort(ranks, n_ranks, sizeof(*ranks), cmp_rank);
+
+	for (depth = 2, i = stats->n_values; i > 1; i >>= 1)
+		depth += 2;
+
+	copy_to_sorted(stats);
+	multi_select_u64(stats->sorted_u64, 0, stats->n_values,
+			 ranks, n_ranks, depth);
+
+	if (sort_start < sort_end) {
+		radix_sort_u64(stats->sorted_u64 + sort_start,
+			       sort_end - sort_start);
+		sorted_from_ordered(stats, sort_start, sort_end);
+	}
+
+	/* Each converted value only once */
+	for (i = 0; i < n_ranks; i++) {
+		if (i && ranks[i] == ranks[i - 1])
+			continue;
+		if (ranks[i] >= sort_start && ranks[i] < sort_end)
+			continue;
+
+		sorted_from_ordered(stats, ranks[i], ranks[i] + 1);
+	}
+}
+
+static void igt_stats_select(igt_stats_t *stats,
+			     unsigned int *ranks, unsigned int n_ranks)
+{
+	igt_stats_select_range(stats, ranks, n_ranks, 0, 0);
+}
+
 /*
  * We use Tukey's hinge for our quartiles determination.
  * ends (end, lower_end) are exclusive.
@@ -377,8 +1009,6 @@ igt_stats_get_median_internal(igt_stats_t *stats,
 	unsigned int mid, n_values = end - start;
 	double median;
 
-	igt_stats_ensure_sorted_values(stats);
-
 	/* odd number of data points */
 	if (n_values % 2 == 1) {
 		/* median is the value in the middle (actual datum) */
@@ -410,6 +1040,26 @@ igt_stats_get_median_internal(igt_stats_t *stats,
 	return median;
 }
 
+/* The ranks igt_stats_get_median_internal() reads */
+static unsigned int median_ranks(unsigned int start, unsigned int end,
+				 unsigned int *lower_end,
+				 unsigned int *upper_start,
+				 unsigned int *ranks)
+{
+	unsigned int n_values = end - start;
+	unsigned int mid = start + (n_values - 1) / 2;
+
+	ranks[0] = mid;
+	ranks[1] = mid + 1;
+
+	if (lower_end)
+		*lower_end = mid + 1;
+	if (upper_start)
+		*upper_start = n_values % 2 ? mid : mid + 1;
+
+	return n_values % 2 ? 1 : 2;
+}
+
 /**
  * igt_stats_get_quartiles:
  * @stats: An #igt_stats_t instance
@@ -424,6 +1074,7 @@ void igt_stats_get_quartiles(igt_stats_t *stats,
 			     double *q1, double *q2, double *q3)
 {
 	unsigned int lower_end, upper_start;
+	unsigned int ranks[6], n_ranks;
 	double ret;
 
 	if (stats->n_values < 3) {
@@ -436,6 +1087,13 @@ void igt_stats_get_quartiles(igt_stats_t *stats,
 		return;
 	}
 
+	n_ranks = median_ranks(0, stats->n_values,
+			       &lower_end, &upper_start, ranks);
+	n_ranks += median_ranks(0, lower_end, NULL, NULL, ranks + n_ranks);
+	n_ranks += median_ranks(upper_start, stats->n_values, NULL, NULL,
+				ranks + n_ranks);
+	igt_stats_select(stats, ranks, n_ranks);
+
 	ret = igt_stats_get_median_internal(stats, 0, stats->n_values,
 					    &lower_end, &upper_start);
 	if (q2)
@@ -475,10 +1133,92 @@ double igt_stats_get_iqr(igt_stats_t *stats)
  */
 double igt_stats_get_median(igt_stats_t *stats)
 {
+	unsigned int ranks[2], n_ranks;
+
+	n_ranks = median_ranks(0, stats->n_values, NULL, NULL, ranks);
+	igt_stats_select(stats, ranks, n_ranks);
+
 	return igt_stats_get_median_internal(stats, 0, stats->n_values,
 					     NULL, NULL);
 }
 
+static void percentile_ranks(igt_stats_t *stats, double percentile,
+			     unsigned int *ranks, double *frac)
+{
+	double h = (stats->n_values - 1) * percentile / 100.;
+
+	if (h < 0)
+		h = 0;
+	if (h > stats->n_values - 1)
+		h = stats->n_values - 1;
+
+	ranks[0] = h;
+	ranks[1] = ranks[0] + 1 < stats->n_values ? ranks[0] + 1 : ranks[0];
+	*frac = h - ranks[0];
+}
+
+/**
+ * igt_stats_get_percentiles:
+ * @stats: An #igt_stats_t instance
+ * @percentiles: (array length=n): The percentiles to compute, from 0 to 100
+ * @values: (array length=n) (out): The values of the percentiles
+ * @n: The number of percentiles
+ *
+ * Retrieves several percentiles of the @stats dataset at once. A
+ * percentile p is linearly interpolated between the two values closest
+ * to the rank (n_values - 1) * p / 100 in the sorted values, so the 50th
+ * percentile is the median returned by igt_stats_get_median(), the 0th
+ * the minimum and the 100th the maximum.
+ *
+ * Unless the values have already been sorted for another query, they are
+ * only partially ordered, with a selection algorithm, which takes linear
+ * time.
+ */
+void igt_stats_get_percentiles(igt_stats_t *stats, const double *percentiles,
+			       double *values, unsigned int n)
+{
+	unsigned int *ranks, r[2], i;
+	double f;
+
+	if (stats->n_values == 0) {
+		for (i = 0; i < n; i++)
+			values[i] = 0.;
+		return;
+	}
+
+	ranks = malloc(2 * n * sizeof(*ranks));
+	igt_assert(ranks);
+
+	for (i = 0; i < n; i++)
+		percentile_ranks(stats, percentiles[i], ranks + 2 * i, &f);
+
+	igt_stats_select(stats, ranks, 2 * n);
+	free(ranks);
+
+	for (i = 0; i < n; i++) {
+		percentile_ranks(stats, percentiles[i], r, &f);
+		values[i] = (1. - f) * sorted_value(stats, r[0]) +
+			    f * sorted_value(stats, r[1]);
+	}
+}
+
+/**
+ * igt_stats_get_percentile:
+ * @stats: An #igt_stats_t instance
+ * @percentile: The percentile, from 0 to 100
+ *
+ * Retrieves a percentile of the @stats dataset, see
+ * igt_stats_get_percentiles().
+ */
+double igt_stats_get_percentile(igt_stats_t *stats, double percentile)
+{
+	double value;
+
+	igt_stats_get_percentiles(stats, &percentile, &value, 1);
+
+	return value;
+}
+
 /*
  * Algorithm popularised by Knuth in:
  *
@@ -495,11 +1235,17 @@ static void igt_stats_knuth_mean_variance(igt_stats_t *stats)
 	if (stats->mean_variance_valid)
 		return;
 
-	for (i = 0; i < stats->n_values; i++) {
-		double delta = unsorted_value(stats, i) - mean;
+	if (stats->is_streaming) {
+		/* Already computed as the values were pushed */
+		mean = stats->mean;
+		m2 = stats->m2;
+	} else {
+		for (i = 0; i < stats->n_values; i++) {
+			double delta = unsorted_value(stats, i) - mean;
 
-		mean += delta / (i + 1);
-		m2 += delta * (unsorted_value(stats, i) - mean);
+			mean += delta / (i + 1);
+			m2 += delta * (unsorted_value(stats, i) - mean);
+		}
 	}
 
 	stats->mean = mean;
@@ -549,6 +1295,14 @@ double igt_stats_get_std_deviation(igt_stats_t *stats)
 	return sqrt(stats->variance);
 }
 
+/* Rank of the partially counted value above q3, within the values */
+static unsigned int iqm_upper_rank(igt_stats_t *stats)
+{
+	unsigned int rank = (3 * stats->n_values + 3) / 4;
+
+	return rank < stats->n_values ? rank : stats->n_values - 1;
+}
+
 /**
  * igt_stats_get_iqm:
  * @stats: An #igt_stats_t instance
@@ -566,22 +1320,34 @@ double igt_stats_get_std_deviation(igt_stats_t *stats)
 double igt_stats_get_iqm(igt_stats_t *stats)
 {
 	unsigned int q1, q3, i;
+	unsigned int ranks[4];
 	double mean;
 
-	igt_stats_ensure_sorted_values(stats);
-
 	q1 = (stats->n_values + 3) / 4;
 	q3 = 3 * stats->n_values / 4;
 
-	mean = 0;
-	for (i = 0; i <= q3 - q1; i++)
-		mean += (sorted_value(stats, q1 + i) - mean) / (i + 1);
+	/* Only the values between the quartiles need to be in order */
+	ranks[0] = q1;
+	ranks[1] = q3;
+	ranks[2] = stats->n_values / 4;
+	ranks[3] = iqm_upper_rank(stats);
+	igt_stats_select_range(stats, ranks, stats->n_values % 4 ? 4 : 2,
+			       q1, q3 + 1);
+
+	if (stats->is_streaming) {
+		mean = streaming_mean(stats, q1, q3);
+		i = q3 - q1 + 1;
+	} else {
+		mean = 0;
+		for (i = 0; i <= q3 - q1; i++)
+			mean += (sorted_value(stats, q1 + i) - mean) / (i + 1);
+	}
 
 	if (stats->n_values % 4) {
 		double rem = .5 * (stats->n_values % 4) / 4;
 
 		q1 = (stats->n_values) / 4;
-		q3 = (3 * stats->n_values + 3) / 4;
+		q3 = iqm_upper_rank(stats);
 
 		mean += rem * (sorted_value(stats, q1) - mean) / i++;
 		mean += rem * (sorted_value(stats, q3) - mean) / i++;
@@ -660,3 +1426,156 @@ double igt_mean_get_variance(struct igt_mean *m)
 	return m->sq / m->count;
 }
 
+/**
+ * igt_stats_collector_init:
+ * @c: An #igt_stats_collector instance
+ *
+ * Initializes an #igt_stats_collector, to gather samples from several
+ * threads without them contending on a shared #igt_stats_t or a lock.
+ *
+ * Each thread gets its own #igt_stats_local from
+ * igt_stats_collector_local(), the only call taking a lock, and pushes to
+ * it with igt_stats_local_push(), which only touches memory of that thread.
+ * Once the threads are done, igt_stats_collector_merge() combines all their
+ * samples into a single #igt_stats_t.
+ *
+ * |[
+ *	static void *worker(void *arg)
+ *	{
+ *		struct igt_stats_collector *c = arg;
+ *		struct igt_stats_local *local = igt_stats_collector_local(c);
+ *
+ *		while (!done)
+ *			igt_stats_local_push(local, measure());
+ *
+ *		return NULL;
+ *	}
+ * ]|
+ *
+ * igt_stats_collector_fini() must be called once finished with @c.
+ */
+void igt_stats_collector_init(struct igt_stats_collector *c)
+{
+	memset(c, 0, sizeof(*c));
+
+	pthread_mutex_init(&c->lock, NULL);
+	igt_assert(pthread_key_create(&c->key, NULL) == 0);
+}
+
+/**
+ * igt_stats_collector_init_streaming:
+ * @c: An #igt_stats_collector instance
+ * @precision: Number of significant bits kept for each value, 1 to 16
+ *
+ * Like igt_stats_collector_init() but the samples of each thread are kept
+ * in streaming mode, see igt_stats_init_streaming().
+ */
+void igt_stats_collector_init_streaming(struct igt_stats_collector *c,
+					unsigned int precision)
+{
+	igt_assert(precision >= 1 && precision <= 16);
+
+	igt_stats_collector_init(c);
+	c->precision = precision;
+}
+
+/**
+ * igt_stats_collector_fini:
+ * @c: An #igt_stats_collector instance
+ *
+ * Frees the samples of all the threads, no thread may use its
+ * #igt_stats_local any more.
+ */
+void igt_stats_collector_fini(struct igt_stats_collector *c)
+{
+	struct igt_stats_local *local, *next;
+
+	for (local = c->locals; local; local = next) {
+		next = local->next;
+		igt_stats_fini(&local->stats);
+		free(local);
+	}
+
+	pthread_key_delete(c->key);
+	pthread_mutex_destroy(&c->lock);
+}
+
+/**
+ * igt_stats_collector_local:
+ * @c: An #igt_stats_collector instance
+ *
+ * Returns: the #igt_stats_local of the calling thread, created on the first
+ * call. It stays valid, with its samples, after the thread exits, until
+ * igt_stats_collector_fini().
+ */
+struct igt_stats_local *igt_stats_collector_local(struct igt_stats_collector *c)
+{
+	struct igt_stats_local *local;
+
+	local = pthread_getspecific(c->key);
+	if (local)
+		return local;
+
+	local = malloc(sizeof(*local));
+	igt_assert(local);
+	local->count = 0;
+	local->is_float = false;
+	if (c->precision)
+		igt_stats_init_streaming(&local->stats, c->precision);
+	else
+		igt_stats_init(&local->stats);
+
+	pthread_mutex_lock(&c->lock);
+	local->next = c->locals;
+	c->locals = local;
+	pthread_mutex_unlock(&c->lock);
+
+	pthread_setspecific(c->key, local);
+
+	return local;
+}
+
+/**
+ * igt_stats_local_flush:
+ * @local: An #igt_stats_local instance
+ *
+ * Moves the values batched by igt_stats_local_push() to the #igt_stats_t of
+ * @local. Called by the thread owning @local, or once it is done pushing.
+ */
+void igt_stats_local_flush(struct igt_stats_local *local)
+{
+	unsigned int i;
+
+	if (local->is_float) {
+		for (i = 0; i < local->count; i++)
+			igt_stats_push_float(&local->stats, local->batch.f[i]);
+	} else {
+		igt_stats_push_array(&local->stats,
+				     local->batch.u64, local->count);
+	}
+
+	local->count = 0;
+}
+
+/**
+ * igt_stats_collector_merge:
+ * @c: An #igt_stats_collector instance
+ * @stats: An #igt_stats_t instance
+ *
+ * Adds the samples of all threads to @stats with igt_stats_merge(). The
+ * threads must not be pushing any more. A streaming collector needs a
+ * @stats in streaming mode, exact results are had by using the same
+ * precision.
+ */
+void igt_stats_collector_merge(struct igt_stats_collector *c,
+			       igt_stats_t *stats)
+{
+	struct igt_stats_local *local;
+
+	pthread_mutex_lock(&c->lock);
+	for (local = c->locals; local; local = local->next) {
+		igt_stats_local_flush(local);
+		igt_stats_merge(stats, &local->stats);
+	}
+	pthread_mutex_unlock(&c->lock);
+}
@@ -28,6 +28,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <math.h>
+#include <pthread.h>
 
 /**
  * igt_stats_t:
@@ -35,6 +36,9 @@
  * @is_float: Whether @values_f or @values_u64 is valid
  * @values_f: An array containing pushed float values
  * @n_values: The number of pushed values
+ *
+ * When initialized with igt_stats_init_streaming(), the pushed values aren't
+ * kept and @values_u64/@values_f are NULL.
  */
 typedef struct {
 	unsigned int n_values;
@@ -49,6 +53,7 @@ typedef struct {
 	unsigned int is_population  : 1;
 	unsigned int mean_variance_valid : 1;
 	unsigned int sorted_array_valid : 1;
+	unsigned int is_streaming : 1;
 
 	uint64_t min, max;
 	double range[2];
@@ -58,10 +63,24 @@ typedef struct {
 		uint64_t *sorted_u64;
 		double *sorted_f;
 	};
+
+	/*
+	 * streaming mode, counts of log-linear histograms of the magnitudes
+	 * of the positive values, [0], and of the negative ones, [1]
+	 */
+	unsigned int precision;
+	unsigned int n_zeros;
+	struct igt_stats_hist {
+		unsigned int n_buckets;
+		uint64_t first_bucket;
+		uint32_t *buckets;
+	} hist[2];
+	double m2;
 } igt_stats_t;
 
 void igt_stats_init(igt_stats_t *stats);
 void igt_stats_init_with_size(igt_stats_t *stats, unsigned int capacity);
+void igt_stats_init_streaming(igt_stats_t *stats, unsigned int precision);
 void igt_stats_fini(igt_stats_t *stats);
 bool igt_stats_is_population(igt_stats_t *stats);
 void igt_stats_set_population(igt_stats_t *stats, bool full_population);
@@ -69,6 +88,7 @@ void igt_stats_push(igt_stats_t *stats, uint64_t value);
 void igt_stats_push_float(igt_stats_t *stats, double value);
 void igt_stats_push_array(igt_stats_t *stats,
 			  const uint64_t *values, unsigned int n_values);
+void igt_stats_merge(igt_stats_t *stats, igt_stats_t *other);
 uint64_t igt_stats_get_min(igt_stats_t *stats);
 uint64_t igt_stats_get_max(igt_stats_t *stats);
 uint64_t igt_stats_get_range(igt_stats_t *stats);
@@ -79,6 +99,9 @@ double igt_stats_get_iqm(igt_stats_t *stats);
 double igt_stats_get_mean(igt_stats_t *stats);
 double igt_stats_get_trimean(igt_stats_t *stats);
 double igt_stats_get_median(igt_stats_t *stats);
+double igt_stats_get_percentile(igt_stats_t *stats, double percentile);
+void igt_stats_get_percentiles(igt_stats_t *stats, const double *percentiles,
+			       double *values, unsigned int n);
 double igt_stats_get_variance(igt_stats_t *stats);
 double igt_stats_get_std_deviation(igt_stats_t *stats);
 
@@ -100,4 +123,102 @@ void igt_mean_add(struct igt_mean *m, double v);
 double igt_mean_get(struct igt_mean *m);
 double igt_mean_get_variance(struct igt_mean *m);
 
+#define IGT_STATS_LOCAL_BATCH 256
+
+/**
+ * igt_stats_local:
+ *
+ * The samples of one thread for an #igt_stats_collector, obtained with
+ * igt_stats_collector_local(). Only that thread may push to it.
+ */
+struct igt_stats_local {
+	/*< private >*/
+	struct igt_stats_local *next;
+	igt_stats_t stats;
+	unsigned int count;
+	bool is_float;
+	union {
+		uint64_t u64[IGT_STATS_LOCAL_BATCH];
+		double f[IGT_STATS_LOCAL_BATCH];
+	} batch;
+};
+
+/**
+ * igt_stats_collector:
+ *
+ * Collects samples from several threads, each in its own #igt_stats_local,
+ * to be merged into one #igt_stats_t with igt_stats_collector_merge().
+ */
+struct igt_stats_collector {
+	/*< private >*/
+	pthread_mutex_t lock;
+	pthread_key_t key;
+	struct igt_stats_local *locals;
+	unsigned int precision;
+};
+
+void igt_stats_collector_init(struct igt_stats_collector *c);
+void igt_stats_collector_init_streaming(struct igt_stats_collector *c,
+					unsigned int precision);
+void igt_stats_collector_fini(struct igt_stats_collector *c);
+struct igt_stats_local *igt_stats_collector_local(struct igt_stats_collector *c);
+void igt_stats_collector_merge(struct igt_stats_collector *c,
+			       igt_stats_t *stats);
+void igt_stats_local_flush(struct igt_stats_local *local);
+
+/**
+ * igt_stats_local_push:
+ * @local: The calling thread's #igt_stats_local
+ * @value: An integer value
+ *
+ * Adds a new value to the samples of the calling thread. This doesn't
+ * synchronize with any other thread.
+ */
+static inline void igt_stats_local_push(struct igt_stats_local *local,
+					uint64_t value)
+{
+	if (local->is_float) {
+		igt_stats_local_flush(local);
+		local->is_float = false;
+	}
+
+	local->batch.u64[local->count++] = value;
+	if (local->count == IGT_STATS_LOCAL_BATCH)
+		igt_stats_local_flush(local);
+}
+
+/**
+ * igt_stats_local_push_float:
+ * @local: The calling thread's #igt_stats_local
+ * @value: A floating point value
+ *
+ * Like igt_stats_local_push() for floating point values.
+ */
+static inline void igt_stats_local_push_float(struct igt_stats_local *local,
+					      double value)
+{
+	if (!local->is_float) {
+		igt_stats_local_flush(local);
+		local->is_float = true;
+	}
+
+	local->batch.f[local->count++] = value;
+	if (local->count == IGT_STATS_LOCAL_BATCH)
+		igt_stats_local_flush(local);
+}
+
+/**
+ * igt_stats_collector_push:
+ * @c: An #igt_stats_collector
+ * @value: An integer value
+ *
+ * Adds a new value to the samples of the calling thread, for callers not
+ * keeping their igt_stats_collector_local().
+ */
+static inline void igt_stats_collector_push(struct igt_stats_collector *c,
+					    uint64_t value)
+{
+	igt_stats_local_push(igt_stats_collector_local(c), value);
+}
+
 #endif /* __IGT_STATS_H__ */
@@ -0,0 +1,255 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <i915_drm.h>
+
+#include "igt_core.h"
+#include "igt_aux.h"
+#include "igt_tiling.h"
+
+/**
+ * SECTION:igt_tiling
+ * @short_description: CPU tiling and detiling of i915 buffers
+ * @title: Tiling
+ * @include: igt_tiling.h
+ *
+ * Copies rectangles between linear memory and a CPU mapping of an X or Y
+ * tiled buffer object. Instead of computing the tiled address of every
+ * pixel, the address is computed once per span of bytes which stay
+ * contiguous in the tiled layout: a 512 byte tile row for X tiling, a 16
+ * byte OWord for Y tiling, and at most 64 bytes with bit 6 swizzling.
+ */
+
+#define TILE_SIZE 4096
+
+/**
+ * tiling_layout:
+ * @width_shift: log2 of the tile width in bytes
+ * @height_shift: log2 of the tile height in rows
+ * @span_shift: log2 of the bytes of a row contiguous in a tile, the rest of
+ *              the tile row is in the following columns of @span bytes
+ */
+struct tiling_layout {
+	int width_shift;
+	int height_shift;
+	int span_shift;
+};
+
+static const struct tiling_layout tiling_x = { 9, 3, 9 };
+static const struct tiling_layout tiling_y = { 7, 5, 4 };
+
+/*
+ * The swizzling flips bit 6 of the address, here 64 or 0, depending on the
+ * bits 9 to 11 of the address, the index in these tables.
+ */
+static const uint8_t swizzle_9[8] = { 0, 64, 0, 64, 0, 64, 0, 64 };
+static const uint8_t swizzle_9_10[8] = { 0, 64, 64, 0, 0, 64, 64, 0 };
+static const uint8_t swizzle_9_11[8] = { 0, 64, 0, 64, 64, 0, 64, 0 };
+static const uint8_t swizzle_9_10_11[8] = { 0, 64, 64, 0, 64, 0, 0, 64 };
+
+static const struct tiling_layout *get_layout(uint32_t tiling)
+{
+	switch (tiling) {
+	case I915_TILING_X:
+		return &tiling_x;
+	case I915_TILING_Y:
+		return &tiling_y;
+	default:
+		return NULL;
+	}
+}
+
+static const uint8_t *get_swizzle_table(uint32_t swizzle)
+{
+	switch (swizzle) {
+	case I915_BIT_6_SWIZZLE_9:
+		return swizzle_9;
+	case I915_BIT_6_SWIZZLE_9_10:
+		return swizzle_9_10;
+	case I915_BIT_6_SWIZZLE_9_11:
+		return swizzle_9_11;
+	case I915_BIT_6_SWIZZLE_9_10_11:
+		return swizzle_9_10_11;
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * igt_tiling_supported:
+ * @tiling: the I915_TILING_* mode of the buffer
+ * @swizzle: the I915_BIT_6_SWIZZLE_* mode of the buffer
+ *
+ * Returns: whether igt_tiling_from_linear() and igt_tiling_to_linear() can
+ * handle buffers with @tiling and @swizzle. The swizzling modes depending on
+ * the physical address aren't supported.
+ */
+bool igt_tiling_supported(uint32_t tiling, uint32_t swizzle)
+{
+	if (tiling != I915_TILING_NONE && !get_layout(tiling))
+		return false;
+
+	return swizzle == I915_BIT_6_SWIZZLE_NONE || get_swizzle_table(swizzle);
+}
+
+static void copy_span(uint8_t *dst, const uint8_t *src, int len)
+{
+	/* Constant sizes for the usual spans, copied with vector moves */
+	if (len == 16)
+		memcpy(dst, src, 16);
+	else if (len == 64)
+		memcpy(dst, src, 64);
+	else
+		memcpy(dst, src, len);
+}
+
+static void copy_rect(uint8_t *linear, uint32_t linear_stride,
+		      uint8_t *tiled, uint32_t tiled_stride,
+		      uint32_t tiling, uint32_t swizzle,
+		      int x, int y, int width, int height, bool to_tiled)
+{
+	const struct tiling_layout *l = get_layout(tiling);
+	const uint8_t *table = get_swizzle_table(swizzle);
+	int tiles_per_row, span, row, rows, n, i, r;
+	uint32_t tile_mask, row_mask, span_mask, base, start, off;
+
+	igt_assert_f(igt_tiling_supported(tiling, swizzle),
+		     "tiling %u, swizzle %u\n", tiling, swizzle);
+
+	if (!l) {
+		for (row = 0; row < height; row++) {
+			uint8_t *t = tiled + (uint64_t)(y + row) * tiled_stride + x;
+			uint8_t *lin = linear + (uint64_t)row * linear_stride;
+
+			if (to_tiled)
+				memcpy(t, lin, width);
+			else
+				memcpy(lin, t, width);
+		}
+		return;
+	}
+
+	tiles_per_row = tiled_stride >> l->width_shift;
+	tile_mask = (1 << l->width_shift) - 1;
+	row_mask = (1 << l->height_shift) - 1;
+	span = 1 << l->span_shift;
+	span_mask = span - 1;
+
+	/*
+	 * A row of tiles at a time, copying each span for all the rows before
+	 * moving to the next one, so that the writes to a Y tile are
+	 * sequential.
+	 */
+	for (row = y; row < y + height; row += rows) {
+		rows = min(y + height, (row | row_mask) + 1) - row;
+
+		/* Offset of the first tile of the row, and of the row in it */
+		base = (uint32_t)(row >> l->height_shift) * tiles_per_row *
+			TILE_SIZE;
+		base += (row & row_mask) << l->span_shift;
+
+		for (i = 0; i < width; i += n) {
+			int pos = x + i;
+			uint8_t *lin = linear + i;
+
+			start = base + (pos >> l->width_shift) * TILE_SIZE +
+				(((pos & tile_mask) >> l->span_shift) <<
+				 (l->span_shift + l->height_shift)) +
+				(pos & span_mask);
+			n = span - (pos & span_mask);
+
+			/* The swizzle applies to 64 byte blocks */
+			if (table)
+				n = min(n, 64 - (start & 63));
+
+			n = min(n, width - i);
+
+			for (r = 0; r < rows; r++, lin += linear_stride) {
+				off = start + (r << l->span_shift);
+				if (table)
+					off ^= table[(off >> 9) & 7];
+
+				if (to_tiled)
+					copy_span(tiled + off, lin, n);
+				else
+					copy_span(lin, tiled + off, n);
+			}
+		}
+
+		linear += rows * linear_stride;
+	}
+}
+
+/**
+ * igt_tiling_from_linear:
+ * @tiled: CPU mapping of the tiled buffer
+ * @tiled_stride: stride of the tiled buffer in bytes, a multiple of the tile
+ *                width
+ * @tiling: the I915_TILING_* mode of the buffer
+ * @swizzle: the I915_BIT_6_SWIZZLE_* mode of the buffer
+ * @x: first byte of the rectangle in each row of the tiled buffer
+ * @y: first row of the rectangle
+ * @width: width of the rectangle in bytes
+ * @height: height of the rectangle in rows
+ * @linear: the first byte to copy to the rectangle
+ * @linear_stride: stride of @linear in bytes, 0 to copy the same row to all
+ *                 the rows of the rectangle
+ *
+ * Copies @linear to a rectangle of the tiled buffer. Fails the current test
+ * if @tiling and @swizzle aren't supported, see igt_tiling_supported().
+ */
+void igt_tiling_from_linear(void *tiled, uint32_t tiled_stride,
+			    uint32_t tiling, uint32_t swizzle,
+			    int x, int y, int width, int height,
+			    const void *linear, uint32_t linear_stride)
+{
+	copy_rect((uint8_t *)linear, linear_stride, tiled, tiled_stride,
+		  tiling, swizzle, x, y, width, height, true);
+}
+
+/**
+ * igt_tiling_to_linear:
+ * @linear: where to copy the rectangle to
+ * @linear_stride: stride of @linear in bytes
+ * @tiled: CPU mapping of the tiled buffer
+ * @tiled_stride: stride of the tiled buffer in bytes, a multiple of the tile
+ *                width
+ * @tiling: the I915_TILING_* mode of the buffer
+ * @swizzle: the I915_BIT_6_SWIZZLE_* mode of the buffer
+ * @x: first byte of the rectangle in each row of the tiled buffer
+ * @y: first row of the rectangle
+ * @width: width of the rectangle in bytes
+ * @height: height of the rectangle in rows
+ *
+ * Copies a rectangle of the tiled buffer to @linear. Fails the current test
+ * if @tiling and @swizzle aren't supported, see igt_tiling_supported().
+ */
+void igt_tiling_to_linear(void *linear, uint32_t linear_stride,
+			  const void *tiled, uint32_t tiled_stride,
+			  uint32_t tiling, uint32_t swizzle,
+			  int x, int y, int width, int height)
+{
+	copy_rect(linear, linear_stride, (uint8_t *)tiled, tiled_stride,
+		  tiling, swizzle, x, y, width, height, false);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_TILING_H__
+#define __IGT_TILING_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * CPU copies between linear memory and i915 X/Y tiled buffer objects, as
+ * laid out from gen4 on, including bit 6 swizzling. Coordinates and widths
+ * are in bytes, so the copies work for any bpp.
+ */
+
+bool igt_tiling_supported(uint32_t tiling, uint32_t swizzle);
+void igt_tiling_from_linear(void *tiled, uint32_t tiled_stride,
+			    uint32_t tiling, uint32_t swizzle,
+			    int x, int y, int width, int height,
+			    const void *linear, uint32_t linear_stride);
+void igt_tiling_to_linear(void *linear, uint32_t linear_stride,
+			  const void *tiled, uint32_t tiled_stride,
+			  uint32_t tiling, uint32_t swizzle,
+			  int x, int y, int width, int height);
+
+#endif /* __IGT_TILING_H__ */
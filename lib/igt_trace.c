@@ -0,0 +1,508 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_trace.h"
+
+/**
+ * SECTION:igt_trace
+ * @short_description: Binary event tracing
+ * @title: Trace
+ * @include: igt_trace.h
+ *
+ * Records timestamped begin, end and counter events from the library and
+ * the tests into a ring per thread, to see where the time goes in a test
+ * without strace or perf.
+ *
+ * Running a test with IGT_TRACE=<file> in the environment traces it and
+ * writes the events to <file> at exit, forked children writing to
+ * <file>.<pid>. The files are converted to the Chrome trace event format
+ * with:
+ *
+ * |[
+ *	igt_trace_to_json <file> <file>.* > trace.json
+ * ]|
+ *
+ * Trace points in the library cover the i915 ioctl wrappers, igt_fork()
+ * and igt_waitchildren(), framebuffer creation and CRC reads.
+ */
+
+/* Events kept per thread, older ones are overwritten */
+#define TRACE_EVENTS (1 << 16)
+
+/* Exited threads whose events are kept until the trace is written */
+#define MAX_RETIRED 16
+
+struct trace_record {
+	uint64_t timestamp;
+	uint64_t value;
+	const char *name;
+	enum igt_trace_type type;
+};
+
+/*
+ * Only written by its thread, except for start which is moved past the
+ * events already written out. Event t is in records[t % size], size being
+ * TRACE_EVENTS while the thread runs. When it exits, the buffer is
+ * replaced by a retired one holding only the events not written out yet,
+ * and the oldest retired buffers are freed past MAX_RETIRED.
+ */
+struct trace_buffer {
+	struct trace_buffer *next;
+	uint32_t tid;
+	bool retired;
+	uint64_t start, count;
+	uint64_t size;
+	struct trace_record records[];
+};
+
+bool igt_trace_enabled;
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+static struct trace_buffer *trace_buffers;
+static __thread struct trace_buffer *trace_local;
+static char *trace_path;
+static bool trace_child;
+
+/* Oldest first, events [begin, end) of @buf which can still be read */
+static uint64_t trace_buffer_begin(const struct trace_buffer *buf,
+				   uint64_t end)
+{
+	return end - buf->start > buf->size ? end - buf->size : buf->start;
+}
+
+static void trace_buffer_retire(void *arg)
+{
+	struct trace_buffer *buf = arg, *old, **p;
+	uint64_t begin, t;
+	int retired = 0;
+
+	/* Destructors of other keys may still trace from a new buffer */
+	trace_local = NULL;
+
+	pthread_mutex_lock(&trace_mutex);
+
+	begin = trace_buffer_begin(buf, buf->count);
+	old = buf;
+	buf = NULL;
+
+	/* Without the events written out or overwritten */
+	if (old->count > begin)
+		buf = malloc(sizeof(*buf) +
+			     (old->count - begin) * sizeof(buf->records[0]));
+	if (buf) {
+		buf->tid = old->tid;
+		buf->retired = true;
+		buf->start = old->start;
+		buf->count = old->count;
+		buf->size = old->count - begin;
+		for (t = begin; t < old->count; t++)
+			buf->records[t % buf->size] =
+				old->records[t % old->size];
+	}
+
+	for (p = &trace_buffers; *p != old; p = &(*p)->next)
+		;
+	if (buf) {
+		buf->next = old->next;
+		*p = buf;
+	} else {
+		*p = old->next;
+	}
+	free(old);
+
+	/* Newest first, only the most recent exited threads are kept */
+	for (p = &trace_buffers; *p; ) {
+		if ((*p)->retired && ++retired > MAX_RETIRED) {
+			struct trace_buffer *dead = *p;
+
+			*p = dead->next;
+			free(dead);
+		} else {
+			p = &(*p)->next;
+		}
+	}
+
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+static void trace_key_init(void)
+{
+	pthread_key_create(&trace_key, trace_buffer_retire);
+}
+
+static struct trace_buffer *trace_buffer_create(void)
+{
+	struct trace_buffer *buf;
+
+	pthread_once(&trace_key_once, trace_key_init);
+
+	buf = malloc(sizeof(*buf) + TRACE_EVENTS * sizeof(buf->records[0]));
+	if (!buf)
+		return NULL;
+
+	buf->tid = syscall(SYS_gettid);
+	buf->retired = false;
+	buf->start = buf->count = 0;
+	buf->size = TRACE_EVENTS;
+
+	pthread_mutex_lock(&trace_mutex);
+	buf->next = trace_buffers;
+	trace_buffers = buf;
+	pthread_mutex_unlock(&trace_mutex);
+
+	/* Retired when the thread exits */
+	pthread_setspecific(trace_key, buf);
+
+	return buf;
+}
+
+void __igt_trace(enum igt_trace_type type, const char *name, uint64_t value)
+{
+	struct trace_buffer *buf = trace_local;
+	struct trace_record *rec;
+	struct timespec ts;
+	int err = errno;
+
+	if (!buf) {
+		buf = trace_local = trace_buffer_create();
+		if (!buf)
+			goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	/*
+	 * The record is overwritten after the previous event was published,
+	 * write_trace() then sees the count move past it.
+	 */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	rec = &buf->records[buf->count % TRACE_EVENTS];
+	rec->timestamp = ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+	rec->value = value;
+	rec->name = name;
+	rec->type = type;
+
+	__atomic_store_n(&buf->count, buf->count + 1, __ATOMIC_RELEASE);
+
+out:
+	/* Trace points sit between ioctls and their callers */
+	errno = err;
+}
+
+static void trace_prepare_fork(void)
+{
+	pthread_mutex_lock(&trace_mutex);
+}
+
+static void trace_parent_fork(void)
+{
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+static void trace_child_fork(void)
+{
+	struct trace_buffer *buf;
+
+	/* The child only traces what happens after the fork */
+	for (buf = trace_buffers; buf; buf = buf->next)
+		buf->start = buf->count;
+
+	if (trace_local)
+		trace_local->tid = syscall(SYS_gettid);
+
+	trace_child = true;
+
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+static void trace_exit(void)
+{
+	igt_trace_stop();
+}
+
+static void trace_init(void)
+{
+	const char *path = getenv("IGT_TRACE");
+
+	if (path && *path)
+		igt_trace_start(path);
+}
+
+/**
+ * igt_trace_init:
+ *
+ * Enables tracing if IGT_TRACE is set in the environment, once. This is
+ * done when the library is loaded, users only need to call it from their
+ * own constructors to check igt_trace_enabled there.
+ */
+void igt_trace_init(void)
+{
+	pthread_once(&trace_once, trace_init);
+}
+
+igt_constructor {
+	igt_trace_init();
+}
+
+/**
+ * igt_trace_start:
+ * @path: the file to write the trace to
+ *
+ * Starts tracing, until igt_trace_stop() or the exit of the process. Forked
+ * children write their trace to @path.<pid>.
+ */
+void igt_trace_start(const char *path)
+{
+	static bool registered;
+
+	pthread_mutex_lock(&trace_mutex);
+
+	free(trace_path);
+	trace_path = strdup(path);
+
+	if (!registered) {
+		pthread_atfork(trace_prepare_fork, trace_parent_fork,
+			       trace_child_fork);
+		atexit(trace_exit);
+		registered = true;
+	}
+
+	pthread_mutex_unlock(&trace_mutex);
+
+	igt_trace_enabled = trace_path != NULL;
+}
+
+static uint32_t name_id(const char ***names, uint32_t *num_names,
+			const char *name)
+{
+	uint32_t i;
+
+	/* Few names, but many events in a row with the same one */
+	for (i = *num_names; i--; )
+		if ((*names)[i] == name)
+			return i;
+
+	if (!(*num_names & (*num_names - 1))) {
+		*names = realloc(*names, sizeof(**names) *
+				 (*num_names ? 2 * *num_names : 16));
+		igt_assert(*names);
+	}
+
+	(*names)[*num_names] = name;
+	return (*num_names)++;
+}
+
+struct trace_snapshot {
+	uint64_t begin, end;
+	struct trace_record *records;
+};
+
+/*
+ * Copies the events of @buf recorded up to now, which its thread may be
+ * overwriting meanwhile. Event t may have been overwritten if the count
+ * has since reached t + size, those are dropped. Nothing is recording
+ * into the buffers of the caller and of the exited threads.
+ */
+static void trace_snapshot(struct trace_snapshot *s,
+			   const struct trace_buffer *buf)
+{
+	uint64_t t, end;
+
+	s->end = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+	s->begin = trace_buffer_begin(buf, s->end);
+
+	s->records = malloc((s->end - s->begin) * sizeof(*s->records) + 1);
+	igt_assert(s->records);
+	for (t = s->begin; t < s->end; t++)
+		s->records[t - s->begin] = buf->records[t % buf->size];
+
+	if (buf == trace_local || buf->retired)
+		return;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	end = __atomic_load_n(&buf->count, __ATOMIC_RELAXED);
+
+	if (end - s->begin >= buf->size) {
+		uint64_t valid = end - buf->size + 1;
+
+		if (valid > s->end)
+			valid = s->end;
+		memmove(s->records, s->records + (valid - s->begin),
+			(s->end - valid) * sizeof(*s->records));
+		s->begin = valid;
+	}
+}
+
+static int write_trace(FILE *file)
+{
+	struct igt_trace_header header = {
+		.magic = IGT_TRACE_MAGIC,
+		.version = IGT_TRACE_VERSION,
+		.pid = getpid(),
+	};
+	struct trace_snapshot *snap;
+	struct trace_buffer *buf;
+	const char **names = NULL;
+	uint32_t i;
+	int n;
+
+	for (buf = trace_buffers, n = 0; buf; buf = buf->next)
+		n++;
+
+	snap = calloc(n + 1, sizeof(*snap));
+	igt_assert(snap);
+
+	/* Other threads may go on, only the events up to now are written */
+	for (buf = trace_buffers, n = 0; buf; buf = buf->next, n++) {
+		struct trace_snapshot *s = &snap[n];
+		uint64_t t;
+
+		trace_snapshot(s, buf);
+
+		for (t = 0; t < s->end - s->begin; t++)
+			name_id(&names, &header.num_names, s->records[t].name);
+
+		if (s->end > s->begin)
+			header.num_threads++;
+	}
+
+	fwrite(&header, sizeof(header), 1, file);
+
+	for (i = 0; i < header.num_names; i++) {
+		uint32_t len = strlen(names[i]);
+
+		fwrite(&len, sizeof(len), 1, file);
+		fwrite(names[i], len, 1, file);
+	}
+
+	for (buf = trace_buffers, n = 0; buf; buf = buf->next, n++) {
+		struct trace_snapshot *s = &snap[n];
+		struct igt_trace_thread thread = {
+			.tid = buf->tid,
+			.num_events = s->end - s->begin,
+			.dropped = s->begin - buf->start,
+		};
+		uint64_t t;
+
+		buf->start = s->end;
+		if (!thread.num_events) {
+			free(s->records);
+			continue;
+		}
+
+		fwrite(&thread, sizeof(thread), 1, file);
+
+		for (t = 0; t < s->end - s->begin; t++) {
+			const struct trace_record *rec = &s->records[t];
+			struct igt_trace_event ev = {
+				.timestamp = rec->timestamp,
+				.value = rec->value,
+				.name = name_id(&names, &header.num_names,
+						rec->name),
+				.type = rec->type,
+			};
+
+			fwrite(&ev, sizeof(ev), 1, file);
+		}
+
+		free(s->records);
+	}
+
+	free(names);
+	free(snap);
+
+	return ferror(file) ? -EIO : 0;
+}
+
+/**
+ * igt_trace_stop:
+ *
+ * Stops tracing and writes the events recorded since igt_trace_start() to
+ * the trace file, including those of the last threads which exited. Events
+ * recorded by other threads while the trace is written may be missing from
+ * it, the ones overwritten while being copied being counted as dropped.
+ *
+ * Returns: 0 on success, a negative error code if the trace couldn't be
+ * written.
+ */
+int igt_trace_stop(void)
+{
+	char *path = NULL;
+	FILE *file;
+	int ret;
+
+	pthread_mutex_lock(&trace_mutex);
+
+	if (!trace_path) {
+		pthread_mutex_unlock(&trace_mutex);
+		return 0;
+	}
+
+	igt_trace_enabled = false;
+
+	if (trace_child)
+		ret = asprintf(&path, "%s.%d", trace_path, getpid());
+	else
+		ret = asprintf(&path, "%s", trace_path);
+	free(trace_path);
+	trace_path = NULL;
+
+	if (ret < 0) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	file = fopen(path, "w");
+	if (!file) {
+		ret = -errno;
+		goto out;
+	}
+
+	ret = write_trace(file);
+	if (fclose(file) && !ret)
+		ret = -errno;
+
+out:
+	pthread_mutex_unlock(&trace_mutex);
+
+	if (ret)
+		igt_warn("Failed to write the trace to %s: %s\n",
+			 path, strerror(-ret));
+	free(path);
+
+	return ret;
+}
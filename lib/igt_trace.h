@@ -0,0 +1,128 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_TRACE_H__
+#define __IGT_TRACE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Binary tracing of where the time goes in tests and benchmarks. Events are
+ * recorded with a CLOCK_MONOTONIC timestamp into a ring per thread, without
+ * locking nor allocation, and written out when the process exits. Setting
+ * IGT_TRACE=<file> enables tracing, otherwise each trace point costs a single
+ * test of igt_trace_enabled.
+ *
+ * tools/igt_trace_to_json converts the files to the Chrome trace event
+ * format, which chrome://tracing and Perfetto open.
+ */
+
+/**
+ * igt_trace_type:
+ * @IGT_TRACE_BEGIN: start of a slice, the value is attached to the slice
+ * @IGT_TRACE_END: end of the innermost slice of the thread
+ * @IGT_TRACE_COUNTER: new value of a counter
+ * @IGT_TRACE_INSTANT: a point in time, with a value
+ */
+enum igt_trace_type {
+	IGT_TRACE_BEGIN,
+	IGT_TRACE_END,
+	IGT_TRACE_COUNTER,
+	IGT_TRACE_INSTANT,
+};
+
+extern bool igt_trace_enabled;
+
+void igt_trace_init(void);
+void igt_trace_start(const char *path);
+int igt_trace_stop(void);
+
+void __igt_trace(enum igt_trace_type type, const char *name, uint64_t value);
+
+/**
+ * igt_trace:
+ * @type: the #igt_trace_type of the event
+ * @name: the name of the event, which must stay valid until the trace is
+ *        written, such as a string literal
+ * @value: value attached to the event
+ *
+ * Records an event in the trace of the calling thread, if tracing is
+ * enabled.
+ */
+static inline void igt_trace(enum igt_trace_type type, const char *name,
+			     uint64_t value)
+{
+	if (__builtin_expect(igt_trace_enabled, 0))
+		__igt_trace(type, name, value);
+}
+
+#define igt_trace_begin(name) igt_trace(IGT_TRACE_BEGIN, name, 0)
+#define igt_trace_end(name) igt_trace(IGT_TRACE_END, name, 0)
+#define igt_trace_counter(name, value) igt_trace(IGT_TRACE_COUNTER, name, value)
+
+/*
+ * The trace file, in host byte order: an igt_trace_header, header->num_names
+ * names as a uint32_t length followed by that many bytes, the index of a name
+ * in this list being its id, then header->num_threads times an
+ * igt_trace_thread followed by its events.
+ */
+
+#define IGT_TRACE_MAGIC "IGTTRACE"
+#define IGT_TRACE_VERSION 1
+
+struct igt_trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t pid;
+	uint32_t num_names;
+	uint32_t num_threads;
+};
+
+/**
+ * igt_trace_thread:
+ * @tid: the thread id
+ * @num_events: the number of events following, oldest first
+ * @dropped: the number of older events overwritten in the ring
+ */
+struct igt_trace_thread {
+	uint32_t tid;
+	uint32_t num_events;
+	uint64_t dropped;
+};
+
+/**
+ * igt_trace_event:
+ * @timestamp: CLOCK_MONOTONIC time of the event in nanoseconds
+ * @value: the value attached to the event
+ * @name: the id of the name of the event
+ * @type: the #igt_trace_type
+ */
+struct igt_trace_event {
+	uint64_t timestamp;
+	uint64_t value;
+	uint32_t name;
+	uint32_t type;
+};
+
+#endif /* __IGT_TRACE_H__ */
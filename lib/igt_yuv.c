@@ -0,0 +1,344 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "igt_kernels.h"
+#include "igt_yuv.h"
+#include "igt_matrix.h"
+
+static void coeffs_from_matrix(struct igt_yuv_coeffs *c,
+			       const struct igt_mat4 *mat)
+{
+	int i, j;
+
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 4; j++)
+			c->m[i][j] = lroundf(mat->d[m(i, j)] * (1 << IGT_YUV_SHIFT));
+}
+
+/**
+ * igt_ycbcr_to_rgb_coeffs:
+ * @c: coefficients to initialize
+ * @color_encoding: YCbCr encoding of the source
+ * @color_range: YCbCr range of the source
+ *
+ * Computes the fixed point equivalent of igt_ycbcr_to_rgb_matrix(), with
+ * the results rounded to nearest.
+ */
+void igt_ycbcr_to_rgb_coeffs(struct igt_yuv_coeffs *c,
+			     enum igt_color_encoding color_encoding,
+			     enum igt_color_range color_range)
+{
+	struct igt_mat4 mat = igt_ycbcr_to_rgb_matrix(color_encoding,
+						      color_range);
+	int i;
+
+	coeffs_from_matrix(c, &mat);
+
+	for (i = 0; i < 3; i++)
+		c->m[i][3] += 1 << (IGT_YUV_SHIFT - 1);
+}
+
+/**
+ * igt_rgb_to_ycbcr_coeffs:
+ * @c: coefficients to initialize
+ * @color_encoding: YCbCr encoding of the destination
+ * @color_range: YCbCr range of the destination
+ *
+ * Computes the fixed point equivalent of igt_rgb_to_ycbcr_matrix(), with
+ * the results truncated.
+ */
+void igt_rgb_to_ycbcr_coeffs(struct igt_yuv_coeffs *c,
+			     enum igt_color_encoding color_encoding,
+			     enum igt_color_range color_range)
+{
+	struct igt_mat4 mat = igt_rgb_to_ycbcr_matrix(color_encoding,
+						      color_range);
+
+	coeffs_from_matrix(c, &mat);
+}
+
+static inline int32_t transform(const int32_t *m, int32_t a, int32_t b, int32_t c)
+{
+	return m[0] * a + m[1] * b + m[2] * c + m[3];
+}
+
+static void ycbcr_to_rgb_generic(const struct igt_yuv_coeffs *c, uint8_t *rgb,
+				 const uint8_t *y, const uint8_t *cb,
+				 const uint8_t *cr, int width)
+{
+	int x;
+
+	for (x = 0; x < width; x++) {
+		int32_t Y = y[x], Cb = cb[x / 2], Cr = cr[x / 2];
+
+		rgb[x * 4 + 2] = igt_yuv_clamp(transform(c->m[0], Y, Cb, Cr) >> IGT_YUV_SHIFT);
+		rgb[x * 4 + 1] = igt_yuv_clamp(transform(c->m[1], Y, Cb, Cr) >> IGT_YUV_SHIFT);
+		rgb[x * 4 + 0] = igt_yuv_clamp(transform(c->m[2], Y, Cb, Cr) >> IGT_YUV_SHIFT);
+	}
+}
+
+static void rgb_to_ycbcr_generic(const struct igt_yuv_coeffs *c, uint8_t *y,
+				 int32_t *cb, int32_t *cr, const uint8_t *rgb,
+				 int width)
+{
+	int x;
+
+	for (x = 0; x < width; x++) {
+		int32_t R = rgb[x * 4 + 2], G = rgb[x * 4 + 1], B = rgb[x * 4 + 0];
+
+		y[x] = igt_yuv_clamp(transform(c->m[0], R, G, B) >> IGT_YUV_SHIFT);
+		cb[x] = transform(c->m[1], R, G, B);
+		cr[x] = transform(c->m[2], R, G, B);
+	}
+}
+
+#if defined(__x86_64__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+
+#include <smmintrin.h>
+
+static inline __m128i load16_sse41(const void *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return _mm_cvtsi32_si128(v);
+}
+
+static inline __m128i load32_sse41(const void *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return _mm_cvtsi32_si128(v);
+}
+
+static inline __m128i transform_sse41(const __m128i *m,
+				      __m128i a, __m128i b, __m128i c)
+{
+	return _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(m[0], a),
+					   _mm_mullo_epi32(m[1], b)),
+			     _mm_add_epi32(_mm_mullo_epi32(m[2], c), m[3]));
+}
+
+static inline __m128i clamp_sse41(__m128i v)
+{
+	v = _mm_srai_epi32(v, IGT_YUV_SHIFT);
+	return _mm_min_epi32(_mm_max_epi32(v, _mm_setzero_si128()),
+			     _mm_set1_epi32(255));
+}
+
+static void ycbcr_to_rgb_sse41(const struct igt_yuv_coeffs *c, uint8_t *rgb,
+			       const uint8_t *y, const uint8_t *cb,
+			       const uint8_t *cr, int width)
+{
+	const __m128i x_mask = _mm_set1_epi32(0xff000000);
+	__m128i m[3][4];
+	int i, j, x;
+
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 4; j++)
+			m[i][j] = _mm_set1_epi32(c->m[i][j]);
+
+	for (x = 0; x + 4 <= width; x += 4) {
+		__m128i *dst = (__m128i *)(rgb + x * 4);
+		__m128i Y, Cb, Cr, R, G, B, px;
+
+		Y = _mm_cvtepu8_epi32(load32_sse41(y + x));
+		Cb = _mm_cvtepu8_epi32(load16_sse41(cb + x / 2));
+		Cb = _mm_shuffle_epi32(Cb, _MM_SHUFFLE(1, 1, 0, 0));
+		Cr = _mm_cvtepu8_epi32(load16_sse41(cr + x / 2));
+		Cr = _mm_shuffle_epi32(Cr, _MM_SHUFFLE(1, 1, 0, 0));
+
+		R = clamp_sse41(transform_sse41(m[0], Y, Cb, Cr));
+		G = clamp_sse41(transform_sse41(m[1], Y, Cb, Cr));
+		B = clamp_sse41(transform_sse41(m[2], Y, Cb, Cr));
+
+		px = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(R, 16),
+					       _mm_slli_epi32(G, 8)), B);
+		px = _mm_or_si128(px, _mm_and_si128(_mm_loadu_si128(dst), x_mask));
+		_mm_storeu_si128(dst, px);
+	}
+
+	ycbcr_to_rgb_generic(c, rgb + x * 4, y + x, cb + x / 2, cr + x / 2,
+			     width - x);
+}
+
+static void rgb_to_ycbcr_sse41(const struct igt_yuv_coeffs *c, uint8_t *y,
+			       int32_t *cb, int32_t *cr, const uint8_t *rgb,
+			       int width)
+{
+	const __m128i byte_mask = _mm_set1_epi32(0xff);
+	__m128i m[3][4];
+	int i, j, x;
+
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 4; j++)
+			m[i][j] = _mm_set1_epi32(c->m[i][j]);
+
+	for (x = 0; x + 4 <= width; x += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(rgb + x * 4));
+		__m128i R, G, B, Y;
+		uint32_t luma;
+
+		R = _mm_and_si128(_mm_srli_epi32(px, 16), byte_mask);
+		G = _mm_and_si128(_mm_srli_epi32(px, 8), byte_mask);
+		B = _mm_and_si128(px, byte_mask);
+
+		Y = clamp_sse41(transform_sse41(m[0], R, G, B));
+		Y = _mm_packs_epi32(Y, Y);
+		Y = _mm_packus_epi16(Y, Y);
+		luma = _mm_cvtsi128_si32(Y);
+		memcpy(y + x, &luma, sizeof(luma));
+
+		_mm_storeu_si128((__m128i *)(cb + x),
+				 transform_sse41(m[1], R, G, B));
+		_mm_storeu_si128((__m128i *)(cr + x),
+				 transform_sse41(m[2], R, G, B));
+	}
+
+	rgb_to_ycbcr_generic(c, y + x, cb + x, cr + x, rgb + x * 4, width - x);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <immintrin.h>
+
+static inline __m256i transform_avx2(const __m256i *m,
+				     __m256i a, __m256i b, __m256i c)
+{
+	return _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(m[0], a),
+						 _mm256_mullo_epi32(m[1], b)),
+				_mm256_add_epi32(_mm256_mullo_epi32(m[2], c), m[3]));
+}
+
+static inline __m256i clamp_avx2(__m256i v)
+{
+	v = _mm256_srai_epi32(v, IGT_YUV_SHIFT);
+	return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()),
+				_mm256_set1_epi32(255));
+}
+
+static void ycbcr_to_rgb_avx2(const struct igt_yuv_coeffs *c, uint8_t *rgb,
+			      const uint8_t *y, const uint8_t *cb,
+			      const uint8_t *cr, int width)
+{
+	const __m256i x_mask = _mm256_set1_epi32(0xff000000);
+	const __m256i dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	__m256i m[3][4];
+	int i, j, x;
+
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 4; j++)
+			m[i][j] = _mm256_set1_epi32(c->m[i][j]);
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m256i *dst = (__m256i *)(rgb + x * 4);
+		__m256i Y, Cb, Cr, R, G, B, px;
+
+		Y = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(y + x)));
+		Cb = _mm256_cvtepu8_epi32(load32_sse41(cb + x / 2));
+		Cb = _mm256_permutevar8x32_epi32(Cb, dup);
+		Cr = _mm256_cvtepu8_epi32(load32_sse41(cr + x / 2));
+		Cr = _mm256_permutevar8x32_epi32(Cr, dup);
+
+		R = clamp_avx2(transform_avx2(m[0], Y, Cb, Cr));
+		G = clamp_avx2(transform_avx2(m[1], Y, Cb, Cr));
+		B = clamp_avx2(transform_avx2(m[2], Y, Cb, Cr));
+
+		px = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(R, 16),
+						     _mm256_slli_epi32(G, 8)), B);
+		px = _mm256_or_si256(px, _mm256_and_si256(_mm256_loadu_si256(dst),
+							  x_mask));
+		_mm256_storeu_si256(dst, px);
+	}
+
+	ycbcr_to_rgb_generic(c, rgb + x * 4, y + x, cb + x / 2, cr + x / 2,
+			     width - x);
+}
+
+static void rgb_to_ycbcr_avx2(const struct igt_yuv_coeffs *c, uint8_t *y,
+			      int32_t *cb, int32_t *cr, const uint8_t *rgb,
+			      int width)
+{
+	const __m256i byte_mask = _mm256_set1_epi32(0xff);
+	__m256i m[3][4];
+	int i, j, x;
+
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 4; j++)
+			m[i][j] = _mm256_set1_epi32(c->m[i][j]);
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m256i px = _mm256_loadu_si256((const __m256i *)(rgb + x * 4));
+		__m256i R, G, B, Y;
+		__m128i luma;
+
+		R = _mm256_and_si256(_mm256_srli_epi32(px, 16), byte_mask);
+		G = _mm256_and_si256(_mm256_srli_epi32(px, 8), byte_mask);
+		B = _mm256_and_si256(px, byte_mask);
+
+		Y = clamp_avx2(transform_avx2(m[0], R, G, B));
+		luma = _mm_packs_epi32(_mm256_castsi256_si128(Y),
+				       _mm256_extracti128_si256(Y, 1));
+		luma = _mm_packus_epi16(luma, luma);
+		_mm_storel_epi64((__m128i *)(y + x), luma);
+
+		_mm256_storeu_si256((__m256i *)(cb + x),
+				    transform_avx2(m[1], R, G, B));
+		_mm256_storeu_si256((__m256i *)(cr + x),
+				    transform_avx2(m[2], R, G, B));
+	}
+
+	rgb_to_ycbcr_generic(c, y + x, cb + x, cr + x, rgb + x * 4, width - x);
+}
+
+#pragma GCC pop_options
+#endif
+
+static const struct igt_yuv_kernels yuv_kernels[] = {
+#if defined(__x86_64__) && !defined(__clang__)
+	{ "avx2", AVX2, ycbcr_to_rgb_avx2, rgb_to_ycbcr_avx2 },
+	{ "sse4.1", SSE4_1, ycbcr_to_rgb_sse41, rgb_to_ycbcr_sse41 },
+#endif
+	{ "generic", 0, ycbcr_to_rgb_generic, rgb_to_ycbcr_generic },
+};
+
+/**
+ * igt_yuv_kernels:
+ * @features: igt_x86_features() the implementation is allowed to use
+ *
+ * Returns: the fastest conversion implementation only using @features,
+ * the generic C implementation if @features is 0.
+ */
+const struct igt_yuv_kernels *igt_yuv_kernels(unsigned features)
+{
+	return igt_kernels_select(yuv_kernels, features);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_YUV_H__
+#define __IGT_YUV_H__
+
+#include <stdint.h>
+
+#include "igt_color_encoding.h"
+
+/*
+ * Fixed point YCbCr <-> RGB conversion of single rows of pixels, used by
+ * the igt_fb format conversions. RGB pixels are little endian XRGB8888,
+ * ie. B, G, R, X in memory.
+ */
+
+#define IGT_YUV_SHIFT 16
+
+/**
+ * igt_yuv_coeffs:
+ * @m: the first three rows of the 4x4 color conversion matrix, in fixed
+ *     point with IGT_YUV_SHIFT fractional bits
+ */
+struct igt_yuv_coeffs {
+	int32_t m[3][4];
+};
+
+void igt_ycbcr_to_rgb_coeffs(struct igt_yuv_coeffs *c,
+			     enum igt_color_encoding color_encoding,
+			     enum igt_color_range color_range);
+void igt_rgb_to_ycbcr_coeffs(struct igt_yuv_coeffs *c,
+			     enum igt_color_encoding color_encoding,
+			     enum igt_color_range color_range);
+
+/**
+ * igt_yuv_kernels:
+ * @name: name of the implementation
+ * @features: the igt_x86_features() the implementation requires
+ * @ycbcr_to_rgb: converts @width pixels to XRGB8888, taking the chroma of
+ *                pixel x from cb[x / 2] and cr[x / 2]. The X byte of @rgb
+ *                is left untouched.
+ * @rgb_to_ycbcr: converts @width XRGB8888 pixels, storing luma in @y and
+ *                the unrounded fixed point chroma of every pixel in @cb
+ *                and @cr, to be subsampled with igt_yuv_chroma() or
+ *                igt_yuv_chroma2()
+ *
+ * All implementations give bit identical results.
+ */
+struct igt_yuv_kernels {
+	const char *name;
+	unsigned features;
+	void (*ycbcr_to_rgb)(const struct igt_yuv_coeffs *c, uint8_t *rgb,
+			     const uint8_t *y, const uint8_t *cb,
+			     const uint8_t *cr, int width);
+	void (*rgb_to_ycbcr)(const struct igt_yuv_coeffs *c, uint8_t *y,
+			     int32_t *cb, int32_t *cr, const uint8_t *rgb,
+			     int width);
+};
+
+const struct igt_yuv_kernels *igt_yuv_kernels(unsigned features);
+
+static inline uint8_t igt_yuv_clamp(int32_t v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/**
+ * igt_yuv_chroma:
+ * @a: fixed point chroma from igt_yuv_kernels.rgb_to_ycbcr
+ *
+ * Returns: the chroma sample for a single pixel
+ */
+static inline uint8_t igt_yuv_chroma(int32_t a)
+{
+	return igt_yuv_clamp(a >> IGT_YUV_SHIFT);
+}
+
+/**
+ * igt_yuv_chroma2:
+ * @a: fixed point chroma from igt_yuv_kernels.rgb_to_ycbcr
+ * @b: fixed point chroma from igt_yuv_kernels.rgb_to_ycbcr
+ *
+ * Returns: the chroma sample for the average of two pixels
+ */
+static inline uint8_t igt_yuv_chroma2(int32_t a, int32_t b)
+{
+	return igt_yuv_clamp((a + b) >> (IGT_YUV_SHIFT + 1));
+}
+
+#endif /* __IGT_YUV_H__ */
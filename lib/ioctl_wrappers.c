@@ -54,6 +54,7 @@
 #include "intel_io.h"
 #include "igt_debugfs.h"
 #include "igt_sysfs.h"
+#include "igt_trace.h"
 #include "config.h"
 
 #ifdef HAVE_VALGRIND
@@ -88,6 +89,19 @@
 
 int (*igt_ioctl)(int fd, unsigned long request, void *arg) = drmIoctl;
 
+/* igt_ioctl(), traced under the name of the calling wrapper */
+static int trace_ioctl(const char *name,
+		       int fd, unsigned long request, void *arg)
+{
+	int ret;
+
+	igt_trace(IGT_TRACE_BEGIN, name, request);
+	ret = igt_ioctl(fd, request, arg);
+	igt_trace_end(name);
+
+	return ret;
+}
+
 
 /**
  * gem_handle_to_libdrm_bo:
@@ -126,7 +140,7 @@ __gem_get_tiling(int fd, struct drm_i915_gem_get_tiling *arg)
 	int err;
 
 	err = 0;
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_GET_TILING, arg))
+	if (trace_ioctl(__func__, fd, DRM_IOCTL_I915_GEM_GET_TILING, arg))
 		err = -errno;
 	errno = 0;
 
@@ -209,7 +223,7 @@ int __gem_set_caching(int fd, uint32_t handle, uint32_t caching)
 	arg.caching = caching;
 
 	err = 0;
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_SET_CACHING, &arg))
+	if (trace_ioctl(__func__, fd, DRM_IOCTL_I915_GEM_SET_CACHING, &arg))
 		err = -errno;
 
 	errno = 0;
@@ -320,7 +334,9 @@ void gem_close(int fd, uint32_t handle)
 
 	memset(&close_bo, 0, sizeof(close_bo));
 	close_bo.handle = handle;
-	do_ioctl(fd, DRM_IOCTL_GEM_CLOSE, &close_bo);
+	igt_assert_eq(trace_ioctl(__func__, fd,
+				  DRM_IOCTL_GEM_CLOSE, &close_bo), 0);
+	errno = 0;
 }
 
 int __gem_write(int fd, uint32_t handle, uint64_t offset, const void *buf, uint64_t length)
@@ -334,9 +350,11 @@ int __gem_write(int fd, uint32_t handle, uint64_t offset, const void *buf, uint6
 	gem_pwrite.size = length;
 	gem_pwrite.data_ptr = to_user_pointer(buf);
 
+	igt_trace(IGT_TRACE_BEGIN, __func__, DRM_IOCTL_I915_GEM_PWRITE);
 	err = 0;
 	if (drmIoctl(fd, DRM_IOCTL_I915_GEM_PWRITE, &gem_pwrite))
 		err = -errno;
+	igt_trace_end(__func__);
 	return err;
 }
 
@@ -367,9 +385,11 @@ static int __gem_read(int fd, uint32_t handle, uint64_t offset, void *buf, uint6
 	gem_pread.size = length;
 	gem_pread.data_ptr = to_user_pointer(buf);
 
+	igt_trace(IGT_TRACE_BEGIN, __func__, DRM_IOCTL_I915_GEM_PREAD);
 	err = 0;
 	if (drmIoctl(fd, DRM_IOCTL_I915_GEM_PREAD, &gem_pread))
 		err = -errno;
+	igt_trace_end(__func__);
 	return err;
 }
 /**
@@ -399,7 +419,8 @@ int __gem_set_domain(int fd, uint32_t handle, uint32_t read, uint32_t write)
 	set_domain.write_domain = write;
 
 	err = 0;
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_SET_DOMAIN, &set_domain))
+	if (trace_ioctl(__func__, fd,
+			DRM_IOCTL_I915_GEM_SET_DOMAIN, &set_domain))
 		err = -errno;
 
 	return err;
@@ -443,7 +464,7 @@ int gem_wait(int fd, uint32_t handle, int64_t *timeout_ns)
 	wait.flags = 0;
 
 	ret = 0;
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_WAIT, &wait))
+	if (trace_ioctl(__func__, fd, DRM_IOCTL_I915_GEM_WAIT, &wait))
 		ret = -errno;
 
 	if (timeout_ns)
@@ -547,7 +568,7 @@ int __gem_create(int fd, uint64_t size, uint32_t *handle)
 	};
 	int err = 0;
 
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_CREATE, &create) == 0)
+	if (trace_ioctl(__func__, fd, DRM_IOCTL_I915_GEM_CREATE, &create) == 0)
 		*handle = create.handle;
 	else
 		err = -errno;
@@ -586,7 +607,7 @@ uint32_t gem_create(int fd, uint64_t size)
 int __gem_execbuf(int fd, struct drm_i915_gem_execbuffer2 *execbuf)
 {
 	int err = 0;
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_EXECBUFFER2, execbuf))
+	if (trace_ioctl(__func__, fd, DRM_IOCTL_I915_GEM_EXECBUFFER2, execbuf))
 		err = -errno;
 	errno = 0;
 	return err;
@@ -616,7 +637,8 @@ void gem_execbuf(int fd, struct drm_i915_gem_execbuffer2 *execbuf)
 int __gem_execbuf_wr(int fd, struct drm_i915_gem_execbuffer2 *execbuf)
 {
 	int err = 0;
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_EXECBUFFER2_WR, execbuf))
+	if (trace_ioctl(__func__, fd,
+			DRM_IOCTL_I915_GEM_EXECBUFFER2_WR, execbuf))
 		err = -errno;
 	errno = 0;
 	return err;
@@ -654,7 +676,7 @@ void *__gem_mmap__gtt(int fd, uint32_t handle, uint64_t size, unsigned prot)
 
 	memset(&mmap_arg, 0, sizeof(mmap_arg));
 	mmap_arg.handle = handle;
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_MMAP_GTT, &mmap_arg))
+	if (trace_ioctl(__func__, fd, DRM_IOCTL_I915_GEM_MMAP_GTT, &mmap_arg))
 		return NULL;
 
 	ptr = mmap64(0, size, prot, MAP_SHARED, fd, mmap_arg.offset);
@@ -765,7 +787,7 @@ void *__gem_mmap__wc(int fd, uint32_t handle, uint64_t offset, uint64_t size, un
 	arg.offset = offset;
 	arg.size = size;
 	arg.flags = I915_MMAP_WC;
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_MMAP, &arg))
+	if (trace_ioctl(__func__, fd, DRM_IOCTL_I915_GEM_MMAP, &arg))
 		return NULL;
 
 	VG(VALGRIND_MAKE_MEM_DEFINED(from_user_pointer(arg.addr_ptr), arg.size));
@@ -814,7 +836,7 @@ void *__gem_mmap__cpu(int fd, uint32_t handle, uint64_t offset, uint64_t size, u
 	mmap_arg.handle = handle;
 	mmap_arg.offset = offset;
 	mmap_arg.size = size;
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_MMAP, &mmap_arg))
+	if (trace_ioctl(__func__, fd, DRM_IOCTL_I915_GEM_MMAP, &mmap_arg))
 		return NULL;
 
 	VG(VALGRIND_MAKE_MEM_DEFINED(from_user_pointer(mmap_arg.addr_ptr), mmap_arg.size));
@@ -864,7 +886,9 @@ int gem_madvise(int fd, uint32_t handle, int state)
 	madv.handle = handle;
 	madv.madv = state;
 	madv.retained = 1;
-	do_ioctl(fd, DRM_IOCTL_I915_GEM_MADVISE, &madv);
+	igt_assert_eq(trace_ioctl(__func__, fd,
+				  DRM_IOCTL_I915_GEM_MADVISE, &madv), 0);
+	errno = 0;
 
 	return madv.retained;
 }
@@ -880,7 +904,7 @@ int __gem_userptr(int fd, void *ptr, uint64_t size, int read_only, uint32_t flag
 	if (read_only)
 		userptr.flags |= I915_USERPTR_READ_ONLY;
 
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GEM_USERPTR, &userptr))
+	if (trace_ioctl(__func__, fd, DRM_IOCTL_I915_GEM_USERPTR, &userptr))
 		return -errno;
 
 	*handle = userptr.handle;
@@ -939,7 +963,9 @@ bool gem_bo_busy(int fd, uint32_t handle)
 	memset(&busy, 0, sizeof(busy));
 	busy.handle = handle;
 
-	do_ioctl(fd, DRM_IOCTL_I915_GEM_BUSY, &busy);
+	igt_assert_eq(trace_ioctl(__func__, fd,
+				  DRM_IOCTL_I915_GEM_BUSY, &busy), 0);
+	errno = 0;
 
 	return !!busy.busy;
 }
@@ -1700,7 +1726,7 @@ int __kms_addfb(int fd, uint32_t handle,
 		f.offsets[i] = offsets[i];
 	}
 
-	ret = igt_ioctl(fd, DRM_IOCTL_MODE_ADDFB2, &f);
+	ret = trace_ioctl(__func__, fd, DRM_IOCTL_MODE_ADDFB2, &f);
 
 	*buf_id = f.fb_id;
 
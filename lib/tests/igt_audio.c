@@ -0,0 +1,230 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_audio.h"
+#include "igt_core.h"
+#include "igt_aux.h"
+
+#define CHANNELS 2
+#define SAMPLING_RATE 48000
+
+static const int freqs[] = { 300, 600, 1200, 10000 };
+
+static struct audio_signal *signal_init(int count)
+{
+	struct audio_signal *signal;
+	int i;
+
+	signal = audio_signal_init(CHANNELS, SAMPLING_RATE);
+	for (i = 0; i < count; i++)
+		igt_assert(audio_signal_add_frequency(signal, freqs[i]) == 0);
+	audio_signal_synthesize(signal);
+
+	return signal;
+}
+
+static short *capture(struct audio_signal *signal, int frames)
+{
+	short *buffer = malloc(frames * CHANNELS * sizeof(*buffer));
+	int i, n;
+
+	igt_assert(buffer);
+
+	/* Like the playback callbacks, in periods of various sizes */
+	for (i = 0; i < frames; i += n) {
+		n = min(frames - i, 1000 + 37 * (i % 11));
+		audio_signal_fill(signal, buffer + i * CHANNELS, n);
+	}
+
+	return buffer;
+}
+
+/* The sum of the sines, as audio_signal_synthesize() computes them */
+static short reference_sample(int count, int frame)
+{
+	short sample = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		int freq = SAMPLING_RATE / (SAMPLING_RATE / freqs[i]);
+		int period = SAMPLING_RATE / freq;
+		double value;
+
+		value = 2.0 * M_PI * freq / SAMPLING_RATE * (frame % period);
+		sample += (short)(sin(value) * SHRT_MAX / count);
+	}
+
+	return sample;
+}
+
+static void test_fill(int channels)
+{
+	struct audio_signal *signal;
+	int frames = SAMPLING_RATE / 4;
+	short *buffer;
+	int count, i, j, n;
+
+	buffer = malloc(frames * channels * sizeof(*buffer));
+	igt_assert(buffer);
+
+	for (count = 0; count <= ARRAY_SIZE(freqs); count++) {
+		signal = audio_signal_init(channels, SAMPLING_RATE);
+		for (i = 0; i < count; i++)
+			audio_signal_add_frequency(signal, freqs[i]);
+		audio_signal_synthesize(signal);
+
+		/* Periods of various sizes, not multiples of anything */
+		for (i = 0; i < frames; i += n) {
+			n = min(frames - i, 1 + 337 * (i % 7));
+			audio_signal_fill(signal, buffer + i * channels, n);
+		}
+
+		for (i = 0; i < frames; i++) {
+			short sample = reference_sample(count, i);
+
+			for (j = 0; j < channels; j++)
+				igt_assert_f(buffer[i * channels + j] == sample,
+					     "%d frequencies, frame %d, channel %d: %d, expected %d\n",
+					     count, i, j,
+					     buffer[i * channels + j], sample);
+		}
+
+		audio_signal_clean(signal);
+		free(signal);
+	}
+
+	free(buffer);
+}
+
+static void test_detect(int frames)
+{
+	struct audio_signal *signal = signal_init(ARRAY_SIZE(freqs));
+	struct audio_signal *missing = signal_init(ARRAY_SIZE(freqs) - 1);
+	short *buffer = capture(signal, frames);
+
+	igt_assert(audio_signal_detect(signal, CHANNELS, SAMPLING_RATE,
+				       buffer, frames));
+
+	/* The last frequency is extra */
+	igt_assert(!audio_signal_detect(missing, CHANNELS, SAMPLING_RATE,
+					buffer, frames));
+
+	free(buffer);
+	buffer = capture(missing, frames);
+
+	/* The last frequency is missing */
+	igt_assert(!audio_signal_detect(signal, CHANNELS, SAMPLING_RATE,
+					buffer, frames));
+	igt_assert(audio_signal_detect(missing, CHANNELS, SAMPLING_RATE,
+				       buffer, frames));
+
+	free(buffer);
+	audio_signal_clean(signal);
+	audio_signal_clean(missing);
+	free(signal);
+	free(missing);
+}
+
+static void test_streaming(int window, int chunk)
+{
+	struct audio_signal *signal = signal_init(ARRAY_SIZE(freqs));
+	struct audio_signal_detector *det;
+	int frames = 2 * SAMPLING_RATE;
+	/* Long enough for a few windows to be entirely silent */
+	int dropout_start = SAMPLING_RATE / 2, dropout_end = SAMPLING_RATE;
+	int step = (window + 1) / 2;
+	short *buffer = capture(signal, frames);
+	const bool *results;
+	int windows, failed, i, n;
+
+	memset(buffer + dropout_start * CHANNELS, 0,
+	       (dropout_end - dropout_start) * CHANNELS * sizeof(*buffer));
+
+	det = audio_signal_detector_init(signal, CHANNELS, SAMPLING_RATE,
+					 window);
+
+	failed = 0;
+	for (i = 0; i < frames; i += n) {
+		n = min(frames - i, chunk);
+		failed += audio_signal_detector_process(det,
+							buffer + i * CHANNELS,
+							n);
+	}
+
+	results = audio_signal_detector_get_results(det, &windows);
+	igt_assert_eq(windows, (frames - window) / step + 1);
+	igt_assert_eq(failed, audio_signal_detector_get_failed(det));
+
+	n = 0;
+	for (i = 0; i < windows; i++) {
+		int start = i * step, end = start + window;
+
+		igt_debug("window %d, frames %d-%d: %s\n", i, start, end,
+			  results[i] ? "detected" : "not detected");
+
+		if (end <= dropout_start || start >= dropout_end)
+			igt_assert_f(results[i],
+				     "Signal not detected in window %d\n", i);
+		else if (start >= dropout_start && end <= dropout_end)
+			igt_assert_f(!results[i],
+				     "Signal detected in silent window %d\n", i);
+
+		n += !results[i];
+	}
+	igt_assert_eq(n, failed);
+
+	audio_signal_detector_fini(det);
+	free(buffer);
+	audio_signal_clean(signal);
+	free(signal);
+}
+
+igt_main
+{
+	igt_subtest("fill-mono")
+		test_fill(1);
+
+	igt_subtest("fill-stereo")
+		test_fill(2);
+
+	igt_subtest("fill-8ch")
+		test_fill(8);
+
+	igt_subtest("detect")
+		test_detect(4096);
+
+	igt_subtest("detect-npot")
+		test_detect(4800);
+
+	igt_subtest("streaming")
+		test_streaming(4096, 4096);
+
+	igt_subtest("streaming-npot")
+		test_streaming(4800, 1001);
+}
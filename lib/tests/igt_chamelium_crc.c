@@ -0,0 +1,150 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_chamelium_crc.h"
+#include "igt_core.h"
+#include "igt_kernels.h"
+#include "igt_rand.h"
+
+static const struct {
+	int width, height;
+} sizes[] = {
+	{ 1, 1 },
+	{ 3, 1 },
+	{ 5, 3 },
+	{ 7, 7 },
+	{ 64, 64 },
+	/* Neither a multiple of the groups nor of the vector widths */
+	{ 1021, 67 },
+	{ 1024, 768 },
+};
+
+/* How igt_chamelium used to compute each hash, a pass over the frame each */
+static uint32_t xrgb_hash16_ref(const unsigned char *buffer, int width,
+				int height, int k, int m)
+{
+	unsigned char r, g, b;
+	uint64_t sum = 0;
+	uint64_t count = 0;
+	uint64_t value;
+	uint32_t hash;
+	int index;
+	int i;
+
+	for (i=0; i < width * height; i++) {
+		if ((i % m) != k)
+			continue;
+
+		index = i * 4;
+
+		r = buffer[index + 2];
+		g = buffer[index + 1];
+		b = buffer[index + 0];
+
+		value = r | (g << 8) | (b << 16);
+		sum += ++count * value;
+	}
+
+	hash = ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+
+	return hash;
+}
+
+static unsigned char *random_frame(int width, int height, uint32_t seed)
+{
+	unsigned char *buffer = malloc(width * height * 4);
+	int i;
+
+	igt_assert(buffer);
+	for (i = 0; i < width * height * 4; i++)
+		buffer[i] = hars_petruska_f54_1_random(&seed);
+
+	return buffer;
+}
+
+static void check_hash(const uint32_t *hash, const unsigned char *buffer,
+		       int width, int height)
+{
+	int k;
+
+	for (k = 0; k < CHAMELIUM_CRC_WORDS; k++) {
+		uint32_t ref = xrgb_hash16_ref(buffer, width, height,
+					       k, CHAMELIUM_CRC_WORDS);
+
+		igt_assert_f(hash[k] == ref,
+			     "%dx%d: hash %d is %04x, expected %04x\n",
+			     width, height, k, hash[k], ref);
+	}
+}
+
+static void test_kernels(const struct chamelium_crc_kernels *k)
+{
+	uint32_t hash[CHAMELIUM_CRC_WORDS];
+	int i, threads;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		int width = sizes[i].width, height = sizes[i].height;
+		unsigned char *buffer = random_frame(width, height, i);
+
+		/* Uneven bands, and more threads than groups */
+		for (threads = 1; threads <= 3; threads++) {
+			memset(hash, 0xff, sizeof(hash));
+			chamelium_xrgb_hash16_with(k, hash, buffer,
+						   width, height, threads);
+			check_hash(hash, buffer, width, height);
+		}
+
+		free(buffer);
+	}
+}
+
+static void test_frame(int width, int height, bool white)
+{
+	uint32_t hash[CHAMELIUM_CRC_WORDS];
+	unsigned char *buffer = random_frame(width, height, width);
+
+	/* Large sums, wrapping around */
+	if (white)
+		memset(buffer, 0xff, width * height * 4);
+
+	chamelium_xrgb_hash16(hash, buffer, width, height);
+	check_hash(hash, buffer, width, height);
+
+	free(buffer);
+}
+
+igt_main
+{
+	igt_subtest_kernels(chamelium_crc_kernels, test_kernels);
+
+	/* Split across threads */
+	igt_subtest("1080p")
+		test_frame(1920, 1080, false);
+
+	igt_subtest("4k-white")
+		test_frame(3840, 2160, true);
+}
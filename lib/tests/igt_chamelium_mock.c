@@ -0,0 +1,306 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_chamelium.h"
+#include "igt_chamelium_mock.h"
+
+/*
+ * Feeds the mock Chamelium requests a real client never sends, which must
+ * get a reply or a closed connection, never a hung or crashed server, and
+ * runs the client code that can't be run against a real board reliably.
+ */
+
+#define CALL "<?xml version=\"1.0\"?>\r\n" \
+	"<methodCall><methodName>GetSupportedInputs</methodName>" \
+	"<params></params></methodCall>\r\n"
+
+#define REPLY_TIMEOUT_MS 5000
+
+static int mock_connect(struct chamelium_mock *mock)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	int port, fd;
+
+	igt_assert_eq(sscanf(chamelium_mock_get_url(mock),
+			     "http://127.0.0.1:%d/", &port), 1);
+	addr.sin_port = htons(port);
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	igt_assert_lte(0, fd);
+	igt_assert_eq(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+
+	return fd;
+}
+
+static void send_request(int fd, const char *headers, const char *body)
+{
+	char request[4096];
+	int len;
+
+	len = snprintf(request, sizeof(request), "%s%s", headers, body);
+	igt_assert(len < sizeof(request));
+	igt_assert_eq(write(fd, request, len), len);
+}
+
+static void send_call(int fd)
+{
+	char headers[256];
+
+	snprintf(headers, sizeof(headers),
+		 "POST /RPC2 HTTP/1.1\r\n"
+		 "Content-Type: text/xml\r\n"
+		 "Content-Length: %zu\r\n"
+		 "\r\n", strlen(CALL));
+	send_request(fd, headers, CALL);
+}
+
+/*
+ * Reads one reply into @buf, returns its length, or 0 if the mock closed
+ * the connection instead. Fails if neither happens in time.
+ */
+static size_t read_reply(int fd, char *buf, size_t size)
+{
+	size_t len = 0, length = 0;
+	char *end = NULL, *p;
+
+	for (;;) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		ssize_t ret;
+
+		if (end && len >= end + 4 - buf + length)
+			return len;
+
+		igt_assert_f(poll(&pfd, 1, REPLY_TIMEOUT_MS) == 1,
+			     "No reply from the mock Chamelium\n");
+
+		ret = read(fd, buf + len, size - len - 1);
+		igt_assert_lte(0, ret);
+		if (ret == 0) {
+			igt_assert_eq(len, 0);
+			return 0;
+		}
+		len += ret;
+		buf[len] = '\0';
+
+		if (!end && (end = strstr(buf, "\r\n\r\n"))) {
+			p = strcasestr(buf, "Content-Length:");
+			igt_assert(p && p < end);
+			length = strtoul(p + strlen("Content-Length:"), NULL, 10);
+			igt_assert(end + 4 - buf + length < size);
+		}
+	}
+}
+
+static void assert_answered(int fd, bool fault)
+{
+	char buf[4096];
+
+	igt_assert_lt(0, read_reply(fd, buf, sizeof(buf)));
+	igt_assert(!strncmp(buf, "HTTP/1.1 200 OK\r\n",
+			    strlen("HTTP/1.1 200 OK\r\n")));
+	igt_assert_eq(!!strstr(buf, "<fault>"), fault);
+}
+
+static void assert_closed(int fd)
+{
+	char buf[4096];
+
+	igt_assert_eq(read_reply(fd, buf, sizeof(buf)), 0);
+}
+
+static int count_fds(void)
+{
+	DIR *dir = opendir("/proc/self/fd");
+	int count = 0;
+
+	igt_assert(dir);
+	while (readdir(dir))
+		count++;
+	closedir(dir);
+
+	return count;
+}
+
+igt_main
+{
+	struct chamelium_mock *mock = NULL;
+
+	igt_fixture {
+		struct chamelium_mock_params params = {
+			.width = 16, .height = 16,
+		};
+
+		mock = chamelium_mock_start(&params);
+		igt_require(mock);
+
+		/* A spinning connection thread would hang the stop */
+		igt_set_timeout(60, "the mock Chamelium hung");
+	}
+
+	igt_subtest("leading-crlf") {
+		unsigned long calls = chamelium_mock_get_call_count(mock);
+		int fd = mock_connect(mock);
+		char headers[256];
+
+		/* A call after a stray CRLF */
+		snprintf(headers, sizeof(headers),
+			 "\r\nPOST /RPC2 HTTP/1.1\r\n"
+			 "Content-Length: %zu\r\n"
+			 "\r\n", strlen(CALL));
+		send_request(fd, headers, CALL);
+		assert_answered(fd, false);
+
+		/* A request of just an empty line */
+		send_request(fd, "\r\n\r\n\r\n", "");
+		assert_answered(fd, true);
+		igt_assert_eq(chamelium_mock_get_call_count(mock), calls + 2);
+
+		close(fd);
+	}
+
+	igt_subtest("no-headers") {
+		int fd = mock_connect(mock);
+
+		send_request(fd, "POST /RPC2 HTTP/1.1\r\n\r\n", "");
+		assert_answered(fd, true);
+
+		/* Still serving the connection */
+		send_call(fd);
+		assert_answered(fd, false);
+
+		close(fd);
+	}
+
+	igt_subtest("bad-content-length") {
+		int fd = mock_connect(mock);
+
+		send_request(fd, "POST /RPC2 HTTP/1.1\r\n"
+			     "Content-Length: 18446744073709551615\r\n"
+			     "\r\n", CALL);
+		assert_closed(fd);
+		close(fd);
+
+		fd = mock_connect(mock);
+		send_request(fd, "POST /RPC2 HTTP/1.1\r\n"
+			     "Content-Length: -1\r\n"
+			     "\r\n", CALL);
+		assert_closed(fd);
+		close(fd);
+	}
+
+	igt_subtest("truncated") {
+		int fd = mock_connect(mock);
+
+		send_request(fd, "POST /RPC2 HTTP/1.1\r\n"
+			     "Content-Length: 1000\r\n"
+			     "\r\n", CALL);
+		shutdown(fd, SHUT_WR);
+		assert_closed(fd);
+		close(fd);
+
+		fd = mock_connect(mock);
+		send_call(fd);
+		assert_answered(fd, false);
+		close(fd);
+	}
+
+	igt_subtest("reap-connections") {
+		int before, i;
+
+		before = count_fds();
+		for (i = 0; i < 100; i++) {
+			int fd = mock_connect(mock);
+
+			send_call(fd);
+			assert_answered(fd, false);
+			close(fd);
+		}
+
+		/* The mock closes its end once it sees ours closed */
+		igt_assert_f(count_fds() < before + 10,
+			     "%d fds before 100 connections, %d after\n",
+			     before, count_fds());
+	}
+
+	igt_subtest("capture-queue") {
+		struct chamelium_capture_queue *queue;
+		struct chamelium_port **ports;
+		struct chamelium *chamelium;
+		unsigned long calls;
+		int i, n;
+
+		chamelium = chamelium_init_url(chamelium_mock_get_url(mock));
+		igt_assert(chamelium);
+		ports = chamelium_get_ports(chamelium, &n);
+		igt_assert_lt(0, n);
+		chamelium_plug(chamelium, ports[0]);
+		chamelium_capture(chamelium, ports[0], 0, 0, 0, 0, 4);
+
+		queue = chamelium_capture_queue_create(chamelium, 2);
+		calls = chamelium_mock_get_call_count(mock);
+
+		/*
+		 * A few frames ahead of the ones handed back, for many more
+		 * frames than the request array starts with.
+		 */
+		for (i = 0; i < 3; i++)
+			chamelium_capture_queue_read_captured_frame(queue, i % 4);
+		for (i = 3; i < 1000; i++) {
+			struct chamelium_frame_dump *dump;
+
+			chamelium_capture_queue_read_captured_frame(queue, i % 4);
+			dump = chamelium_capture_queue_wait(queue);
+			igt_assert(dump);
+			chamelium_destroy_frame_dump(dump);
+		}
+
+		/* Each frame and its resolution */
+		igt_assert_lte(calls + 2 * (1000 - 3),
+			       chamelium_mock_get_call_count(mock));
+
+		/* Along with the frames never handed back */
+		chamelium_capture_queue_destroy(queue);
+
+		free(ports);
+		chamelium_deinit(chamelium);
+	}
+
+	igt_fixture {
+		chamelium_mock_stop(mock);
+	}
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "igt_frame_error.h"
+#include "igt_kernels.h"
+#include "igt_rand.h"
+
+/* Odd and not a multiple of any vector width, to exercise the tails */
+#define WIDTH 1021
+#define HEIGHT 67
+/* With some padding at the end of each row */
+#define STRIDE (WIDTH * 4 + 64)
+
+enum capture {
+	IDENTICAL,
+	/* What a DAC-ADC chain gives, an error linear in the value */
+	ANALOG,
+	RANDOM,
+	/* Runs of the same color, everything off by one */
+	FLAT,
+	NUM_CAPTURES,
+};
+
+static const char *capture_names[] = {
+	[IDENTICAL] = "identical",
+	[ANALOG] = "analog",
+	[RANDOM] = "random",
+	[FLAT] = "flat",
+};
+
+static void make_frames(enum capture capture, uint8_t *reference,
+			uint8_t *capture_pixels, int width, int height,
+			int stride)
+{
+	uint32_t seed = capture;
+	int x, y, i;
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			uint8_t *ref = reference + y * stride + x * 4;
+			uint8_t *cap = capture_pixels + y * stride + x * 4;
+			uint32_t r = hars_petruska_f54_1_random(&seed);
+
+			for (i = 0; i < 4; i++) {
+				int v = (r >> (8 * i)) & 0xff;
+
+				switch (capture) {
+				case IDENTICAL:
+					ref[i] = cap[i] = v;
+					break;
+				case ANALOG:
+					ref[i] = v;
+					cap[i] = v - v / 16 + (r >> (30 - i) & 1);
+					break;
+				case RANDOM:
+					ref[i] = v;
+					cap[i] = hars_petruska_f54_1_random(&seed);
+					break;
+				case FLAT:
+					ref[i] = (x / 64 + y) * (i + 1);
+					cap[i] = ref[i] ^ 1;
+					break;
+				default:
+					igt_assert(0);
+				}
+			}
+		}
+	}
+}
+
+/* How igt_check_analog_frame_match() used to collect the error */
+static void frame_error_ref(struct igt_frame_error *e,
+			    const uint8_t *reference,
+			    const uint8_t *capture_pixels,
+			    int width, int height, int stride)
+{
+	const uint8_t *p, *q;
+	int x, y, i, diff;
+
+	memset(e, 0, sizeof(*e));
+
+	for (x = 0; x < width; x++) {
+		for (y = 0; y < height; y++) {
+			p = &capture_pixels[y * stride + x * 4];
+			q = &reference[y * stride + x * 4];
+
+			for (i = 0; i < 3; i++) {
+				diff = (int) p[i] - q[i];
+				if (diff < 0)
+					diff = -diff;
+
+				e->sum[i][q[i]] += diff;
+				e->count[i][q[i]]++;
+			}
+		}
+	}
+}
+
+static void assert_same_error(const struct igt_frame_error *e,
+			      const struct igt_frame_error *ref,
+			      const char *name)
+{
+	int i, v;
+
+	for (i = 0; i < 3; i++) {
+		for (v = 0; v < 256; v++) {
+			igt_assert_f(e->sum[i][v] == ref->sum[i][v] &&
+				     e->count[i][v] == ref->count[i][v],
+				     "%s: channel %d, value %d: sum %"PRIu64", count %"PRIu64", reference sum %"PRIu64", count %"PRIu64"\n",
+				     name, i, v,
+				     e->sum[i][v], e->count[i][v],
+				     ref->sum[i][v], ref->count[i][v]);
+		}
+	}
+}
+
+static void test_kernels(const struct igt_frame_error_kernels *k)
+{
+	struct igt_frame_error e, ref;
+	uint8_t *reference, *capture_pixels;
+	enum capture capture;
+
+	reference = malloc(STRIDE * HEIGHT);
+	capture_pixels = malloc(STRIDE * HEIGHT);
+	igt_assert(reference && capture_pixels);
+
+	for (capture = 0; capture < NUM_CAPTURES; capture++) {
+		make_frames(capture, reference, capture_pixels,
+			    WIDTH, HEIGHT, STRIDE);
+		frame_error_ref(&ref, reference, capture_pixels,
+				WIDTH, HEIGHT, STRIDE);
+
+		memset(&e, 0, sizeof(e));
+		igt_frame_error_add_rows(&e, k, reference, STRIDE,
+					 capture_pixels, STRIDE,
+					 WIDTH, HEIGHT);
+		assert_same_error(&e, &ref, capture_names[capture]);
+	}
+
+	free(capture_pixels);
+	free(reference);
+}
+
+static void test_compute(int width, int height)
+{
+	struct igt_frame_error e, ref;
+	uint8_t *reference, *capture_pixels;
+	enum capture capture;
+
+	reference = malloc(width * 4 * height);
+	capture_pixels = malloc(width * 4 * height);
+	igt_assert(reference && capture_pixels);
+
+	for (capture = 0; capture < NUM_CAPTURES; capture++) {
+		make_frames(capture, reference, capture_pixels,
+			    width, height, width * 4);
+		frame_error_ref(&ref, reference, capture_pixels,
+				width, height, width * 4);
+
+		igt_frame_error_compute(&e, reference, width * 4,
+					capture_pixels, width * 4,
+					width, height);
+		assert_same_error(&e, &ref, capture_names[capture]);
+	}
+
+	free(capture_pixels);
+	free(reference);
+}
+
+igt_main
+{
+	igt_subtest_kernels(igt_frame_error_kernels, test_kernels);
+
+	igt_subtest("small-frame")
+		test_compute(640, 480);
+
+	/* Split across threads */
+	igt_subtest("large-frame")
+		test_compute(1920, 1080);
+}
@@ -0,0 +1,358 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_kms_cache.h"
+
+/*
+ * A snapshot of the KMS objects of a machine with 3 pipes, 3 planes each,
+ * and 2 connectors, the property ids being shared by all the objects of a
+ * type as with the kernel.
+ */
+static const char * const snapshot_props[] = {
+	[1] = "type",
+	[2] = "FB_ID",
+	[3] = "IN_FENCE_FD",
+	[4] = "CRTC_ID",
+	[5] = "SRC_X",
+	[6] = "SRC_Y",
+	[7] = "SRC_W",
+	[8] = "SRC_H",
+	[9] = "CRTC_X",
+	[10] = "CRTC_Y",
+	[11] = "CRTC_W",
+	[12] = "CRTC_H",
+	[13] = "rotation",
+	[14] = "ACTIVE",
+	[15] = "MODE_ID",
+	[16] = "OUT_FENCE_PTR",
+	[17] = "GAMMA_LUT",
+	[18] = "DPMS",
+	[19] = "EDID",
+	[20] = "Broadcast RGB",
+};
+
+#define NUM_SNAPSHOT_PROPS (ARRAY_SIZE(snapshot_props) - 1)
+
+static const uint32_t plane_props[] = {
+	1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13
+};
+static const uint32_t crtc_props[] = { 14, 15, 16, 17 };
+static const uint32_t connector_props[] = { 4, 18, 19, 20 };
+
+struct snapshot_object {
+	uint32_t id;
+	uint32_t type;
+	const uint32_t *props;
+	int count;
+};
+
+#define PLANE(id) { id, DRM_MODE_OBJECT_PLANE, plane_props, ARRAY_SIZE(plane_props) }
+#define CRTC(id) { id, DRM_MODE_OBJECT_CRTC, crtc_props, ARRAY_SIZE(crtc_props) }
+#define CONNECTOR(id) { id, DRM_MODE_OBJECT_CONNECTOR, connector_props, ARRAY_SIZE(connector_props) }
+
+static const struct snapshot_object snapshot_objects[] = {
+	PLANE(28), PLANE(29), PLANE(30), CRTC(31),
+	PLANE(32), PLANE(33), PLANE(34), CRTC(35),
+	PLANE(36), PLANE(37), PLANE(38), CRTC(39),
+	CONNECTOR(300), CONNECTOR(310),
+};
+
+/* Listed only with DRM_CLIENT_CAP_ATOMIC, as with the kernel */
+static bool is_atomic_prop(uint32_t prop_id)
+{
+	return (prop_id >= 2 && prop_id <= 12) ||
+		(prop_id >= 14 && prop_id <= 16);
+}
+
+static bool snapshot_atomic = true;
+static int object_calls, property_calls;
+
+static drmModeObjectPropertiesPtr
+snapshot_get_object_properties(int fd, uint32_t object_id, uint32_t object_type)
+{
+	drmModeObjectPropertiesPtr props;
+	int i, j;
+
+	object_calls++;
+
+	for (i = 0; i < ARRAY_SIZE(snapshot_objects); i++) {
+		const struct snapshot_object *obj = &snapshot_objects[i];
+
+		if (obj->id != object_id || obj->type != object_type)
+			continue;
+
+		props = calloc(1, sizeof(*props));
+		igt_assert(props);
+		props->props = calloc(obj->count, sizeof(*props->props));
+		props->prop_values = calloc(obj->count,
+					    sizeof(*props->prop_values));
+		igt_assert(props->props && props->prop_values);
+		for (j = 0; j < obj->count; j++)
+			if (snapshot_atomic || !is_atomic_prop(obj->props[j]))
+				props->props[props->count_props++] = obj->props[j];
+
+		return props;
+	}
+
+	errno = ENOENT;
+	return NULL;
+}
+
+static drmModePropertyPtr snapshot_get_property(int fd, uint32_t prop_id)
+{
+	drmModePropertyPtr prop;
+
+	property_calls++;
+
+	if (prop_id == 0 || prop_id > NUM_SNAPSHOT_PROPS) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	prop = calloc(1, sizeof(*prop));
+	igt_assert(prop);
+	prop->prop_id = prop_id;
+	strcpy(prop->name, snapshot_props[prop_id]);
+
+	return prop;
+}
+
+static int snapshot_set_client_cap(int fd, uint64_t capability,
+				   uint64_t value)
+{
+	if (capability == DRM_CLIENT_CAP_ATOMIC)
+		snapshot_atomic = value;
+
+	return 0;
+}
+
+static const struct igt_kms_backend snapshot_backend = {
+	.get_object_properties = snapshot_get_object_properties,
+	.get_property = snapshot_get_property,
+	.set_client_cap = snapshot_set_client_cap,
+};
+
+static const char * const plane_names[] = { "CRTC_ID", "FB_ID", "rotation" };
+static const char * const crtc_names[] = { "ACTIVE", "MODE_ID", "DEGAMMA_LUT" };
+static const char * const connector_names[] = { "CRTC_ID", "Broadcast RGB" };
+
+/* What igt_display_init() looks up, as in igt_fill_*_props() */
+static void find_all(int fd)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(snapshot_objects); i++) {
+		const struct snapshot_object *obj = &snapshot_objects[i];
+		const char * const *names;
+		uint32_t ids[3] = {};
+		int num, expected;
+
+		switch (obj->type) {
+		case DRM_MODE_OBJECT_PLANE:
+			names = plane_names;
+			num = ARRAY_SIZE(plane_names);
+			expected = num;
+			break;
+		case DRM_MODE_OBJECT_CRTC:
+			names = crtc_names;
+			num = ARRAY_SIZE(crtc_names);
+			/* No DEGAMMA_LUT in the snapshot */
+			expected = num - 1;
+			break;
+		default:
+			names = connector_names;
+			num = ARRAY_SIZE(connector_names);
+			expected = num;
+			break;
+		}
+
+		igt_assert_eq(igt_kms_cache_find_properties(fd, obj->id,
+							    obj->type, num,
+							    names, ids),
+			      expected);
+	}
+
+	igt_assert_eq(igt_kms_cache_find_property(fd, 28, DRM_MODE_OBJECT_PLANE,
+						  "type"), 1);
+	igt_assert_eq(igt_kms_cache_find_property(fd, 300,
+						  DRM_MODE_OBJECT_CONNECTOR,
+						  "CRTC_ID"), 4);
+	igt_assert_eq(igt_kms_cache_find_property(fd, 31, DRM_MODE_OBJECT_CRTC,
+						  "CTM"), 0);
+}
+
+static void reset_calls(void)
+{
+	object_calls = 0;
+	property_calls = 0;
+}
+
+static void report_calls(const char *what)
+{
+	igt_info("%s: %d object property lists, %d properties\n",
+		 what, object_calls, property_calls);
+}
+
+static void assert_cold(void)
+{
+	/* Each object and each property definition fetched exactly once */
+	igt_assert_eq(object_calls, ARRAY_SIZE(snapshot_objects));
+	igt_assert_eq(property_calls, NUM_SNAPSHOT_PROPS);
+}
+
+static void assert_warm(void)
+{
+	igt_assert_eq(object_calls, 0);
+	igt_assert_eq(property_calls, 0);
+}
+
+igt_main
+{
+	int fd = -1;
+
+	igt_fixture {
+		fd = open("/dev/null", O_RDWR);
+		igt_assert_lte(0, fd);
+
+		igt_kms_cache_set_backend(&snapshot_backend);
+	}
+
+	igt_subtest("cold-warm") {
+		int i, uncached = 0;
+
+		/* igt_kms used to get the object and all of its properties */
+		for (i = 0; i < ARRAY_SIZE(snapshot_objects); i++)
+			uncached += 1 + snapshot_objects[i].count;
+		igt_info("uncached: %d ioctls\n", uncached);
+
+		igt_kms_cache_invalidate(fd);
+
+		reset_calls();
+		find_all(fd);
+		report_calls("cold");
+		assert_cold();
+
+		reset_calls();
+		find_all(fd);
+		find_all(fd);
+		report_calls("warm");
+		assert_warm();
+	}
+
+	igt_subtest("invalidate") {
+		find_all(fd);
+
+		igt_kms_cache_invalidate(fd);
+
+		reset_calls();
+		find_all(fd);
+		report_calls("after invalidate");
+		assert_cold();
+	}
+
+	igt_subtest("fd-reuse") {
+		int other;
+
+		find_all(fd);
+
+		/* Same fd number, different device */
+		other = open("/dev/zero", O_RDWR);
+		igt_assert_lte(0, other);
+		igt_assert_eq(dup2(other, fd), fd);
+		close(other);
+
+		/* Not noticed by warm lookups until the next periodic check */
+		reset_calls();
+		find_all(fd);
+		assert_warm();
+
+		igt_kms_cache_check(fd);
+		reset_calls();
+		find_all(fd);
+		report_calls("after reuse");
+		assert_cold();
+	}
+
+	igt_subtest("client-cap") {
+		/* As in igt_display_init(), the first time the caps are unknown */
+		find_all(fd);
+		igt_assert_eq(igt_kms_cache_set_client_cap(fd, DRM_CLIENT_CAP_ATOMIC, 1), 0);
+		reset_calls();
+		find_all(fd);
+		assert_cold();
+
+		/* And the next times they don't change */
+		igt_assert_eq(igt_kms_cache_set_client_cap(fd, DRM_CLIENT_CAP_ATOMIC, 1), 0);
+		reset_calls();
+		find_all(fd);
+		assert_warm();
+
+		/* As in kms_properties, which looks at both sets */
+		igt_assert_eq(igt_kms_cache_set_client_cap(fd, DRM_CLIENT_CAP_ATOMIC, 0), 0);
+		igt_assert_eq(igt_kms_cache_find_property(fd, 28,
+							  DRM_MODE_OBJECT_PLANE,
+							  "CRTC_ID"), 0);
+		igt_assert_eq(igt_kms_cache_find_property(fd, 28,
+							  DRM_MODE_OBJECT_PLANE,
+							  "rotation"), 13);
+
+		igt_assert_eq(igt_kms_cache_set_client_cap(fd, DRM_CLIENT_CAP_ATOMIC, 1), 0);
+		reset_calls();
+		find_all(fd);
+		assert_cold();
+	}
+
+	igt_subtest("missing") {
+		const uint32_t *ids;
+		uint32_t id = 0;
+
+		igt_assert_eq(igt_kms_cache_get_object_props(fd, 1000,
+							     DRM_MODE_OBJECT_PLANE,
+							     &ids), -ENOENT);
+		igt_assert_eq(igt_kms_cache_find_properties(fd, 1000,
+							    DRM_MODE_OBJECT_PLANE,
+							    1, plane_names,
+							    &id), -ENOENT);
+		igt_assert_eq(id, 0);
+
+		/* A plane id looked up as a crtc */
+		igt_assert_eq(igt_kms_cache_find_property(fd, 28,
+							  DRM_MODE_OBJECT_CRTC,
+							  "ACTIVE"), 0);
+		igt_assert(!igt_kms_cache_get_property(fd, 1000));
+	}
+
+	igt_fixture {
+		igt_kms_cache_set_backend(NULL);
+		close(fd);
+	}
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "igt_core.h"
+
+/* The number of lines the log buffer keeps */
+#define LOG_LINES 256
+
+#define NUM_THREADS 16
+#define THREAD_LINES 20000
+
+struct line_check {
+	int count;
+	int last[NUM_THREADS];
+	int first;
+	bool ok;
+};
+
+/* Skips the "(program:pid) DEBUG: " prefix */
+static const char *skip_prefix(const char *line)
+{
+	const char *msg = strstr(line, " DEBUG: ");
+
+	igt_assert_f(line[0] == '(' && msg, "bad prefix: %s", line);
+
+	return msg + strlen(" DEBUG: ");
+}
+
+static bool check_thread_line(const char *line, void *data)
+{
+	struct line_check *c = data;
+	int thread, n, end = 0;
+
+	if (sscanf(skip_prefix(line), "thread %d line %d\n%n",
+		   &thread, &n, &end) != 2 || !end ||
+	    thread < 0 || thread >= NUM_THREADS ||
+	    n <= c->last[thread] || n >= THREAD_LINES) {
+		igt_warn("bad line %d: %s", c->count, line);
+		c->ok = false;
+		return true;
+	}
+
+	c->last[thread] = n;
+	c->count++;
+
+	return false;
+}
+
+static void *log_thread(void *arg)
+{
+	int thread = (long)arg;
+	int i;
+
+	for (i = 0; i < THREAD_LINES; i++)
+		igt_debug("thread %d line %d\n", thread, i);
+
+	return NULL;
+}
+
+static void test_concurrent(void)
+{
+	pthread_t threads[NUM_THREADS];
+	struct line_check c = { .ok = true };
+	long i;
+
+	for (i = 0; i < NUM_THREADS; i++)
+		igt_assert(pthread_create(&threads[i], NULL,
+					  log_thread, (void *)i) == 0);
+	for (i = 0; i < NUM_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < NUM_THREADS; i++)
+		c.last[i] = -1;
+
+	/* Whole lines only, in order for each thread */
+	igt_log_buffer_inspect(check_thread_line, &c);
+	igt_assert(c.ok);
+
+	/* Nothing is being written anymore, so nothing was skipped */
+	igt_assert_eq(c.count, LOG_LINES);
+}
+
+static bool check_sequence(const char *line, void *data)
+{
+	struct line_check *c = data;
+	int n;
+
+	if (sscanf(skip_prefix(line), "line %d\n", &n) != 1 ||
+	    n != c->first + c->count) {
+		igt_warn("bad line %d: %s", c->count, line);
+		c->ok = false;
+		return true;
+	}
+
+	c->count++;
+
+	return false;
+}
+
+static void test_wraparound(void)
+{
+	struct line_check c = { .ok = true };
+	int i;
+
+	for (i = 0; i < 1000; i++)
+		igt_debug("line %d\n", i);
+
+	/* Exactly the last lines, oldest first */
+	c.first = 1000 - LOG_LINES;
+	igt_log_buffer_inspect(check_sequence, &c);
+	igt_assert(c.ok);
+	igt_assert_eq(c.count, LOG_LINES);
+}
+
+static bool check_stop(const char *line, void *data)
+{
+	int *count = data;
+
+	return ++*count == 10;
+}
+
+static bool copy_last(const char *line, void *data)
+{
+	char **last = data;
+
+	free(*last);
+	*last = strdup(line);
+
+	return false;
+}
+
+static void test_long_line(void)
+{
+	char msg[8192], *last = NULL;
+	const char *logged;
+	int i, count = 0;
+
+	for (i = 0; i < sizeof(msg) - 2; i++)
+		msg[i] = 'a' + i % 26;
+	msg[i++] = '\n';
+	msg[i] = '\0';
+
+	igt_debug("%s", msg);
+
+	/* Truncated, but the start of the line and its end are kept */
+	igt_log_buffer_inspect(copy_last, &last);
+	igt_assert(last);
+	logged = skip_prefix(last);
+	igt_assert(strlen(logged) > 1 && strlen(logged) < strlen(msg));
+	igt_assert(strncmp(logged, msg, strlen(logged) - 1) == 0);
+	igt_assert(logged[strlen(logged) - 1] == '\n');
+	free(last);
+	last = NULL;
+
+	/* And the next line still gets its prefix */
+	igt_debug("line %d\n", 0);
+	igt_log_buffer_inspect(copy_last, &last);
+	igt_assert(last);
+	igt_assert_eq(strcmp(skip_prefix(last), "line 0\n"), 0);
+	free(last);
+
+	/* Stopping early */
+	for (i = 1; i < 20; i++)
+		igt_debug("line %d\n", i);
+	igt_log_buffer_inspect(check_stop, &count);
+	igt_assert_eq(count, 10);
+}
+
+static void test_continuation(void)
+{
+	char *last = NULL;
+
+	igt_debug("first half, ");
+	igt_debug("second half\n");
+
+	/* Continued lines are logged without prefix */
+	igt_log_buffer_inspect(copy_last, &last);
+	igt_assert(last);
+	igt_assert_eq(strcmp(last, "second half\n"), 0);
+	free(last);
+}
+
+igt_main
+{
+	igt_subtest("concurrent")
+		test_concurrent();
+
+	igt_subtest("wraparound")
+		test_wraparound();
+
+	igt_subtest("long-line")
+		test_long_line();
+
+	igt_subtest("continuation")
+		test_continuation();
+}
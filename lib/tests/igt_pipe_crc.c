@@ -0,0 +1,333 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_aux.h"
+#include "igt_debugfs.h"
+#include "igt_kms.h"
+
+/*
+ * Runs the pipe CRC reader against a directory laid out like debugfs, with
+ * a fifo as crtc-0/crc/data which a thread fills with lines formatted like
+ * the kernel's, as fast as it can.
+ */
+
+#define N_WORDS 5
+/* Lines written at once, and the most a paced writer gets ahead */
+#define BURST 1024
+
+struct writer {
+	pthread_t thread;
+	char dir[32];
+	char path[64];
+	int n_crcs;
+	bool paced;
+	const char *extra;
+	volatile int consumed;
+};
+
+static uint32_t crc_word(uint32_t frame, int i)
+{
+	return frame * 0x9e3779b1 + i;
+}
+
+static int format_crc(char *buf, uint32_t frame)
+{
+	int len, i;
+
+	len = sprintf(buf, "%#10x", frame);
+	for (i = 0; i < N_WORDS; i++)
+		len += sprintf(buf + len, " %#10x", crc_word(frame, i));
+	buf[len++] = '\n';
+
+	return len;
+}
+
+static void write_all(int fd, const char *buf, int len)
+{
+	while (len) {
+		int ret = write(fd, buf, len);
+
+		igt_assert_lt(0, ret);
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static void *writer_thread(void *arg)
+{
+	struct writer *w = arg;
+	static char buf[BURST * (11 * (N_WORDS + 1) + 1)];
+	int fd, frame = 0;
+
+	fd = open(w->path, O_WRONLY);
+	igt_assert_lte(0, fd);
+
+	if (w->extra)
+		write_all(fd, w->extra, strlen(w->extra));
+
+	while (frame < w->n_crcs) {
+		int len = 0;
+		int end = min(frame + BURST, w->n_crcs);
+
+		/* Don't get more than a burst ahead of the test */
+		while (w->paced && w->consumed + BURST < frame)
+			sched_yield();
+
+		for (; frame < end; frame++)
+			len += format_crc(buf + len, frame);
+
+		write_all(fd, buf, len);
+	}
+
+	close(fd);
+
+	return NULL;
+}
+
+static const char * const fake_debugfs[] = {
+	"crtc-0/crc/data",
+	"crtc-0/crc/control",
+	"crtc-0/crc",
+	"crtc-0",
+};
+
+static igt_pipe_crc_t *fake_pipe_crc(struct writer *w, int n_crcs,
+				     bool paced, int flags)
+{
+	char path[64];
+	int fd;
+
+	strcpy(w->dir, "/tmp/igt_pipe_crc.XXXXXX");
+	igt_assert(mkdtemp(w->dir));
+
+	snprintf(path, sizeof(path), "%s/%s", w->dir, fake_debugfs[3]);
+	igt_assert_eq(mkdir(path, 0700), 0);
+	snprintf(path, sizeof(path), "%s/%s", w->dir, fake_debugfs[2]);
+	igt_assert_eq(mkdir(path, 0700), 0);
+	snprintf(path, sizeof(path), "%s/%s", w->dir, fake_debugfs[1]);
+	fd = open(path, O_WRONLY | O_CREAT, 0600);
+	igt_assert_lte(0, fd);
+	close(fd);
+	snprintf(w->path, sizeof(w->path), "%s/%s", w->dir, fake_debugfs[0]);
+	igt_assert_eq(mkfifo(w->path, 0600), 0);
+
+	w->n_crcs = n_crcs;
+	w->paced = paced;
+	igt_assert_eq(pthread_create(&w->thread, NULL, writer_thread, w), 0);
+
+	fd = open(w->dir, O_RDONLY | O_DIRECTORY);
+	igt_assert_lte(0, fd);
+
+	return __igt_pipe_crc_new(fd, PIPE_A, INTEL_PIPE_CRC_SOURCE_AUTO,
+				  flags);
+}
+
+static void fake_pipe_crc_free(igt_pipe_crc_t *pipe_crc, struct writer *w)
+{
+	char path[64];
+	int i;
+
+	pthread_join(w->thread, NULL);
+	igt_pipe_crc_free(pipe_crc);
+
+	for (i = 0; i < ARRAY_SIZE(fake_debugfs); i++) {
+		snprintf(path, sizeof(path), "%s/%s", w->dir, fake_debugfs[i]);
+		remove(path);
+	}
+	rmdir(w->dir);
+}
+
+static void check_crc(const igt_crc_t *crc, uint32_t frame)
+{
+	int i;
+
+	igt_assert(crc->has_valid_frame);
+	igt_assert_eq_u32(crc->frame, frame);
+	igt_assert_eq(crc->n_words, N_WORDS);
+	for (i = 0; i < N_WORDS; i++)
+		igt_assert_eq_u32(crc->crc[i], crc_word(frame, i));
+	igt_assert(crc->timestamp);
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+		1e-9 * (now.tv_nsec - start->tv_nsec);
+}
+
+static void test_queued(void)
+{
+	const int n_crcs = 1 << 18;
+	struct writer w = {};
+	igt_pipe_crc_t *pipe_crc;
+	igt_crc_t crcs[512];
+	struct timespec start;
+	uint64_t last = 0;
+	int n, i;
+
+	pipe_crc = fake_pipe_crc(&w, n_crcs, true, O_RDONLY);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	igt_pipe_crc_start_reader(pipe_crc);
+
+	while ((n = igt_pipe_crc_get_queued(pipe_crc, crcs,
+					    ARRAY_SIZE(crcs))) >= 0) {
+		if (!n)
+			sched_yield();
+
+		for (i = 0; i < n; i++) {
+			check_crc(&crcs[i], w.consumed + i);
+			igt_assert(crcs[i].timestamp >= last);
+			last = crcs[i].timestamp;
+		}
+
+		w.consumed += n;
+	}
+
+	igt_assert_eq(n, -EPIPE);
+	igt_assert_eq(w.consumed, n_crcs);
+	igt_info("%d CRCs in %.1fms\n", n_crcs, 1e3 * elapsed(&start));
+
+	fake_pipe_crc_free(pipe_crc, &w);
+}
+
+static void test_blocking(void)
+{
+	const int n_crcs = 1 << 16;
+	struct writer w = {};
+	igt_pipe_crc_t *pipe_crc;
+	igt_crc_t *crcs, crc;
+	int i;
+
+	pipe_crc = fake_pipe_crc(&w, n_crcs, true, O_RDONLY);
+	igt_pipe_crc_start_reader(pipe_crc);
+
+	igt_pipe_crc_get_single(pipe_crc, &crc);
+	check_crc(&crc, 0);
+	w.consumed = 1;
+
+	while (w.consumed < n_crcs) {
+		int n = min(n_crcs - w.consumed, 1000);
+
+		igt_assert_eq(igt_pipe_crc_get_crcs(pipe_crc, n, &crcs), n);
+		for (i = 0; i < n; i++)
+			check_crc(&crcs[i], w.consumed + i);
+		free(crcs);
+
+		w.consumed += n;
+	}
+
+	igt_pipe_crc_stop(pipe_crc);
+	fake_pipe_crc_free(pipe_crc, &w);
+}
+
+static void test_overflow(void)
+{
+	const int n_crcs = 3 * 4096 + 100;
+	struct writer w = {};
+	igt_pipe_crc_t *pipe_crc;
+	igt_crc_t crcs[512];
+	int n, i, first = -1;
+
+	pipe_crc = fake_pipe_crc(&w, n_crcs, false, O_RDONLY | O_NONBLOCK);
+	igt_pipe_crc_start_reader(pipe_crc);
+
+	/* Everything written was read, and the queue won't change anymore */
+	igt_assert_eq(igt_pipe_crc_wait_reader(pipe_crc), -EPIPE);
+
+	/* Only the newest are left */
+	while ((n = igt_pipe_crc_get_queued(pipe_crc, crcs,
+					    ARRAY_SIZE(crcs))) >= 0) {
+		if (!n)
+			sched_yield();
+
+		if (n && first < 0)
+			first = crcs[0].frame;
+
+		for (i = 0; i < n; i++)
+			check_crc(&crcs[i], first + w.consumed + i);
+
+		w.consumed += n;
+	}
+
+	igt_assert_eq(first + w.consumed, n_crcs);
+	igt_assert_eq(w.consumed, 4096);
+
+	fake_pipe_crc_free(pipe_crc, &w);
+}
+
+static void test_malformed(void)
+{
+	struct writer w = {
+		.extra = "garbage\n"
+			 "XXXXXXXXXX 0x12345678\n",
+	};
+	igt_pipe_crc_t *pipe_crc;
+	igt_crc_t crc;
+
+	pipe_crc = fake_pipe_crc(&w, 2, false, O_RDONLY);
+	igt_pipe_crc_start_reader(pipe_crc);
+
+	igt_pipe_crc_get_single(pipe_crc, &crc);
+	igt_assert(!crc.has_valid_frame);
+	igt_assert_eq(crc.n_words, 1);
+	igt_assert_eq_u32(crc.crc[0], 0x12345678);
+
+	igt_pipe_crc_get_single(pipe_crc, &crc);
+	check_crc(&crc, 0);
+	igt_pipe_crc_get_single(pipe_crc, &crc);
+	check_crc(&crc, 1);
+
+	fake_pipe_crc_free(pipe_crc, &w);
+}
+
+igt_main
+{
+	igt_subtest("queued")
+		test_queued();
+
+	igt_subtest("blocking")
+		test_blocking();
+
+	igt_subtest("overflow")
+		test_overflow();
+
+	igt_subtest("malformed")
+		test_malformed();
+}
@@ -22,7 +22,10 @@
  *
  */
 
+#include <pthread.h>
+
 #include "igt_core.h"
+#include "igt_rand.h"
 #include "igt_stats.h"
 
 #define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
@@ -228,6 +231,600 @@ static void test_reallocation(void)
 	igt_stats_fini(&stats);
 }
 
+#define STREAMING_PRECISION 7
+#define STREAMING_VALUES (1 << 20)
+
+static double streaming_bound(double exact)
+{
+	return ldexp(fabs(exact), -(STREAMING_PRECISION + 1)) + 1e-12;
+}
+
+static void compare_streaming(igt_stats_t *exact, igt_stats_t *streaming,
+			      const char *name)
+{
+	double e[3], s[3], bound;
+	int i;
+
+	igt_debug("%s\n", name);
+
+	igt_assert_eq(exact->n_values, streaming->n_values);
+
+	igt_assert_f(fabs(igt_stats_get_mean(streaming) - igt_stats_get_mean(exact)) <=
+		     1e-9 * fabs(igt_stats_get_mean(exact)) + 1e-9,
+		     "%s: mean %f, exact %f\n", name,
+		     igt_stats_get_mean(streaming), igt_stats_get_mean(exact));
+	igt_assert_f(fabs(igt_stats_get_variance(streaming) - igt_stats_get_variance(exact)) <=
+		     1e-6 * igt_stats_get_variance(exact) + 1e-9,
+		     "%s: variance %f, exact %f\n", name,
+		     igt_stats_get_variance(streaming),
+		     igt_stats_get_variance(exact));
+
+	igt_stats_get_quartiles(exact, &e[0], &e[1], &e[2]);
+	igt_stats_get_quartiles(streaming, &s[0], &s[1], &s[2]);
+	for (i = 0; i < 3; i++)
+		igt_assert_f(fabs(s[i] - e[i]) <= streaming_bound(e[i]),
+			     "%s: q%d %f, exact %f\n", name, i + 1, s[i], e[i]);
+
+	igt_assert_f(fabs(igt_stats_get_median(streaming) - e[1]) <=
+		     streaming_bound(e[1]),
+		     "%s: median %f, exact %f\n", name,
+		     igt_stats_get_median(streaming), e[1]);
+
+	bound = streaming_bound(e[0]) + streaming_bound(e[2]);
+	igt_assert_f(fabs(igt_stats_get_iqr(streaming) - igt_stats_get_iqr(exact)) <= bound,
+		     "%s: iqr %f, exact %f\n", name,
+		     igt_stats_get_iqr(streaming), igt_stats_get_iqr(exact));
+
+	bound = streaming_bound(fabs(e[0]) + 2 * fabs(e[1]) + fabs(e[2])) / 4;
+	igt_assert_f(fabs(igt_stats_get_trimean(streaming) - igt_stats_get_trimean(exact)) <= bound,
+		     "%s: trimean %f, exact %f\n", name,
+		     igt_stats_get_trimean(streaming),
+		     igt_stats_get_trimean(exact));
+
+	/* The interquartile values lie between the quartiles */
+	bound = streaming_bound(fmax(fabs(e[0]), fabs(e[2])));
+	igt_assert_f(fabs(igt_stats_get_iqm(streaming) - igt_stats_get_iqm(exact)) <= bound,
+		     "%s: iqm %f, exact %f\n", name,
+		     igt_stats_get_iqm(streaming), igt_stats_get_iqm(exact));
+}
+
+static void test_streaming_exact_small(void)
+{
+	igt_stats_t exact, streaming;
+	double e[3], s[3];
+	unsigned int i;
+
+	/* Integers below 2^(precision + 1) have a bucket of their own */
+	igt_stats_init(&exact);
+	igt_stats_init_streaming(&streaming, STREAMING_PRECISION);
+
+	for (i = 0; i < 10001; i++) {
+		uint64_t v = (i * 7919) % (2 << STREAMING_PRECISION);
+
+		igt_stats_push(&exact, v);
+		igt_stats_push(&streaming, v);
+	}
+	igt_assert(streaming.values_u64 == NULL);
+
+	igt_stats_get_quartiles(&exact, &e[0], &e[1], &e[2]);
+	igt_stats_get_quartiles(&streaming, &s[0], &s[1], &s[2]);
+	for (i = 0; i < 3; i++)
+		igt_assert_eq_double(s[i], e[i]);
+	/* Only summed in a different order */
+	igt_assert(fabs(igt_stats_get_iqm(&streaming) -
+			igt_stats_get_iqm(&exact)) < 1e-9);
+	igt_assert_eq(igt_stats_get_min(&streaming), igt_stats_get_min(&exact));
+	igt_assert_eq(igt_stats_get_max(&streaming), igt_stats_get_max(&exact));
+
+	igt_stats_fini(&streaming);
+	igt_stats_fini(&exact);
+}
+
+enum streaming_input {
+	UNIFORM,
+	EXPONENTIAL,
+	ASCENDING,
+	DESCENDING,
+	CONSTANT,
+	CLUSTERS,
+	ALTERNATING,
+	FLOAT_MIXED_SIGN,
+	FLOAT_ZEROS,
+	FLOAT_UNIT_SIGNS,
+	FLOAT_HUGE_RANGE,
+	INT_THEN_FLOAT,
+	NUM_STREAMING_INPUTS,
+};
+
+static const char *streaming_input_names[] = {
+	[UNIFORM] = "uniform",
+	[EXPONENTIAL] = "exponential",
+	[ASCENDING] = "ascending",
+	[DESCENDING] = "descending",
+	[CONSTANT] = "constant",
+	[CLUSTERS] = "clusters",
+	[ALTERNATING] = "alternating",
+	[FLOAT_MIXED_SIGN] = "float-mixed-sign",
+	[FLOAT_ZEROS] = "float-zeros",
+	[FLOAT_UNIT_SIGNS] = "float-unit-signs",
+	[FLOAT_HUGE_RANGE] = "float-huge-range",
+	[INT_THEN_FLOAT] = "int-then-float",
+};
+
+static void push_both(igt_stats_t *a, igt_stats_t *b, bool is_float,
+		      uint64_t u, double f)
+{
+	if (is_float) {
+		igt_stats_push_float(a, f);
+		igt_stats_push_float(b, f);
+	} else {
+		igt_stats_push(a, u);
+		igt_stats_push(b, u);
+	}
+}
+
+static void test_streaming_input(enum streaming_input input)
+{
+	igt_stats_t exact, streaming;
+	uint32_t seed = input;
+	unsigned int i;
+
+	igt_stats_init_with_size(&exact, STREAMING_VALUES);
+	igt_stats_init_streaming(&streaming, STREAMING_PRECISION);
+
+	for (i = 0; i < STREAMING_VALUES; i++) {
+		uint32_t r = hars_petruska_f54_1_random(&seed);
+		uint64_t u = 0;
+		double f = 0.;
+		bool is_float = false;
+
+		switch (input) {
+		case UNIFORM:
+			u = (uint64_t)r << 8 | (r & 0xff);
+			break;
+		case EXPONENTIAL:
+			/* latency like, with a long tail */
+			u = 1000 * -log((r + 1.) / 4294967297.);
+			break;
+		case ASCENDING:
+			u = (uint64_t)i * i;
+			break;
+		case DESCENDING:
+			u = (uint64_t)(STREAMING_VALUES - i) << 20;
+			break;
+		case CONSTANT:
+			u = 123456789;
+			break;
+		case CLUSTERS:
+			u = r & 1 ? 1 + (r >> 28) : (1ull << 60) + r;
+			break;
+		case ALTERNATING:
+			u = i & 1 ? ~0ull - r : r;
+			break;
+		case FLOAT_MIXED_SIGN:
+			is_float = true;
+			f = ((double)r - 2147483648.) / 3.;
+			break;
+		case FLOAT_ZEROS:
+			is_float = true;
+			f = r % 3 ? 0. : r / 4294967296.;
+			break;
+		case FLOAT_UNIT_SIGNS:
+			is_float = true;
+			f = r % 3 == 0 ? -1. : r % 3 == 1 ? 1. : -0.;
+			break;
+		case FLOAT_HUGE_RANGE:
+			is_float = true;
+			f = ldexp(1. + r / 4294967296., (int)(r % 600) - 300);
+			break;
+		case INT_THEN_FLOAT:
+			is_float = i >= STREAMING_VALUES / 2;
+			u = r;
+			f = r + 0.5;
+			break;
+		default:
+			igt_assert(0);
+		}
+
+		push_both(&exact, &streaming, is_float, u, f);
+	}
+
+	compare_streaming(&exact, &streaming, streaming_input_names[input]);
+
+	/* Bounded by the range of the values, not their number */
+	igt_assert(streaming.hist[0].n_buckets + streaming.hist[1].n_buckets <=
+		   2 * (2048 + 65) << STREAMING_PRECISION);
+
+	igt_stats_fini(&streaming);
+	igt_stats_fini(&exact);
+}
+
+static void test_streaming_zero_sign(void)
+{
+	static const double values[] = { 0., 1., -1., -0., 1e-9, -1e9 };
+	igt_stats_t exact, streaming;
+	double e[3], s[3];
+	unsigned int i;
+
+	/*
+	 * Zero and the signs don't make the histograms span all the doubles
+	 * in between, even at the highest precision.
+	 */
+	igt_stats_init(&exact);
+	igt_stats_init_streaming(&streaming, 16);
+
+	for (i = 0; i < 3 * 1000; i++) {
+		igt_stats_push_float(&exact, values[i % 3]);
+		igt_stats_push_float(&streaming, values[i % 3]);
+	}
+	igt_assert_eq(streaming.n_zeros, 1000);
+	igt_assert_eq(streaming.hist[0].n_buckets, 64);
+	igt_assert_eq(streaming.hist[1].n_buckets, 64);
+
+	igt_stats_get_quartiles(&exact, &e[0], &e[1], &e[2]);
+	igt_stats_get_quartiles(&streaming, &s[0], &s[1], &s[2]);
+	for (i = 0; i < 3; i++)
+		igt_assert_eq_double(s[i], e[i]);
+	igt_assert(fabs(igt_stats_get_iqm(&streaming) -
+			igt_stats_get_iqm(&exact)) < 1e-9);
+
+	/* Each sign then spans 30 powers of two, 8MiB at 2^16 buckets each */
+	for (i = 4; i < 6; i++) {
+		igt_stats_push_float(&exact, values[i]);
+		igt_stats_push_float(&streaming, values[i]);
+	}
+	igt_assert(streaming.hist[0].n_buckets <= 1 << 21);
+	igt_assert(streaming.hist[1].n_buckets <= 1 << 21);
+	compare_streaming(&exact, &streaming, "zero-sign");
+
+	igt_stats_fini(&streaming);
+	igt_stats_fini(&exact);
+}
+
+static void test_streaming(void)
+{
+	enum streaming_input input;
+
+	test_streaming_exact_small();
+	test_streaming_zero_sign();
+
+	for (input = 0; input < NUM_STREAMING_INPUTS; input++)
+		test_streaming_input(input);
+}
+
+static int cmp_double(const void *pa, const void *pb)
+{
+	const double *a = pa, *b = pb;
+
+	return *a < *b ? -1 : *a > *b;
+}
+
+/* Tukey's hinges on a sorted array, as igt_stats always defined them */
+static double sorted_median(const double *v, unsigned int start,
+			    unsigned int end, unsigned int *lower_end,
+			    unsigned int *upper_start)
+{
+	unsigned int n = end - start, mid;
+
+	if (n % 2) {
+		mid = start + n / 2;
+		*lower_end = mid + 1;
+		*upper_start = mid;
+		return v[mid];
+	}
+
+	mid = start + n / 2 - 1;
+	*lower_end = mid + 1;
+	*upper_start = mid + 1;
+	return (v[mid] + v[mid + 1]) / 2.;
+}
+
+static double sorted_percentile(const double *v, unsigned int n, double p)
+{
+	double h = (n - 1) * p / 100.;
+	unsigned int lo = h;
+	double f = h - lo;
+
+	return (1. - f) * v[lo] + f * v[lo + 1 < n ? lo + 1 : lo];
+}
+
+static const double percentiles[] = { 0, 1, 10, 25, 50, 75, 90, 99, 99.9, 100 };
+
+static void check_selection(igt_stats_t *stats, double *sorted, unsigned int n)
+{
+	double q[3], eq[3], values[ARRAY_SIZE(percentiles)];
+	unsigned int lower_end, upper_start, dummy, i;
+
+	qsort(sorted, n, sizeof(*sorted), cmp_double);
+
+	eq[1] = sorted_median(sorted, 0, n, &lower_end, &upper_start);
+	eq[0] = sorted_median(sorted, 0, lower_end, &dummy, &dummy);
+	eq[2] = sorted_median(sorted, upper_start, n, &dummy, &dummy);
+
+	igt_stats_get_quartiles(stats, &q[0], &q[1], &q[2]);
+	for (i = 0; i < 3; i++)
+		igt_assert_eq_double(q[i], eq[i]);
+	igt_assert_eq_double(igt_stats_get_median(stats), eq[1]);
+	igt_assert_eq_double(igt_stats_get_percentile(stats, 50), eq[1]);
+
+	igt_stats_get_percentiles(stats, percentiles, values,
+				  ARRAY_SIZE(percentiles));
+	for (i = 0; i < ARRAY_SIZE(percentiles); i++)
+		igt_assert_eq_double(values[i],
+				     sorted_percentile(sorted, n, percentiles[i]));
+	igt_assert_eq_double(values[0], sorted[0]);
+	igt_assert_eq_double(values[ARRAY_SIZE(percentiles) - 1], sorted[n - 1]);
+}
+
+static void test_selection(void)
+{
+	static const unsigned int sizes[] = { 3, 4, 5, 17, 100, 1001, 65536, 1000003 };
+	unsigned int s, i, kind;
+	uint32_t seed = 1;
+
+	for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+		unsigned int n = sizes[s];
+		double *sorted = malloc(n * sizeof(*sorted));
+
+		/* random, few distinct values, ascending, descending, floats */
+		for (kind = 0; kind < 5; kind++) {
+			double values[ARRAY_SIZE(percentiles)];
+			igt_stats_t stats, copy;
+			double iqm;
+
+			igt_stats_init_with_size(&stats, n);
+			for (i = 0; i < n; i++) {
+				uint32_t r = hars_petruska_f54_1_random(&seed);
+				uint64_t v;
+
+				switch (kind) {
+				case 0: v = (uint64_t)r << 24 ^ r; break;
+				case 1: v = r % 3; break;
+				case 2: v = i; break;
+				case 3: v = n - i; break;
+				default:
+					sorted[i] = ((double)r - 2147483648.) / 7.;
+					igt_stats_push_float(&stats, sorted[i]);
+					continue;
+				}
+
+				sorted[i] = v;
+				igt_stats_push(&stats, v);
+			}
+
+			/*
+			 * The same values, fully sorted by asking for many
+			 * percentiles before any other query.
+			 */
+			igt_stats_init_with_size(&copy, n);
+			for (i = 0; i < n; i++) {
+				if (stats.is_float)
+					igt_stats_push_float(&copy, stats.values_f[i]);
+				else
+					igt_stats_push(&copy, stats.values_u64[i]);
+			}
+			igt_stats_get_percentiles(&copy, percentiles, values,
+						  ARRAY_SIZE(percentiles));
+			igt_assert(copy.sorted_array_valid);
+
+			/* Selected and partially sorted */
+			iqm = igt_stats_get_iqm(&stats);
+			igt_assert(!stats.sorted_array_valid);
+			igt_assert_eq_double(igt_stats_get_iqm(&copy), iqm);
+
+			check_selection(&stats, sorted, n);
+			check_selection(&copy, sorted, n);
+
+			igt_stats_fini(&copy);
+			igt_stats_fini(&stats);
+		}
+
+		free(sorted);
+	}
+}
+
+#define MERGE_THREADS 4
+#define MERGE_VALUES 20011
+
+static uint64_t merge_value(unsigned int i)
+{
+	uint32_t seed = i;
+
+	return hars_petruska_f54_1_random(&seed) >> (i % 24);
+}
+
+static void assert_same_quartiles(igt_stats_t *a, igt_stats_t *b)
+{
+	double qa[3], qb[3];
+	unsigned int i;
+
+	igt_assert_eq(a->n_values, b->n_values);
+
+	igt_stats_get_quartiles(a, &qa[0], &qa[1], &qa[2]);
+	igt_stats_get_quartiles(b, &qb[0], &qb[1], &qb[2]);
+	for (i = 0; i < 3; i++)
+		igt_assert_eq_double(qa[i], qb[i]);
+
+	igt_assert_eq_double(igt_stats_get_percentile(a, 99),
+			     igt_stats_get_percentile(b, 99));
+	igt_assert(fabs(igt_stats_get_mean(a) - igt_stats_get_mean(b)) <=
+		   1e-9 * fabs(igt_stats_get_mean(b)));
+	igt_assert(fabs(igt_stats_get_variance(a) - igt_stats_get_variance(b)) <=
+		   1e-9 * igt_stats_get_variance(b));
+}
+
+static void test_merge_exact(void)
+{
+	igt_stats_t parts[3], merged, all;
+	unsigned int i;
+
+	igt_stats_init(&all);
+	for (i = 0; i < 3; i++)
+		igt_stats_init(&parts[i]);
+
+	/* The last part converts the merged values to floats */
+	for (i = 0; i < MERGE_VALUES; i++) {
+		unsigned int part = 3 * i / MERGE_VALUES;
+
+		if (part == 2) {
+			igt_stats_push_float(&parts[part], merge_value(i) + 0.25);
+			igt_stats_push_float(&all, merge_value(i) + 0.25);
+		} else {
+			igt_stats_push(&parts[part], merge_value(i));
+			igt_stats_push(&all, merge_value(i));
+		}
+	}
+
+	igt_stats_init(&merged);
+	for (i = 0; i < 3; i++)
+		igt_stats_merge(&merged, &parts[i]);
+
+	igt_assert(merged.is_float);
+	assert_same_quartiles(&merged, &all);
+	igt_assert_eq_double(merged.range[1], all.range[1]);
+
+	/* Merging into a streaming set is the same as pushing to it */
+	igt_stats_fini(&merged);
+	igt_stats_fini(&all);
+	igt_stats_init_streaming(&merged, STREAMING_PRECISION);
+	igt_stats_init_streaming(&all, STREAMING_PRECISION);
+	for (i = 0; i < 2; i++) {
+		igt_stats_merge(&merged, &parts[i]);
+		igt_stats_push_array(&all, parts[i].values_u64,
+				     parts[i].n_values);
+	}
+	assert_same_quartiles(&merged, &all);
+	igt_assert_eq(igt_stats_get_min(&merged), igt_stats_get_min(&all));
+	igt_assert_eq(igt_stats_get_max(&merged), igt_stats_get_max(&all));
+
+	for (i = 0; i < 3; i++)
+		igt_stats_fini(&parts[i]);
+	igt_stats_fini(&merged);
+	igt_stats_fini(&all);
+}
+
+static void test_merge_streaming(void)
+{
+	igt_stats_t parts[3], merged, all, coarse;
+	double e[3], s[3];
+	unsigned int i;
+
+	igt_stats_init_streaming(&all, STREAMING_PRECISION);
+	for (i = 0; i < 3; i++)
+		igt_stats_init_streaming(&parts[i], STREAMING_PRECISION);
+
+	/* Disjoint ranges, and floats in the last part */
+	for (i = 0; i < MERGE_VALUES; i++) {
+		unsigned int part = i % 3;
+		uint64_t v = merge_value(i) << (8 * part);
+
+		if (part == 2) {
+			igt_stats_push_float(&parts[part], v / 3.);
+			igt_stats_push_float(&all, v / 3.);
+		} else {
+			igt_stats_push(&parts[part], v);
+			igt_stats_push(&all, v);
+		}
+	}
+
+	/* Same precision, the histograms are simply added */
+	igt_stats_init_streaming(&merged, STREAMING_PRECISION);
+	for (i = 0; i < 3; i++)
+		igt_stats_merge(&merged, &parts[i]);
+	assert_same_quartiles(&merged, &all);
+	igt_assert_eq_double(merged.range[0], all.range[0]);
+	igt_assert_eq_double(merged.range[1], all.range[1]);
+
+	/* With a lower precision, within the error of both */
+	igt_stats_init_streaming(&coarse, STREAMING_PRECISION - 2);
+	for (i = 0; i < 3; i++)
+		igt_stats_merge(&coarse, &parts[i]);
+	igt_assert_eq(coarse.n_values, all.n_values);
+	igt_stats_get_quartiles(&all, &e[0], &e[1], &e[2]);
+	igt_stats_get_quartiles(&coarse, &s[0], &s[1], &s[2]);
+	for (i = 0; i < 3; i++)
+		igt_assert(fabs(s[i] - e[i]) <=
+			   ldexp(fabs(e[i]), 2 - STREAMING_PRECISION));
+
+	for (i = 0; i < 3; i++)
+		igt_stats_fini(&parts[i]);
+	igt_stats_fini(&coarse);
+	igt_stats_fini(&merged);
+	igt_stats_fini(&all);
+}
+
+struct merge_thread {
+	pthread_t thread;
+	struct igt_stats_collector *c;
+	unsigned int id;
+};
+
+static void *merge_thread(void *arg)
+{
+	struct merge_thread *t = arg;
+	struct igt_stats_local *local = igt_stats_collector_local(t->c);
+	unsigned int i;
+
+	igt_assert(igt_stats_collector_local(t->c) == local);
+
+	for (i = t->id; i < MERGE_VALUES; i += MERGE_THREADS)
+		igt_stats_local_push(local, merge_value(i));
+
+	return NULL;
+}
+
+static void test_merge_collector(bool streaming)
+{
+	struct merge_thread threads[MERGE_THREADS];
+	struct igt_stats_collector c;
+	igt_stats_t merged, all;
+	unsigned int i;
+
+	if (streaming) {
+		igt_stats_collector_init_streaming(&c, STREAMING_PRECISION);
+		igt_stats_init_streaming(&merged, STREAMING_PRECISION);
+		igt_stats_init_streaming(&all, STREAMING_PRECISION);
+	} else {
+		igt_stats_collector_init(&c);
+		igt_stats_init(&merged);
+		igt_stats_init(&all);
+	}
+
+	for (i = 0; i < MERGE_THREADS; i++) {
+		threads[i].c = &c;
+		threads[i].id = i;
+		igt_assert(pthread_create(&threads[i].thread, NULL,
+					  merge_thread, &threads[i]) == 0);
+	}
+
+	/* The main thread also gets a set of its own */
+	igt_stats_collector_push(&c, 1ull << 40);
+	igt_stats_push(&all, 1ull << 40);
+
+	for (i = 0; i < MERGE_THREADS; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	for (i = 0; i < MERGE_VALUES; i++)
+		igt_stats_push(&all, merge_value(i));
+
+	igt_stats_collector_merge(&c, &merged);
+	assert_same_quartiles(&merged, &all);
+	igt_assert_eq(igt_stats_get_min(&merged), igt_stats_get_min(&all));
+	igt_assert_eq(igt_stats_get_max(&merged), igt_stats_get_max(&all));
+
+	igt_stats_collector_fini(&c);
+	igt_stats_fini(&merged);
+	igt_stats_fini(&all);
+}
+
+static void test_merge(void)
+{
+	test_merge_exact();
+	test_merge_streaming();
+	test_merge_collector(false);
+	test_merge_collector(true);
+}
+
 igt_simple_main
 {
 	test_init_zero();
@@ -240,4 +837,7 @@ igt_simple_main
 	test_invalidate_mean();
 	test_std_deviation();
 	test_reallocation();
+	test_streaming();
+	test_selection();
+	test_merge();
 }
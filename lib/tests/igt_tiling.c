@@ -0,0 +1,254 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <string.h>
+#include <i915_drm.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_rand.h"
+#include "igt_tiling.h"
+
+#define TILES_PER_ROW 5
+#define TILE_ROWS 3
+#define RECTS 500
+
+static uint32_t seed;
+
+/* The per pixel address computations igt_draw used to do */
+static unsigned long swizzle_bit(unsigned int bit, unsigned long offset)
+{
+	return (offset & (1ul << bit)) >> (bit - 6);
+}
+
+static int swizzle_addr(unsigned long addr, int swizzle)
+{
+	switch (swizzle) {
+	case I915_BIT_6_SWIZZLE_NONE:
+		return addr;
+	case I915_BIT_6_SWIZZLE_9:
+		return addr ^ swizzle_bit(9, addr);
+	case I915_BIT_6_SWIZZLE_9_10:
+		return addr ^ swizzle_bit(9, addr) ^ swizzle_bit(10, addr);
+	case I915_BIT_6_SWIZZLE_9_11:
+		return addr ^ swizzle_bit(9, addr) ^ swizzle_bit(11, addr);
+	case I915_BIT_6_SWIZZLE_9_10_11:
+		return (addr ^
+			swizzle_bit(9, addr) ^
+			swizzle_bit(10, addr) ^
+			swizzle_bit(11, addr));
+	default:
+		igt_assert(false);
+		return addr;
+	}
+}
+
+static int tile(int x, int y, uint32_t x_tile_size, uint32_t y_tile_size,
+		uint32_t line_size, bool xmajor)
+{
+	int tile_size, tiles_per_line, x_tile_n, y_tile_n, tile_off, pos;
+	int tile_n, x_tile_off, y_tile_off;
+
+	tiles_per_line = line_size / x_tile_size;
+	tile_size = x_tile_size * y_tile_size;
+
+	x_tile_n = x / x_tile_size;
+	y_tile_n = y / y_tile_size;
+	tile_n = y_tile_n * tiles_per_line + x_tile_n;
+
+	x_tile_off = x % x_tile_size;
+	y_tile_off = y % y_tile_size;
+
+	if (xmajor)
+		tile_off = y_tile_off * x_tile_size + x_tile_off;
+	else
+		tile_off = x_tile_off * y_tile_size + y_tile_off;
+
+	pos = tile_n * tile_size + tile_off;
+
+	return pos;
+}
+
+static int linear_x_y_to_xtiled_pos(int x, int y, uint32_t stride, int swizzle,
+				    int bpp)
+{
+	int pos;
+	int pixel_size = bpp / 8;
+
+	x *= pixel_size;
+	pos = tile(x, y, 512, 8, stride, true);
+	pos = swizzle_addr(pos, swizzle);
+	return pos / pixel_size;
+}
+
+static int linear_x_y_to_ytiled_pos(int x, int y, uint32_t stride, int swizzle,
+				    int bpp)
+{
+	int ow_tile_n, pos;
+	int ow_size = 16;
+	int pixel_size = bpp / 8;
+
+	x *= pixel_size;
+	ow_tile_n = tile(x / ow_size, y, 128 / ow_size, 32,
+			 stride / ow_size, false);
+	pos = ow_tile_n * ow_size + (x % ow_size);
+	pos = swizzle_addr(pos, swizzle);
+	return pos / pixel_size;
+}
+
+static int ref_pos(uint32_t tiling, int x, int y, uint32_t stride,
+		   uint32_t swizzle, int bpp)
+{
+	if (tiling == I915_TILING_X)
+		return linear_x_y_to_xtiled_pos(x, y, stride, swizzle, bpp);
+	else
+		return linear_x_y_to_ytiled_pos(x, y, stride, swizzle, bpp);
+}
+
+static void fill_random(uint8_t *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = hars_petruska_f54_1_random(&seed);
+}
+
+static void test_tiling(uint32_t tiling, uint32_t swizzle, int bpp)
+{
+	int tile_width = tiling == I915_TILING_X ? 512 : 128;
+	int tile_height = tiling == I915_TILING_X ? 8 : 32;
+	int cpp = bpp / 8;
+	uint32_t stride = TILES_PER_ROW * tile_width;
+	int width = stride / cpp, height = TILE_ROWS * tile_height;
+	int size = stride * height;
+	uint8_t *linear, *tiled, *exp, *out;
+	int x, y, i, n;
+
+	igt_assert(igt_tiling_supported(tiling, swizzle));
+
+	linear = malloc(size);
+	tiled = malloc(size);
+	exp = malloc(size);
+	out = malloc(size);
+	igt_assert(linear && tiled && exp && out);
+
+	/* The whole buffer, every pixel against the per pixel address */
+	fill_random(linear, size);
+	igt_tiling_from_linear(tiled, stride, tiling, swizzle,
+			       0, 0, stride, height, linear, stride);
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			int pos = ref_pos(tiling, x, y, stride, swizzle, bpp);
+
+			igt_assert_f(memcmp(tiled + pos * cpp,
+					    linear + y * stride + x * cpp,
+					    cpp) == 0,
+				     "pixel %d,%d at %d\n", x, y, pos * cpp);
+		}
+	}
+
+	memset(out, 0, size);
+	igt_tiling_to_linear(out, stride, tiled, stride, tiling, swizzle,
+			     0, 0, stride, height);
+	igt_assert(memcmp(out, linear, size) == 0);
+
+	/* Rectangles, and fills, leaving the rest of the buffer alone */
+	for (i = 0; i < RECTS; i++) {
+		int rx = hars_petruska_f54_1_random(&seed) % width;
+		int ry = hars_petruska_f54_1_random(&seed) % height;
+		int rw = 1 + hars_petruska_f54_1_random(&seed) % (width - rx);
+		int rh = 1 + hars_petruska_f54_1_random(&seed) % (height - ry);
+		uint32_t linear_stride = i % 4 ? rw * cpp : 0;
+
+		fill_random(linear, rh * rw * cpp);
+		fill_random(tiled, size);
+		memcpy(exp, tiled, size);
+
+		for (y = 0; y < rh; y++) {
+			for (x = 0; x < rw; x++) {
+				n = ref_pos(tiling, rx + x, ry + y, stride,
+					    swizzle, bpp);
+				memcpy(exp + n * cpp,
+				       linear + y * linear_stride + x * cpp,
+				       cpp);
+			}
+		}
+
+		igt_tiling_from_linear(tiled, stride, tiling, swizzle,
+				       rx * cpp, ry, rw * cpp, rh,
+				       linear, linear_stride);
+		igt_assert_f(memcmp(tiled, exp, size) == 0,
+			     "rectangle %dx%d at %d,%d, linear stride %u\n",
+			     rw, rh, rx, ry, linear_stride);
+
+		memset(out, 0, rh * rw * cpp);
+		igt_tiling_to_linear(out, rw * cpp, tiled, stride, tiling,
+				     swizzle, rx * cpp, ry, rw * cpp, rh);
+		for (y = 0; y < rh; y++)
+			igt_assert(memcmp(out + y * rw * cpp,
+					  linear + y * linear_stride,
+					  rw * cpp) == 0);
+	}
+
+	free(linear);
+	free(tiled);
+	free(exp);
+	free(out);
+}
+
+static const struct {
+	uint32_t swizzle;
+	const char *name;
+} swizzles[] = {
+	{ I915_BIT_6_SWIZZLE_NONE, "" },
+	{ I915_BIT_6_SWIZZLE_9, "-swizzle-9" },
+	{ I915_BIT_6_SWIZZLE_9_10, "-swizzle-9-10" },
+	{ I915_BIT_6_SWIZZLE_9_11, "-swizzle-9-11" },
+	{ I915_BIT_6_SWIZZLE_9_10_11, "-swizzle-9-10-11" },
+};
+
+igt_main
+{
+	static const int bpps[] = { 8, 16, 32 };
+	int i, j;
+
+	igt_fixture
+		igt_assert(!igt_tiling_supported(I915_TILING_X,
+						 I915_BIT_6_SWIZZLE_9_17));
+
+	for (i = 0; i < ARRAY_SIZE(swizzles); i++) {
+		for (j = 0; j < ARRAY_SIZE(bpps); j++) {
+			igt_subtest_f("x-tiled%s-%dbpp", swizzles[i].name,
+				      bpps[j])
+				test_tiling(I915_TILING_X, swizzles[i].swizzle,
+					    bpps[j]);
+
+			igt_subtest_f("y-tiled%s-%dbpp", swizzles[i].name,
+				      bpps[j])
+				test_tiling(I915_TILING_Y, swizzles[i].swizzle,
+					    bpps[j]);
+		}
+	}
+}
@@ -0,0 +1,335 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_trace.h"
+
+#define NUM_THREADS 4
+#define THREAD_EVENTS 1000
+
+/* The events kept per thread */
+#define RING_EVENTS (1 << 16)
+
+/* The exited threads kept until the trace is written */
+#define RETIRED_THREADS 16
+
+struct trace_thread {
+	struct igt_trace_thread t;
+	struct igt_trace_event *events;
+};
+
+struct trace {
+	struct igt_trace_header header;
+	char **names;
+	struct trace_thread *threads;
+};
+
+static void read_trace(struct trace *trace, const char *path)
+{
+	struct igt_trace_header *h = &trace->header;
+	FILE *file;
+	uint32_t i, len;
+
+	file = fopen(path, "r");
+	igt_assert_f(file, "no trace at %s\n", path);
+
+	igt_assert(fread(h, sizeof(*h), 1, file) == 1);
+	igt_assert(memcmp(h->magic, IGT_TRACE_MAGIC, sizeof(h->magic)) == 0);
+	igt_assert_eq(h->version, IGT_TRACE_VERSION);
+
+	trace->names = calloc(h->num_names, sizeof(*trace->names));
+	for (i = 0; i < h->num_names; i++) {
+		igt_assert(fread(&len, sizeof(len), 1, file) == 1);
+		trace->names[i] = calloc(len + 1, 1);
+		igt_assert(fread(trace->names[i], 1, len, file) == len);
+	}
+
+	trace->threads = calloc(h->num_threads, sizeof(*trace->threads));
+	for (i = 0; i < h->num_threads; i++) {
+		struct trace_thread *t = &trace->threads[i];
+
+		igt_assert(fread(&t->t, sizeof(t->t), 1, file) == 1);
+		t->events = calloc(t->t.num_events, sizeof(*t->events));
+		igt_assert(fread(t->events, sizeof(*t->events),
+				 t->t.num_events, file) == t->t.num_events);
+	}
+
+	/* Nothing left over */
+	igt_assert(fgetc(file) == EOF);
+	fclose(file);
+}
+
+static void free_trace(struct trace *trace)
+{
+	uint32_t i;
+
+	for (i = 0; i < trace->header.num_names; i++)
+		free(trace->names[i]);
+	for (i = 0; i < trace->header.num_threads; i++)
+		free(trace->threads[i].events);
+	free(trace->names);
+	free(trace->threads);
+}
+
+static const char *event_name(struct trace *trace,
+			      const struct igt_trace_event *ev)
+{
+	igt_assert(ev->name < trace->header.num_names);
+
+	return trace->names[ev->name];
+}
+
+static void *trace_thread(void *arg)
+{
+	uint64_t i;
+
+	for (i = 0; i < THREAD_EVENTS; i++) {
+		igt_trace(IGT_TRACE_BEGIN, "slice", i);
+		igt_trace_counter("counter", i);
+		igt_trace_end("slice");
+	}
+
+	return NULL;
+}
+
+static char *trace_path(char *dir)
+{
+	char *path;
+
+	strcpy(dir, "/tmp/igt_trace.XXXXXX");
+	igt_assert(mkdtemp(dir));
+	igt_assert(asprintf(&path, "%s/trace", dir) > 0);
+
+	return path;
+}
+
+static void remove_dir(const char *dir)
+{
+	struct dirent *de;
+	DIR *d = opendir(dir);
+
+	while ((de = readdir(d)))
+		unlinkat(dirfd(d), de->d_name, 0);
+	closedir(d);
+	rmdir(dir);
+}
+
+static void test_threads(void)
+{
+	pthread_t threads[NUM_THREADS];
+	struct trace trace;
+	char dir[32], *path = trace_path(dir);
+	uint32_t i, j;
+
+	igt_trace_start(path);
+	igt_assert(igt_trace_enabled);
+
+	for (i = 0; i < NUM_THREADS; i++)
+		igt_assert(pthread_create(&threads[i], NULL,
+					  trace_thread, NULL) == 0);
+	for (i = 0; i < NUM_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	igt_assert_eq(igt_trace_stop(), 0);
+	igt_assert(!igt_trace_enabled);
+
+	/* Not traced */
+	trace_thread(NULL);
+
+	read_trace(&trace, path);
+	igt_assert_eq(trace.header.pid, getpid());
+	igt_assert_eq(trace.header.num_names, 2);
+	igt_assert_eq(trace.header.num_threads, NUM_THREADS);
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		struct trace_thread *t = &trace.threads[i];
+
+		igt_assert_eq(t->t.num_events, 3 * THREAD_EVENTS);
+		igt_assert_eq(t->t.dropped, 0);
+
+		for (j = 0; j < t->t.num_events; j++) {
+			struct igt_trace_event *ev = &t->events[j];
+			static const enum igt_trace_type types[] = {
+				IGT_TRACE_BEGIN, IGT_TRACE_COUNTER, IGT_TRACE_END
+			};
+
+			igt_assert_eq(ev->type, types[j % 3]);
+			igt_assert(strcmp(event_name(&trace, ev),
+					  j % 3 == 1 ? "counter" : "slice") == 0);
+			if (ev->type != IGT_TRACE_END)
+				igt_assert_eq(ev->value, j / 3);
+			if (j)
+				igt_assert(ev->timestamp >= ev[-1].timestamp);
+		}
+	}
+
+	free_trace(&trace);
+	free(path);
+	remove_dir(dir);
+}
+
+static void test_thread_exit(void)
+{
+	struct trace trace;
+	char dir[32], *path = trace_path(dir);
+	uint32_t i;
+
+	igt_trace_start(path);
+
+	for (i = 0; i < 4 * RETIRED_THREADS; i++) {
+		pthread_t thread;
+
+		igt_assert(pthread_create(&thread, NULL,
+					  trace_thread, NULL) == 0);
+		pthread_join(thread, NULL);
+	}
+
+	igt_assert_eq(igt_trace_stop(), 0);
+
+	/* Only the last threads to exit, with all their events */
+	read_trace(&trace, path);
+	igt_assert_eq(trace.header.num_threads, RETIRED_THREADS);
+	for (i = 0; i < RETIRED_THREADS; i++) {
+		igt_assert_eq(trace.threads[i].t.num_events,
+			      3 * THREAD_EVENTS);
+		igt_assert_eq(trace.threads[i].t.dropped, 0);
+	}
+
+	free_trace(&trace);
+	free(path);
+	remove_dir(dir);
+}
+
+static void test_wraparound(void)
+{
+	struct trace trace;
+	char dir[32], *path = trace_path(dir);
+	uint64_t i, n = RING_EVENTS + 12345;
+	struct trace_thread *t;
+
+	/* Events from before start aren't part of the trace */
+	igt_trace_start(path);
+	igt_trace_counter("before", 0);
+	igt_assert_eq(igt_trace_stop(), 0);
+	igt_trace_start(path);
+
+	for (i = 0; i < n; i++)
+		igt_trace_counter("counter", i);
+
+	igt_assert_eq(igt_trace_stop(), 0);
+
+	/* Only the newest events, in order */
+	read_trace(&trace, path);
+	igt_assert_eq(trace.header.num_threads, 1);
+	t = &trace.threads[0];
+	igt_assert_eq(t->t.num_events, RING_EVENTS);
+	igt_assert_eq(t->t.dropped, n - RING_EVENTS);
+
+	for (i = 0; i < RING_EVENTS; i++) {
+		igt_assert_eq(t->events[i].type, IGT_TRACE_COUNTER);
+		igt_assert_eq(t->events[i].value, n - RING_EVENTS + i);
+	}
+
+	free_trace(&trace);
+	free(path);
+	remove_dir(dir);
+}
+
+static void test_fork(void)
+{
+	char dir[32], *path = trace_path(dir);
+	struct trace trace;
+	struct dirent *de;
+	int children = 0;
+	DIR *d;
+
+	igt_trace_start(path);
+
+	igt_trace_counter("parent", 1);
+	igt_fork(child, 2)
+		igt_trace_counter("child", child);
+	igt_waitchildren();
+
+	igt_assert_eq(igt_trace_stop(), 0);
+
+	/* The children only have their own events, in their own file */
+	d = opendir(dir);
+	while ((de = readdir(d))) {
+		char *child_path;
+		pid_t pid;
+
+		if (sscanf(de->d_name, "trace.%d", &pid) != 1)
+			continue;
+
+		igt_assert(asprintf(&child_path, "%s/%s", dir, de->d_name) > 0);
+		read_trace(&trace, child_path);
+		igt_assert_eq(trace.header.pid, pid);
+		igt_assert_eq(trace.header.num_threads, 1);
+		igt_assert_eq(trace.threads[0].t.num_events, 1);
+		igt_assert(strcmp(event_name(&trace, &trace.threads[0].events[0]),
+				  "child") == 0);
+		free_trace(&trace);
+		free(child_path);
+
+		children++;
+	}
+	closedir(d);
+	igt_assert_eq(children, 2);
+
+	/* The parent has the library's igt_fork() and igt_waitchildren() */
+	read_trace(&trace, path);
+	igt_assert_eq(trace.header.num_threads, 1);
+	igt_assert(strcmp(event_name(&trace, &trace.threads[0].events[0]),
+			  "parent") == 0);
+	igt_assert(trace.header.num_names > 1);
+	free_trace(&trace);
+
+	free(path);
+	remove_dir(dir);
+}
+
+igt_main
+{
+	igt_fixture
+		igt_assert_eq(igt_trace_stop(), 0);
+
+	igt_subtest("threads")
+		test_threads();
+
+	igt_subtest("thread-exit")
+		test_thread_exit();
+
+	igt_subtest("wraparound")
+		test_wraparound();
+
+	igt_subtest("fork")
+		test_fork();
+}
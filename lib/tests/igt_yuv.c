@@ -0,0 +1,195 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "igt_core.h"
+#include "igt_kernels.h"
+#include "igt_matrix.h"
+#include "igt_rand.h"
+#include "igt_yuv.h"
+
+/* Odd and not a multiple of any vector width, to exercise the tails */
+#define WIDTH 1021
+#define ROWS 64
+
+static uint32_t seed;
+
+static void fill_random(uint8_t *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = hars_petruska_f54_1_random(&seed);
+}
+
+static int clamp_ref(float val)
+{
+	int v = val;
+
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/* The floating point conversions igt_fb used to do per pixel */
+static void ycbcr_to_rgb_ref(const struct igt_mat4 *m, uint8_t *rgb,
+			     const uint8_t *y, const uint8_t *cb,
+			     const uint8_t *cr, int width)
+{
+	int x;
+
+	for (x = 0; x < width; x++) {
+		struct igt_vec4 yuv = { .d = { y[x], cb[x / 2], cr[x / 2], 1.0f } };
+		struct igt_vec4 v = igt_matrix_transform(m, &yuv);
+
+		rgb[x * 4 + 2] = clamp_ref(v.d[0] + 0.5f);
+		rgb[x * 4 + 1] = clamp_ref(v.d[1] + 0.5f);
+		rgb[x * 4 + 0] = clamp_ref(v.d[2] + 0.5f);
+	}
+}
+
+static void rgb_to_ycbcr_ref(const struct igt_mat4 *m, uint8_t *y,
+			     float *cb, float *cr, const uint8_t *rgb,
+			     int width)
+{
+	int x;
+
+	for (x = 0; x < width; x++) {
+		struct igt_vec4 in = { .d = { rgb[x * 4 + 2], rgb[x * 4 + 1],
+					      rgb[x * 4 + 0], 1.0f } };
+		struct igt_vec4 v = igt_matrix_transform(m, &in);
+
+		y[x] = clamp_ref(v.d[0]);
+		cb[x] = v.d[1];
+		cr[x] = v.d[2];
+	}
+}
+
+static void assert_close(int a, int b, const char *what, int x)
+{
+	igt_assert_f(abs(a - b) <= 1,
+		     "%s at pixel %d: %d, reference %d\n", what, x, a, b);
+}
+
+static void test_ycbcr_to_rgb(const struct igt_yuv_kernels *k,
+			      enum igt_color_encoding encoding,
+			      enum igt_color_range range)
+{
+	const struct igt_yuv_kernels *generic = igt_yuv_kernels(0);
+	struct igt_mat4 m = igt_ycbcr_to_rgb_matrix(encoding, range);
+	struct igt_yuv_coeffs c;
+	uint8_t y[WIDTH], cb[(WIDTH + 1) / 2], cr[(WIDTH + 1) / 2];
+	uint8_t out[WIDTH * 4], exp[WIDTH * 4], ref[WIDTH * 4];
+	int row, x;
+
+	igt_ycbcr_to_rgb_coeffs(&c, encoding, range);
+
+	for (row = 0; row < ROWS; row++) {
+		fill_random(y, sizeof(y));
+		fill_random(cb, sizeof(cb));
+		fill_random(cr, sizeof(cr));
+		fill_random(out, sizeof(out));
+		memcpy(exp, out, sizeof(exp));
+
+		k->ycbcr_to_rgb(&c, out, y, cb, cr, WIDTH);
+		generic->ycbcr_to_rgb(&c, exp, y, cb, cr, WIDTH);
+		ycbcr_to_rgb_ref(&m, ref, y, cb, cr, WIDTH);
+
+		/* Also checks the X bytes were left alone */
+		igt_assert(memcmp(out, exp, sizeof(out)) == 0);
+
+		for (x = 0; x < WIDTH; x++) {
+			assert_close(out[x * 4 + 0], ref[x * 4 + 0], "B", x);
+			assert_close(out[x * 4 + 1], ref[x * 4 + 1], "G", x);
+			assert_close(out[x * 4 + 2], ref[x * 4 + 2], "R", x);
+		}
+	}
+}
+
+static void test_rgb_to_ycbcr(const struct igt_yuv_kernels *k,
+			      enum igt_color_encoding encoding,
+			      enum igt_color_range range)
+{
+	const struct igt_yuv_kernels *generic = igt_yuv_kernels(0);
+	struct igt_mat4 m = igt_rgb_to_ycbcr_matrix(encoding, range);
+	struct igt_yuv_coeffs c;
+	uint8_t rgb[WIDTH * 4];
+	uint8_t y[WIDTH], y_exp[WIDTH], y_ref[WIDTH];
+	int32_t cb[WIDTH], cr[WIDTH], cb_exp[WIDTH], cr_exp[WIDTH];
+	float cb_ref[WIDTH], cr_ref[WIDTH];
+	int row, x;
+
+	igt_rgb_to_ycbcr_coeffs(&c, encoding, range);
+
+	for (row = 0; row < ROWS; row++) {
+		fill_random(rgb, sizeof(rgb));
+
+		k->rgb_to_ycbcr(&c, y, cb, cr, rgb, WIDTH);
+		generic->rgb_to_ycbcr(&c, y_exp, cb_exp, cr_exp, rgb, WIDTH);
+		rgb_to_ycbcr_ref(&m, y_ref, cb_ref, cr_ref, rgb, WIDTH);
+
+		igt_assert(memcmp(y, y_exp, sizeof(y)) == 0);
+		igt_assert(memcmp(cb, cb_exp, sizeof(cb)) == 0);
+		igt_assert(memcmp(cr, cr_exp, sizeof(cr)) == 0);
+
+		for (x = 0; x < WIDTH; x++) {
+			assert_close(y[x], y_ref[x], "Y", x);
+			assert_close(igt_yuv_chroma(cb[x]),
+				     clamp_ref(cb_ref[x]), "Cb", x);
+			assert_close(igt_yuv_chroma(cr[x]),
+				     clamp_ref(cr_ref[x]), "Cr", x);
+		}
+
+		for (x = 0; x + 1 < WIDTH; x += 2) {
+			assert_close(igt_yuv_chroma2(cb[x], cb[x + 1]),
+				     clamp_ref((cb_ref[x] + cb_ref[x + 1]) / 2.0f),
+				     "subsampled Cb", x);
+			assert_close(igt_yuv_chroma2(cr[x], cr[x + 1]),
+				     clamp_ref((cr_ref[x] + cr_ref[x + 1]) / 2.0f),
+				     "subsampled Cr", x);
+		}
+	}
+}
+
+static void test_kernels(const struct igt_yuv_kernels *k)
+{
+	enum igt_color_encoding encoding;
+	enum igt_color_range range;
+
+	for (encoding = 0; encoding < IGT_NUM_COLOR_ENCODINGS; encoding++) {
+		for (range = 0; range < IGT_NUM_COLOR_RANGES; range++) {
+			igt_debug("%s: %s, %s\n", k->name,
+				  igt_color_encoding_to_str(encoding),
+				  igt_color_range_to_str(range));
+
+			seed = encoding * IGT_NUM_COLOR_RANGES + range;
+			test_ycbcr_to_rgb(k, encoding, range);
+			test_rgb_to_ycbcr(k, encoding, range);
+		}
+	}
+}
+
+igt_main
+{
+	igt_subtest_kernels(igt_yuv_kernels, test_kernels);
+}
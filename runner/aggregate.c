@@ -0,0 +1,493 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <json.h>
+
+#include "igt_stats.h"
+#include "aggregate.h"
+
+/*
+ * A runtime regression is a runtime above the upper outlier fence,
+ * Q3 + 1.5 * IQR, of the earlier runs. Tests need to have run a few
+ * times before that says anything, and differences below the minimum
+ * are considered noise.
+ */
+#define RUNTIME_MIN_RUNS 4
+#define RUNTIME_MIN_REGRESSION 0.1
+
+struct run_entry {
+	const char *name;
+	uint8_t result;
+	float runtime;
+};
+
+struct run_entries {
+	struct run_entry *entries;
+	size_t size;
+	size_t alloc;
+};
+
+void init_aggregate(struct aggregate *aggregate, size_t num_runs)
+{
+	memset(aggregate, 0, sizeof(*aggregate));
+	aggregate->num_runs = num_runs;
+	pthread_mutex_init(&aggregate->lock, NULL);
+}
+
+void free_aggregate(struct aggregate *aggregate)
+{
+	size_t i;
+
+	for (i = 0; i < aggregate->num_tests; i++) {
+		free(aggregate->tests[i].name);
+		free(aggregate->tests[i].results);
+		free(aggregate->tests[i].runtimes);
+	}
+
+	free(aggregate->tests);
+	free(aggregate->slots);
+	pthread_mutex_destroy(&aggregate->lock);
+	memset(aggregate, 0, sizeof(*aggregate));
+}
+
+static size_t hash_name(const char *name)
+{
+	size_t hash = 0xcbf29ce484222325ULL;
+
+	/* FNV-1a */
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/* Slots hold test indices plus one, zero is an empty slot */
+static size_t *find_slot(struct aggregate *aggregate, const char *name)
+{
+	size_t mask = aggregate->slots_alloc - 1;
+	size_t slot = hash_name(name) & mask;
+
+	while (aggregate->slots[slot] != 0 &&
+	       strcmp(aggregate->tests[aggregate->slots[slot] - 1].name, name))
+		slot = (slot + 1) & mask;
+
+	return &aggregate->slots[slot];
+}
+
+static void grow_slots(struct aggregate *aggregate)
+{
+	size_t i;
+
+	free(aggregate->slots);
+	aggregate->slots_alloc = aggregate->slots_alloc ? aggregate->slots_alloc * 2 : 1024;
+	aggregate->slots = calloc(aggregate->slots_alloc, sizeof(*aggregate->slots));
+
+	for (i = 0; i < aggregate->num_tests; i++)
+		*find_slot(aggregate, aggregate->tests[i].name) = i + 1;
+}
+
+static struct aggregate_test *get_test(struct aggregate *aggregate, const char *name)
+{
+	struct aggregate_test *test;
+	size_t *slot;
+	size_t i;
+
+	if (2 * (aggregate->num_tests + 1) > aggregate->slots_alloc)
+		grow_slots(aggregate);
+
+	slot = find_slot(aggregate, name);
+	if (*slot != 0)
+		return &aggregate->tests[*slot - 1];
+
+	if (aggregate->num_tests == aggregate->tests_alloc) {
+		aggregate->tests_alloc = aggregate->tests_alloc ? aggregate->tests_alloc * 2 : 1024;
+		aggregate->tests = realloc(aggregate->tests,
+					   aggregate->tests_alloc * sizeof(*aggregate->tests));
+	}
+
+	test = &aggregate->tests[aggregate->num_tests++];
+	test->name = strdup(name);
+	test->results = malloc(aggregate->num_runs);
+	memset(test->results, AGGREGATE_MISSING, aggregate->num_runs);
+	test->runtimes = malloc(aggregate->num_runs * sizeof(*test->runtimes));
+	for (i = 0; i < aggregate->num_runs; i++)
+		test->runtimes[i] = NAN;
+
+	*slot = aggregate->num_tests;
+
+	return test;
+}
+
+static void add_entry(struct run_entries *entries, const char *name,
+		      int result, double runtime)
+{
+	if (entries->size == entries->alloc) {
+		entries->alloc = entries->alloc ? entries->alloc * 2 : 1024;
+		entries->entries = realloc(entries->entries,
+					   entries->alloc * sizeof(*entries->entries));
+	}
+
+	entries->entries[entries->size].name = name;
+	entries->entries[entries->size].result = result < 0 ? AGGREGATE_MISSING : result;
+	entries->entries[entries->size].runtime = runtime;
+	entries->size++;
+}
+
+static void entries_from_json(struct run_entries *entries, struct json_object *root)
+{
+	struct json_object *tests;
+
+	if (!json_object_object_get_ex(root, "tests", &tests))
+		return;
+
+	json_object_object_foreach(tests, name, test) {
+		struct json_object *obj, *timeobj;
+		double runtime = NAN;
+		int result = -1;
+
+		if (json_object_object_get_ex(test, "result", &obj))
+			result = results_store_result_from_name(json_object_get_string(obj));
+
+		if (json_object_object_get_ex(test, "time", &timeobj) &&
+		    json_object_object_get_ex(timeobj, "end", &obj)) {
+			runtime = json_object_get_double(obj);
+			if (json_object_object_get_ex(timeobj, "start", &obj))
+				runtime -= json_object_get_double(obj);
+		}
+
+		add_entry(entries, name, result, runtime);
+	}
+}
+
+static void entries_from_store(struct run_entries *entries, struct results_store *store)
+{
+	uint32_t i;
+
+	for (i = 0; i < store->header->num_tests; i++) {
+		const struct results_store_test *test = &store->tests[i];
+		const char *name = results_store_string(store, test->name);
+
+		if (!name)
+			continue;
+
+		add_entry(entries, name,
+			  test->flags & RESULTS_STORE_HAS_RESULT ? (int)test->result : -1,
+			  test->flags & RESULTS_STORE_HAS_TIME ?
+			  test->time_end - test->time_start : NAN);
+	}
+}
+
+bool aggregate_add_run(struct aggregate *aggregate, size_t run, const char *path)
+{
+	struct run_entries entries = {};
+	struct results_store store = {};
+	struct json_object *root = NULL;
+	struct stat statbuf;
+	size_t i;
+
+	if (run >= aggregate->num_runs || stat(path, &statbuf))
+		return false;
+
+	if (S_ISDIR(statbuf.st_mode)) {
+		int dirfd = open(path, O_DIRECTORY | O_RDONLY);
+		bool have_store;
+
+		if (dirfd < 0)
+			return false;
+
+		/* The binary store doesn't need parsing, prefer it */
+		have_store = faccessat(dirfd, RESULTS_STORE_FILENAME, R_OK, 0) == 0 &&
+			open_results_store(&store, dirfd);
+
+		if (!have_store) {
+			char *jsonpath;
+
+			asprintf(&jsonpath, "%s/results.json", path);
+			root = json_object_from_file(jsonpath);
+			free(jsonpath);
+		}
+
+		close(dirfd);
+
+		if (!have_store && !root)
+			return false;
+	} else if ((root = json_object_from_file(path)) == NULL) {
+		return false;
+	}
+
+	if (root)
+		entries_from_json(&entries, root);
+	else
+		entries_from_store(&entries, &store);
+
+	pthread_mutex_lock(&aggregate->lock);
+	for (i = 0; i < entries.size; i++) {
+		struct aggregate_test *test = get_test(aggregate, entries.entries[i].name);
+
+		test->results[run] = entries.entries[i].result;
+		test->runtimes[run] = entries.entries[i].runtime;
+	}
+	pthread_mutex_unlock(&aggregate->lock);
+
+	free(entries.entries);
+	if (root)
+		json_object_put(root);
+	else
+		close_results_store(&store);
+
+	return true;
+}
+
+struct loader {
+	struct aggregate *aggregate;
+	char **paths;
+	size_t next;
+	bool ok;
+	pthread_mutex_t lock;
+};
+
+static void *load_runs(void *data)
+{
+	struct loader *loader = data;
+
+	while (true) {
+		size_t run;
+
+		pthread_mutex_lock(&loader->lock);
+		run = loader->next++;
+		pthread_mutex_unlock(&loader->lock);
+
+		if (run >= loader->aggregate->num_runs)
+			break;
+
+		if (!aggregate_add_run(loader->aggregate, run, loader->paths[run])) {
+			fprintf(stderr, "Cannot load results from %s\n", loader->paths[run]);
+			pthread_mutex_lock(&loader->lock);
+			loader->ok = false;
+			pthread_mutex_unlock(&loader->lock);
+		}
+	}
+
+	return NULL;
+}
+
+bool aggregate_load_runs(struct aggregate *aggregate, char **paths,
+			 int num_threads)
+{
+	struct loader loader = {
+		.aggregate = aggregate,
+		.paths = paths,
+		.ok = true,
+	};
+	pthread_t *threads;
+	int i, started = 0;
+
+	if (num_threads < 1)
+		num_threads = 1;
+
+	pthread_mutex_init(&loader.lock, NULL);
+	threads = calloc(num_threads, sizeof(*threads));
+
+	for (i = 0; i < num_threads; i++) {
+		if (pthread_create(&threads[i], NULL, load_runs, &loader))
+			break;
+		started++;
+	}
+
+	/* Load in this thread if no threads could be started */
+	if (started == 0)
+		load_runs(&loader);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_mutex_destroy(&loader.lock);
+
+	return loader.ok;
+}
+
+void summarize_aggregate_test(struct aggregate *aggregate,
+			      struct aggregate_test *test,
+			      struct aggregate_summary *summary)
+{
+	igt_stats_t stats;
+	size_t run, lastrun = 0;
+	int prev = -1;
+
+	memset(summary, 0, sizeof(*summary));
+	summary->last = summary->previous = -1;
+	summary->last_runtime = NAN;
+
+	for (run = 0; run < aggregate->num_runs; run++) {
+		int result = test->results[run];
+
+		if (result == AGGREGATE_MISSING)
+			continue;
+
+		summary->present++;
+		if (result < RESULTS_STORE_NUM_RESULTS)
+			summary->counts[result]++;
+
+		if (prev >= 0 && prev != result)
+			summary->transitions++;
+
+		summary->previous = prev;
+		summary->last = prev = result;
+		lastrun = run;
+	}
+
+	if (summary->present == 0 || isnan(test->runtimes[lastrun]))
+		return;
+
+	summary->last_runtime = test->runtimes[lastrun];
+
+	igt_stats_init_with_size(&stats, aggregate->num_runs);
+	for (run = 0; run < lastrun; run++) {
+		if (!isnan(test->runtimes[run]))
+			igt_stats_push_float(&stats, test->runtimes[run]);
+	}
+
+	if (stats.n_values >= RUNTIME_MIN_RUNS) {
+		double q1, q2, q3;
+
+		igt_stats_get_quartiles(&stats, &q1, &q2, &q3);
+		summary->median_runtime = q2;
+		summary->runtime_fence = q3 + 1.5 * (q3 - q1);
+		summary->runtime_regression =
+			summary->last_runtime > summary->runtime_fence &&
+			summary->last_runtime - q2 > RUNTIME_MIN_REGRESSION;
+	}
+
+	igt_stats_fini(&stats);
+}
+
+static const char *result_name(int result)
+{
+	return result >= 0 ? results_store_result_name(result) ?: "?" : "-";
+}
+
+static struct aggregate_summary *sort_summaries;
+
+static int compare_flakiness(const void *a, const void *b)
+{
+	const struct aggregate_summary *one = &sort_summaries[*(const size_t *)a];
+	const struct aggregate_summary *two = &sort_summaries[*(const size_t *)b];
+	double rate1 = (double)one->transitions / (one->present - 1);
+	double rate2 = (double)two->transitions / (two->present - 1);
+
+	return rate1 < rate2 ? 1 : rate1 > rate2 ? -1 : 0;
+}
+
+static int compare_names(const void *a, const void *b, void *data)
+{
+	struct aggregate *aggregate = data;
+
+	return strcmp(aggregate->tests[*(const size_t *)a].name,
+		      aggregate->tests[*(const size_t *)b].name);
+}
+
+void print_aggregate_summary(struct aggregate *aggregate, FILE *f)
+{
+	struct aggregate_summary *summaries;
+	size_t *order, *flaky;
+	size_t i, k, num_changed = 0, num_flaky = 0, num_regressions = 0;
+
+	summaries = calloc(aggregate->num_tests, sizeof(*summaries));
+	order = calloc(aggregate->num_tests, sizeof(*order));
+	flaky = calloc(aggregate->num_tests, sizeof(*flaky));
+
+	for (i = 0; i < aggregate->num_tests; i++) {
+		struct aggregate_summary *summary = &summaries[i];
+
+		summarize_aggregate_test(aggregate, &aggregate->tests[i], summary);
+		order[i] = i;
+
+		if (aggregate->tests[i].results[aggregate->num_runs - 1] != AGGREGATE_MISSING &&
+		    summary->previous >= 0 && summary->previous != summary->last)
+			num_changed++;
+		if (summary->transitions >= 2)
+			flaky[num_flaky++] = i;
+		if (summary->runtime_regression)
+			num_regressions++;
+	}
+
+	qsort_r(order, aggregate->num_tests, sizeof(*order), compare_names, aggregate);
+	sort_summaries = summaries;
+	qsort(flaky, num_flaky, sizeof(*flaky), compare_flakiness);
+
+	fprintf(f, "%zd runs, %zd tests\n", aggregate->num_runs, aggregate->num_tests);
+
+	fprintf(f, "\nChanged in the last run: %zd\n", num_changed);
+	for (k = 0; k < aggregate->num_tests; k++) {
+		struct aggregate_summary *summary = &summaries[order[k]];
+
+		i = order[k];
+		if (aggregate->tests[i].results[aggregate->num_runs - 1] != AGGREGATE_MISSING &&
+		    summary->previous >= 0 && summary->previous != summary->last)
+			fprintf(f, "  %s: %s -> %s\n", aggregate->tests[i].name,
+				result_name(summary->previous), result_name(summary->last));
+	}
+
+	fprintf(f, "\nFlaky: %zd\n", num_flaky);
+	for (k = 0; k < num_flaky; k++) {
+		struct aggregate_summary *summary = &summaries[flaky[k]];
+		const char *delim = "";
+		int r;
+
+		fprintf(f, "  %s: %zd transitions in %zd runs (%.1f%%):",
+			aggregate->tests[flaky[k]].name,
+			summary->transitions, summary->present,
+			100.0 * summary->transitions / (summary->present - 1));
+		for (r = 0; r < RESULTS_STORE_NUM_RESULTS; r++) {
+			if (summary->counts[r]) {
+				fprintf(f, "%s %s %zd", delim, result_name(r), summary->counts[r]);
+				delim = ",";
+			}
+		}
+		fprintf(f, "\n");
+	}
+
+	fprintf(f, "\nRuntime regressions: %zd\n", num_regressions);
+	for (k = 0; k < aggregate->num_tests; k++) {
+		struct aggregate_summary *summary = &summaries[order[k]];
+
+		if (summary->runtime_regression)
+			fprintf(f, "  %s: %.3fs, median %.3fs, upper fence %.3fs\n",
+				aggregate->tests[order[k]].name,
+				summary->last_runtime, summary->median_runtime,
+				summary->runtime_fence);
+	}
+
+	free(summaries);
+	free(order);
+	free(flaky);
+}
+
+void write_runtime_history(struct aggregate *aggregate, FILE *f)
+{
+	size_t i, run;
+
+	for (i = 0; i < aggregate->num_tests; i++) {
+		struct aggregate_test *test = &aggregate->tests[i];
+		igt_stats_t stats;
+
+		igt_stats_init_with_size(&stats, aggregate->num_runs);
+		for (run = 0; run < aggregate->num_runs; run++) {
+			if (!isnan(test->runtimes[run]))
+				igt_stats_push_float(&stats, test->runtimes[run]);
+		}
+
+		if (stats.n_values)
+			fprintf(f, "%.3f %s\n", igt_stats_get_median(&stats), test->name);
+
+		igt_stats_fini(&stats);
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef RUNNER_AGGREGATE_H
+#define RUNNER_AGGREGATE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "resultstore.h"
+
+/*
+ * Aggregation of the results of several runs, in the order the runs
+ * were made. Only the result and runtime of each test in each run is
+ * kept, each run is loaded and dropped on its own.
+ */
+
+#define AGGREGATE_MISSING 0xff
+
+struct aggregate_test {
+	char *name;
+	/* Per run, a results store result or AGGREGATE_MISSING */
+	uint8_t *results;
+	/* Per run, NAN if unknown */
+	float *runtimes;
+};
+
+struct aggregate {
+	size_t num_runs;
+	struct aggregate_test *tests;
+	size_t num_tests;
+	size_t tests_alloc;
+	size_t *slots;
+	size_t slots_alloc;
+	pthread_mutex_t lock;
+};
+
+struct aggregate_summary {
+	size_t present;
+	size_t transitions;
+	size_t counts[RESULTS_STORE_NUM_RESULTS];
+	/* The results of the last two runs the test was in */
+	int last, previous;
+	double last_runtime;
+	double median_runtime;
+	double runtime_fence;
+	bool runtime_regression;
+};
+
+void init_aggregate(struct aggregate *aggregate, size_t num_runs);
+void free_aggregate(struct aggregate *aggregate);
+
+/*
+ * Adds the results of a run, from a results directory (results.bin
+ * or results.json in it) or a results.json file. Can be called from
+ * multiple threads for different runs.
+ */
+bool aggregate_add_run(struct aggregate *aggregate, size_t run, const char *path);
+
+/* Loads paths[i] as run i, using the given amount of threads */
+bool aggregate_load_runs(struct aggregate *aggregate, char **paths,
+			 int num_threads);
+
+void summarize_aggregate_test(struct aggregate *aggregate,
+			      struct aggregate_test *test,
+			      struct aggregate_summary *summary);
+
+void print_aggregate_summary(struct aggregate *aggregate, FILE *f);
+
+/*
+ * Writes the median runtime of each test as a runtime history for
+ * igt_runner --runtime-history.
+ */
+void write_runtime_history(struct aggregate *aggregate, FILE *f);
+
+#endif
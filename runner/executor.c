@@ -1,12 +1,13 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/watchdog.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
-#include <sys/select.h>
 #include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -18,7 +19,9 @@
 
 #include "igt_core.h"
 #include "executor.h"
+#include "journal.h"
 #include "output_strings.h"
+#include "resultgen.h"
 
 static struct {
 	int *fds;
@@ -138,42 +141,36 @@ static void prune_subtest(struct job_list_entry *entry, char *subtest)
 
 static bool prune_from_journal(struct job_list_entry *entry, int fd)
 {
-	char *subtest;
-	FILE *f;
+	struct journal_records records;
 	size_t pruned = 0;
 	size_t old_count = entry->subtest_count;
+	size_t i;
 
 	/*
-	 * Each journal line is a subtest that has been started, or
-	 * the line 'exit:$exitcode (time)', or 'timeout:$exitcode (time)'.
+	 * Each journal record is a subtest that has been started, or
+	 * 'exit:$exitcode (time)', or 'timeout:$exitcode (time)'.
 	 */
 
-	f = fdopen(fd, "r");
-	if (!f)
+	if (!read_journal(fd, &records))
 		return false;
 
-	while (fscanf(f, "%ms", &subtest) == 1) {
-		if (!strncmp(subtest, EXECUTOR_EXIT, strlen(EXECUTOR_EXIT))) {
+	for (i = 0; i < records.size; i++) {
+		char *record = records.records[i];
+
+		if (!strncmp(record, EXECUTOR_EXIT, strlen(EXECUTOR_EXIT))) {
 			/* Fully done. Mark that by making the binary name invalid. */
-			fscanf(f, " (%*fs)");
 			entry->binary[0] = '\0';
-			free(subtest);
 			continue;
 		}
 
-		if (!strncmp(subtest, EXECUTOR_TIMEOUT, strlen(EXECUTOR_TIMEOUT))) {
-			fscanf(f, " (%*fs)");
-			free(subtest);
+		if (!strncmp(record, EXECUTOR_TIMEOUT, strlen(EXECUTOR_TIMEOUT)))
 			continue;
-		}
-
-		prune_subtest(entry, subtest);
 
-		free(subtest);
+		prune_subtest(entry, record);
 		pruned++;
 	}
 
-	fclose(f);
+	free_journal_records(&records);
 
 	/*
 	 * If we know the subtests we originally wanted to run, check
@@ -186,7 +183,7 @@ static bool prune_from_journal(struct job_list_entry *entry, int fd)
 }
 
 static const char *filenames[_F_LAST] = {
-	[_F_JOURNAL] = "journal.txt",
+	[_F_JOURNAL] = JOURNAL_FILENAME,
 	[_F_OUT] = "out.txt",
 	[_F_ERR] = "err.txt",
 	[_F_DMESG] = "dmesg.txt",
@@ -214,13 +211,24 @@ static int open_for_reading(int dirfd, const char *name)
 	return openat(dirfd, name, O_RDONLY);
 }
 
-bool open_output_files(int dirfd, int *fds, bool write)
+static bool open_outputs(int dirfd, int *fds, bool write, bool binary_journal)
 {
 	int i;
 	int (*openfunc)(int, const char*) = write ? open_at_end : open_for_reading;
 
 	for (i = 0; i < _F_LAST; i++) {
-		if ((fds[i] = openfunc(dirfd, filenames[i])) < 0) {
+		const char *name = filenames[i];
+
+		if (i == _F_JOURNAL && binary_journal)
+			name = JOURNAL_BINARY_FILENAME;
+
+		/* The binary journal doesn't end in a newline */
+		if (i == _F_JOURNAL && write && binary_journal)
+			fds[i] = openat(dirfd, name, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+		else
+			fds[i] = openfunc(dirfd, name);
+
+		if (fds[i] < 0) {
 			while (--i >= 0)
 				close(fds[i]);
 			return false;
@@ -230,6 +238,14 @@ bool open_output_files(int dirfd, int *fds, bool write)
 	return true;
 }
 
+bool open_output_files(int dirfd, int *fds, bool write)
+{
+	/* Readers take whichever journal there is */
+	return open_outputs(dirfd, fds, write,
+			    !write && faccessat(dirfd, JOURNAL_FILENAME, F_OK, 0) &&
+			    !faccessat(dirfd, JOURNAL_BINARY_FILENAME, F_OK, 0));
+}
+
 void close_outputs(int *fds)
 {
 	int i;
@@ -332,37 +348,118 @@ static bool kill_child(int sig, pid_t child)
  *  <0 - Failure executing
  *  >0 - Timeout happened, need to recreate from journal
  */
+/*
+ * Size of a single read or splice from the test's output pipes. The
+ * pipes are enlarged to this size too, if allowed, so that chatty
+ * tests wake us up less often.
+ */
+#define OUTPUT_CHUNK_SIZE (1024 * 1024)
+
+/*
+ * Moves what's available in a pipe to an output file. The data is
+ * spliced in the kernel, unless the file doesn't support splicing, in
+ * which case *use_splice is cleared and a buffered copy is used from
+ * then on.
+ *
+ * Returns what read() would: the amount of bytes moved, 0 when the
+ * write end is closed, or -1 on error.
+ */
+static ssize_t copy_pipe_to_file(int pipefd, int filefd, bool *use_splice)
+{
+	char buf[4096];
+	ssize_t s;
+
+	if (*use_splice) {
+		s = splice(pipefd, NULL, filefd, NULL, OUTPUT_CHUNK_SIZE,
+			   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (s >= 0 || errno != EINVAL)
+			return s;
+
+		*use_splice = false;
+	}
+
+	s = read(pipefd, buf, sizeof(buf));
+	if (s > 0)
+		write(filefd, buf, s);
+
+	return s;
+}
+
+static bool monitor_fd(int epollfd, int fd)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+
+	return epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+static void stop_monitoring_fd(int epollfd, int *fd)
+{
+	epoll_ctl(epollfd, EPOLL_CTL_DEL, *fd, NULL);
+	close(*fd);
+	*fd = -1;
+}
+
 static int monitor_output(pid_t child,
 			   int outfd, int errfd, int kmsgfd, int sigfd,
 			   int *outputs,
 			   double *time_spent,
 			   struct settings *settings)
 {
-	fd_set set;
+	struct epoll_event events[4];
 	char buf[2048];
 	char *outbuf = NULL;
-	size_t outbufsize = 0;
+	size_t outbufsize = 0, outbufalloc = 0;
 	char current_subtest[256] = {};
 	struct signalfd_siginfo siginfo;
+	bool splice_err = true;
 	ssize_t s;
-	int n, status;
-	int nfds = outfd;
+	int i, n, status;
+	int epollfd;
 	int timeout = settings->inactivity_timeout;
-	int timeout_intervals = 1, intervals_left;
+	int timeout_intervals = 1, intervals_left = 1;
 	int wd_extra = 10;
 	int killed = 0; /* 0 if not killed, signal number otherwise */
 	struct timespec time_beg, time_end;
 	bool aborting = false;
+	struct journal_writer journal;
+	int sync_fds[] = { outputs[_F_OUT], outputs[_F_ERR], outputs[_F_DMESG] };
 
 	igt_gettime(&time_beg);
 
-	if (errfd > nfds)
-		nfds = errfd;
-	if (kmsgfd > nfds)
-		nfds = kmsgfd;
-	if (sigfd > nfds)
-		nfds = sigfd;
-	nfds++;
+	if (!init_journal_writer(&journal, outputs[_F_JOURNAL],
+				 settings->group_commit > 0, settings->group_commit,
+				 settings->sync, sync_fds,
+				 sizeof(sync_fds) / sizeof(sync_fds[0]))) {
+		fprintf(stderr, "Error repairing the journal: %s\n",
+			strerror(errno));
+		kill_child(SIGKILL, child);
+		waitpid(child, NULL, 0);
+		close(outfd);
+		close(errfd);
+		close(kmsgfd);
+		close(sigfd);
+		return -1;
+	}
+
+	if ((epollfd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+	    !monitor_fd(epollfd, outfd) ||
+	    !monitor_fd(epollfd, errfd) ||
+	    !monitor_fd(epollfd, sigfd)) {
+		fprintf(stderr, "Error setting up output monitoring: %s\n",
+			strerror(errno));
+		close(epollfd);
+		close(outfd);
+		close(errfd);
+		close(kmsgfd);
+		close(sigfd);
+		return -1;
+	}
+
+	if (kmsgfd >= 0 && !monitor_fd(epollfd, kmsgfd)) {
+		/* The kernel log gets dumped after the test instead */
+		fprintf(stderr, "Warning: Cannot monitor kmsg: %s\n",
+			strerror(errno));
+	}
 
 	if (timeout > 0) {
 		/*
@@ -389,24 +486,45 @@ static int monitor_output(pid_t child,
 	}
 
 	while (outfd >= 0 || errfd >= 0 || sigfd >= 0) {
-		struct timeval tv = { .tv_sec = timeout };
-
-		FD_ZERO(&set);
-		if (outfd >= 0)
-			FD_SET(outfd, &set);
-		if (errfd >= 0)
-			FD_SET(errfd, &set);
-		if (kmsgfd >= 0)
-			FD_SET(kmsgfd, &set);
-		if (sigfd >= 0)
-			FD_SET(sigfd, &set);
-
-		n = select(nfds, &set, NULL, NULL, timeout == 0 ? NULL : &tv);
+		bool out_ready = false, err_ready = false;
+		bool kmsg_ready = false, sig_ready = false;
+
+		int wait = timeout == 0 ? -1 : timeout * 1000;
+		int commit_wait = journal_commit_timeout(&journal);
+		bool commit_wakeup = false;
+
+		if (commit_wait >= 0 && (wait < 0 || commit_wait < wait)) {
+			/*
+			 * Only output makes commits pending, and output
+			 * restarts the inactivity timeout anyway, so
+			 * restarting it once more after the commit
+			 * delays it by at most the commit interval.
+			 */
+			wait = commit_wait;
+			commit_wakeup = true;
+		}
+
+		n = epoll_wait(epollfd, events, sizeof(events) / sizeof(events[0]), wait);
 		if (n < 0) {
 			/* TODO */
+			close(epollfd);
 			return -1;
 		}
 
+		for (i = 0; i < n; i++) {
+			int fd = events[i].data.fd;
+
+			out_ready |= fd == outfd;
+			err_ready |= fd == errfd;
+			kmsg_ready |= fd == kmsgfd;
+			sig_ready |= fd == sigfd;
+		}
+
+		if (n == 0 && commit_wakeup) {
+			journal_commit(&journal);
+			continue;
+		}
+
 		if (n == 0) {
 			intervals_left--;
 			if (intervals_left) {
@@ -449,8 +567,10 @@ static int monitor_output(pid_t child,
 				if (settings->log_level >= LOG_LEVEL_NORMAL) {
 					fprintf(stderr, "Child refuses to die. Aborting.\n");
 				}
+				journal_commit(&journal);
 				close_watchdogs(settings);
 				free(outbuf);
+				close(epollfd);
 				close(outfd);
 				close(errfd);
 				close(kmsgfd);
@@ -465,113 +585,126 @@ static int monitor_output(pid_t child,
 		ping_watchdogs();
 
 		/* TODO: Refactor these handlers to their own functions */
-		if (outfd >= 0 && FD_ISSET(outfd, &set)) {
-			char *newline;
+		if (outfd >= 0 && out_ready) {
+			char *linestart, *scan, *newline;
 
-			s = read(outfd, buf, sizeof(buf));
+			/*
+			 * The journal is written based on what the test
+			 * prints, so stdout is read to a buffer and
+			 * written out from there, unlike the other
+			 * outputs.
+			 */
+			if (outbufalloc - outbufsize < OUTPUT_CHUNK_SIZE) {
+				outbufalloc = outbufsize + OUTPUT_CHUNK_SIZE;
+				outbuf = realloc(outbuf, outbufalloc);
+			}
+
+			s = read(outfd, outbuf + outbufsize, outbufalloc - outbufsize);
 			if (s <= 0) {
 				if (s < 0) {
 					fprintf(stderr, "Error reading test's stdout: %s\n",
 						strerror(errno));
 				}
 
-				close(outfd);
-				outfd = -1;
+				stop_monitoring_fd(epollfd, &outfd);
 				goto out_end;
 			}
 
-			write(outputs[_F_OUT], buf, s);
-			if (settings->sync) {
-				fdatasync(outputs[_F_OUT]);
-			}
+			write(outputs[_F_OUT], outbuf + outbufsize, s);
+			journal_output_written(&journal, outputs[_F_OUT]);
 
-			outbuf = realloc(outbuf, outbufsize + s);
-			memcpy(outbuf + outbufsize, buf, s);
+			/* Only the new data can contain a newline */
+			scan = outbuf + outbufsize;
 			outbufsize += s;
+			linestart = outbuf;
 
-			while ((newline = memchr(outbuf, '\n', outbufsize)) != NULL) {
-				size_t linelen = newline - outbuf + 1;
+			while ((newline = memchr(scan, '\n', outbuf + outbufsize - scan)) != NULL) {
+				size_t linelen = newline - linestart + 1;
 
 				if (linelen > strlen(STARTING_SUBTEST) &&
-				    !memcmp(outbuf, STARTING_SUBTEST, strlen(STARTING_SUBTEST))) {
-					write(outputs[_F_JOURNAL], outbuf + strlen(STARTING_SUBTEST),
-					      linelen - strlen(STARTING_SUBTEST));
-					memcpy(current_subtest, outbuf + strlen(STARTING_SUBTEST),
+				    !memcmp(linestart, STARTING_SUBTEST, strlen(STARTING_SUBTEST))) {
+					journal_append(&journal, linestart + strlen(STARTING_SUBTEST),
+						       linelen - strlen(STARTING_SUBTEST) - 1);
+					/*
+					 * Not batched, a resume after the
+					 * machine died in this subtest has
+					 * to know that it started.
+					 */
+					journal_commit(&journal);
+					memcpy(current_subtest, linestart + strlen(STARTING_SUBTEST),
 					       linelen - strlen(STARTING_SUBTEST));
 					current_subtest[linelen - strlen(STARTING_SUBTEST)] = '\0';
 
 					if (settings->log_level >= LOG_LEVEL_VERBOSE) {
-						fwrite(outbuf, 1, linelen, stdout);
+						fwrite(linestart, 1, linelen, stdout);
 					}
 				}
 				if (linelen > strlen(SUBTEST_RESULT) &&
-				    !memcmp(outbuf, SUBTEST_RESULT, strlen(SUBTEST_RESULT))) {
-					char *delim = memchr(outbuf, ':', linelen);
+				    !memcmp(linestart, SUBTEST_RESULT, strlen(SUBTEST_RESULT))) {
+					char *delim = memchr(linestart, ':', linelen);
 
 					if (delim != NULL) {
-						size_t subtestlen = delim - outbuf - strlen(SUBTEST_RESULT);
-						if (memcmp(current_subtest, outbuf + strlen(SUBTEST_RESULT),
+						size_t subtestlen = delim - linestart - strlen(SUBTEST_RESULT);
+						if (memcmp(current_subtest, linestart + strlen(SUBTEST_RESULT),
 							   subtestlen)) {
 							/* Result for a test that didn't ever start */
-							write(outputs[_F_JOURNAL],
-							      outbuf + strlen(SUBTEST_RESULT),
-							      subtestlen);
-							write(outputs[_F_JOURNAL], "\n", 1);
-							if (settings->sync) {
-								fdatasync(outputs[_F_JOURNAL]);
-							}
+							journal_append(&journal,
+								       linestart + strlen(SUBTEST_RESULT),
+								       subtestlen);
 							current_subtest[0] = '\0';
 						}
 
 						if (settings->log_level >= LOG_LEVEL_VERBOSE) {
-							fwrite(outbuf, 1, linelen, stdout);
+							fwrite(linestart, 1, linelen, stdout);
 						}
 					}
 				}
 
-				memmove(outbuf, newline + 1, outbufsize - linelen);
-				outbufsize -= linelen;
+				linestart = scan = newline + 1;
 			}
+
+			/* Keep the incomplete last line for the next round */
+			outbufsize -= linestart - outbuf;
+			memmove(outbuf, linestart, outbufsize);
 		}
 	out_end:
 
-		if (errfd >= 0 && FD_ISSET(errfd, &set)) {
-			s = read(errfd, buf, sizeof(buf));
-			if (s <= 0) {
+		if (errfd >= 0 && err_ready) {
+			s = copy_pipe_to_file(errfd, outputs[_F_ERR], &splice_err);
+			if (s < 0 && errno == EAGAIN) {
+				/* Nothing to move after all */
+			} else if (s <= 0) {
 				if (s < 0) {
 					fprintf(stderr, "Error reading test's stderr: %s\n",
 						strerror(errno));
 				}
-				close(errfd);
-				errfd = -1;
+				stop_monitoring_fd(epollfd, &errfd);
 			} else {
-				write(outputs[_F_ERR], buf, s);
-				if (settings->sync) {
-					fdatasync(outputs[_F_ERR]);
-				}
+				journal_output_written(&journal, outputs[_F_ERR]);
 			}
 		}
 
-		if (kmsgfd >= 0 && FD_ISSET(kmsgfd, &set)) {
+		if (kmsgfd >= 0 && kmsg_ready) {
+			/*
+			 * Kernel log records are read one at a time, and
+			 * can't be spliced.
+			 */
 			s = read(kmsgfd, buf, sizeof(buf));
 			if (s < 0) {
 				if (errno != EPIPE && errno != EINVAL) {
 					fprintf(stderr, "Error reading from kmsg, stopping monitoring: %s\n",
 						strerror(errno));
-					close(kmsgfd);
-					kmsgfd = -1;
+					stop_monitoring_fd(epollfd, &kmsgfd);
 				} else if (errno == EINVAL) {
 					fprintf(stderr, "Warning: Buffer too small for kernel log record, record lost.\n");
 				}
 			} else {
 				write(outputs[_F_DMESG], buf, s);
-				if (settings->sync) {
-					fdatasync(outputs[_F_DMESG]);
-				}
+				journal_output_written(&journal, outputs[_F_DMESG]);
 			}
 		}
 
-		if (sigfd >= 0 && FD_ISSET(sigfd, &set)) {
+		if (sigfd >= 0 && sig_ready) {
 			double time;
 
 			s = read(sigfd, &siginfo, sizeof(siginfo));
@@ -614,28 +747,25 @@ static int monitor_output(pid_t child,
 				time = 0.0;
 
 			if (!aborting) {
-				dprintf(outputs[_F_JOURNAL], "%s%d (%.3fs)\n",
-					killed ? EXECUTOR_TIMEOUT : EXECUTOR_EXIT,
-					status, time);
-				if (settings->sync) {
-					fdatasync(outputs[_F_JOURNAL]);
-				}
+				journal_appendf(&journal, "%s%d (%.3fs)",
+						killed ? EXECUTOR_TIMEOUT : EXECUTOR_EXIT,
+						status, time);
 
 				if (time_spent)
 					*time_spent = time;
 			}
 
-			close(sigfd);
-			sigfd = -1;
+			stop_monitoring_fd(epollfd, &sigfd);
 			child = 0;
 		}
 	}
 
 	dump_dmesg(kmsgfd, outputs[_F_DMESG]);
-	if (settings->sync)
-		fdatasync(outputs[_F_DMESG]);
+	journal_output_written(&journal, outputs[_F_DMESG]);
+	journal_commit(&journal);
 
 	free(outbuf);
+	close(epollfd);
 	close(outfd);
 	close(errfd);
 	close(kmsgfd);
@@ -746,12 +876,15 @@ static int execute_next_entry(struct execute_state *state,
 		return -1;
 	}
 
-	if (!open_output_files(dirfd, outputs, true)) {
+	if (!open_outputs(dirfd, outputs, true, settings->group_commit > 0)) {
 		close(dirfd);
 		fprintf(stderr, "Error opening output files\n");
 		return -1;
 	}
 
+	/* Any previously generated results are outdated from now on */
+	unlinkat(dirfd, RESULTS_FRAGMENT_FILENAME, 0);
+
 	if (settings->sync) {
 		fsync(dirfd);
 		fsync(resdirfd);
@@ -768,6 +901,10 @@ static int execute_next_entry(struct execute_state *state,
 		return -1;
 	}
 
+	/* Failing to resize is fine, the default size just wakes us up more */
+	fcntl(outpipe[0], F_SETPIPE_SZ, OUTPUT_CHUNK_SIZE);
+	fcntl(errpipe[0], F_SETPIPE_SZ, OUTPUT_CHUNK_SIZE);
+
 	if ((kmsgfd = open("/dev/kmsg", O_RDONLY | O_CLOEXEC)) < 0) {
 		fprintf(stderr, "Warning: Cannot open /dev/kmsg\n");
 	} else {
@@ -876,6 +1013,20 @@ static bool clear_test_result_directory(int dirfd)
 		}
 	}
 
+	if (remove_file(dirfd, JOURNAL_BINARY_FILENAME)) {
+		fprintf(stderr, "Error deleting %s from test result directory: %s\n",
+			JOURNAL_BINARY_FILENAME,
+			strerror(errno));
+		return false;
+	}
+
+	if (remove_file(dirfd, RESULTS_FRAGMENT_FILENAME)) {
+		fprintf(stderr, "Error deleting %s from test result directory: %s\n",
+			RESULTS_FRAGMENT_FILENAME,
+			strerror(errno));
+		return false;
+	}
+
 	return true;
 }
 
@@ -946,13 +1097,70 @@ static void init_time_left(struct execute_state *state,
 		state->time_left = settings->overall_timeout;
 }
 
+/*
+ * Prunes the entry using the journal in its result directory.
+ *
+ * Returns true if the entry still needs to be executed, false if it
+ * has completed or is not suitable to re-run.
+ */
+static bool prune_entry_from_result_dir(int resdirfd,
+					struct job_list_entry *entry)
+{
+	bool pruned;
+	int fd;
+
+	if ((fd = openat(resdirfd, JOURNAL_FILENAME, O_RDONLY)) < 0 &&
+	    (fd = openat(resdirfd, JOURNAL_BINARY_FILENAME, O_RDONLY)) < 0)
+		return true;
+
+	pruned = prune_from_journal(entry, fd);
+	close(fd);
+
+	if (!pruned) {
+		/*
+		 * The test does not have subtests, or
+		 * incompleted before the first subtest
+		 * began. Either way, not suitable to
+		 * re-run.
+		 */
+		return false;
+	}
+
+	/* An emptied binary name means the test is fully completed */
+	return entry->binary[0] != '\0';
+}
+
+/*
+ * With parallel execution the result directories can be in any state
+ * of completion, so go through all of them. Entries that don't need
+ * to be executed anymore are marked with an empty binary name.
+ */
+static void prune_all_from_result_dirs(int dirfd, struct job_list *list)
+{
+	size_t i;
+
+	for (i = 0; i < list->size; i++) {
+		struct job_list_entry *entry = &list->entries[i];
+		char name[32];
+		int resdirfd;
+
+		snprintf(name, sizeof(name), "%zd", i);
+		if ((resdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) < 0)
+			continue;
+
+		if (!prune_entry_from_result_dir(resdirfd, entry))
+			entry->binary[0] = '\0';
+
+		close(resdirfd);
+	}
+}
+
 bool initialize_execute_state_from_resume(int dirfd,
 					  struct execute_state *state,
 					  struct settings *settings,
 					  struct job_list *list)
 {
-	struct job_list_entry *entry;
-	int resdirfd, fd, i;
+	int resdirfd = -1, i;
 
 	free_settings(settings);
 	free_job_list(list);
@@ -966,6 +1174,12 @@ bool initialize_execute_state_from_resume(int dirfd,
 
 	init_time_left(state, settings);
 
+	if (settings->jobs > 1) {
+		prune_all_from_result_dirs(dirfd, list);
+		close(dirfd);
+		return true;
+	}
+
 	for (i = list->size; i >= 0; i--) {
 		char name[32];
 
@@ -978,24 +1192,9 @@ bool initialize_execute_state_from_resume(int dirfd,
 		/* Nothing has been executed yet, state is fine as is */
 		goto success;
 
-	entry = &list->entries[i];
 	state->next = i;
-	if ((fd = openat(resdirfd, filenames[_F_JOURNAL], O_RDONLY)) >= 0) {
-		if (!prune_from_journal(entry, fd)) {
-			/*
-			 * The test does not have subtests, or
-			 * incompleted before the first subtest
-			 * began. Either way, not suitable to
-			 * re-run.
-			 */
-			state->next = i + 1;
-		} else if (entry->binary[0] == '\0') {
-			/* This test is fully completed */
-			state->next = i + 1;
-		}
-
-		close(fd);
-	}
+	if (!prune_entry_from_result_dir(resdirfd, &list->entries[i]))
+		state->next = i + 1;
 
  success:
 	close(resdirfd);
@@ -1044,11 +1243,303 @@ static bool overall_timeout_exceeded(struct execute_state *state)
 	return state->time_left == 0.0;
 }
 
+/*
+ * Generates the results of an entry right after it's executed, with
+ * the entry as it was originally in the job list, not as pruned for
+ * resuming. Failures are not fatal, the results will get generated
+ * with the rest at the end.
+ */
+static void generate_results_for_entry(struct settings *settings,
+				       struct job_list *orig_list,
+				       size_t idx,
+				       int resdirfd)
+{
+	char name[32];
+	int dirfd;
+
+	if (!settings->incremental_results || idx >= orig_list->size)
+		return;
+
+	snprintf(name, sizeof(name), "%zd", idx);
+	if ((dirfd = openat(resdirfd, name, O_DIRECTORY | O_RDONLY)) < 0)
+		return;
+
+	if (!generate_entry_results(dirfd, &orig_list->entries[idx], settings))
+		fprintf(stderr, "Warning: Failed generating results for %s\n", name);
+
+	close(dirfd);
+}
+
+struct worker {
+	pid_t pid;
+	size_t idx;
+};
+
+/*
+ * Finds the first entry not yet started that doesn't conflict with
+ * any running entry. Entries that are skipped because of a conflict
+ * reserve their tags so later entries can't starve them, and an
+ * untagged entry that has to wait stops the search altogether.
+ */
+static bool pick_next_entry(struct job_list *job_list,
+			    bool *started,
+			    struct worker *workers,
+			    int num_workers,
+			    size_t *idx)
+{
+	struct job_list_entry reserved = {};
+	size_t i, k;
+	int w;
+
+	reserved.tags = malloc(sizeof(*reserved.tags));
+
+	for (i = 0; i < job_list->size; i++) {
+		struct job_list_entry *entry = &job_list->entries[i];
+		bool conflict = false;
+
+		if (started[i])
+			continue;
+
+		for (w = 0; w < num_workers && !conflict; w++) {
+			if (workers[w].pid > 0 &&
+			    job_list_entries_conflict(entry,
+						      &job_list->entries[workers[w].idx]))
+				conflict = true;
+		}
+
+		if (!conflict && reserved.tag_count > 0 &&
+		    job_list_entries_conflict(entry, &reserved))
+			conflict = true;
+
+		if (!conflict) {
+			free(reserved.tags);
+			*idx = i;
+			return true;
+		}
+
+		if (!entry->tags)
+			break;
+
+		for (k = 0; k < entry->tag_count; k++) {
+			reserved.tag_count++;
+			reserved.tags = realloc(reserved.tags,
+						reserved.tag_count * sizeof(*reserved.tags));
+			reserved.tags[reserved.tag_count - 1] = entry->tags[k];
+		}
+	}
+
+	free(reserved.tags);
+	return false;
+}
+
+/*
+ * Runs the entry to completion in a worker process. If the test gets
+ * killed on a timeout, the rest of its subtests are executed the same
+ * way a resume would.
+ */
+static int execute_in_worker(struct execute_state *state,
+			     struct settings *settings,
+			     struct job_list *job_list,
+			     size_t idx,
+			     int testdirfd, int resdirfd)
+{
+	double time_spent;
+	char name[32];
+	int result, dirfd;
+	bool again;
+
+	state->next = idx;
+
+	while ((result = execute_next_entry(state,
+					    job_list->size,
+					    &time_spent,
+					    settings,
+					    &job_list->entries[idx],
+					    testdirfd, resdirfd)) > 0) {
+		if (!read_job_list(job_list, resdirfd))
+			return -1;
+
+		snprintf(name, sizeof(name), "%zd", idx);
+		if ((dirfd = openat(resdirfd, name, O_DIRECTORY | O_RDONLY)) < 0)
+			return -1;
+
+		again = prune_entry_from_result_dir(dirfd, &job_list->entries[idx]);
+		close(dirfd);
+
+		if (!again)
+			return 0;
+	}
+
+	return result;
+}
+
+/*
+ * Parallel execution: each job list entry is executed by a forked
+ * worker process running the same code as serial execution, so every
+ * entry still gets its own result directory, journal and outputs.
+ * The kernel log is global, so the dmesg of an entry will contain
+ * messages from other entries that were running at the same time.
+ * Only tagged entries run next to each other, tests whose dmesg
+ * matters are meant to be left untagged.
+ *
+ * The overall timeout is counted in wall clock time here, instead of
+ * the sum of test runtimes. Once it has passed no more entries are
+ * started, the running ones are left to finish as in serial execution.
+ */
+static bool execute_parallel(struct execute_state *state,
+			     struct settings *settings,
+			     struct job_list *job_list,
+			     struct job_list *orig_list,
+			     int testdirfd, int resdirfd)
+{
+	struct signalfd_siginfo siginfo;
+	struct timespec time_last, time_now;
+	struct worker *workers;
+	bool *started;
+	bool status = true, stopping = false;
+	int running = 0;
+	sigset_t mask;
+	int sigfd, w;
+	size_t i, idx;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGQUIT);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	if ((sigfd = signalfd(-1, &mask, O_CLOEXEC)) < 0) {
+		fprintf(stderr, "Cannot monitor worker processes with signalfd\n");
+		return false;
+	}
+
+	workers = calloc(settings->jobs, sizeof(*workers));
+	started = calloc(job_list->size, sizeof(*started));
+
+	for (i = 0; i < job_list->size; i++) {
+		/* Empty binary name means completed in a previous run */
+		started[i] = i < state->next || job_list->entries[i].binary[0] == '\0';
+	}
+
+	igt_gettime(&time_last);
+
+	while (true) {
+		struct pollfd pfd = { .fd = sigfd, .events = POLLIN };
+		int timeout = -1;
+		pid_t pid;
+		int wstatus;
+
+		igt_gettime(&time_now);
+		reduce_time_left(settings, state,
+				 igt_time_elapsed(&time_last, &time_now));
+		time_last = time_now;
+
+		if (!stopping && overall_timeout_exceeded(state)) {
+			if (settings->log_level >= LOG_LEVEL_NORMAL) {
+				printf("Overall timeout time exceeded, stopping.\n");
+			}
+
+			stopping = true;
+		}
+
+		while (!stopping && running < settings->jobs &&
+		       pick_next_entry(job_list, started, workers, settings->jobs, &idx)) {
+			for (w = 0; workers[w].pid > 0; w++)
+				;
+
+			/* Don't let our buffered output end up duplicated */
+			fflush(stdout);
+			fflush(stderr);
+
+			if ((pid = fork()) == 0) {
+				int result;
+
+				close(sigfd);
+				result = execute_in_worker(state, settings, job_list,
+							   idx, testdirfd, resdirfd);
+				if (result >= 0)
+					generate_results_for_entry(settings, orig_list,
+								   idx, resdirfd);
+				fflush(stdout);
+				fflush(stderr);
+				_exit(result < 0 ? 1 : 0);
+			}
+
+			if (pid < 0) {
+				fprintf(stderr, "Error forking a worker: %s\n",
+					strerror(errno));
+				status = false;
+				stopping = true;
+				break;
+			}
+
+			workers[w].pid = pid;
+			workers[w].idx = idx;
+			started[idx] = true;
+			running++;
+		}
+
+		if (running == 0)
+			break;
+
+		/* Wake up when the overall timeout passes, not only on exits */
+		if (!stopping && state->time_left > 0)
+			timeout = state->time_left * 1000 + 1;
+
+		if (poll(&pfd, 1, timeout) <= 0)
+			continue;
+
+		if (read(sigfd, &siginfo, sizeof(siginfo)) != sizeof(siginfo)) {
+			fprintf(stderr, "Error reading from signalfd: %s\n",
+				strerror(errno));
+			continue;
+		}
+
+		if (siginfo.ssi_signo != SIGCHLD) {
+			/* We're dying, so we're taking them with us */
+			if (settings->log_level >= LOG_LEVEL_NORMAL)
+				printf("Abort requested, terminating workers\n");
+
+			for (w = 0; w < settings->jobs; w++) {
+				if (workers[w].pid > 0)
+					kill(workers[w].pid, SIGTERM);
+			}
+
+			status = false;
+			stopping = true;
+			continue;
+		}
+
+		while ((pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+			for (w = 0; w < settings->jobs; w++) {
+				if (workers[w].pid != pid)
+					continue;
+
+				workers[w].pid = 0;
+				running--;
+
+				if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+					status = false;
+					stopping = true;
+				}
+			}
+		}
+	}
+
+	close(sigfd);
+	free(started);
+	free(workers);
+
+	return status;
+}
+
 bool execute(struct execute_state *state,
 	     struct settings *settings,
 	     struct job_list *job_list)
 {
 	struct utsname unamebuf;
+	struct job_list orig_list;
 	int resdirfd, testdirfd, unamefd, timefd;
 	double time_spent = 0.0;
 	bool status = true;
@@ -1100,6 +1591,19 @@ bool execute(struct execute_state *state,
 	}
 	close(unamefd);
 
+	init_job_list(&orig_list);
+	if (settings->incremental_results &&
+	    !read_job_list(&orig_list, resdirfd)) {
+		fprintf(stderr, "Warning: Cannot read the job list, "
+			"results will be generated at the end\n");
+	}
+
+	if (settings->jobs > 1) {
+		status = execute_parallel(state, settings, job_list, &orig_list,
+					  testdirfd, resdirfd);
+		goto end;
+	}
+
 	for (; state->next < job_list->size;
 	     state->next++) {
 		int result = execute_next_entry(state,
@@ -1114,6 +1618,10 @@ bool execute(struct execute_state *state,
 			break;
 		}
 
+		if (result == 0)
+			generate_results_for_entry(settings, &orig_list,
+						   state->next, resdirfd);
+
 		reduce_time_left(settings, state, time_spent);
 
 		if (overall_timeout_exceeded(state)) {
@@ -1129,17 +1637,20 @@ bool execute(struct execute_state *state,
 
 			close(testdirfd);
 			close_watchdogs(settings);
+			free_job_list(&orig_list);
 			initialize_execute_state_from_resume(resdirfd, state, settings, job_list);
 			state->time_left = time_left;
 			return execute(state, settings, job_list);
 		}
 	}
 
+ end:
 	if ((timefd = openat(resdirfd, "endtime.txt", O_CREAT | O_WRONLY | O_EXCL, 0666)) >= 0) {
 		dprintf(timefd, "%f\n", timeofday_double());
 		close(timefd);
 	}
 
+	free_job_list(&orig_list);
 	close(testdirfd);
 	close(resdirfd);
 	close_watchdogs(settings);
@@ -2,6 +2,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,6 +11,7 @@
 #include <unistd.h>
 
 #include "job_list.h"
+#include "subtest_cache.h"
 #include "igt_core.h"
 
 static bool matches_any(const char *str, struct regex_list *list)
@@ -26,10 +28,10 @@ static bool matches_any(const char *str, struct regex_list *list)
 	return false;
 }
 
-static void add_job_list_entry(struct job_list *job_list,
-			       char *binary,
-			       char **subtests,
-			       size_t subtest_count)
+static struct job_list_entry *add_job_list_entry(struct job_list *job_list,
+						  char *binary,
+						  char **subtests,
+						  size_t subtest_count)
 {
 	struct job_list_entry *entry;
 
@@ -40,30 +42,148 @@ static void add_job_list_entry(struct job_list *job_list,
 	entry->binary = binary;
 	entry->subtests = subtests;
 	entry->subtest_count = subtest_count;
+	entry->tags = NULL;
+	entry->tag_count = 0;
+
+	return entry;
 }
 
-static void add_subtests(struct job_list *job_list, struct settings *settings,
-			 char *binary,
-			 struct regex_list *include, struct regex_list *exclude)
+static bool has_tag(struct job_list_entry *entry, const char *tag)
+{
+	size_t i;
+
+	for (i = 0; i < entry->tag_count; i++) {
+		if (!strcmp(entry->tags[i], tag))
+			return true;
+	}
+
+	return false;
+}
+
+static void add_tag(struct job_list_entry *entry, const char *tag)
+{
+	if (has_tag(entry, tag))
+		return;
+
+	entry->tag_count++;
+	entry->tags = realloc(entry->tags, entry->tag_count * sizeof(*entry->tags));
+	entry->tags[entry->tag_count - 1] = strdup(tag);
+}
+
+static void free_tags(struct job_list_entry *entry)
+{
+	size_t i;
+
+	for (i = 0; i < entry->tag_count; i++)
+		free(entry->tags[i]);
+	free(entry->tags);
+
+	entry->tags = NULL;
+	entry->tag_count = 0;
+}
+
+/*
+ * Parses an exclusivity tag declaration of the form '[tag1,tag2]'
+ * from the string. Returns false if the string has no tag
+ * declaration. An empty declaration leaves the entry with a non-NULL
+ * tag array with zero tags.
+ */
+static bool parse_tags(struct job_list_entry *entry, const char *str)
+{
+	const char *beg, *end;
+
+	if ((beg = strchr(str, '[')) == NULL ||
+	    (end = strchr(beg, ']')) == NULL)
+		return false;
+
+	if (!entry->tags)
+		entry->tags = malloc(sizeof(*entry->tags));
+
+	beg++;
+	while (beg < end) {
+		const char *delim = memchr(beg, ',', end - beg);
+		char *tag;
+
+		if (!delim)
+			delim = end;
+
+		tag = strndup(beg, delim - beg);
+		if (strlen(tag) > 0)
+			add_tag(entry, tag);
+		free(tag);
+
+		beg = delim + 1;
+	}
+
+	return true;
+}
+
+/*
+ * Merges the tags of a test list line into an entry that is run in
+ * the same execution. A line without declared tags makes the whole
+ * entry conflict with everything.
+ */
+static void merge_tags(struct job_list_entry *entry, const char *str, bool first)
+{
+	struct job_list_entry tmp = {};
+	size_t i;
+
+	if (!parse_tags(&tmp, str)) {
+		free_tags(entry);
+		return;
+	}
+
+	if (first || entry->tags) {
+		if (!entry->tags)
+			entry->tags = malloc(sizeof(*entry->tags));
+
+		for (i = 0; i < tmp.tag_count; i++)
+			add_tag(entry, tmp.tags[i]);
+	}
+
+	free_tags(&tmp);
+}
+
+bool job_list_entries_conflict(struct job_list_entry *one,
+			       struct job_list_entry *two)
+{
+	size_t i;
+
+	if (!one->tags || !two->tags)
+		return true;
+
+	for (i = 0; i < one->tag_count; i++) {
+		if (has_tag(two, one->tags[i]))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Lists the subtests of a binary into the entry, by running it with
+ * --list-subtests. Returns false if the binary couldn't be listed, the
+ * entry then has the subtests it listed before failing.
+ */
+static bool list_subtests(struct settings *settings, const char *binary,
+			  struct subtest_cache_entry *entry)
 {
 	FILE *p;
 	char cmd[256] = {};
 	char *subtestname;
-	char **subtests = NULL;
-	size_t num_subtests = 0;
 	int s;
 
 	s = snprintf(cmd, sizeof(cmd), "%s/%s --list-subtests",
 		     settings->test_root, binary);
 	if (s < 0) {
 		fprintf(stderr, "Failure generating command string, this shouldn't happen.\n");
-		return;
+		return false;
 	}
 
 	if (s >= sizeof(cmd)) {
 		fprintf(stderr, "Path to binary too long, ignoring: %s/%s\n",
 			settings->test_root, binary);
-		return;
+		return false;
 	}
 
 	p = popen(cmd, "r");
@@ -71,23 +191,64 @@ static void add_subtests(struct job_list *job_list, struct settings *settings,
 		fprintf(stderr, "popen failed when executing %s: %s\n",
 			cmd,
 			strerror(errno));
-		return;
+		return false;
 	}
 
 	while (fscanf(p, "%ms", &subtestname) == 1) {
+		entry->num_subtests++;
+		entry->subtests = realloc(entry->subtests,
+					  entry->num_subtests * sizeof(*entry->subtests));
+		entry->subtests[entry->num_subtests - 1] = subtestname;
+	}
+
+	/* Also what a failing binary listed, as those can still be run */
+	entry->has_subtests = true;
+
+	s = pclose(p);
+	if (s == 0) {
+		return true;
+	} else if (s == -1) {
+		fprintf(stderr, "popen error when executing %s: %s\n", binary, strerror(errno));
+	} else if (WIFEXITED(s)) {
+		if (WEXITSTATUS(s) == IGT_EXIT_INVALID) {
+			/* No subtests on this one */
+			entry->has_subtests = false;
+			return true;
+		}
+	} else {
+		fprintf(stderr, "Test binary %s died unexpectedly\n", binary);
+	}
+
+	return false;
+}
+
+static void add_subtests(struct job_list *job_list, struct settings *settings,
+			 char *binary, struct subtest_cache_entry *listing,
+			 struct regex_list *include, struct regex_list *exclude)
+{
+	char **subtests = NULL;
+	size_t num_subtests = 0;
+	size_t i;
+
+	if (!listing->has_subtests) {
+		if (exclude && exclude->size && matches_any(binary, exclude))
+			return;
+		if (!include || !include->size || matches_any(binary, include))
+			add_job_list_entry(job_list, strdup(binary), NULL, 0);
+		return;
+	}
+
+	for (i = 0; i < listing->num_subtests; i++) {
+		char *subtestname = listing->subtests[i];
 		char piglitname[256];
 
 		generate_piglit_name(binary, subtestname, piglitname, sizeof(piglitname));
 
-		if (exclude && exclude->size && matches_any(piglitname, exclude)) {
-			free(subtestname);
+		if (exclude && exclude->size && matches_any(piglitname, exclude))
 			continue;
-		}
 
-		if (include && include->size && !matches_any(piglitname, include)) {
-			free(subtestname);
+		if (include && include->size && !matches_any(piglitname, include))
 			continue;
-		}
 
 		if (settings->multiple_mode) {
 			num_subtests++;
@@ -99,38 +260,178 @@ static void add_subtests(struct job_list *job_list, struct settings *settings,
 			add_job_list_entry(job_list, strdup(binary), subtests, 1);
 			subtests = NULL;
 		}
-
-		free(subtestname);
 	}
 
 	if (num_subtests)
 		add_job_list_entry(job_list, strdup(binary), subtests, num_subtests);
+}
 
-	s = pclose(p);
-	if (s == 0) {
-		return;
-	} else if (s == -1) {
-		fprintf(stderr, "popen error when executing %s: %s\n", binary, strerror(errno));
-	} else if (WIFEXITED(s)) {
-		if (WEXITSTATUS(s) == IGT_EXIT_INVALID) {
-			/* No subtests on this one */
-			if (exclude && exclude->size && matches_any(binary, exclude)) {
-				return;
-			}
-			if (!include || !include->size || matches_any(binary, include)) {
-				add_job_list_entry(job_list, strdup(binary), NULL, 0);
-				return;
-			}
+enum binary_listing_state {
+	/* Excluded, or all subtests run without listing them */
+	LISTING_NOT_NEEDED,
+	LISTING_NEEDED,
+	LISTING_DONE,
+	LISTING_FAILED,
+};
+
+struct binary_listing {
+	char *binary;
+	/* Subtests are filtered only if the binary name didn't match */
+	bool filter_subtests;
+	bool whole_binary;
+	enum binary_listing_state state;
+	bool cached;
+	struct subtest_cache_entry entry;
+};
+
+struct listing_work {
+	struct settings *settings;
+	struct binary_listing *listings;
+	size_t num_listings;
+	size_t next;
+	pthread_mutex_t lock;
+};
+
+static void *list_binaries(void *data)
+{
+	struct listing_work *work = data;
+
+	while (true) {
+		struct binary_listing *listing;
+		size_t i;
+
+		pthread_mutex_lock(&work->lock);
+		while (work->next < work->num_listings &&
+		       work->listings[work->next].state != LISTING_NEEDED)
+			work->next++;
+		i = work->next++;
+		pthread_mutex_unlock(&work->lock);
+
+		if (i >= work->num_listings)
+			break;
+
+		listing = &work->listings[i];
+		if (list_subtests(work->settings, listing->binary, &listing->entry))
+			listing->state = LISTING_DONE;
+		else
+			listing->state = LISTING_FAILED;
+	}
+
+	return NULL;
+}
+
+/*
+ * Lists the subtests of the binaries that need it, taking the lists
+ * from the subtest cache when they're still valid. The rest are
+ * listed in parallel, as running the binaries dominates job list
+ * creation.
+ */
+static void list_all_binaries(struct settings *settings,
+			      struct binary_listing *listings,
+			      size_t num_listings)
+{
+	struct subtest_cache cache;
+	struct listing_work work = {
+		.settings = settings,
+		.listings = listings,
+		.num_listings = num_listings,
+	};
+	pthread_t *threads;
+	size_t i, misses = 0;
+	long num_threads, started = 0;
+
+	init_subtest_cache(&cache);
+	if (settings->subtest_cache && !read_subtest_cache(&cache, settings->subtest_cache))
+		fprintf(stderr, "Cannot read the subtest cache %s, ignoring\n",
+			settings->subtest_cache);
+
+	for (i = 0; i < num_listings; i++) {
+		struct binary_listing *listing = &listings[i];
+		struct subtest_cache_entry *cached;
+		char path[PATH_MAX];
+		size_t k;
+
+		if (listing->state != LISTING_NEEDED)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", settings->test_root, listing->binary);
+		if (!settings->subtest_cache || !subtest_cache_key(&listing->entry, path)) {
+			misses++;
+			continue;
 		}
-	} else {
-		fprintf(stderr, "Test binary %s died unexpectedly\n", binary);
+
+		if ((cached = subtest_cache_lookup(&cache, &listing->entry)) == NULL) {
+			misses++;
+			continue;
+		}
+
+		listing->entry.has_subtests = cached->has_subtests;
+		listing->entry.num_subtests = cached->num_subtests;
+		listing->entry.subtests = malloc(cached->num_subtests * sizeof(char *));
+		for (k = 0; k < cached->num_subtests; k++)
+			listing->entry.subtests[k] = strdup(cached->subtests[k]);
+		listing->state = LISTING_DONE;
+		listing->cached = true;
+	}
+
+	num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads > misses)
+		num_threads = misses;
+
+	pthread_mutex_init(&work.lock, NULL);
+	threads = calloc(num_threads ?: 1, sizeof(*threads));
+
+	for (i = 0; i < num_threads; i++) {
+		if (pthread_create(&threads[i], NULL, list_binaries, &work))
+			break;
+		started++;
 	}
+
+	/* List in this thread what's left if threads couldn't be started */
+	list_binaries(&work);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_mutex_destroy(&work.lock);
+
+	if (settings->subtest_cache) {
+		for (i = 0; i < num_listings; i++) {
+			struct subtest_cache_entry copy;
+			size_t k;
+
+			/* Binaries without a key can't be cached */
+			if (listings[i].state != LISTING_DONE || listings[i].cached ||
+			    !listings[i].entry.path)
+				continue;
+
+			copy = listings[i].entry;
+			copy.path = strdup(copy.path);
+			copy.build_id = strdup(copy.build_id);
+			copy.subtests = malloc(copy.num_subtests * sizeof(char *));
+			for (k = 0; k < copy.num_subtests; k++)
+				copy.subtests[k] = strdup(listings[i].entry.subtests[k]);
+			subtest_cache_store(&cache, &copy);
+		}
+
+		if (cache.dirty)
+			write_subtest_cache(&cache, settings->subtest_cache);
+
+		if (settings->log_level >= LOG_LEVEL_VERBOSE)
+			printf("Subtest list cache: %zd hits, %zd misses\n",
+			       cache.hits, cache.misses);
+	}
+
+	free_subtest_cache(&cache);
 }
 
 static bool filtered_job_list(struct job_list *job_list,
 			      struct settings *settings,
 			      int fd)
 {
+	struct binary_listing *listings = NULL;
+	size_t num_listings = 0, i;
 	FILE *f;
 	char buf[128];
 
@@ -142,6 +443,8 @@ static bool filtered_job_list(struct job_list *job_list,
 	f = fdopen(fd, "r");
 
 	while (fscanf(f, "%127s", buf) == 1) {
+		struct binary_listing *listing;
+
 		if (!strcmp(buf, "TESTLIST") || !(strcmp(buf, "END")))
 			continue;
 
@@ -152,33 +455,56 @@ static bool filtered_job_list(struct job_list *job_list,
 		if (settings->exclude_regexes.size && matches_any(buf, &settings->exclude_regexes))
 			continue;
 
+		num_listings++;
+		listings = realloc(listings, num_listings * sizeof(*listings));
+		listing = &listings[num_listings - 1];
+		memset(listing, 0, sizeof(*listing));
+		listing->binary = strdup(buf);
+		listing->state = LISTING_NEEDED;
+
 		/*
 		 * If the binary name matches include filters (or include filters not present),
 		 * all subtests except those matching exclude filters are added.
 		 */
 		if (!settings->include_regexes.size || matches_any(buf, &settings->include_regexes)) {
-			if (settings->multiple_mode && !settings->exclude_regexes.size)
+			if (settings->multiple_mode && !settings->exclude_regexes.size) {
 				/*
 				 * Optimization; we know that all
 				 * subtests will be included, so we
 				 * get to omit executing
 				 * --list-subtests.
 				 */
-				add_job_list_entry(job_list, strdup(buf), NULL, 0);
-			else
-				add_subtests(job_list, settings, buf,
-					     NULL, &settings->exclude_regexes);
+				listing->whole_binary = true;
+				listing->state = LISTING_NOT_NEEDED;
+			}
 			continue;
 		}
 
 		/*
 		 * Binary name doesn't match exclude or include filters.
 		 */
-		add_subtests(job_list, settings, buf,
-			     &settings->include_regexes,
-			     &settings->exclude_regexes);
+		listing->filter_subtests = true;
 	}
 
+	list_all_binaries(settings, listings, num_listings);
+
+	for (i = 0; i < num_listings; i++) {
+		struct binary_listing *listing = &listings[i];
+
+		if (listing->whole_binary)
+			add_job_list_entry(job_list, strdup(listing->binary), NULL, 0);
+		else if (listing->state == LISTING_DONE ||
+			 (listing->state == LISTING_FAILED && listing->entry.num_subtests))
+			add_subtests(job_list, settings, listing->binary, &listing->entry,
+				     listing->filter_subtests ? &settings->include_regexes : NULL,
+				     &settings->exclude_regexes);
+
+		free(listing->binary);
+		free_subtest_cache_entry(&listing->entry);
+	}
+
+	free(listings);
+
 	return job_list->size != 0;
 }
 
@@ -222,13 +548,15 @@ static bool job_list_from_test_list(struct job_list *job_list,
 				*delim++ = '\0';
 
 			if (!settings->multiple_mode) {
+				struct job_list_entry *added;
 				char **subtests = NULL;
 				if (delim) {
 					subtests = malloc(sizeof(char*));
 					subtests[0] = strdup(delim);
 				}
-				add_job_list_entry(job_list, strdup(binary),
-						   subtests, (size_t)(subtests != NULL));
+				added = add_job_list_entry(job_list, strdup(binary),
+							   subtests, (size_t)(subtests != NULL));
+				parse_tags(added, line);
 				any = true;
 				free(binary);
 				binary = NULL;
@@ -255,13 +583,19 @@ static bool job_list_from_test_list(struct job_list *job_list,
 							 entry.subtest_count *
 							 sizeof(*entry.subtests));
 				entry.subtests[entry.subtest_count - 1] = strdup(delim);
+				merge_tags(&entry, line, false);
 				free(binary);
 				binary = NULL;
 				continue;
 			}
 
 			if (entry.binary) {
-				add_job_list_entry(job_list, entry.binary, entry.subtests, entry.subtest_count);
+				struct job_list_entry *added;
+
+				added = add_job_list_entry(job_list, entry.binary,
+							   entry.subtests, entry.subtest_count);
+				added->tags = entry.tags;
+				added->tag_count = entry.tag_count;
 				any = true;
 			}
 
@@ -272,6 +606,7 @@ static bool job_list_from_test_list(struct job_list *job_list,
 				entry.subtests[0] = strdup(delim);
 				entry.subtest_count = 1;
 			}
+			merge_tags(&entry, line, true);
 
 			free(binary);
 			binary = NULL;
@@ -279,7 +614,12 @@ static bool job_list_from_test_list(struct job_list *job_list,
 	}
 
 	if (entry.binary) {
-		add_job_list_entry(job_list, entry.binary, entry.subtests, entry.subtest_count);
+		struct job_list_entry *added;
+
+		added = add_job_list_entry(job_list, entry.binary,
+					   entry.subtests, entry.subtest_count);
+		added->tags = entry.tags;
+		added->tag_count = entry.tag_count;
 		any = true;
 	}
 
@@ -341,11 +681,270 @@ void free_job_list(struct job_list *job_list)
 			free(entry->subtests[k]);
 		}
 		free(entry->subtests);
+		free_tags(entry);
 	}
 	free(job_list->entries);
 	init_job_list(job_list);
 }
 
+/*
+ * Expected runtimes of tests, sorted by piglit name so that both
+ * single tests and all subtests of a binary can be looked up.
+ */
+struct runtime_history_entry {
+	char *name;
+	double runtime;
+};
+
+struct runtime_history {
+	struct runtime_history_entry *entries;
+	size_t size;
+	/* Used for tests not in the history */
+	double fallback;
+};
+
+static int compare_history_entries(const void *a, const void *b)
+{
+	const struct runtime_history_entry *one = a, *two = b;
+
+	return strcmp(one->name, two->name);
+}
+
+static void free_runtime_history(struct runtime_history *history)
+{
+	size_t i;
+
+	for (i = 0; i < history->size; i++)
+		free(history->entries[i].name);
+	free(history->entries);
+}
+
+static bool read_runtime_history(struct runtime_history *history,
+				 const char *filename)
+{
+	FILE *f;
+	char *line = NULL;
+	size_t line_len = 0, alloc = 0;
+	double total = 0.0;
+
+	memset(history, 0, sizeof(*history));
+	history->fallback = 1.0;
+
+	if (!filename)
+		return true;
+
+	if ((f = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, "Cannot open runtime history file %s\n", filename);
+		return false;
+	}
+
+	while (getline(&line, &line_len, f) != -1) {
+		double runtime;
+		char *name;
+
+		if (sscanf(line, "%lf %ms", &runtime, &name) != 2)
+			continue;
+
+		if (history->size == alloc) {
+			alloc = alloc ? alloc * 2 : 256;
+			history->entries = realloc(history->entries,
+						   alloc * sizeof(*history->entries));
+		}
+
+		history->entries[history->size].name = name;
+		history->entries[history->size].runtime = runtime;
+		history->size++;
+		total += runtime;
+	}
+
+	free(line);
+	fclose(f);
+
+	qsort(history->entries, history->size, sizeof(*history->entries),
+	      compare_history_entries);
+
+	if (history->size)
+		history->fallback = total / history->size;
+
+	return true;
+}
+
+static bool history_runtime(struct runtime_history *history, const char *name,
+			    double *runtime)
+{
+	struct runtime_history_entry key = { .name = (char *)name };
+	struct runtime_history_entry *found;
+
+	found = bsearch(&key, history->entries, history->size,
+			sizeof(*history->entries), compare_history_entries);
+	if (!found)
+		return false;
+
+	*runtime = found->runtime;
+	return true;
+}
+
+/* Sum of the runtimes of all subtests of a binary */
+static bool history_runtime_all(struct runtime_history *history, const char *binary,
+				double *runtime)
+{
+	char prefix[256];
+	size_t lo = 0, hi = history->size, len;
+	bool found = false;
+
+	generate_piglit_name(binary, NULL, prefix, sizeof(prefix));
+	if (history_runtime(history, prefix, runtime))
+		return true;
+
+	strncat(prefix, "@", sizeof(prefix) - strlen(prefix) - 1);
+	len = strlen(prefix);
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (strcmp(history->entries[mid].name, prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*runtime = 0.0;
+	for (; lo < history->size && !strncmp(history->entries[lo].name, prefix, len); lo++) {
+		*runtime += history->entries[lo].runtime;
+		found = true;
+	}
+
+	return found;
+}
+
+static double expected_runtime(struct runtime_history *history,
+			       struct job_list_entry *entry)
+{
+	double runtime, total = 0.0;
+	size_t i;
+
+	if (entry->subtest_count == 0) {
+		if (history_runtime_all(history, entry->binary, &runtime))
+			return runtime;
+		return history->fallback;
+	}
+
+	for (i = 0; i < entry->subtest_count; i++) {
+		char name[256];
+
+		generate_piglit_name(entry->binary, entry->subtests[i], name, sizeof(name));
+		total += history_runtime(history, name, &runtime) ? runtime : history->fallback;
+	}
+
+	return total;
+}
+
+static const double *sort_runtimes;
+
+/* Longest first, in job list order when equal */
+static int compare_runtimes(const void *a, const void *b)
+{
+	size_t one = *(const size_t *)a, two = *(const size_t *)b;
+
+	if (sort_runtimes[one] != sort_runtimes[two])
+		return sort_runtimes[one] < sort_runtimes[two] ? 1 : -1;
+
+	return one < two ? -1 : one > two;
+}
+
+static int compare_indices(const void *a, const void *b)
+{
+	size_t one = *(const size_t *)a, two = *(const size_t *)b;
+
+	return one < two ? -1 : one > two;
+}
+
+/*
+ * Picks the entries of the requested shard and orders them. The
+ * entries are assigned to shards longest first, each to the shard
+ * with the least expected runtime so far, which keeps the shards
+ * within the runtime of one entry of each other. The result only
+ * depends on the job list and the runtime history.
+ */
+static bool shard_job_list(struct job_list *job_list, struct settings *settings)
+{
+	struct runtime_history history;
+	struct job_list_entry *entries;
+	double *runtimes, *loads, shard_total = 0.0, total = 0.0;
+	size_t *order, *picked;
+	size_t i, num_picked = 0;
+	int shard_index = settings->shard_count ? settings->shard_index : 1;
+	int shard, shard_count = settings->shard_count ? settings->shard_count : 1;
+
+	if (!read_runtime_history(&history, settings->runtime_history))
+		return false;
+
+	runtimes = calloc(job_list->size, sizeof(*runtimes));
+	order = calloc(job_list->size, sizeof(*order));
+	picked = calloc(job_list->size, sizeof(*picked));
+	loads = calloc(shard_count, sizeof(*loads));
+
+	for (i = 0; i < job_list->size; i++) {
+		runtimes[i] = expected_runtime(&history, &job_list->entries[i]);
+		total += runtimes[i];
+		order[i] = i;
+	}
+
+	sort_runtimes = runtimes;
+	qsort(order, job_list->size, sizeof(*order), compare_runtimes);
+
+	for (i = 0; i < job_list->size; i++) {
+		int k, min = 0;
+
+		for (k = 1; k < shard_count; k++) {
+			if (loads[k] < loads[min])
+				min = k;
+		}
+
+		loads[min] += runtimes[order[i]];
+
+		if (min == shard_index - 1)
+			picked[num_picked++] = order[i];
+	}
+
+	/* Picked in longest first order, restore the job list order if needed */
+	if (!settings->longest_first)
+		qsort(picked, num_picked, sizeof(*picked), compare_indices);
+
+	entries = calloc(num_picked ?: 1, sizeof(*entries));
+	for (i = 0; i < num_picked; i++) {
+		entries[i] = job_list->entries[picked[i]];
+		memset(&job_list->entries[picked[i]], 0, sizeof(*job_list->entries));
+		shard_total += runtimes[picked[i]];
+	}
+
+	if (settings->log_level >= LOG_LEVEL_VERBOSE && settings->shard_count) {
+		printf("Shard %d/%d: %zd of %zd job list entries, expected runtime %.1fs of %.1fs\n",
+		       settings->shard_index, settings->shard_count,
+		       num_picked, job_list->size, shard_total, total);
+		for (shard = 0; shard < shard_count; shard++)
+			printf("  Shard %d: %.1fs\n", shard + 1, loads[shard]);
+	}
+
+	free_job_list(job_list);
+	job_list->entries = entries;
+	job_list->size = num_picked;
+
+	free(runtimes);
+	free(order);
+	free(picked);
+	free(loads);
+	free_runtime_history(&history);
+
+	if (num_picked == 0) {
+		fprintf(stderr, "Shard %d/%d has no tests\n",
+			settings->shard_index, settings->shard_count);
+		return false;
+	}
+
+	return true;
+}
+
 bool create_job_list(struct job_list *job_list,
 		     struct settings *settings)
 {
@@ -386,6 +985,9 @@ bool create_job_list(struct job_list *job_list,
 	close(fd);
 	close(dirfd);
 
+	if (result && (settings->shard_count || settings->longest_first))
+		result = shard_job_list(job_list, settings);
+
 	return result;
 }
 
@@ -452,6 +1054,19 @@ bool serialize_job_list(struct job_list *job_list, struct settings *settings)
 			}
 		}
 
+		if (entry->tags) {
+			const char *delim = "";
+
+			fprintf(f, " [");
+
+			for (k = 0; k < entry->tag_count; k++) {
+				fprintf(f, "%s%s", delim, entry->tags[k]);
+				delim = ",";
+			}
+
+			fprintf(f, "]");
+		}
+
 		fprintf(f, "\n");
 	}
 
@@ -485,7 +1100,8 @@ bool read_job_list(struct job_list *job_list, int dirfd)
 	}
 
 	while ((read = getline(&line, &line_len, f))) {
-		char *binary, *sublist, *comma;
+		struct job_list_entry *entry;
+		char *binary, *sublist, *comma, *tags;
 		char **subtests = NULL;
 		size_t num_subtests = 0, len;
 
@@ -500,9 +1116,15 @@ bool read_job_list(struct job_list *job_list, int dirfd)
 		if (len > 0 && line[len - 1] == '\n')
 			line[len - 1] = '\0';
 
+		/* Exclusivity tags, if any, are last on the line */
+		if ((tags = strstr(line, " [")) != NULL)
+			*tags++ = '\0';
+
 		sublist = strchr(line, ' ');
 		if (!sublist) {
-			add_job_list_entry(job_list, strdup(line), NULL, 0);
+			entry = add_job_list_entry(job_list, strdup(line), NULL, 0);
+			if (tags)
+				parse_tags(entry, tags);
 			continue;
 		}
 
@@ -521,7 +1143,9 @@ bool read_job_list(struct job_list *job_list, int dirfd)
 			sublist = comma;
 		} while (comma != NULL);
 
-		add_job_list_entry(job_list, binary, subtests, num_subtests);
+		entry = add_job_list_entry(job_list, binary, subtests, num_subtests);
+		if (tags)
+			parse_tags(entry, tags);
 	}
 
 	free(line);
@@ -19,6 +19,15 @@ struct job_list_entry {
 	 * the above array.
 	 */
 	size_t subtest_count;
+	/*
+	 * Exclusivity tags for parallel execution, from the test
+	 * list. Entries sharing a tag are never executed at the same
+	 * time. NULL tags means no tags were declared, and the entry
+	 * conflicts with every other entry. An explicitly empty
+	 * declaration ('[]') is a non-NULL array with tag_count 0.
+	 */
+	char **tags;
+	size_t tag_count;
 };
 
 struct job_list
@@ -27,6 +36,9 @@ struct job_list
 	size_t size;
 };
 
+bool job_list_entries_conflict(struct job_list_entry *one,
+			       struct job_list_entry *two);
+
 void generate_piglit_name(const char *binary, const char *subtest,
 			  char *namebuf, size_t namebuf_size);
 
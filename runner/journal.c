@@ -0,0 +1,295 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+#define MAX_RECORD_LEN 4096
+
+struct record_header {
+	uint32_t len;
+	uint32_t hash;
+};
+
+static uint32_t hash_record(const char *data, size_t len)
+{
+	uint32_t hash = 0x811c9dc5;
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end)
+{
+	return 1e3 * (end->tv_sec - start->tv_sec) + 1e-6 * (end->tv_nsec - start->tv_nsec);
+}
+
+/*
+ * Returns the length of the valid part of a binary journal, 0 if
+ * there's no valid magic.
+ */
+static off_t valid_journal_length(int fd)
+{
+	char magic[sizeof(JOURNAL_MAGIC) - 1];
+	char record[MAX_RECORD_LEN];
+	struct record_header header;
+	off_t offset = sizeof(magic);
+
+	if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+	    memcmp(magic, JOURNAL_MAGIC, sizeof(magic)))
+		return 0;
+
+	while (pread(fd, &header, sizeof(header), offset) == sizeof(header) &&
+	       header.len <= MAX_RECORD_LEN &&
+	       pread(fd, record, header.len, offset + sizeof(header)) == header.len &&
+	       hash_record(record, header.len) == header.hash)
+		offset += sizeof(header) + header.len;
+
+	return offset;
+}
+
+/*
+ * Drops a torn record left by a crash from the end of a binary
+ * journal, so that records appended on resume can be read.
+ */
+static bool truncate_binary_journal(int fd)
+{
+	off_t length = valid_journal_length(fd);
+
+	if (length != lseek(fd, 0, SEEK_END) && ftruncate(fd, length))
+		return false;
+
+	if (length == 0 &&
+	    write(fd, JOURNAL_MAGIC, strlen(JOURNAL_MAGIC)) != strlen(JOURNAL_MAGIC))
+		return false;
+
+	return true;
+}
+
+bool init_journal_writer(struct journal_writer *writer, int fd,
+			 bool binary, int commit_interval, bool sync,
+			 int *sync_fds, int num_sync_fds)
+{
+	memset(writer, 0, sizeof(*writer));
+	writer->fd = fd;
+	writer->binary = binary;
+	writer->commit_interval = commit_interval;
+	writer->sync = sync;
+	writer->sync_fds = sync_fds;
+	writer->num_sync_fds = num_sync_fds;
+
+	/* The first records of a test get committed right away */
+	clock_gettime(CLOCK_MONOTONIC, &writer->last_commit);
+	writer->last_commit.tv_sec -= (commit_interval / 1000) + 1;
+
+	if (binary)
+		return truncate_binary_journal(fd);
+
+	return true;
+}
+
+void journal_commit(struct journal_writer *writer)
+{
+	int i;
+
+	if (!writer->pending)
+		return;
+
+	for (i = 0; i < writer->num_sync_fds; i++)
+		fdatasync(writer->sync_fds[i]);
+	fdatasync(writer->fd);
+
+	writer->pending = false;
+	writer->commits++;
+	clock_gettime(CLOCK_MONOTONIC, &writer->last_commit);
+}
+
+int journal_commit_timeout(struct journal_writer *writer)
+{
+	struct timespec now;
+	double left;
+
+	if (!writer->pending)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	left = writer->commit_interval - elapsed_ms(&writer->last_commit, &now);
+
+	return left > 0 ? (int)left + 1 : 0;
+}
+
+void journal_commit_if_due(struct journal_writer *writer)
+{
+	if (journal_commit_timeout(writer) == 0)
+		journal_commit(writer);
+}
+
+/*
+ * Without a commit for a while, the write is committed immediately.
+ * Otherwise it waits for the commit interval to pass, so bursts of
+ * writes get committed together.
+ */
+static void written(struct journal_writer *writer)
+{
+	writer->pending = true;
+	journal_commit_if_due(writer);
+}
+
+void journal_append(struct journal_writer *writer, const char *record, size_t len)
+{
+	char buf[sizeof(struct record_header) + MAX_RECORD_LEN + 1];
+
+	if (len > MAX_RECORD_LEN)
+		len = MAX_RECORD_LEN;
+
+	if (!writer->binary) {
+		memcpy(buf, record, len);
+		buf[len] = '\n';
+		write(writer->fd, buf, len + 1);
+		if (writer->sync)
+			fdatasync(writer->fd);
+		return;
+	}
+
+	/* One write per record, so that a record is torn only by a crash */
+	((struct record_header *)buf)->len = len;
+	((struct record_header *)buf)->hash = hash_record(record, len);
+	memcpy(buf + sizeof(struct record_header), record, len);
+	write(writer->fd, buf, sizeof(struct record_header) + len);
+
+	written(writer);
+}
+
+void journal_appendf(struct journal_writer *writer, const char *fmt, ...)
+{
+	char record[MAX_RECORD_LEN];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(record, sizeof(record), fmt, ap);
+	va_end(ap);
+
+	if (len < 0)
+		return;
+
+	journal_append(writer, record, len < sizeof(record) ? len : sizeof(record) - 1);
+}
+
+void journal_output_written(struct journal_writer *writer, int fd)
+{
+	if (!writer->binary) {
+		if (writer->sync)
+			fdatasync(fd);
+		return;
+	}
+
+	written(writer);
+}
+
+static void add_record(struct journal_records *records, char *record)
+{
+	records->size++;
+	records->records = realloc(records->records,
+				   records->size * sizeof(*records->records));
+	records->records[records->size - 1] = record;
+}
+
+static bool read_binary_journal(FILE *f, struct journal_records *records)
+{
+	struct record_header header;
+	char *record;
+
+	while (fread(&header, sizeof(header), 1, f) == 1) {
+		if (header.len > MAX_RECORD_LEN)
+			break;
+
+		record = malloc(header.len + 1);
+		if ((header.len && fread(record, header.len, 1, f) != 1) ||
+		    hash_record(record, header.len) != header.hash) {
+			free(record);
+			break;
+		}
+
+		/* Empty records are valid but dropped, like empty lines */
+		record[header.len] = '\0';
+		if (header.len)
+			add_record(records, record);
+		else
+			free(record);
+	}
+
+	return true;
+}
+
+static bool read_text_journal(FILE *f, struct journal_records *records)
+{
+	char *line = NULL;
+	size_t linelen = 0;
+	ssize_t read;
+
+	while ((read = getline(&line, &linelen, f)) >= 0) {
+		if (read > 0 && line[read - 1] == '\n')
+			line[--read] = '\0';
+
+		if (read > 0)
+			add_record(records, strdup(line));
+	}
+
+	free(line);
+
+	return true;
+}
+
+bool read_journal(int fd, struct journal_records *records)
+{
+	char magic[sizeof(JOURNAL_MAGIC) - 1];
+	bool ret;
+	FILE *f;
+
+	memset(records, 0, sizeof(*records));
+
+	/* Reading through a duplicate leaves the fd for the caller to close */
+	if ((fd = dup(fd)) < 0)
+		return false;
+
+	if ((f = fdopen(fd, "r")) == NULL) {
+		close(fd);
+		return false;
+	}
+
+	rewind(f);
+	if (fread(magic, sizeof(magic), 1, f) == 1 &&
+	    !memcmp(magic, JOURNAL_MAGIC, sizeof(magic))) {
+		ret = read_binary_journal(f, records);
+	} else {
+		rewind(f);
+		ret = read_text_journal(f, records);
+	}
+
+	fclose(f);
+
+	return ret;
+}
+
+void free_journal_records(struct journal_records *records)
+{
+	size_t i;
+
+	for (i = 0; i < records->size; i++)
+		free(records->records[i]);
+	free(records->records);
+
+	memset(records, 0, sizeof(*records));
+}
@@ -0,0 +1,79 @@
+#ifndef RUNNER_JOURNAL_H
+#define RUNNER_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * The execution journal records the subtests a test has started, and
+ * finally how it exited. It is normally journal.txt, one record per
+ * line.
+ *
+ * With group commit, the journal is journal.bin instead: a magic
+ * followed by records of a 32-bit length, a 32-bit FNV-1a hash of the
+ * record, and the record text. Records are written as they come, but
+ * synced to disk at most once per commit interval, together with the
+ * test outputs. A record torn by a crash fails the length or hash
+ * check, and it and everything after it is ignored.
+ */
+
+#define JOURNAL_FILENAME "journal.txt"
+#define JOURNAL_BINARY_FILENAME "journal.bin"
+#define JOURNAL_MAGIC "IGTJRNL1"
+
+struct journal_writer {
+	int fd;
+	bool binary;
+	/* Text journals only, sync after every record and output write */
+	bool sync;
+	/* Binary journals only, in milliseconds */
+	int commit_interval;
+	/* Synced on commit along with the journal */
+	int *sync_fds;
+	int num_sync_fds;
+	bool pending;
+	struct timespec last_commit;
+	size_t commits;
+};
+
+/*
+ * Sets up writing to an open journal, positioned at its end. A new
+ * binary journal gets its magic written, an existing one gets a torn
+ * record at its end dropped. Returns false if that fails.
+ */
+bool init_journal_writer(struct journal_writer *writer, int fd,
+			 bool binary, int commit_interval, bool sync,
+			 int *sync_fds, int num_sync_fds);
+
+/* Appends a record, given without the trailing newline */
+void journal_append(struct journal_writer *writer, const char *record, size_t len);
+void journal_appendf(struct journal_writer *writer, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* Notes that an output file was written to */
+void journal_output_written(struct journal_writer *writer, int fd);
+
+/*
+ * Milliseconds until the pending writes need to be committed, or -1
+ * if there's nothing pending.
+ */
+int journal_commit_timeout(struct journal_writer *writer);
+
+/* Commits if the commit interval has passed since the last commit */
+void journal_commit_if_due(struct journal_writer *writer);
+
+/* Commits the pending writes now */
+void journal_commit(struct journal_writer *writer);
+
+struct journal_records {
+	char **records;
+	size_t size;
+};
+
+/* Reads a journal of either format */
+bool read_journal(int fd, struct journal_records *records);
+void free_journal_records(struct journal_records *records);
+
+#endif
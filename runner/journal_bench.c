@@ -0,0 +1,102 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+/*
+ * Measures journal write throughput for a test with a lot of short
+ * dynamic subtests: the text journal synced after every record, like
+ * with --sync, against the binary journal with group commit.
+ */
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static int run(const char *dir, bool binary, int interval, int records)
+{
+	struct journal_writer journal;
+	struct timespec start, end;
+	char path[4096];
+	double time;
+	int fd, i;
+
+	snprintf(path, sizeof(path), "%s/journal_bench.%d", dir, getpid());
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0666)) < 0) {
+		fprintf(stderr, "Cannot create %s\n", path);
+		return 1;
+	}
+
+	if (!init_journal_writer(&journal, fd, binary, interval, true, NULL, 0)) {
+		fprintf(stderr, "Cannot write the journal magic to %s\n", path);
+		close(fd);
+		unlink(path);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < records; i++) {
+		journal_appendf(&journal, "dynamic-subtest-%d", i);
+		journal_commit_if_due(&journal);
+	}
+	journal_appendf(&journal, "exit:0 (%.3fs)", 1.0);
+	journal_commit(&journal);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	time = elapsed(&start, &end);
+	if (binary)
+		printf("binary, group commit %d ms: %d records in %.3fs, %.0f records/s, %zd commits\n",
+		       interval, records + 1, time, (records + 1) / time, journal.commits);
+	else
+		printf("text, sync per record: %d records in %.3fs, %.0f records/s\n",
+		       records + 1, time, (records + 1) / time);
+
+	close(fd);
+	unlink(path);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = ".";
+	int records = 10000, interval = 50;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:n:i:")) != -1) {
+		switch (c) {
+		case 'd':
+			dir = optarg;
+			break;
+
+		case 'n':
+			records = atoi(optarg);
+			if (records < 1)
+				records = 1;
+			break;
+
+		case 'i':
+			interval = atoi(optarg);
+			if (interval < 1)
+				interval = 1;
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-d directory] [-n records] [-i commit-interval-ms]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	return run(dir, false, 0, records) || run(dir, true, interval, records);
+}
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
@@ -14,7 +15,9 @@
 #include "resultgen.h"
 #include "settings.h"
 #include "executor.h"
+#include "journal.h"
 #include "output_strings.h"
+#include "resultstore.h"
 
 #define INCOMPLETE_EXITCODE -1
 
@@ -148,15 +151,6 @@ static size_t count_lines(const char *buf, const char *bufend)
 	return ret;
 }
 
-static void append_line(char **buf, size_t *buflen, char *line)
-{
-	size_t linelen = strlen(line);
-
-	*buf = realloc(*buf, *buflen + linelen + 1);
-	strcpy(*buf + *buflen, line);
-	*buflen += linelen;
-}
-
 static const struct {
 	const char *output_str;
 	const char *result_str;
@@ -319,11 +313,14 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 	char *igt_version = NULL;
 	size_t igt_version_len = 0;
 	struct json_object *current_test = NULL;
+	size_t mapped_size;
 	size_t i;
 
 	if (fstat(fd, &statbuf))
 		return false;
 
+	mapped_size = statbuf.st_size;
+
 	if (statbuf.st_size != 0) {
 		buf = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
 		if (buf == MAP_FAILED)
@@ -361,6 +358,8 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 					       json_object_new_string_len(igt_version,
 									  igt_version_len));
 
+		if (buf)
+			munmap(buf, mapped_size);
 		return true;
 	}
 
@@ -380,6 +379,8 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 
 		if (begin_len < 0 || result_len < 0) {
 			fprintf(stderr, "Failure generating strings\n");
+			if (buf)
+				munmap(buf, mapped_size);
 			return false;
 		}
 
@@ -461,6 +462,9 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 		}
 	}
 
+	if (buf)
+		munmap(buf, mapped_size);
+
 	return true;
 }
 
@@ -502,6 +506,125 @@ static const char igt_piglit_style_dmesg_blacklist[] =
 
 static regex_t re;
 
+/*
+ * Literal strings, one of which any message matching the regexp must
+ * contain. Checking for them is much cheaper than running the regexp,
+ * which is only done for messages containing one. NULL if the regexp
+ * doesn't allow extracting them.
+ */
+static char **re_literals;
+static size_t *re_literal_lens;
+static size_t re_num_literals;
+
+/* Returns the end of the bracket expression, group or character at regex */
+static const char *skip_regex_atom(const char *regex)
+{
+	switch (*regex) {
+	case '\\':
+		return regex[1] ? regex + 2 : regex + 1;
+	case '[':
+		regex++;
+		/* A ']' right after the opening bracket is literal */
+		if (*regex == '^')
+			regex++;
+		if (*regex == ']')
+			regex++;
+		while (*regex && *regex != ']')
+			regex++;
+		return *regex ? regex + 1 : regex;
+	case '(':
+		regex++;
+		while (*regex && *regex != ')')
+			regex = skip_regex_atom(regex);
+		return *regex ? regex + 1 : regex;
+	default:
+		return regex + 1;
+	}
+}
+
+static char *literal_prefix(const char *begin, const char *end)
+{
+	static const char special[] = ".[]()*+?{}|^$\\";
+	static const char quantifiers[] = "*+?{";
+	char *literal = malloc(end - begin + 1);
+	size_t len = 0;
+
+	while (begin < end) {
+		const char *next;
+		char c;
+
+		if (*begin == '\\') {
+			if (begin + 1 == end || !strchr(special, begin[1]))
+				break;
+			c = begin[1];
+			next = begin + 2;
+		} else if (strchr(special, *begin)) {
+			break;
+		} else {
+			c = *begin;
+			next = begin + 1;
+		}
+
+		/* A quantified character isn't always there */
+		if (next < end && strchr(quantifiers, *next))
+			break;
+
+		literal[len++] = c;
+		begin = next;
+	}
+
+	literal[len] = '\0';
+	return literal;
+}
+
+static void free_regex_literals(void)
+{
+	size_t i;
+
+	for (i = 0; i < re_num_literals; i++)
+		free(re_literals[i]);
+	free(re_literals);
+	free(re_literal_lens);
+	re_literals = NULL;
+	re_literal_lens = NULL;
+	re_num_literals = 0;
+}
+
+static void collect_regex_literals(const char *regex)
+{
+	const char *begin = regex, *end = regex + strlen(regex);
+
+	/* Look inside a group covering the whole regexp */
+	if (*begin == '(' && skip_regex_atom(begin) == end) {
+		begin++;
+		end--;
+	}
+
+	while (begin <= end) {
+		const char *alt_end = begin;
+		char *literal;
+
+		while (alt_end < end && *alt_end != '|')
+			alt_end = skip_regex_atom(alt_end);
+
+		literal = literal_prefix(begin, alt_end);
+		if (!*literal) {
+			/* Anything could match */
+			free(literal);
+			free_regex_literals();
+			return;
+		}
+
+		re_literals = realloc(re_literals, (re_num_literals + 1) * sizeof(*re_literals));
+		re_literal_lens = realloc(re_literal_lens, (re_num_literals + 1) * sizeof(*re_literal_lens));
+		re_literals[re_num_literals] = literal;
+		re_literal_lens[re_num_literals] = strlen(literal);
+		re_num_literals++;
+
+		begin = alt_end + 1;
+	}
+}
+
 static int init_regex_whitelist(struct settings *settings)
 {
 	static int status = -1;
@@ -517,41 +640,208 @@ static int init_regex_whitelist(struct settings *settings)
 			return false;
 		}
 
+		collect_regex_literals(regex);
+
 		status = 0;
 	}
 
 	return status;
 }
 
-static bool parse_dmesg_line(char* line,
-			     unsigned *flags, unsigned long long *ts_usec,
-			     char *continuation, char **message)
+static bool matches_regex(const char *message, size_t len)
+{
+	char *str;
+	bool ret;
+	size_t i;
+
+	if (re_literals) {
+		for (i = 0; i < re_num_literals; i++)
+			if (memmem(message, len, re_literals[i], re_literal_lens[i]))
+				break;
+
+		if (i == re_num_literals)
+			return false;
+	}
+
+	str = strndup(message, len);
+	ret = regexec(&re, str, (size_t)0, NULL, 0) != REG_NOMATCH;
+	free(str);
+
+	return ret;
+}
+
+/*
+ * A kernel log record in a mapped dmesg.txt. The message is not
+ * nul-terminated, but includes the newline if there is one.
+ */
+struct dmesg_record {
+	const char *message;
+	size_t len;
+	unsigned long long ts_usec;
+	unsigned flags;
+	char continuation;
+};
+
+/*
+ * All records of a dmesg.txt and the positions of the records where
+ * subtests start, collected in a single pass.
+ */
+struct dmesg_index {
+	struct dmesg_record *records;
+	size_t size;
+	size_t *subtest_starts;
+	size_t num_subtests;
+};
+
+static bool parse_number(const char **p, const char *end, unsigned long long *val)
+{
+	const char *begin = *p;
+
+	*val = 0;
+	while (*p < end && isdigit(**p))
+		*val = *val * 10 + *(*p)++ - '0';
+
+	return *p != begin;
+}
+
+static bool parse_dmesg_line(const char *line, size_t linelen,
+			     struct dmesg_record *record)
 {
-	unsigned long long seq;
-	int s;
+	const char *p = line, *end = line + linelen;
+	unsigned long long flags, seq;
 
-	s = sscanf(line, "%u,%llu,%llu,%c;", flags, &seq, ts_usec, continuation);
-	if (s != 4) {
+	if (!parse_number(&p, end, &flags) || p == end || *p++ != ',' ||
+	    !parse_number(&p, end, &seq) || p == end || *p++ != ',' ||
+	    !parse_number(&p, end, &record->ts_usec) || p == end || *p++ != ',' ||
+	    p == end) {
 		/*
 		 * Machine readable key/value pairs begin with
 		 * a space. We ignore them.
 		 */
 		if (line[0] != ' ') {
-			fprintf(stderr, "Cannot parse kmsg record: %s\n", line);
+			fprintf(stderr, "Cannot parse kmsg record: %.*s\n",
+				(int)linelen, line);
 		}
 		return false;
 	}
 
-	*message = strchr(line, ';');
-	if (!message) {
+	record->flags = flags;
+	record->continuation = *p;
+
+	record->message = memchr(p, ';', end - p);
+	if (!record->message) {
 		fprintf(stderr, "No ; found in kmsg record, this shouldn't happen\n");
 		return false;
 	}
-	(*message)++;
+	record->message++;
+	record->len = end - record->message;
 
 	return true;
 }
 
+static void index_dmesg(const char *buf, size_t size, struct dmesg_index *index)
+{
+	const char *line = buf, *end = buf + size;
+	size_t alloc = 0, subtests_alloc = 0;
+
+	memset(index, 0, sizeof(*index));
+
+	while (line < end) {
+		const char *newline = memchr(line, '\n', end - line);
+		size_t linelen = newline ? newline - line + 1 : end - line;
+		struct dmesg_record record;
+
+		if (parse_dmesg_line(line, linelen, &record)) {
+			if (index->size == alloc) {
+				alloc = alloc ? alloc * 2 : 256;
+				index->records = realloc(index->records,
+							 alloc * sizeof(*index->records));
+			}
+
+			if (memmem(record.message, record.len, STARTING_SUBTEST_DMESG,
+				   strlen(STARTING_SUBTEST_DMESG))) {
+				if (index->num_subtests == subtests_alloc) {
+					subtests_alloc = subtests_alloc ? subtests_alloc * 2 : 16;
+					index->subtest_starts = realloc(index->subtest_starts,
+									subtests_alloc * sizeof(*index->subtest_starts));
+				}
+				index->subtest_starts[index->num_subtests++] = index->size;
+			}
+
+			index->records[index->size++] = record;
+		}
+
+		line += linelen;
+	}
+}
+
+static void free_dmesg_index(struct dmesg_index *index)
+{
+	free(index->records);
+	free(index->subtest_starts);
+}
+
+struct dmesg_text {
+	char *buf;
+	size_t len;
+	size_t alloc;
+};
+
+static void append_dmesg_record(struct dmesg_text *text,
+				const struct dmesg_record *record)
+{
+	char header[64];
+	int headerlen;
+
+	headerlen = snprintf(header, sizeof(header), "<%u> [%llu.%06llu] ",
+			     record->flags & 0x07,
+			     record->ts_usec / 1000000,
+			     record->ts_usec % 1000000);
+
+	if (text->len + headerlen + record->len + 1 > text->alloc) {
+		text->alloc = text->len + headerlen + record->len + 1;
+		if (text->alloc < 2 * text->len)
+			text->alloc = 2 * text->len;
+		text->buf = realloc(text->buf, text->alloc);
+	}
+
+	memcpy(text->buf + text->len, header, headerlen);
+	memcpy(text->buf + text->len + headerlen, record->message, record->len);
+	text->len += headerlen + record->len;
+	text->buf[text->len] = '\0';
+}
+
+static bool is_dmesg_warning(const struct dmesg_record *record,
+			     struct settings *settings)
+{
+	/* Cheap checks first, the regexp is only needed for warnings */
+	if (record->continuation == 'c')
+		return false;
+
+	if (settings->piglit_style_dmesg)
+		return (record->flags & 0x07) <= 5 &&
+			matches_regex(record->message, record->len);
+
+	return (record->flags & 0x07) <= 4 &&
+		!matches_regex(record->message, record->len);
+}
+
+static void format_dmesg(struct dmesg_index *index, size_t begin, size_t end,
+			 struct settings *settings,
+			 struct dmesg_text *dmesg, struct dmesg_text *warnings)
+{
+	size_t i;
+
+	memset(dmesg, 0, sizeof(*dmesg));
+	memset(warnings, 0, sizeof(*warnings));
+
+	for (i = begin; i < end; i++) {
+		if (is_dmesg_warning(&index->records[i], settings))
+			append_dmesg_record(warnings, &index->records[i]);
+		append_dmesg_record(dmesg, &index->records[i]);
+	}
+}
+
 static void add_dmesg(struct json_object *obj,
 		      const char *dmesg, size_t dmesglen,
 		      const char *warnings, size_t warningslen)
@@ -589,70 +879,62 @@ static bool fill_from_dmesg(int fd,
 			    struct subtests *subtests,
 			    struct json_object *tests)
 {
-	char *line = NULL, *warnings = NULL, *dmesg = NULL;
-	size_t linelen = 0, warningslen = 0, dmesglen = 0;
+	struct dmesg_index index;
+	struct dmesg_text dmesg, warnings;
 	struct json_object *current_test = NULL;
-	FILE *f = fdopen(fd, "r");
+	struct stat statbuf;
 	char piglit_name[256];
-	ssize_t read;
+	char *buf = NULL;
 	size_t i;
 
-	if (!f) {
+	if (fstat(fd, &statbuf))
 		return false;
+
+	if (statbuf.st_size != 0) {
+		buf = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (buf == MAP_FAILED)
+			return false;
 	}
 
 	if (init_regex_whitelist(settings)) {
-		fclose(f);
+		if (buf)
+			munmap(buf, statbuf.st_size);
 		return false;
 	}
 
-	while ((read = getline(&line, &linelen, f)) > 0) {
-		char *formatted;
-		unsigned flags;
-		unsigned long long ts_usec;
-		char continuation;
-		char *message, *subtest;
+	index_dmesg(buf, statbuf.st_size, &index);
 
-		if (!parse_dmesg_line(line, &flags, &ts_usec, &continuation, &message))
-			continue;
-
-		asprintf(&formatted, "<%u> [%llu.%06llu] %s",
-			 flags & 0x07, ts_usec / 1000000, ts_usec % 1000000, message);
+	for (i = 0; i < index.num_subtests; i++) {
+		struct dmesg_record *start = &index.records[index.subtest_starts[i]];
+		const char *subtest;
+		char *name;
 
-		if ((subtest = strstr(message, STARTING_SUBTEST_DMESG)) != NULL) {
-			if (current_test != NULL) {
-				/* Done with the previous subtest, file up */
-				add_dmesg(current_test, dmesg, dmesglen, warnings, warningslen);
+		subtest = memmem(start->message, start->len, STARTING_SUBTEST_DMESG,
+				 strlen(STARTING_SUBTEST_DMESG));
+		subtest += strlen(STARTING_SUBTEST_DMESG);
+		name = strndup(subtest, start->message + start->len - subtest);
+		generate_piglit_name(binary, name, piglit_name, sizeof(piglit_name));
+		free(name);
 
-				free(dmesg);
-				free(warnings);
-				dmesg = warnings = NULL;
-				dmesglen = warningslen = 0;
-			}
+		/*
+		 * Kernel messages before the first subtest are
+		 * attributed to the first subtest.
+		 */
+		format_dmesg(&index,
+			     i == 0 ? 0 : index.subtest_starts[i],
+			     i + 1 < index.num_subtests ? index.subtest_starts[i + 1] : index.size,
+			     settings, &dmesg, &warnings);
 
-			subtest += strlen(STARTING_SUBTEST_DMESG);
-			generate_piglit_name(binary, subtest, piglit_name, sizeof(piglit_name));
-			current_test = get_or_create_json_object(tests, piglit_name);
-		}
+		current_test = get_or_create_json_object(tests, piglit_name);
+		add_dmesg(current_test, dmesg.buf, dmesg.len, warnings.buf, warnings.len);
 
-		if (settings->piglit_style_dmesg) {
-			if ((flags & 0x07) <= 5 && continuation != 'c' &&
-			    regexec(&re, message, (size_t)0, NULL, 0) != REG_NOMATCH) {
-				append_line(&warnings, &warningslen, formatted);
-			}
-		} else {
-			if ((flags & 0x07) <= 4 && continuation != 'c' &&
-			    regexec(&re, message, (size_t)0, NULL, 0) == REG_NOMATCH) {
-				append_line(&warnings, &warningslen, formatted);
-			}
-		}
-		append_line(&dmesg, &dmesglen, formatted);
-		free(formatted);
+		free(dmesg.buf);
+		free(warnings.buf);
 	}
 
-	if (current_test != NULL) {
-		add_dmesg(current_test, dmesg, dmesglen, warnings, warningslen);
-	} else {
+	if (current_test == NULL) {
+		format_dmesg(&index, 0, index.size, settings, &dmesg, &warnings);
+
 		/*
 		 * Didn't get any subtest messages at all. If there
 		 * are subtests, add all of the dmesg gotten to all of
@@ -666,21 +948,25 @@ static bool fill_from_dmesg(int fd,
 			 * there are would have skip as their result
 			 * anyway.
 			 */
-			add_dmesg(current_test, dmesg, dmesglen, NULL, 0);
+			add_dmesg(current_test, dmesg.buf, dmesg.len, NULL, 0);
 		}
 
 		if (subtests->size == 0) {
 			generate_piglit_name(binary, NULL, piglit_name, sizeof(piglit_name));
 			current_test = get_or_create_json_object(tests, piglit_name);
-			add_dmesg(current_test, dmesg, dmesglen, warnings, warningslen);
+			add_dmesg(current_test, dmesg.buf, dmesg.len, warnings.buf, warnings.len);
 		}
+
+		free(dmesg.buf);
+		free(warnings.buf);
 	}
 
 	add_empty_dmesgs_where_missing(tests, binary, subtests);
 
-	free(dmesg);
-	free(warnings);
-	fclose(f);
+	free_dmesg_index(&index);
+	if (buf)
+		munmap(buf, statbuf.st_size);
+	close(fd);
 	return true;
 }
 
@@ -722,10 +1008,8 @@ static void fill_from_journal(int fd,
 			      struct subtests *subtests,
 			      struct results *results)
 {
-	FILE *f = fdopen(fd, "r");
-	char *line = NULL;
-	size_t linelen = 0;
-	ssize_t read;
+	struct journal_records records;
+	size_t i;
 	char exitline[] = "exit:";
 	char timeoutline[] = "timeout:";
 	int exitcode = INCOMPLETE_EXITCODE;
@@ -733,7 +1017,13 @@ static void fill_from_journal(int fd,
 	struct json_object *tests = results->tests;
 	struct json_object *runtimes = results->runtimes;
 
-	while ((read = getline(&line, &linelen, f)) > 0) {
+	/* An unreadable journal is like an empty one */
+	read_journal(fd, &records);
+
+	for (i = 0; i < records.size; i++) {
+		char *line = records.records[i];
+		size_t read = strlen(line);
+
 		if (read >= strlen(exitline) && !memcmp(line, exitline, strlen(exitline))) {
 			char *p = strchr(line, '(');
 			char piglit_name[256];
@@ -808,8 +1098,7 @@ static void fill_from_journal(int fd,
 		set_result(obj, result);
 	}
 
-	free(line);
-	fclose(f);
+	free_journal_records(&records);
 }
 
 static void override_result_single(struct json_object *obj)
@@ -888,7 +1177,8 @@ static struct json_object *get_totals_object(struct json_object *totals,
 }
 
 static void add_result_to_totals(struct json_object *totals,
-				 const char *result)
+				 const char *result,
+				 int count)
 {
 	json_object *numobj = NULL;
 	int old;
@@ -899,7 +1189,7 @@ static void add_result_to_totals(struct json_object *totals,
 	}
 
 	old = json_object_get_int(numobj);
-	json_object_object_add(totals, result, json_object_new_int(old + 1));
+	json_object_object_add(totals, result, json_object_new_int(old + count));
 }
 
 static void add_to_totals(char *binary,
@@ -923,9 +1213,9 @@ static void add_to_totals(char *binary,
 			return;
 		}
 		result = json_object_get_string(resultobj);
-		add_result_to_totals(emptystrtotal, result);
-		add_result_to_totals(roottotal, result);
-		add_result_to_totals(binarytotal, result);
+		add_result_to_totals(emptystrtotal, result, 1);
+		add_result_to_totals(roottotal, result, 1);
+		add_result_to_totals(binarytotal, result, 1);
 		return;
 	}
 
@@ -937,9 +1227,9 @@ static void add_to_totals(char *binary,
 			return;
 		}
 		result = json_object_get_string(resultobj);
-		add_result_to_totals(emptystrtotal, result);
-		add_result_to_totals(roottotal, result);
-		add_result_to_totals(binarytotal, result);
+		add_result_to_totals(emptystrtotal, result, 1);
+		add_result_to_totals(roottotal, result, 1);
+		add_result_to_totals(binarytotal, result, 1);
 	}
 }
 
@@ -977,15 +1267,444 @@ static bool parse_test_directory(int dirfd,
 	return true;
 }
 
-static void create_result_root_nodes(struct json_object *root,
-				     struct results *results)
+static void create_result_root_nodes(struct results *results)
 {
 	results->tests = json_object_new_object();
-	json_object_object_add(root, "tests", results->tests);
 	results->totals = json_object_new_object();
-	json_object_object_add(root, "totals", results->totals);
 	results->runtimes = json_object_new_object();
-	json_object_object_add(root, "runtimes", results->runtimes);
+}
+
+static void free_result_root_nodes(struct results *results)
+{
+	json_object_put(results->tests);
+	json_object_put(results->totals);
+	json_object_put(results->runtimes);
+}
+
+/*
+ * The results of a single job list entry are kept in memory only
+ * until they are written out. The tests of an entry are written as
+ * text that can be spliced into the "tests" object of results.json
+ * as is, and the totals and runtimes of the entry are kept as a
+ * summary object that gets merged into the running totals.
+ */
+
+static const char *tests_as_members(struct json_object *tests, size_t *len)
+{
+	const char *str, *beg, *end;
+
+	*len = 0;
+
+	if (json_object_object_length(tests) == 0)
+		return NULL;
+
+	str = json_object_to_json_string_ext(tests, JSON_C_TO_STRING_PRETTY);
+
+	/* Strip the braces of the object */
+	beg = strchr(str, '{');
+	end = strrchr(str, '}');
+	if (!beg || !end || end <= beg)
+		return NULL;
+
+	beg++;
+	*len = end - beg;
+	return beg;
+}
+
+static struct json_object *entry_summary(struct results *results)
+{
+	struct json_object *summary = json_object_new_object();
+
+	json_object_object_add(summary, "totals",
+			       json_object_get(get_totals_object(results->totals, "root")));
+	json_object_object_add(summary, "runtimes",
+			       json_object_get(results->runtimes));
+
+	return summary;
+}
+
+static void merge_summary(struct results *results,
+			  const char *binary,
+			  struct json_object *summary)
+{
+	struct json_object *totals, *runtimes, *emptystrtotal, *roottotal, *binarytotal;
+	char piglit_name[256];
+
+	generate_piglit_name(binary, NULL, piglit_name, sizeof(piglit_name));
+	emptystrtotal = get_totals_object(results->totals, "");
+	roottotal = get_totals_object(results->totals, "root");
+	binarytotal = get_totals_object(results->totals, piglit_name);
+
+	if (json_object_object_get_ex(summary, "totals", &totals)) {
+		json_object_object_foreach(totals, result, countobj) {
+			int count = json_object_get_int(countobj);
+
+			add_result_to_totals(emptystrtotal, result, count);
+			add_result_to_totals(roottotal, result, count);
+			add_result_to_totals(binarytotal, result, count);
+		}
+	}
+
+	if (json_object_object_get_ex(summary, "runtimes", &runtimes)) {
+		json_object_object_foreach(runtimes, name, obj) {
+			struct json_object *timeobj, *endobj;
+
+			if (json_object_object_get_ex(obj, "time", &timeobj) &&
+			    json_object_object_get_ex(timeobj, "end", &endobj))
+				add_runtime(get_or_create_json_object(results->runtimes, name),
+					    json_object_get_double(endobj));
+		}
+	}
+}
+
+static bool parse_entry(int testdirfd,
+			struct job_list_entry *entry,
+			struct settings *settings,
+			struct results *results)
+{
+	create_result_root_nodes(results);
+
+	if (!parse_test_directory(testdirfd, entry, settings, results)) {
+		free_result_root_nodes(results);
+		return false;
+	}
+
+	return true;
+}
+
+static const char fragment_filename[] = RESULTS_FRAGMENT_FILENAME;
+static const char fragment_tmp_filename[] = RESULTS_FRAGMENT_FILENAME ".tmp";
+
+bool generate_entry_results(int testdirfd,
+			    struct job_list_entry *entry,
+			    struct settings *settings)
+{
+	struct results results;
+	struct json_object *summary;
+	const char *str;
+	size_t len;
+	int fd;
+
+	if (!parse_entry(testdirfd, entry, settings, &results))
+		return false;
+
+	if ((fd = openat(testdirfd, fragment_tmp_filename,
+			 O_CREAT | O_TRUNC | O_WRONLY, 0666)) < 0) {
+		fprintf(stderr, "resultgen: Cannot create %s\n", fragment_tmp_filename);
+		free_result_root_nodes(&results);
+		return false;
+	}
+
+	/* First line is the summary, the rest are the tests */
+	summary = entry_summary(&results);
+	str = json_object_to_json_string_ext(summary, JSON_C_TO_STRING_PLAIN);
+	write(fd, str, strlen(str));
+	write(fd, "\n", 1);
+	json_object_put(summary);
+
+	str = tests_as_members(results.tests, &len);
+	if (str)
+		write(fd, str, len);
+
+	if (settings->sync)
+		fsync(fd);
+	close(fd);
+
+	free_result_root_nodes(&results);
+
+	if (renameat(testdirfd, fragment_tmp_filename,
+		     testdirfd, fragment_filename)) {
+		fprintf(stderr, "resultgen: Cannot rename %s: %s\n",
+			fragment_tmp_filename, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+static void begin_tests_member(int resultsfd, bool *first)
+{
+	if (!*first)
+		write(resultsfd, ",", 1);
+	*first = false;
+}
+
+static bool store_log(struct results_store_writer *store,
+		      struct json_object *test, const char *key,
+		      struct results_store_blob *blob,
+		      uint32_t flag, uint32_t *flags)
+{
+	struct json_object *obj;
+
+	if (!json_object_object_get_ex(test, key, &obj))
+		return true;
+
+	if (!results_store_add_log(store, json_object_get_string(obj),
+				   json_object_get_string_len(obj), blob))
+		return false;
+
+	*flags |= flag;
+	return true;
+}
+
+static bool store_tests(struct results_store_writer *store,
+			struct json_object *tests)
+{
+	json_object_object_foreach(tests, name, test) {
+		struct results_store_test record = {};
+		struct json_object *obj, *timeobj;
+		int result;
+
+		record.name = results_store_add_string(store, name);
+
+		if (json_object_object_get_ex(test, "result", &obj) &&
+		    (result = results_store_result_from_name(json_object_get_string(obj))) >= 0) {
+			record.result = result;
+			record.flags |= RESULTS_STORE_HAS_RESULT;
+		}
+
+		if (json_object_object_get_ex(test, "time", &timeobj)) {
+			if (json_object_object_get_ex(timeobj, "start", &obj))
+				record.time_start = json_object_get_double(obj);
+			if (json_object_object_get_ex(timeobj, "end", &obj))
+				record.time_end = json_object_get_double(obj);
+			record.flags |= RESULTS_STORE_HAS_TIME;
+		}
+
+		if (!store_log(store, test, "out", &record.out,
+			       RESULTS_STORE_HAS_OUT, &record.flags) ||
+		    !store_log(store, test, "err", &record.err,
+			       RESULTS_STORE_HAS_ERR, &record.flags) ||
+		    !store_log(store, test, "dmesg", &record.dmesg,
+			       RESULTS_STORE_HAS_DMESG, &record.flags) ||
+		    !store_log(store, test, "dmesg-warnings", &record.dmesg_warnings,
+			       RESULTS_STORE_HAS_DMESG_WARNINGS, &record.flags) ||
+		    !store_log(store, test, "igt-version", &record.igt_version,
+			       RESULTS_STORE_HAS_IGT_VERSION, &record.flags))
+			return false;
+
+		results_store_add_test(store, &record);
+	}
+
+	return true;
+}
+
+/* The store is dropped, rather than finished with logs missing */
+static void abort_store(struct results_store_writer **store)
+{
+	fprintf(stderr, "resultgen: Cannot write %s\n", RESULTS_STORE_FILENAME);
+	results_store_writer_abort(*store);
+	*store = NULL;
+}
+
+static void store_run(struct results_store_writer *store,
+		      struct json_object *root)
+{
+	struct json_object *obj, *elapsed;
+
+	store->header.results_version = 9;
+
+	if (json_object_object_get_ex(root, "name", &obj))
+		store->header.name = results_store_add_string(store, json_object_get_string(obj));
+
+	if (json_object_object_get_ex(root, "uname", &obj)) {
+		store->header.uname = results_store_add_string(store, json_object_get_string(obj));
+		store->header.flags |= RESULTS_STORE_HAS_UNAME;
+	}
+
+	if (json_object_object_get_ex(root, "time_elapsed", &elapsed)) {
+		if (json_object_object_get_ex(elapsed, "start", &obj)) {
+			store->header.time_start = json_object_get_double(obj);
+			store->header.flags |= RESULTS_STORE_HAS_START;
+		}
+		if (json_object_object_get_ex(elapsed, "end", &obj)) {
+			store->header.time_end = json_object_get_double(obj);
+			store->header.flags |= RESULTS_STORE_HAS_END;
+		}
+	}
+}
+
+static bool finish_store(struct results_store_writer *store,
+			 struct results *results)
+{
+	json_object_object_foreach(results->totals, name, totalsobj) {
+		struct results_store_totals record = {};
+
+		record.name = results_store_add_string(store, name);
+		json_object_object_foreach(totalsobj, result, countobj) {
+			int i = results_store_result_from_name(result);
+
+			if (i >= 0)
+				record.counts[i] = json_object_get_int(countobj);
+		}
+
+		results_store_add_totals(store, &record);
+	}
+
+	json_object_object_foreach(results->runtimes, binary, runtimeobj) {
+		struct results_store_runtime record = {};
+		struct json_object *timeobj, *endobj;
+
+		record.name = results_store_add_string(store, binary);
+		if (json_object_object_get_ex(runtimeobj, "time", &timeobj) &&
+		    json_object_object_get_ex(timeobj, "end", &endobj))
+			record.time = json_object_get_double(endobj);
+
+		results_store_add_runtime(store, &record);
+	}
+
+	return results_store_writer_finish(store);
+}
+
+/* The tests in a fragment aren't an object, only its members */
+static bool store_members(struct results_store_writer *store,
+			  const char *members, size_t len)
+{
+	struct json_object *tests;
+	char *str = malloc(len + 3);
+	bool ret = true;
+
+	str[0] = '{';
+	memcpy(str + 1, members, len);
+	str[len + 1] = '}';
+	str[len + 2] = '\0';
+
+	if ((tests = json_tokener_parse(str)) != NULL) {
+		ret = store_tests(store, tests);
+		json_object_put(tests);
+	} else {
+		fprintf(stderr, "resultgen: Cannot parse %s for %s\n",
+			fragment_filename, RESULTS_STORE_FILENAME);
+	}
+
+	free(str);
+	return ret;
+}
+
+static bool splice_entry_results(int testdirfd,
+				 struct job_list_entry *entry,
+				 struct results *results,
+				 struct results_store_writer **store,
+				 int resultsfd,
+				 bool *first)
+{
+	struct json_object *summary;
+	char *line = NULL, *members = NULL;
+	size_t linelen = 0, memberslen = 0;
+	char buf[65536];
+	bool any = false;
+	ssize_t r;
+	FILE *f;
+	int fd;
+
+	if ((fd = openat(testdirfd, fragment_filename, O_RDONLY)) < 0)
+		return false;
+
+	if ((f = fdopen(fd, "r")) == NULL) {
+		close(fd);
+		return false;
+	}
+
+	if (getline(&line, &linelen, f) <= 0 ||
+	    (summary = json_tokener_parse(line)) == NULL) {
+		fprintf(stderr, "resultgen: Corrupt %s, regenerating\n", fragment_filename);
+		free(line);
+		fclose(f);
+		return false;
+	}
+
+	merge_summary(results, entry->binary, summary);
+	json_object_put(summary);
+	free(line);
+
+	while ((r = fread(buf, 1, sizeof(buf), f)) > 0) {
+		if (!any)
+			begin_tests_member(resultsfd, first);
+		any = true;
+		write(resultsfd, buf, r);
+
+		if (*store) {
+			members = realloc(members, memberslen + r);
+			memcpy(members + memberslen, buf, r);
+			memberslen += r;
+		}
+	}
+
+	if (*store && memberslen && !store_members(*store, members, memberslen))
+		abort_store(store);
+
+	free(members);
+	fclose(f);
+	return true;
+}
+
+static bool write_entry_results(int testdirfd,
+				struct job_list_entry *entry,
+				struct settings *settings,
+				struct results *results,
+				struct results_store_writer **store,
+				int resultsfd,
+				bool *first)
+{
+	struct results entry_results;
+	struct json_object *summary;
+	const char *str;
+	size_t len;
+
+	if (!parse_entry(testdirfd, entry, settings, &entry_results))
+		return false;
+
+	summary = entry_summary(&entry_results);
+	merge_summary(results, entry->binary, summary);
+	json_object_put(summary);
+
+	str = tests_as_members(entry_results.tests, &len);
+	if (str) {
+		begin_tests_member(resultsfd, first);
+		write(resultsfd, str, len);
+	}
+
+	if (*store && !store_tests(*store, entry_results.tests))
+		abort_store(store);
+
+	free_result_root_nodes(&entry_results);
+
+	return true;
+}
+
+static void write_json_member(int resultsfd, const char *key,
+			      struct json_object *obj)
+{
+	const char *str = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY);
+
+	dprintf(resultsfd, ",\n  \"%s\":", key);
+	write(resultsfd, str, strlen(str));
+}
+
+/*
+ * Writes everything before the tests, leaving the object open. The
+ * tests are streamed in one entry at a time and only totals and
+ * runtimes are kept in memory.
+ */
+static void write_results_header(int resultsfd, struct json_object *obj)
+{
+	const char *json_string, *end;
+
+	json_string = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY);
+	end = strrchr(json_string, '}');
+	while (end > json_string && isspace(*(end - 1)))
+		end--;
+	write(resultsfd, json_string, end - json_string);
+
+	dprintf(resultsfd, ",\n  \"tests\":{");
+}
+
+static void write_results_footer(int resultsfd, struct results *results)
+{
+	dprintf(resultsfd, "\n  }");
+	write_json_member(resultsfd, "totals", results->totals);
+	write_json_member(resultsfd, "runtimes", results->runtimes);
+	dprintf(resultsfd, "\n}\n");
 }
 
 bool generate_results(int dirfd)
@@ -994,8 +1713,9 @@ bool generate_results(int dirfd)
 	struct job_list job_list;
 	struct json_object *obj, *elapsed;
 	struct results results;
+	struct results_store_writer storebuf, *store = NULL;
 	int resultsfd, testdirfd, fd;
-	const char *json_string;
+	bool first = true;
 	size_t i;
 
 	init_settings(&settings);
@@ -1053,8 +1773,6 @@ bool generate_results(int dirfd)
 	}
 	json_object_object_add(obj, "time_elapsed", elapsed);
 
-	create_result_root_nodes(obj, &results);
-
 	/*
 	 * Result fields that won't be added:
 	 *
@@ -1068,26 +1786,205 @@ bool generate_results(int dirfd)
 	 * - options
 	 */
 
+	if (settings.binary_results) {
+		if (results_store_writer_open(&storebuf, dirfd)) {
+			store = &storebuf;
+			store_run(store, obj);
+		} else {
+			fprintf(stderr, "resultgen: Cannot create %s\n", RESULTS_STORE_FILENAME);
+		}
+	}
+
+	write_results_header(resultsfd, obj);
+	json_object_put(obj);
+
+	create_result_root_nodes(&results);
+
 	for (i = 0; i < job_list.size; i++) {
 		char name[16];
 
 		snprintf(name, 16, "%zd", i);
 		if ((testdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) < 0) {
+			/*
+			 * With parallel execution, later entries can
+			 * have results even if this one was never
+			 * started.
+			 */
+			if (settings.jobs > 1)
+				continue;
+
 			fprintf(stderr, "Warning: Cannot open result directory %s\n", name);
 			break;
 		}
 
-		if (!parse_test_directory(testdirfd, &job_list.entries[i], &settings, &results)) {
+		/*
+		 * With incremental results the executor has already
+		 * written the results of completed entries.
+		 */
+		if (settings.incremental_results &&
+		    splice_entry_results(testdirfd, &job_list.entries[i],
+					 &results, &store, resultsfd, &first)) {
+			close(testdirfd);
+			continue;
+		}
+
+		if (!write_entry_results(testdirfd, &job_list.entries[i], &settings,
+					 &results, &store, resultsfd, &first)) {
 			close(testdirfd);
 			close(resultsfd);
+			free_result_root_nodes(&results);
+			if (store)
+				results_store_writer_abort(store);
 			return false;
 		}
 		close(testdirfd);
 	}
 
-	json_string = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY);
-	write(resultsfd, json_string, strlen(json_string));
+	write_results_footer(resultsfd, &results);
+
+	if (store && !finish_store(store, &results))
+		fprintf(stderr, "resultgen: Cannot write %s\n", RESULTS_STORE_FILENAME);
+
+	free_result_root_nodes(&results);
+	close(resultsfd);
+	return true;
+}
+
+static struct json_object *new_time_attribute(void)
+{
+	struct json_object *obj = json_object_new_object();
+
+	json_object_object_add(obj, "__type__", json_object_new_string("TimeAttribute"));
+
+	return obj;
+}
+
+static void add_stored_log(struct json_object *obj, const char *key,
+			   struct results_store *store,
+			   const struct results_store_test *test,
+			   const struct results_store_blob *blob,
+			   uint32_t flag)
+{
+	const char *log;
+	size_t len;
+
+	if (!(test->flags & flag))
+		return;
+
+	log = results_store_log(store, blob, &len);
+	json_object_object_add(obj, key, json_object_new_string_len(log ?: "", len));
+}
+
+bool generate_results_json_from_store(int dirfd)
+{
+	const struct results_store_header *header;
+	struct results_store store;
+	struct results results;
+	struct json_object *obj, *elapsed;
+	bool first = true;
+	int resultsfd;
+	uint32_t i, k;
+
+	if (!open_results_store(&store, dirfd)) {
+		fprintf(stderr, "resultgen: Cannot open %s\n", RESULTS_STORE_FILENAME);
+		return false;
+	}
+	header = store.header;
+
+	if ((resultsfd = openat(dirfd, "results.json", O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+		fprintf(stderr, "resultgen: Cannot create results file\n");
+		close_results_store(&store);
+		return false;
+	}
+
+	obj = json_object_new_object();
+	json_object_object_add(obj, "__type__", json_object_new_string("TestrunResult"));
+	json_object_object_add(obj, "results_version",
+			       json_object_new_int(header->results_version));
+	json_object_object_add(obj, "name",
+			       json_object_new_string(results_store_string(&store, header->name) ?: ""));
+	if (header->flags & RESULTS_STORE_HAS_UNAME)
+		json_object_object_add(obj, "uname",
+				       json_object_new_string(results_store_string(&store, header->uname) ?: ""));
+
+	elapsed = new_time_attribute();
+	if (header->flags & RESULTS_STORE_HAS_START)
+		json_object_object_add(elapsed, "start", json_object_new_double(header->time_start));
+	if (header->flags & RESULTS_STORE_HAS_END)
+		json_object_object_add(elapsed, "end", json_object_new_double(header->time_end));
+	json_object_object_add(obj, "time_elapsed", elapsed);
+
+	write_results_header(resultsfd, obj);
+	json_object_put(obj);
+
+	create_result_root_nodes(&results);
+
+	for (i = 0; i < header->num_tests; i++) {
+		const struct results_store_test *test = &store.tests[i];
+		struct json_object *testobj = json_object_new_object();
+		const char *name = results_store_string(&store, test->name);
+		const char *str;
+		size_t len;
+
+		if (!name)
+			continue;
+
+		add_stored_log(testobj, "out", &store, test, &test->out, RESULTS_STORE_HAS_OUT);
+		add_stored_log(testobj, "igt-version", &store, test, &test->igt_version,
+			       RESULTS_STORE_HAS_IGT_VERSION);
+		add_stored_log(testobj, "err", &store, test, &test->err, RESULTS_STORE_HAS_ERR);
+		add_stored_log(testobj, "dmesg", &store, test, &test->dmesg, RESULTS_STORE_HAS_DMESG);
+		add_stored_log(testobj, "dmesg-warnings", &store, test, &test->dmesg_warnings,
+			       RESULTS_STORE_HAS_DMESG_WARNINGS);
+
+		if (test->flags & RESULTS_STORE_HAS_RESULT &&
+		    results_store_result_name(test->result))
+			set_result(testobj, results_store_result_name(test->result));
+
+		if (test->flags & RESULTS_STORE_HAS_TIME) {
+			struct json_object *timeobj = new_time_attribute();
+
+			json_object_object_add(timeobj, "start", json_object_new_double(test->time_start));
+			json_object_object_add(timeobj, "end", json_object_new_double(test->time_end));
+			json_object_object_add(testobj, "time", timeobj);
+		}
+
+		/* One test at a time, to keep the memory use bounded */
+		json_object_object_add(results.tests, name, testobj);
+		str = tests_as_members(results.tests, &len);
+		if (str) {
+			begin_tests_member(resultsfd, &first);
+			write(resultsfd, str, len);
+		}
+		json_object_object_del(results.tests, name);
+	}
+
+	for (i = 0; i < header->num_totals; i++) {
+		const char *name = results_store_string(&store, store.totals[i].name);
+		struct json_object *totalsobj;
+
+		if (!name)
+			continue;
+
+		totalsobj = get_totals_object(results.totals, name);
+		for (k = 0; k < RESULTS_STORE_NUM_RESULTS; k++)
+			json_object_object_add(totalsobj, results_store_result_name(k),
+					       json_object_new_int(store.totals[i].counts[k]));
+	}
+
+	for (i = 0; i < header->num_runtimes; i++) {
+		const char *name = results_store_string(&store, store.runtimes[i].name);
+
+		if (name)
+			set_runtime(get_or_create_json_object(results.runtimes, name),
+				    store.runtimes[i].time);
+	}
+
+	write_results_footer(resultsfd, &results);
+
+	free_result_root_nodes(&results);
 	close(resultsfd);
+	close_results_store(&store);
 	return true;
 }
 
@@ -3,7 +3,24 @@
 
 #include <stdbool.h>
 
+#include "job_list.h"
+#include "settings.h"
+
+#define RESULTS_FRAGMENT_FILENAME "results.part"
+
+/*
+ * Writes the results of an executed job list entry to its test
+ * result directory, so that generating results.json can splice them
+ * in without parsing the outputs of the entry again.
+ */
+bool generate_entry_results(int testdirfd,
+			    struct job_list_entry *entry,
+			    struct settings *settings);
+
 bool generate_results(int dirfd);
 bool generate_results_path(char *resultspath);
 
+/* Generates results.json from the binary results store */
+bool generate_results_json_from_store(int dirfd);
+
 #endif
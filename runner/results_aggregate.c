@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "aggregate.h"
+
+int main(int argc, char **argv)
+{
+	struct aggregate aggregate;
+	const char *history = NULL;
+	int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int c;
+
+	while ((c = getopt(argc, argv, "j:r:")) != -1) {
+		switch (c) {
+		case 'j':
+			num_threads = atoi(optarg);
+			break;
+		case 'r':
+			history = optarg;
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Usage: %s [-j threads] [-r runtime-history] results...\n"
+			"Summarizes result changes, flaky tests and runtime regressions\n"
+			"over runs, given as result directories or results.json files\n"
+			"from the oldest to the newest. With -r, also writes the median\n"
+			"runtimes of tests for igt_runner --runtime-history\n", argv[0]);
+		exit(1);
+	}
+
+	init_aggregate(&aggregate, argc - optind);
+
+	if (!aggregate_load_runs(&aggregate, &argv[optind], num_threads)) {
+		free_aggregate(&aggregate);
+		exit(1);
+	}
+
+	print_aggregate_summary(&aggregate, stdout);
+
+	if (history) {
+		FILE *f = fopen(history, "w");
+
+		if (!f) {
+			fprintf(stderr, "Cannot open %s for writing\n", history);
+			free_aggregate(&aggregate);
+			exit(1);
+		}
+
+		write_runtime_history(&aggregate, f);
+		fclose(f);
+	}
+	free_aggregate(&aggregate);
+
+	exit(0);
+}
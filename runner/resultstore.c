@@ -0,0 +1,485 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "resultstore.h"
+
+static const char *result_names[RESULTS_STORE_NUM_RESULTS] = {
+	[RESULTS_STORE_CRASH] = "crash",
+	[RESULTS_STORE_PASS] = "pass",
+	[RESULTS_STORE_DMESG_FAIL] = "dmesg-fail",
+	[RESULTS_STORE_DMESG_WARN] = "dmesg-warn",
+	[RESULTS_STORE_SKIP] = "skip",
+	[RESULTS_STORE_INCOMPLETE] = "incomplete",
+	[RESULTS_STORE_TIMEOUT] = "timeout",
+	[RESULTS_STORE_NOTRUN] = "notrun",
+	[RESULTS_STORE_FAIL] = "fail",
+	[RESULTS_STORE_WARN] = "warn",
+};
+
+static const char tmp_filename[] = RESULTS_STORE_FILENAME ".tmp";
+
+const char *results_store_result_name(uint32_t result)
+{
+	if (result >= RESULTS_STORE_NUM_RESULTS)
+		return NULL;
+
+	return result_names[result];
+}
+
+int results_store_result_from_name(const char *name)
+{
+	int i;
+
+	for (i = 0; i < RESULTS_STORE_NUM_RESULTS; i++) {
+		if (!strcmp(name, result_names[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+static bool table_in_bounds(uint64_t offset, uint64_t count, size_t elemsize,
+			    size_t size)
+{
+	if (offset > size)
+		return false;
+
+	return count <= (size - offset) / elemsize;
+}
+
+bool open_results_store(struct results_store *store, int dirfd)
+{
+	const struct results_store_header *header;
+	struct stat statbuf;
+	int fd;
+
+	memset(store, 0, sizeof(*store));
+
+	if ((fd = openat(dirfd, RESULTS_STORE_FILENAME, O_RDONLY)) < 0)
+		return false;
+
+	if (fstat(fd, &statbuf) ||
+	    statbuf.st_size < sizeof(struct results_store_header)) {
+		fprintf(stderr, "Invalid %s\n", RESULTS_STORE_FILENAME);
+		close(fd);
+		return false;
+	}
+
+	store->size = statbuf.st_size;
+	store->map = mmap(NULL, store->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (store->map == MAP_FAILED) {
+		store->map = NULL;
+		return false;
+	}
+
+	header = store->header = store->map;
+
+	if (memcmp(header->magic, RESULTS_STORE_MAGIC, sizeof(header->magic)) ||
+	    header->version != RESULTS_STORE_VERSION) {
+		fprintf(stderr, "%s is not a results store of a known version\n",
+			RESULTS_STORE_FILENAME);
+		close_results_store(store);
+		return false;
+	}
+
+	if (!table_in_bounds(header->tests_offset, header->num_tests,
+			     sizeof(struct results_store_test), store->size) ||
+	    !table_in_bounds(header->totals_offset, header->num_totals,
+			     sizeof(struct results_store_totals), store->size) ||
+	    !table_in_bounds(header->runtimes_offset, header->num_runtimes,
+			     sizeof(struct results_store_runtime), store->size) ||
+	    !table_in_bounds(header->index_offset, header->num_tests,
+			     sizeof(uint32_t), store->size) ||
+	    !table_in_bounds(header->strings_offset, header->strings_size, 1, store->size) ||
+	    !table_in_bounds(header->logs_offset, header->logs_size, 1, store->size) ||
+	    header->strings_size == 0 ||
+	    ((const char *)store->map)[header->strings_offset + header->strings_size - 1] != '\0') {
+		fprintf(stderr, "Corrupt %s\n", RESULTS_STORE_FILENAME);
+		close_results_store(store);
+		return false;
+	}
+
+	store->tests = (const void *)((const char *)store->map + header->tests_offset);
+	store->totals = (const void *)((const char *)store->map + header->totals_offset);
+	store->runtimes = (const void *)((const char *)store->map + header->runtimes_offset);
+	store->index = (const void *)((const char *)store->map + header->index_offset);
+	store->strings = (const char *)store->map + header->strings_offset;
+	store->logs = (const char *)store->map + header->logs_offset;
+
+	return true;
+}
+
+void close_results_store(struct results_store *store)
+{
+	if (store->map)
+		munmap(store->map, store->size);
+
+	memset(store, 0, sizeof(*store));
+}
+
+const char *results_store_string(const struct results_store *store, uint32_t ref)
+{
+	if (ref >= store->header->strings_size)
+		return NULL;
+
+	return store->strings + ref;
+}
+
+const char *results_store_log(const struct results_store *store,
+			      const struct results_store_blob *blob,
+			      size_t *len)
+{
+	if (!table_in_bounds(blob->offset, blob->len, 1, store->header->logs_size)) {
+		*len = 0;
+		return NULL;
+	}
+
+	*len = blob->len;
+	return store->logs + blob->offset;
+}
+
+const struct results_store_test *results_store_find_test(const struct results_store *store,
+							 const char *name)
+{
+	size_t lo = 0, hi = store->header->num_tests;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		uint32_t idx = store->index[mid];
+		const char *midname;
+		int cmp;
+
+		if (idx >= store->header->num_tests ||
+		    (midname = results_store_string(store, store->tests[idx].name)) == NULL)
+			return NULL;
+
+		cmp = strcmp(name, midname);
+		if (cmp == 0)
+			return &store->tests[idx];
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+static bool write_all(int fd, const void *data, size_t len)
+{
+	const char *buf = data;
+
+	while (len > 0) {
+		ssize_t s = write(fd, buf, len);
+
+		if (s < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		buf += s;
+		len -= s;
+	}
+
+	return true;
+}
+
+static bool pwrite_all(int fd, const void *data, size_t len, off_t offset)
+{
+	const char *buf = data;
+
+	while (len > 0) {
+		ssize_t s = pwrite(fd, buf, len, offset);
+
+		if (s < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		buf += s;
+		len -= s;
+		offset += s;
+	}
+
+	return true;
+}
+
+static void *grow(void *array, size_t *alloc, size_t needed, size_t elemsize)
+{
+	if (needed <= *alloc)
+		return array;
+
+	*alloc = *alloc ? *alloc * 2 : 64;
+	if (*alloc < needed)
+		*alloc = needed;
+
+	return realloc(array, *alloc * elemsize);
+}
+
+bool results_store_writer_open(struct results_store_writer *writer, int dirfd)
+{
+	memset(writer, 0, sizeof(*writer));
+
+	writer->dirfd = dirfd;
+	if ((writer->fd = openat(dirfd, tmp_filename,
+				 O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0) {
+		fprintf(stderr, "Cannot create %s: %s\n", tmp_filename, strerror(errno));
+		return false;
+	}
+
+	memcpy(writer->header.magic, RESULTS_STORE_MAGIC, sizeof(writer->header.magic));
+	writer->header.version = RESULTS_STORE_VERSION;
+	writer->header.logs_offset = sizeof(writer->header);
+
+	/* The empty string is always at offset 0 */
+	results_store_add_string(writer, "");
+
+	return true;
+}
+
+uint32_t results_store_add_string(struct results_store_writer *writer, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	uint32_t ref = writer->header.strings_size;
+
+	writer->strings = grow(writer->strings, &writer->strings_alloc,
+			       writer->header.strings_size + len, 1);
+	memcpy(writer->strings + ref, str, len);
+	writer->header.strings_size += len;
+
+	return ref;
+}
+
+static uint64_t hash_log(const char *data, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static bool log_equals(struct results_store_writer *writer,
+		       const struct results_store_blob *blob,
+		       const char *data)
+{
+	char buf[4096];
+	uint64_t done = 0;
+
+	while (done < blob->len) {
+		size_t chunk = blob->len - done < sizeof(buf) ? blob->len - done : sizeof(buf);
+
+		if (pread(writer->fd, buf, chunk,
+			  writer->header.logs_offset + blob->offset + done) != chunk ||
+		    memcmp(buf, data + done, chunk))
+			return false;
+
+		done += chunk;
+	}
+
+	return true;
+}
+
+static void rehash_logs(struct results_store_writer *writer)
+{
+	size_t old_alloc = writer->logs_alloc;
+	struct results_store_log_entry *old = writer->logs;
+	size_t i;
+
+	writer->logs_alloc = old_alloc ? old_alloc * 2 : 1024;
+	writer->logs = calloc(writer->logs_alloc, sizeof(*writer->logs));
+
+	for (i = 0; i < old_alloc; i++) {
+		size_t slot;
+
+		if (old[i].blob.len == 0)
+			continue;
+
+		slot = old[i].hash & (writer->logs_alloc - 1);
+		while (writer->logs[slot].blob.len != 0)
+			slot = (slot + 1) & (writer->logs_alloc - 1);
+		writer->logs[slot] = old[i];
+	}
+
+	free(old);
+}
+
+bool results_store_add_log(struct results_store_writer *writer,
+			   const char *data, size_t len,
+			   struct results_store_blob *blob)
+{
+	uint64_t hash;
+	size_t slot;
+
+	memset(blob, 0, sizeof(*blob));
+
+	if (len == 0)
+		return true;
+
+	if (2 * (writer->num_logs + 1) > writer->logs_alloc)
+		rehash_logs(writer);
+
+	hash = hash_log(data, len);
+	slot = hash & (writer->logs_alloc - 1);
+
+	/* Empty slots have zero length, as empty logs aren't stored */
+	while (writer->logs[slot].blob.len != 0) {
+		if (writer->logs[slot].hash == hash &&
+		    writer->logs[slot].blob.len == len &&
+		    log_equals(writer, &writer->logs[slot].blob, data)) {
+			*blob = writer->logs[slot].blob;
+			return true;
+		}
+
+		slot = (slot + 1) & (writer->logs_alloc - 1);
+	}
+
+	/*
+	 * At its offset rather than appended, so that what a failed write
+	 * left gets overwritten by the next log, or cut when finishing.
+	 */
+	if (!pwrite_all(writer->fd, data, len,
+			writer->header.logs_offset + writer->header.logs_size)) {
+		fprintf(stderr, "Error writing %s: %s\n", tmp_filename, strerror(errno));
+		return false;
+	}
+
+	blob->offset = writer->header.logs_size;
+	blob->len = len;
+
+	writer->header.logs_size += len;
+	writer->logs[slot].hash = hash;
+	writer->logs[slot].blob = *blob;
+	writer->num_logs++;
+
+	return true;
+}
+
+void results_store_add_test(struct results_store_writer *writer,
+			    const struct results_store_test *test)
+{
+	writer->tests = grow(writer->tests, &writer->tests_alloc,
+			     writer->header.num_tests + 1, sizeof(*test));
+	writer->tests[writer->header.num_tests++] = *test;
+}
+
+void results_store_add_totals(struct results_store_writer *writer,
+			      const struct results_store_totals *totals)
+{
+	writer->totals = grow(writer->totals, &writer->totals_alloc,
+			      writer->header.num_totals + 1, sizeof(*totals));
+	writer->totals[writer->header.num_totals++] = *totals;
+}
+
+void results_store_add_runtime(struct results_store_writer *writer,
+			       const struct results_store_runtime *runtime)
+{
+	writer->runtimes = grow(writer->runtimes, &writer->runtimes_alloc,
+				writer->header.num_runtimes + 1, sizeof(*runtime));
+	writer->runtimes[writer->header.num_runtimes++] = *runtime;
+}
+
+static int compare_test_names(const void *a, const void *b, void *arg)
+{
+	struct results_store_writer *writer = arg;
+	const struct results_store_test *one = &writer->tests[*(const uint32_t *)a];
+	const struct results_store_test *two = &writer->tests[*(const uint32_t *)b];
+
+	return strcmp(writer->strings + one->name, writer->strings + two->name);
+}
+
+static void free_writer(struct results_store_writer *writer)
+{
+	free(writer->tests);
+	free(writer->totals);
+	free(writer->runtimes);
+	free(writer->strings);
+	free(writer->logs);
+	writer->tests = NULL;
+	writer->totals = NULL;
+	writer->runtimes = NULL;
+	writer->strings = NULL;
+	writer->logs = NULL;
+	close(writer->fd);
+	writer->fd = -1;
+}
+
+bool results_store_writer_finish(struct results_store_writer *writer)
+{
+	struct results_store_header *header = &writer->header;
+	static const char padding[8];
+	uint64_t pos = header->logs_offset + header->logs_size;
+	uint32_t *index;
+	uint32_t i;
+	bool ok;
+
+	/* The tables are aligned for mapping */
+	ok = ftruncate(writer->fd, pos) == 0 &&
+		lseek(writer->fd, pos, SEEK_SET) == pos &&
+		write_all(writer->fd, padding, -pos & 7);
+	pos += -pos & 7;
+
+	header->tests_offset = pos;
+	pos += header->num_tests * sizeof(*writer->tests);
+	header->totals_offset = pos;
+	pos += header->num_totals * sizeof(*writer->totals);
+	header->runtimes_offset = pos;
+	pos += header->num_runtimes * sizeof(*writer->runtimes);
+	header->index_offset = pos;
+	pos += header->num_tests * sizeof(*index);
+	header->strings_offset = pos;
+
+	index = malloc(header->num_tests * sizeof(*index) + 1);
+	for (i = 0; i < header->num_tests; i++)
+		index[i] = i;
+	qsort_r(index, header->num_tests, sizeof(*index), compare_test_names, writer);
+
+	ok = ok &&
+		write_all(writer->fd, writer->tests, header->num_tests * sizeof(*writer->tests)) &&
+		write_all(writer->fd, writer->totals, header->num_totals * sizeof(*writer->totals)) &&
+		write_all(writer->fd, writer->runtimes, header->num_runtimes * sizeof(*writer->runtimes)) &&
+		write_all(writer->fd, index, header->num_tests * sizeof(*index)) &&
+		write_all(writer->fd, writer->strings, header->strings_size) &&
+		pwrite(writer->fd, header, sizeof(*header), 0) == sizeof(*header) &&
+		lseek(writer->fd, 0, SEEK_END) == header->strings_offset + header->strings_size;
+
+	free(index);
+
+	if (!ok) {
+		fprintf(stderr, "Error writing %s\n", tmp_filename);
+		results_store_writer_abort(writer);
+		return false;
+	}
+
+	free_writer(writer);
+
+	if (renameat(writer->dirfd, tmp_filename, writer->dirfd, RESULTS_STORE_FILENAME)) {
+		fprintf(stderr, "Cannot rename %s: %s\n", tmp_filename, strerror(errno));
+		unlinkat(writer->dirfd, tmp_filename, 0);
+		return false;
+	}
+
+	return true;
+}
+
+void results_store_writer_abort(struct results_store_writer *writer)
+{
+	free_writer(writer);
+	unlinkat(writer->dirfd, tmp_filename, 0);
+}
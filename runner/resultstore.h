@@ -0,0 +1,185 @@
+#ifndef RUNNER_RESULTSTORE_H
+#define RUNNER_RESULTSTORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary results store, results.bin, an alternative to results.json
+ * that can be mapped and queried without parsing.
+ *
+ * The file is a header, the log blob, and then the test, totals,
+ * runtime and name index tables followed by the string table. All
+ * values are in host byte order. Strings are referred to with their
+ * offset in the string table. Test outputs are referred to with their
+ * offset and length in the log blob, where identical outputs are
+ * stored only once.
+ */
+
+#define RESULTS_STORE_FILENAME "results.bin"
+#define RESULTS_STORE_MAGIC "IGTRSLT"
+#define RESULTS_STORE_VERSION 1
+
+/* In the order piglit lists them in totals */
+enum results_store_result {
+	RESULTS_STORE_CRASH,
+	RESULTS_STORE_PASS,
+	RESULTS_STORE_DMESG_FAIL,
+	RESULTS_STORE_DMESG_WARN,
+	RESULTS_STORE_SKIP,
+	RESULTS_STORE_INCOMPLETE,
+	RESULTS_STORE_TIMEOUT,
+	RESULTS_STORE_NOTRUN,
+	RESULTS_STORE_FAIL,
+	RESULTS_STORE_WARN,
+	RESULTS_STORE_NUM_RESULTS,
+};
+
+/* Fields present in a test record */
+enum {
+	RESULTS_STORE_HAS_RESULT = 1 << 0,
+	RESULTS_STORE_HAS_TIME = 1 << 1,
+	RESULTS_STORE_HAS_OUT = 1 << 2,
+	RESULTS_STORE_HAS_ERR = 1 << 3,
+	RESULTS_STORE_HAS_DMESG = 1 << 4,
+	RESULTS_STORE_HAS_DMESG_WARNINGS = 1 << 5,
+	RESULTS_STORE_HAS_IGT_VERSION = 1 << 6,
+};
+
+/* Fields present in the header */
+enum {
+	RESULTS_STORE_HAS_START = 1 << 0,
+	RESULTS_STORE_HAS_END = 1 << 1,
+	RESULTS_STORE_HAS_UNAME = 1 << 2,
+};
+
+struct results_store_blob {
+	uint64_t offset;
+	uint64_t len;
+};
+
+struct results_store_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t results_version;
+	uint32_t name;
+	uint32_t uname;
+	uint32_t flags;
+	uint32_t num_tests;
+	uint32_t num_totals;
+	uint32_t num_runtimes;
+	double time_start;
+	double time_end;
+	uint64_t tests_offset;
+	uint64_t totals_offset;
+	uint64_t runtimes_offset;
+	uint64_t index_offset;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint64_t logs_offset;
+	uint64_t logs_size;
+};
+
+struct results_store_test {
+	uint32_t name;
+	uint32_t result;
+	uint32_t flags;
+	uint32_t reserved;
+	double time_start;
+	double time_end;
+	struct results_store_blob out;
+	struct results_store_blob err;
+	struct results_store_blob dmesg;
+	struct results_store_blob dmesg_warnings;
+	struct results_store_blob igt_version;
+};
+
+struct results_store_totals {
+	uint32_t name;
+	uint32_t counts[RESULTS_STORE_NUM_RESULTS];
+	uint32_t reserved;
+};
+
+struct results_store_runtime {
+	uint32_t name;
+	uint32_t reserved;
+	double time;
+};
+
+_Static_assert(sizeof(struct results_store_header) == 120, "results store header layout");
+_Static_assert(sizeof(struct results_store_test) == 112, "results store test layout");
+_Static_assert(sizeof(struct results_store_totals) == 48, "results store totals layout");
+_Static_assert(sizeof(struct results_store_runtime) == 16, "results store runtime layout");
+
+/* A mapped results store */
+struct results_store {
+	void *map;
+	size_t size;
+	const struct results_store_header *header;
+	const struct results_store_test *tests;
+	const struct results_store_totals *totals;
+	const struct results_store_runtime *runtimes;
+	const uint32_t *index;
+	const char *strings;
+	const char *logs;
+};
+
+bool open_results_store(struct results_store *store, int dirfd);
+void close_results_store(struct results_store *store);
+
+const char *results_store_string(const struct results_store *store, uint32_t ref);
+const char *results_store_log(const struct results_store *store,
+			      const struct results_store_blob *blob,
+			      size_t *len);
+
+/* Finds a test by its piglit name, NULL if there's no such test */
+const struct results_store_test *results_store_find_test(const struct results_store *store,
+							 const char *name);
+
+const char *results_store_result_name(uint32_t result);
+int results_store_result_from_name(const char *name);
+
+/*
+ * Writing a results store. Logs are written to the file as they are
+ * added, the tables are kept in memory until the store is finished.
+ */
+struct results_store_log_entry {
+	uint64_t hash;
+	struct results_store_blob blob;
+};
+
+struct results_store_writer {
+	int dirfd;
+	int fd;
+	struct results_store_header header;
+	struct results_store_test *tests;
+	size_t tests_alloc;
+	struct results_store_totals *totals;
+	size_t totals_alloc;
+	struct results_store_runtime *runtimes;
+	size_t runtimes_alloc;
+	char *strings;
+	size_t strings_alloc;
+	struct results_store_log_entry *logs;
+	size_t logs_alloc;
+	size_t num_logs;
+};
+
+bool results_store_writer_open(struct results_store_writer *writer, int dirfd);
+uint32_t results_store_add_string(struct results_store_writer *writer, const char *str);
+bool results_store_add_log(struct results_store_writer *writer,
+			   const char *data, size_t len,
+			   struct results_store_blob *blob);
+void results_store_add_test(struct results_store_writer *writer,
+			    const struct results_store_test *test);
+void results_store_add_totals(struct results_store_writer *writer,
+			      const struct results_store_totals *totals);
+void results_store_add_runtime(struct results_store_writer *writer,
+			       const struct results_store_runtime *runtime);
+
+/* Writes the tables and header and moves the store in place */
+bool results_store_writer_finish(struct results_store_writer *writer);
+void results_store_writer_abort(struct results_store_writer *writer);
+
+#endif
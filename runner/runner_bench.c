@@ -0,0 +1,220 @@
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "settings.h"
+#include "job_list.h"
+#include "executor.h"
+
+/*
+ * Measures how much CPU time the runner itself spends per MiB of test
+ * output. The benchmark executes itself as the test, under the name
+ * below, and in that role only prints the requested amount of output.
+ */
+
+#define SPEW_NAME "spew"
+#define SPEW_SIZE_ENV "RUNNER_BENCH_SIZE"
+#define SPEW_STREAM_ENV "RUNNER_BENCH_STREAM"
+
+#define MiB (1024 * 1024)
+
+static int spew(void)
+{
+	const char *stream = getenv(SPEW_STREAM_ENV);
+	const char *size = getenv(SPEW_SIZE_ENV);
+	int fd = stream && !strcmp(stream, "err") ? STDERR_FILENO : STDOUT_FILENO;
+	size_t left = size ? strtoull(size, NULL, 0) : 0;
+	char buf[65536];
+	size_t i;
+
+	/* Lines of 100 characters, like a test with debug output enabled */
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i % 100 == 99 ? '\n' : 'a' + i % 26;
+
+	while (left > 0) {
+		size_t len = left < sizeof(buf) ? left : sizeof(buf);
+		ssize_t s = write(fd, buf, len);
+
+		if (s <= 0)
+			return 1;
+
+		left -= s;
+	}
+
+	return 0;
+}
+
+static int remove_entry(const char *path, const struct stat *sb,
+			int typeflag, struct FTW *ftwbuf)
+{
+	return remove(path);
+}
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static double tv_to_sec(const struct timeval *tv)
+{
+	return tv->tv_sec + 1e-6*tv->tv_usec;
+}
+
+static bool setup_test_root(char *root)
+{
+	char exe[PATH_MAX], path[PATH_MAX];
+	ssize_t len;
+	FILE *f;
+
+	if ((len = readlink("/proc/self/exe", exe, sizeof(exe) - 1)) < 0)
+		return false;
+	exe[len] = '\0';
+
+	snprintf(path, sizeof(path), "%s/%s", root, SPEW_NAME);
+	if (symlink(exe, path))
+		return false;
+
+	snprintf(path, sizeof(path), "%s/test-list.txt", root);
+	if ((f = fopen(path, "w")) == NULL)
+		return false;
+	fprintf(f, "%s\n", SPEW_NAME);
+	fclose(f);
+
+	snprintf(path, sizeof(path), "%s/bench-list.txt", root);
+	if ((f = fopen(path, "w")) == NULL)
+		return false;
+	fprintf(f, "igt@%s\n", SPEW_NAME);
+	fclose(f);
+
+	return true;
+}
+
+static int run(char *root, const char *stream, int size, int reps)
+{
+	char listpath[PATH_MAX], resultspath[PATH_MAX];
+	char *argv[] = { "runner_bench",
+			 "--test-list", listpath,
+			 "--overwrite",
+			 "-l", "quiet",
+			 root,
+			 resultspath,
+	};
+	struct settings settings;
+	struct job_list job_list;
+	struct execute_state state;
+	double user = 0.0, sys = 0.0, wall = 0.0;
+	char sizestr[32];
+	int i;
+
+	snprintf(listpath, sizeof(listpath), "%s/bench-list.txt", root);
+	snprintf(resultspath, sizeof(resultspath), "%s/results", root);
+	snprintf(sizestr, sizeof(sizestr), "%llu", (unsigned long long)size * MiB);
+	setenv(SPEW_SIZE_ENV, sizestr, 1);
+	setenv(SPEW_STREAM_ENV, stream, 1);
+
+	init_settings(&settings);
+	init_job_list(&job_list);
+
+	if (!parse_options(sizeof(argv) / sizeof(argv[0]), argv, &settings) ||
+	    !create_job_list(&job_list, &settings))
+		return 1;
+
+	for (i = 0; i < reps; i++) {
+		struct rusage before, after;
+		struct timespec start, end;
+
+		if (!initialize_execute_state(&state, &settings, &job_list))
+			return 1;
+
+		getrusage(RUSAGE_SELF, &before);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		if (!execute(&state, &settings, &job_list))
+			return 1;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		getrusage(RUSAGE_SELF, &after);
+
+		user += tv_to_sec(&after.ru_utime) - tv_to_sec(&before.ru_utime);
+		sys += tv_to_sec(&after.ru_stime) - tv_to_sec(&before.ru_stime);
+		wall += elapsed(&start, &end);
+	}
+
+	printf("std%s, %d MiB x %d: runner cpu %.3f ms/MiB (user %.3f, sys %.3f), wall %.3f ms/MiB\n",
+	       stream, size, reps,
+	       1e3 * (user + sys) / size / reps,
+	       1e3 * user / size / reps,
+	       1e3 * sys / size / reps,
+	       1e3 * wall / size / reps);
+
+	free_job_list(&job_list);
+	free_settings(&settings);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *stream = "out";
+	char root[] = "/tmp/runner_bench.XXXXXX";
+	int size = 64, reps = 5;
+	int c, ret;
+	char *name;
+
+	name = strrchr(argv[0], '/');
+	name = name ? name + 1 : argv[0];
+	if (!strcmp(name, SPEW_NAME))
+		return spew();
+
+	while ((c = getopt(argc, argv, "e:s:r:")) != -1) {
+		switch (c) {
+		case 'e':
+			stream = optarg;
+			break;
+
+		case 's':
+			size = atoi(optarg);
+			if (size < 1)
+				size = 1;
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-e out|err] [-s MiB] [-r reps]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (strcmp(stream, "out") && strcmp(stream, "err")) {
+		fprintf(stderr, "Unknown stream '%s'\n", stream);
+		return 1;
+	}
+
+	if (mkdtemp(root) == NULL) {
+		fprintf(stderr, "Cannot create a temporary directory\n");
+		return 1;
+	}
+
+	if (setup_test_root(root))
+		ret = run(root, stream, size, reps);
+	else
+		ret = 1;
+
+	nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+	return ret;
+}
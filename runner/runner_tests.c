@@ -1,5 +1,7 @@
 #include <dirent.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -9,10 +11,15 @@
 #include "settings.h"
 #include "job_list.h"
 #include "executor.h"
+#include "resultgen.h"
+#include "resultstore.h"
+#include "aggregate.h"
+#include "subtest_cache.h"
+#include "journal.h"
 
 static char testdatadir[] = TESTDATA_DIRECTORY;
 
-static void igt_assert_eqstr(char *one, char *two)
+static void igt_assert_eqstr(const char *one, const char *two)
 {
 	if (one == NULL && two == NULL)
 		return;
@@ -61,6 +68,41 @@ static char *dump_file(int dirfd, char *name)
 	return buf;
 }
 
+static int count_in_file(int dirfd, char *name, const char *needle)
+{
+	struct stat st;
+	char *buf, *p;
+	int fd, count = 0;
+
+	if ((fd = openat(dirfd, name, O_RDONLY)) < 0)
+		return -1;
+
+	if (fstat(fd, &st) || (buf = calloc(st.st_size + 1, 1)) == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	if (read(fd, buf, st.st_size) == st.st_size)
+		for (p = buf; (p = strstr(p, needle)) != NULL; p++)
+			count++;
+
+	free(buf);
+	close(fd);
+	return count;
+}
+
+static struct aggregate_test *find_aggregate_test(struct aggregate *aggregate,
+						  const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < aggregate->num_tests; i++)
+		if (!strcmp(aggregate->tests[i].name, name))
+			return &aggregate->tests[i];
+
+	return NULL;
+}
+
 static void job_list_filter_test(char *name, char *filterarg1, char *filterarg2,
 				 size_t expected_normal, size_t expected_multiple)
 {
@@ -155,6 +197,15 @@ static void assert_settings_equal(struct settings *one, struct settings *two)
 	igt_assert_eqstr(one->test_root, two->test_root);
 	igt_assert_eqstr(one->results_path, two->results_path);
 	igt_assert_eq(one->piglit_style_dmesg, two->piglit_style_dmesg);
+	igt_assert_eq(one->jobs, two->jobs);
+	igt_assert_eq(one->incremental_results, two->incremental_results);
+	igt_assert_eq(one->binary_results, two->binary_results);
+	igt_assert_eqstr(one->runtime_history, two->runtime_history);
+	igt_assert_eq(one->shard_index, two->shard_index);
+	igt_assert_eq(one->shard_count, two->shard_count);
+	igt_assert_eq(one->longest_first, two->longest_first);
+	igt_assert_eqstr(one->subtest_cache, two->subtest_cache);
+	igt_assert_eq(one->group_commit, two->group_commit);
 }
 
 static void assert_job_list_equal(struct job_list *one, struct job_list *two)
@@ -173,6 +224,13 @@ static void assert_job_list_equal(struct job_list *one, struct job_list *two)
 		for (k = 0; k < eone->subtest_count; k++) {
 			igt_assert_eqstr(eone->subtests[k], etwo->subtests[k]);
 		}
+
+		igt_assert_eq(eone->tags == NULL, etwo->tags == NULL);
+		igt_assert_eq(eone->tag_count, etwo->tag_count);
+
+		for (k = 0; k < eone->tag_count; k++) {
+			igt_assert_eqstr(eone->tags[k], etwo->tags[k]);
+		}
 	}
 }
 
@@ -224,6 +282,14 @@ igt_main
 		igt_assert(strstr(settings.test_root, "test-root-dir") != NULL);
 		igt_assert(strstr(settings.results_path, "path-to-results") != NULL);
 		igt_assert(!settings.piglit_style_dmesg);
+		igt_assert_eq(settings.jobs, 0);
+		igt_assert(!settings.incremental_results);
+		igt_assert(!settings.binary_results);
+		igt_assert(settings.runtime_history == NULL);
+		igt_assert_eq(settings.shard_count, 0);
+		igt_assert(!settings.longest_first);
+		igt_assert(settings.subtest_cache == NULL);
+		igt_assert_eq(settings.group_commit, 0);
 	}
 
 	igt_subtest_group {
@@ -364,6 +430,14 @@ igt_main
 				 "--overall-timeout", "360",
 				 "--use-watchdog",
 				 "--piglit-style-dmesg",
+				 "--jobs", "4",
+				 "--incremental-results",
+				 "--binary-results",
+				 "--runtime-history", "path-to-history",
+				 "--shard", "2/3",
+				 "--longest-first",
+				 "--subtest-cache", "path-to-cache",
+				 "--group-commit", "20",
 				 "test-root-dir",
 				 "path-to-results",
 		};
@@ -390,6 +464,58 @@ igt_main
 		igt_assert(strstr(settings.test_root, "test-root-dir") != NULL);
 		igt_assert(strstr(settings.results_path, "path-to-results") != NULL);
 		igt_assert(settings.piglit_style_dmesg);
+		igt_assert_eq(settings.jobs, 4);
+		igt_assert(settings.incremental_results);
+		igt_assert(settings.binary_results);
+		igt_assert(strstr(settings.runtime_history, "path-to-history") != NULL);
+		igt_assert_eq(settings.shard_index, 2);
+		igt_assert_eq(settings.shard_count, 3);
+		igt_assert(settings.longest_first);
+		igt_assert(strstr(settings.subtest_cache, "path-to-cache") != NULL);
+		igt_assert_eq(settings.group_commit, 20);
+	}
+
+	igt_subtest("parse-subtest-cache-before-runtime-history") {
+		char *argv[] = { "runner",
+				 "--subtest-cache", "path-to-cache",
+				 "--runtime-history", "path-to-history",
+				 "test-root-dir",
+				 "path-to-results",
+		};
+
+		igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+
+		igt_assert(strstr(settings.subtest_cache, "path-to-cache") != NULL);
+		igt_assert(strstr(settings.runtime_history, "path-to-history") != NULL);
+
+		free_settings(&settings);
+		igt_assert(settings.subtest_cache == NULL);
+		igt_assert(settings.runtime_history == NULL);
+	}
+
+	igt_subtest("invalid-job-count") {
+		char *argv[] = { "runner",
+				 "--jobs", "0",
+				 "test-root-dir",
+				 "results-path",
+		};
+
+		igt_assert(!parse_options(ARRAY_SIZE(argv), argv, &settings));
+	}
+
+	igt_subtest("invalid-shard") {
+		char *shards[] = { "0/2", "3/2", "1", "a/b" };
+		size_t i;
+
+		for (i = 0; i < ARRAY_SIZE(shards); i++) {
+			char *argv[] = { "runner",
+					 "--shard", shards[i],
+					 "test-root-dir",
+					 "results-path",
+			};
+
+			igt_assert(!parse_options(ARRAY_SIZE(argv), argv, &settings));
+		}
 	}
 
 	igt_subtest("invalid-option") {
@@ -475,6 +601,20 @@ igt_main
 			igt_assert(validate_settings(&settings));
 		}
 
+		igt_subtest("validate-jobs-with-watchdog") {
+			char *argv[] = { "runner",
+					 "--test-list", filename,
+					 "--jobs", "2",
+					 "--use-watchdog",
+					 testdatadir,
+					 "path-to-results",
+			};
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+
+			igt_assert(!validate_settings(&settings));
+		}
+
 		igt_fixture {
 			unlink(filename);
 		}
@@ -596,6 +736,264 @@ igt_main
 		}
 	}
 
+	igt_subtest_group {
+		char filename[] = "tmplistXXXXXX";
+		char historyname[] = "tmphistoryXXXXXX";
+		char testlisttext[] = "igt@successtest@first-subtest\n"
+			"igt@successtest@second-subtest\n"
+			"igt@no-subtests\n"
+			"igt@skippers@skip-one\n"
+			"igt@skippers@skip-two\n";
+		char historytext[] = "10.0 igt@successtest@first-subtest\n"
+			"1.0 igt@successtest@second-subtest\n"
+			"6.0 igt@no-subtests\n"
+			"4.0 igt@skippers@skip-one\n"
+			"3.0 igt@skippers@skip-two\n";
+		int fd = -1;
+		struct job_list list;
+
+		igt_fixture {
+			igt_require((fd = mkstemp(filename)) >= 0);
+			igt_require(write(fd, testlisttext, strlen(testlisttext)) == strlen(testlisttext));
+			close(fd);
+			igt_require((fd = mkstemp(historyname)) >= 0);
+			igt_require(write(fd, historytext, strlen(historytext)) == strlen(historytext));
+			close(fd);
+			init_job_list(&list);
+		}
+
+		igt_subtest("job-list-shards") {
+			/*
+			 * Assigned longest first to the least loaded
+			 * shard: first-subtest (10) to 1, no-subtests (6)
+			 * to 2, skip-one (4) to 2, skip-two (3) to 1,
+			 * second-subtest (1) to 2.
+			 */
+			char *argv[] = { "runner",
+					 "--test-list", filename,
+					 "--runtime-history", historyname,
+					 "--shard", "1/2",
+					 testdatadir,
+					 "path-to-results",
+			};
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+
+			igt_assert_eq(list.size, 2);
+			igt_assert_eqstr(list.entries[0].subtests[0], "first-subtest");
+			igt_assert_eqstr(list.entries[1].subtests[0], "skip-two");
+
+			argv[6] = "2/2";
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+
+			/* In test list order */
+			igt_assert_eq(list.size, 3);
+			igt_assert_eqstr(list.entries[0].subtests[0], "second-subtest");
+			igt_assert_eqstr(list.entries[1].binary, "no-subtests");
+			igt_assert_eqstr(list.entries[2].subtests[0], "skip-one");
+
+			/* More shards than tests */
+			argv[6] = "6/6";
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(!create_job_list(&list, &settings));
+		}
+
+		igt_subtest("job-list-shards-longest-first") {
+			char *argv[] = { "runner",
+					 "--test-list", filename,
+					 "--runtime-history", historyname,
+					 "--shard", "2/2",
+					 "--longest-first",
+					 "--subtest-cache", "path-to-cache",
+					 "--group-commit", "20",
+				 "--group-commit", "20",
+					 testdatadir,
+					 "path-to-results",
+			};
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+
+			igt_assert_eq(list.size, 3);
+			igt_assert_eqstr(list.entries[0].binary, "no-subtests");
+			igt_assert_eqstr(list.entries[1].subtests[0], "skip-one");
+			igt_assert_eqstr(list.entries[2].subtests[0], "second-subtest");
+		}
+
+		igt_subtest("job-list-longest-first-multiple") {
+			/* Whole binaries are expected to take the sum of their subtests */
+			char *argv[] = { "runner",
+					 "--multiple-mode",
+					 "--runtime-history", historyname,
+					 "--longest-first",
+					 testdatadir,
+					 "path-to-results",
+			};
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+
+			igt_assert_eq(list.size, 3);
+			igt_assert_eqstr(list.entries[0].binary, "successtest");
+			igt_assert_eqstr(list.entries[1].binary, "skippers");
+			igt_assert_eqstr(list.entries[2].binary, "no-subtests");
+		}
+
+		igt_fixture {
+			unlink(filename);
+			unlink(historyname);
+			free_job_list(&list);
+		}
+	}
+
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		char cachename[PATH_MAX];
+		struct subtest_cache cache;
+		struct job_list list;
+
+		igt_fixture {
+			igt_require(mkdtemp(dirname) != NULL);
+			snprintf(cachename, sizeof(cachename), "%s/subtests", dirname);
+			init_subtest_cache(&cache);
+			init_job_list(&list);
+		}
+
+		igt_subtest("job-list-subtest-cache") {
+			char *argv[] = { "runner",
+					 "--subtest-cache", cachename,
+					 testdatadir,
+					 "path-to-results",
+			};
+			struct subtest_cache_entry *entry = NULL;
+			size_t i;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+			igt_assert_eq(list.size, 5);
+
+			igt_assert(read_subtest_cache(&cache, cachename));
+			igt_assert_eq(cache.size, 3);
+			for (i = 0; i < cache.size; i++) {
+				if (strstr(cache.entries[i].path, "/successtest"))
+					entry = &cache.entries[i];
+				if (strstr(cache.entries[i].path, "/no-subtests"))
+					igt_assert(!cache.entries[i].has_subtests);
+			}
+			igt_assert(entry != NULL);
+			igt_assert(entry->has_subtests);
+			igt_assert_eq(entry->num_subtests, 2);
+
+			/* Cached lists are used as is */
+			entry->subtests = realloc(entry->subtests, 3 * sizeof(char *));
+			entry->subtests[entry->num_subtests++] = strdup("cached-subtest");
+			igt_assert(write_subtest_cache(&cache, cachename));
+
+			igt_assert(create_job_list(&list, &settings));
+			igt_assert_eq(list.size, 6);
+			igt_assert_eqstr(list.entries[2].subtests[0], "cached-subtest");
+
+			/* ... until the binary changes */
+			entry->size++;
+			igt_assert(write_subtest_cache(&cache, cachename));
+
+			igt_assert(create_job_list(&list, &settings));
+			igt_assert_eq(list.size, 5);
+
+			igt_assert(read_subtest_cache(&cache, cachename));
+			igt_assert_eq(cache.size, 3);
+		}
+
+		igt_fixture {
+			unlink(cachename);
+			rmdir(dirname);
+			free_subtest_cache(&cache);
+			free_job_list(&list);
+		}
+	}
+
+	igt_subtest_group {
+		char filename[] = "tmplistXXXXXX";
+		char testlisttext[] = "igt@successtest@first-subtest [gem,kms]\n"
+			"igt@successtest@second-subtest [kms]\n"
+			"igt@no-subtests []\n"
+			"igt@skippers@skip-one\n";
+		char dirname[] = "tmpdirXXXXXX";
+		int fd = -1, dirfd = -1, multiple;
+		struct job_list list, cmp_list;
+
+		igt_fixture {
+			igt_require((fd = mkstemp(filename)) >= 0);
+			igt_require(write(fd, testlisttext, strlen(testlisttext)) == strlen(testlisttext));
+			close(fd);
+			fd = -1;
+			igt_require(mkdtemp(dirname) != NULL);
+			rmdir(dirname);
+			init_job_list(&list);
+			init_job_list(&cmp_list);
+		}
+
+		for (multiple = 0; multiple < 2; multiple++) {
+			igt_subtest_f("job-list-tags-%s", multiple ? "multiple" : "normal") {
+				char *argv[] = { "runner",
+						 "--test-list", filename,
+						 multiple ? "--multiple-mode" : "--sync",
+						 "--overwrite",
+						 testdatadir,
+						 dirname,
+				};
+				struct job_list_entry *nosubtests, *skippers;
+
+				igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+				igt_assert(create_job_list(&list, &settings));
+
+				igt_assert_eq(list.size, multiple ? 3 : 4);
+				nosubtests = &list.entries[multiple ? 1 : 2];
+				skippers = &list.entries[multiple ? 2 : 3];
+
+				if (multiple) {
+					/* Union of the tags of the merged lines */
+					igt_assert_eq(list.entries[0].tag_count, 2);
+					igt_assert_eqstr(list.entries[0].tags[0], "gem");
+					igt_assert_eqstr(list.entries[0].tags[1], "kms");
+				} else {
+					igt_assert_eq(list.entries[0].tag_count, 2);
+					igt_assert_eq(list.entries[1].tag_count, 1);
+					igt_assert_eqstr(list.entries[1].tags[0], "kms");
+					igt_assert(job_list_entries_conflict(&list.entries[0],
+									     &list.entries[1]));
+				}
+
+				/* Explicitly empty tags never conflict */
+				igt_assert(nosubtests->tags != NULL);
+				igt_assert_eq(nosubtests->tag_count, 0);
+				igt_assert(!job_list_entries_conflict(&list.entries[0], nosubtests));
+
+				/* No tags declared conflicts with everything */
+				igt_assert(skippers->tags == NULL);
+				igt_assert(job_list_entries_conflict(skippers, nosubtests));
+
+				igt_assert(serialize_settings(&settings));
+				igt_assert(serialize_job_list(&list, &settings));
+				igt_assert((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+				igt_assert(read_job_list(&cmp_list, dirfd));
+				assert_job_list_equal(&list, &cmp_list);
+				close(dirfd);
+				dirfd = -1;
+			}
+		}
+
+		igt_fixture {
+			unlink(filename);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(&list);
+			free_job_list(&cmp_list);
+		}
+	}
+
 	igt_subtest_group {
 		char dirname[] = "tmpdirXXXXXX";
 		int dirfd = -1, fd = -1;
@@ -626,6 +1024,12 @@ igt_main
 					 "--overall-timeout", "360",
 					 "--use-watchdog",
 					 "--piglit-style-dmesg",
+					 "--jobs", "4",
+					 "--incremental-results",
+					 "--binary-results",
+					 "--runtime-history", "path-to-history",
+					 "--shard", "2/3",
+					 "--longest-first",
 					 testdatadir,
 					 dirname,
 			};
@@ -805,6 +1209,112 @@ igt_main
 		}
 	}
 
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		struct job_list list;
+		int dirfd = -1, subdirfd = -1, fd = -1;
+
+		igt_fixture {
+			init_job_list(&list);
+			igt_require(mkdtemp(dirname) != NULL);
+		}
+
+		igt_subtest("execute-group-commit-resume") {
+			struct execute_state state;
+			char *argv[] = { "runner",
+					 "--multiple-mode",
+					 "--group-commit", "5",
+					 "-t", "successtest",
+					 testdatadir,
+					 dirname,
+			};
+			struct journal_writer journal;
+			struct journal_records records;
+			char torn[] = { 20, 0, 0, 0, 1, 2, 3 };
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+			igt_assert(serialize_settings(&settings));
+			igt_assert(serialize_job_list(&list, &settings));
+
+			/* A crash while writing the second record */
+			igt_assert((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert(mkdirat(dirfd, "0", 0770) == 0);
+			igt_assert((subdirfd = openat(dirfd, "0", O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert((fd = openat(subdirfd, "journal.bin", O_CREAT | O_RDWR | O_EXCL, 0660)) >= 0);
+			igt_assert(init_journal_writer(&journal, fd, true, 5, false, NULL, 0));
+			journal_append(&journal, "first-subtest", strlen("first-subtest"));
+			igt_assert(write(fd, torn, sizeof(torn)) == sizeof(torn));
+			close(fd);
+			fd = -1;
+
+			free_job_list(&list);
+			free_settings(&settings);
+			igt_assert(initialize_execute_state_from_resume(dirfd, &state, &settings, &list));
+
+			igt_assert_eq(settings.group_commit, 5);
+			igt_assert_eq(state.next, 0);
+			igt_assert_eq(list.entries[0].subtest_count, 2);
+			igt_assert_eqstr(list.entries[0].subtests[0], "*");
+			igt_assert_eqstr(list.entries[0].subtests[1], "!first-subtest");
+
+			igt_assert(execute(&state, &settings, &list));
+
+			/* The torn record is dropped, new records are readable */
+			igt_assert((fd = openat(subdirfd, "journal.bin", O_RDONLY)) >= 0);
+			igt_assert(read_journal(fd, &records));
+			igt_assert_eq(records.size, 3);
+			igt_assert_eqstr(records.records[0], "first-subtest");
+			igt_assert_eqstr(records.records[1], "second-subtest");
+			igt_assert(!strncmp(records.records[2], "exit:0 ", strlen("exit:0 ")));
+			free_journal_records(&records);
+
+			close(dirfd);
+			igt_assert((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert(generate_results(dirfd));
+			igt_assert_eq(count_in_file(dirfd, "results.json", "\"igt@successtest@second-subtest\""), 1);
+		}
+
+		igt_fixture {
+			close(fd);
+			close(subdirfd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(&list);
+		}
+	}
+
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		int dirfd = -1, fd = -1;
+
+		igt_fixture {
+			igt_require(mkdtemp(dirname) != NULL);
+			igt_require((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+		}
+
+		igt_subtest("journal-repair-failure") {
+			struct journal_writer journal;
+			char torn[] = { 20, 0, 0, 0, 1, 2, 3 };
+
+			igt_assert((fd = openat(dirfd, "journal.bin", O_CREAT | O_RDWR | O_EXCL, 0660)) >= 0);
+			igt_assert(init_journal_writer(&journal, fd, true, 5, false, NULL, 0));
+			journal_append(&journal, "first-subtest", strlen("first-subtest"));
+			igt_assert(write(fd, torn, sizeof(torn)) == sizeof(torn));
+			close(fd);
+
+			/* The torn record can't be dropped, so no resuming */
+			igt_assert((fd = openat(dirfd, "journal.bin", O_RDONLY)) >= 0);
+			igt_assert(!init_journal_writer(&journal, fd, true, 5, false, NULL, 0));
+		}
+
+		igt_fixture {
+			close(fd);
+			close(dirfd);
+			clear_directory(dirname);
+		}
+	}
+
 	igt_subtest_group {
 		char dirname[] = "tmpdirXXXXXX";
 		struct job_list list;
@@ -1062,6 +1572,402 @@ igt_main
 		}
 	}
 
+	igt_subtest_group {
+		char filename[] = "tmplistXXXXXX";
+		char testlisttext[] = "igt@successtest@first-subtest [gem]\n"
+			"igt@successtest@second-subtest [kms]\n"
+			"igt@no-subtests []\n"
+			"igt@skippers@skip-one\n"
+			"igt@skippers@skip-two [gem]\n";
+		char dirname[] = "tmpdirXXXXXX";
+		struct job_list list;
+		int dirfd = -1, subdirfd = -1, fd = -1;
+
+		igt_fixture {
+			igt_require((fd = mkstemp(filename)) >= 0);
+			igt_require(write(fd, testlisttext, strlen(testlisttext)) == strlen(testlisttext));
+			close(fd);
+			fd = -1;
+			igt_require(mkdtemp(dirname) != NULL);
+			rmdir(dirname);
+			init_job_list(&list);
+		}
+
+		igt_subtest("execute-parallel") {
+			struct execute_state state;
+			char *argv[] = { "runner",
+					 "--test-list", filename,
+					 "--jobs", "3",
+					 testdatadir,
+					 dirname,
+			};
+			char testdirname[16];
+			char *dump;
+			size_t i;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+			igt_assert_eq(list.size, 5);
+			igt_assert(initialize_execute_state(&state, &settings, &list));
+
+			igt_assert(execute(&state, &settings, &list));
+			igt_assert_f((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create the results directory\n");
+
+			for (i = 0; i < list.size; i++) {
+				snprintf(testdirname, 16, "%zd", i);
+
+				igt_assert_f((subdirfd = openat(dirfd, testdirname, O_DIRECTORY | O_RDONLY)) >= 0,
+					     "Execute didn't create result directory '%s'\n", testdirname);
+				assert_execution_results_exist(subdirfd);
+
+				dump = dump_file(subdirfd, "journal.txt");
+				igt_assert_f(dump != NULL && strstr(dump, "exit:") != NULL,
+					     "Entry %zd didn't complete\n", i);
+				free(dump);
+
+				close(subdirfd);
+				subdirfd = -1;
+			}
+		}
+
+		igt_subtest("execute-parallel-resume") {
+			struct execute_state state;
+			char *argv[] = { "runner",
+					 "--test-list", filename,
+					 "--jobs", "2",
+					 "--overwrite",
+					 testdatadir,
+					 dirname,
+			};
+			char journaltext[] = "second-subtest\nexit:0 (0.001s)\n";
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+			igt_assert(initialize_execute_state(&state, &settings, &list));
+
+			/* Only the second entry was executed */
+			close(dirfd);
+			igt_assert((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert(mkdirat(dirfd, "1", 0770) == 0);
+			igt_assert((subdirfd = openat(dirfd, "1", O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert((fd = openat(subdirfd, "journal.txt", O_CREAT | O_WRONLY | O_EXCL, 0660)) >= 0);
+			igt_assert(write(fd, journaltext, strlen(journaltext)) == strlen(journaltext));
+			close(fd);
+			fd = -1;
+			close(subdirfd);
+			subdirfd = -1;
+
+			free_job_list(&list);
+			free_settings(&settings);
+			igt_assert(initialize_execute_state_from_resume(dup(dirfd), &state, &settings, &list));
+
+			igt_assert_eq(settings.jobs, 2);
+			igt_assert_eq(state.next, 0);
+			igt_assert_eq(list.size, 5);
+			igt_assert_eqstr(list.entries[0].binary, "successtest");
+			igt_assert_eqstr(list.entries[1].binary, "");
+
+			igt_assert(execute(&state, &settings, &list));
+
+			igt_assert((subdirfd = openat(dirfd, "0", O_DIRECTORY | O_RDONLY)) >= 0);
+			assert_execution_results_exist(subdirfd);
+			close(subdirfd);
+			subdirfd = -1;
+
+			/* The completed entry must not have been executed again */
+			igt_assert((subdirfd = openat(dirfd, "1", O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert_f((fd = openat(subdirfd, "out.txt", O_RDONLY)) < 0,
+				     "Completed entry was executed again on resume\n");
+			close(subdirfd);
+			subdirfd = -1;
+		}
+
+		igt_subtest("execute-incremental-results") {
+			struct execute_state state;
+			char *argv[] = { "runner",
+					 "--test-list", filename,
+					 "--incremental-results",
+					 "--overwrite",
+					 testdatadir,
+					 dirname,
+			};
+			char testdirname[16];
+			size_t i;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+			igt_assert(initialize_execute_state(&state, &settings, &list));
+
+			igt_assert(execute(&state, &settings, &list));
+			close(dirfd);
+			igt_assert((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+
+			for (i = 0; i < list.size; i++) {
+				snprintf(testdirname, 16, "%zd", i);
+
+				igt_assert((subdirfd = openat(dirfd, testdirname, O_DIRECTORY | O_RDONLY)) >= 0);
+				igt_assert_f((fd = openat(subdirfd, RESULTS_FRAGMENT_FILENAME, O_RDONLY)) >= 0,
+					     "Execute didn't generate results for entry %zd\n", i);
+				close(fd);
+				fd = -1;
+				close(subdirfd);
+				subdirfd = -1;
+			}
+
+			igt_assert(generate_results(dirfd));
+			igt_assert_f((fd = openat(dirfd, "results.json", O_RDONLY)) >= 0,
+				     "Results generation didn't create results.json\n");
+		}
+
+		igt_subtest("dmesg-results") {
+			struct execute_state state;
+			char *argv[] = { "runner",
+					 "--test-list", filename,
+					 "--overwrite",
+					 testdatadir,
+					 dirname,
+			};
+			char dmesgtext[] =
+				"6,1,900000,-;[IGT] successtest: executing\n"
+				"6,2,1000000,-;[IGT] successtest: starting subtest first-subtest\n"
+				" SUBSYSTEM=drm\n"
+				"4,3,1500000,-;Setting dangerous option foo - tainting kernel\n"
+				"3,4,2000000,-;i915 0000:00:02.0: something broke\n"
+				"4,5,2500000,c;continued line\n"
+				"6,6,3000000,-;[IGT] successtest: starting subtest second-subtest\n"
+				"3,7,3500000,-;IRQ 12: no longer affine to CPU3\n";
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+			igt_assert(initialize_execute_state(&state, &settings, &list));
+			igt_assert(execute(&state, &settings, &list));
+
+			close(fd);
+			close(dirfd);
+			igt_assert((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert((fd = openat(dirfd, "0/dmesg.txt", O_WRONLY | O_TRUNC)) >= 0);
+			igt_assert(write(fd, dmesgtext, strlen(dmesgtext)) == strlen(dmesgtext));
+			close(fd);
+			fd = -1;
+
+			igt_assert(generate_results(dirfd));
+
+			/* Messages before the first subtest go to the first subtest */
+			igt_assert_eq(count_in_file(dirfd, "results.json", "<6> [0.900000] [IGT] successtest: executing"), 1);
+			igt_assert_eq(count_in_file(dirfd, "results.json", "<6> [1.000000] [IGT] successtest: starting subtest first-subtest"), 1);
+			/* Whitelisted messages and continuations aren't warnings */
+			igt_assert_eq(count_in_file(dirfd, "results.json", "<4> [1.500000] Setting dangerous option foo"), 1);
+			igt_assert_eq(count_in_file(dirfd, "results.json", "<4> [2.500000] continued line"), 1);
+			igt_assert_eq(count_in_file(dirfd, "results.json", "<3> [2.000000] i915 0000:00:02.0: something broke"), 2);
+			igt_assert_eq(count_in_file(dirfd, "results.json", "<3> [3.500000] IRQ 12: no longer affine"), 1);
+			igt_assert_eq(count_in_file(dirfd, "results.json", "SUBSYSTEM=drm"), 0);
+			igt_assert_eq(count_in_file(dirfd, "results.json", "\"dmesg-warnings\""), 1);
+		}
+
+		igt_subtest("binary-results") {
+			struct execute_state state;
+			char *argv[] = { "runner",
+					 "--test-list", filename,
+					 "--overwrite",
+					 "--binary-results",
+					 testdatadir,
+					 dirname,
+			};
+			const struct results_store_test *test;
+			struct results_store store;
+			const char *log;
+			size_t len;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), argv, &settings));
+			igt_assert(create_job_list(&list, &settings));
+			igt_assert(initialize_execute_state(&state, &settings, &list));
+			igt_assert(execute(&state, &settings, &list));
+
+			close(dirfd);
+			igt_assert((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert(generate_results(dirfd));
+
+			igt_assert(open_results_store(&store, dirfd));
+			igt_assert_eq(store.header->num_tests, 5);
+			igt_assert_eqstr(results_store_string(&store, store.header->name), dirname);
+
+			test = results_store_find_test(&store, "igt@successtest@first-subtest");
+			igt_assert(test != NULL);
+			igt_assert(test->flags & RESULTS_STORE_HAS_RESULT);
+			igt_assert_eq(test->result, RESULTS_STORE_PASS);
+			log = results_store_log(&store, &test->out, &len);
+			igt_assert(log != NULL && memmem(log, len, "first-subtest", strlen("first-subtest")));
+
+			test = results_store_find_test(&store, "igt@skippers@skip-one");
+			igt_assert(test != NULL);
+			igt_assert_eq(test->result, RESULTS_STORE_SKIP);
+
+			igt_assert(results_store_find_test(&store, "igt@nonexistent") == NULL);
+			close_results_store(&store);
+
+			/* Converting back gives the same results */
+			igt_assert(unlinkat(dirfd, "results.json", 0) == 0);
+			igt_assert(generate_results_json_from_store(dirfd));
+			igt_assert_eq(count_in_file(dirfd, "results.json", "\"igt@successtest@first-subtest\""), 1);
+			igt_assert_eq(count_in_file(dirfd, "results.json", "\"igt@skippers@skip-two\""), 1);
+		}
+
+		igt_fixture {
+			unlink(filename);
+			close(fd);
+			close(subdirfd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(&list);
+		}
+	}
+
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		int dirfd = -1;
+
+		igt_fixture {
+			igt_require(mkdtemp(dirname) != NULL);
+			igt_require((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+		}
+
+		igt_subtest("results-store-short-log-write") {
+			struct results_store_writer writer;
+			struct results_store_blob blobs[3];
+			struct results_store store;
+			struct rlimit old, limit;
+			char data[3][100];
+			const char *log;
+			size_t len;
+			int i;
+
+			for (i = 0; i < 3; i++)
+				memset(data[i], 'a' + i, sizeof(data[i]));
+
+			igt_assert(results_store_writer_open(&writer, dirfd));
+			igt_assert(results_store_add_log(&writer, data[0], sizeof(data[0]), &blobs[0]));
+
+			/* The file size limit cuts the second log short */
+			igt_assert(signal(SIGXFSZ, SIG_IGN) != SIG_ERR);
+			igt_assert(getrlimit(RLIMIT_FSIZE, &old) == 0);
+			limit = old;
+			limit.rlim_cur = writer.header.logs_offset + sizeof(data[0]) + sizeof(data[1]) / 2;
+			igt_assert(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+			igt_assert(!results_store_add_log(&writer, data[1], sizeof(data[1]), &blobs[1]));
+			igt_assert(setrlimit(RLIMIT_FSIZE, &old) == 0);
+			signal(SIGXFSZ, SIG_DFL);
+			igt_assert_eq(blobs[1].len, 0);
+
+			/* The writer can still be used, the failed log doesn't end up in it */
+			igt_assert(results_store_add_log(&writer, data[2], sizeof(data[2]), &blobs[2]));
+			igt_assert(results_store_writer_finish(&writer));
+
+			igt_assert(open_results_store(&store, dirfd));
+			igt_assert_eq(store.header->logs_size, sizeof(data[0]) + sizeof(data[2]));
+			for (i = 0; i < 3; i += 2) {
+				log = results_store_log(&store, &blobs[i], &len);
+				igt_assert(log != NULL);
+				igt_assert_eq(len, sizeof(data[i]));
+				igt_assert(!memcmp(log, data[i], len));
+			}
+			close_results_store(&store);
+		}
+
+		igt_fixture {
+			close(dirfd);
+			clear_directory(dirname);
+		}
+	}
+
+	igt_subtest("aggregate-results") {
+		static const char * const results[][6] = {
+			{ "pass", "pass", "pass", "pass", "pass", "pass" },
+			{ "pass", "fail", "pass", "fail", "pass", "fail" },
+			{ "pass", "pass", "pass", "pass", "pass", "fail" },
+			{ "pass", "pass", "pass", "pass", "pass", "pass" },
+			{ NULL, NULL, NULL, NULL, NULL, "skip" },
+		};
+		static const char * const names[] = {
+			"igt@a@stable", "igt@a@flaky", "igt@a@changed",
+			"igt@a@slower", "igt@a@new",
+		};
+		static const double slower[] = { 1.0, 1.1, 0.9, 1.0, 1.05, 5.0 };
+		char dirname[] = "tmpdirXXXXXX";
+		char *paths[6];
+		struct aggregate aggregate;
+		struct aggregate_summary summary;
+		struct aggregate_test *test;
+		int run, i;
+
+		igt_require(mkdtemp(dirname) != NULL);
+
+		for (run = 0; run < 6; run++) {
+			FILE *f;
+
+			igt_assert(asprintf(&paths[run], "%s/%d.json", dirname, run) > 0);
+			igt_assert((f = fopen(paths[run], "w")) != NULL);
+			fprintf(f, "{ \"tests\": {");
+			for (i = 0; i < ARRAY_SIZE(names); i++) {
+				if (!results[i][run])
+					continue;
+				fprintf(f, "%s \"%s\": { \"result\": \"%s\", "
+					"\"time\": { \"start\": 10.0, \"end\": %f } }",
+					i ? "," : "", names[i], results[i][run],
+					10.0 + (i == 3 ? slower[run] : 1.0));
+			}
+			fprintf(f, " } }\n");
+			fclose(f);
+		}
+
+		init_aggregate(&aggregate, 6);
+		igt_assert(aggregate_load_runs(&aggregate, paths, 3));
+		igt_assert_eq(aggregate.num_tests, 5);
+
+		igt_assert((test = find_aggregate_test(&aggregate, "igt@a@stable")) != NULL);
+		summarize_aggregate_test(&aggregate, test, &summary);
+		igt_assert_eq(summary.present, 6);
+		igt_assert_eq(summary.transitions, 0);
+		igt_assert_eq(summary.counts[RESULTS_STORE_PASS], 6);
+		igt_assert(!summary.runtime_regression);
+
+		igt_assert((test = find_aggregate_test(&aggregate, "igt@a@flaky")) != NULL);
+		summarize_aggregate_test(&aggregate, test, &summary);
+		igt_assert_eq(summary.transitions, 5);
+		igt_assert_eq(summary.counts[RESULTS_STORE_FAIL], 3);
+
+		igt_assert((test = find_aggregate_test(&aggregate, "igt@a@changed")) != NULL);
+		summarize_aggregate_test(&aggregate, test, &summary);
+		igt_assert_eq(summary.transitions, 1);
+		igt_assert_eq(summary.previous, RESULTS_STORE_PASS);
+		igt_assert_eq(summary.last, RESULTS_STORE_FAIL);
+
+		igt_assert((test = find_aggregate_test(&aggregate, "igt@a@slower")) != NULL);
+		summarize_aggregate_test(&aggregate, test, &summary);
+		igt_assert(summary.runtime_regression);
+		igt_assert(summary.last_runtime > 4.9);
+
+		igt_assert((test = find_aggregate_test(&aggregate, "igt@a@new")) != NULL);
+		summarize_aggregate_test(&aggregate, test, &summary);
+		igt_assert_eq(summary.present, 1);
+		igt_assert_eq(summary.previous, -1);
+		igt_assert_eq(test->results[0], AGGREGATE_MISSING);
+
+		/* A missing run fails the load */
+		free_aggregate(&aggregate);
+		init_aggregate(&aggregate, 1);
+		paths[0][strlen(paths[0]) - 6] = 'x';
+		igt_assert(!aggregate_load_runs(&aggregate, paths, 1));
+		paths[0][strlen(paths[0]) - 6] = '0';
+		free_aggregate(&aggregate);
+
+		for (run = 0; run < 6; run++) {
+			unlink(paths[run]);
+			free(paths[run]);
+		}
+		rmdir(dirname);
+	}
+
 	igt_subtest("file-descriptor-leakage") {
 		int i;
 
@@ -18,6 +18,13 @@ enum {
 	OPT_IGNORE_MISSING,
 	OPT_PIGLIT_DMESG,
 	OPT_OVERALL_TIMEOUT,
+	OPT_INCREMENTAL_RESULTS,
+	OPT_BINARY_RESULTS,
+	OPT_RUNTIME_HISTORY,
+	OPT_SHARD,
+	OPT_LONGEST_FIRST,
+	OPT_SUBTEST_CACHE,
+	OPT_GROUP_COMMIT,
 	OPT_HELP = 'h',
 	OPT_NAME = 'n',
 	OPT_DRY_RUN = 'd',
@@ -29,6 +36,7 @@ enum {
 	OPT_MULTIPLE = 'm',
 	OPT_TIMEOUT = 'c',
 	OPT_WATCHDOG = 'g',
+	OPT_JOBS = 'j',
 };
 
 static struct {
@@ -93,6 +101,38 @@ static const char *usage_str =
 	"  --use-watchdog        Use hardware watchdog for lethal enforcement of the\n"
 	"                        above timeout. Killing the test process is still\n"
 	"                        attempted at timeout trigger.\n"
+	"  -j <N>, --jobs <N>    Execute up to N job list entries concurrently. Entries\n"
+	"                        only run next to each other if their exclusivity\n"
+	"                        tags, given in the testlist as e.g.\n"
+	"                        'igt@gem_foo@bar [gem,suspend]', don't overlap.\n"
+	"                        Entries without tags are always run alone. The\n"
+	"                        kernel log of an entry includes what the entries\n"
+	"                        run next to it logged, leave entries whose dmesg\n"
+	"                        matters untagged.\n"
+	"  --incremental-results Generate the results of each test as soon as it has\n"
+	"                        been executed, making the final results.json\n"
+	"                        generation only combine them.\n"
+	"  --binary-results      Also generate results.bin, a binary form of the\n"
+	"                        results that can be read without parsing. Use\n"
+	"                        igt_results_convert to turn it into results.json.\n"
+	"  --runtime-history <file>\n"
+	"                        Expected runtimes of tests for --shard and\n"
+	"                        --longest-first, as lines of '<seconds> <test name>'.\n"
+	"                        igt_results_aggregate -r writes one from the results\n"
+	"                        of earlier runs.\n"
+	"  --shard <k/N>         Split the job list to N shards of about equal\n"
+	"                        expected runtime and only run the k:th one, from 1\n"
+	"                        to N\n"
+	"  --longest-first       Execute the job list entries with the longest\n"
+	"                        expected runtime first, helpful with --jobs\n"
+	"  --subtest-cache <file>\n"
+	"                        Keep the subtest lists of test binaries in the file,\n"
+	"                        and only run the binaries changed since they were\n"
+	"                        cached with --list-subtests\n"
+	"  --group-commit <ms>   Write the execution journal in a crash tolerant\n"
+	"                        binary format, and sync it and the test outputs to\n"
+	"                        disk at most every <ms> milliseconds instead of\n"
+	"                        after every write like --sync does\n"
 	"  --piglit-style-dmesg  Filter dmesg like piglit does. Piglit considers matches\n"
 	"                        against a short filter list to mean the test result\n"
 	"                        should be changed to dmesg-warn/dmesg-fail. Without\n"
@@ -174,6 +214,8 @@ void free_settings(struct settings *settings)
 	free(settings->name);
 	free(settings->test_root);
 	free(settings->results_path);
+	free(settings->runtime_history);
+	free(settings->subtest_cache);
 
 	free_regexes(&settings->include_regexes);
 	free_regexes(&settings->exclude_regexes);
@@ -204,6 +246,14 @@ bool parse_options(int argc, char **argv,
 		{"overall-timeout", required_argument, NULL, OPT_OVERALL_TIMEOUT},
 		{"use-watchdog", no_argument, NULL, OPT_WATCHDOG},
 		{"piglit-style-dmesg", no_argument, NULL, OPT_PIGLIT_DMESG},
+		{"jobs", required_argument, NULL, OPT_JOBS},
+		{"incremental-results", no_argument, NULL, OPT_INCREMENTAL_RESULTS},
+		{"binary-results", no_argument, NULL, OPT_BINARY_RESULTS},
+		{"runtime-history", required_argument, NULL, OPT_RUNTIME_HISTORY},
+		{"shard", required_argument, NULL, OPT_SHARD},
+		{"longest-first", no_argument, NULL, OPT_LONGEST_FIRST},
+		{"subtest-cache", required_argument, NULL, OPT_SUBTEST_CACHE},
+		{"group-commit", required_argument, NULL, OPT_GROUP_COMMIT},
 		{ 0, 0, 0, 0},
 	};
 
@@ -211,7 +261,7 @@ bool parse_options(int argc, char **argv,
 
 	optind = 1;
 
-	while ((c = getopt_long(argc, argv, "hn:dt:x:sl:om", long_options, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hn:dt:x:sl:omj:", long_options, NULL)) != -1) {
 		switch (c) {
 		case OPT_HELP:
 			usage(NULL, stdout);
@@ -266,6 +316,47 @@ bool parse_options(int argc, char **argv,
 		case OPT_PIGLIT_DMESG:
 			settings->piglit_style_dmesg = true;
 			break;
+		case OPT_JOBS:
+			settings->jobs = atoi(optarg);
+			if (settings->jobs < 1) {
+				usage("Job count must be at least 1", stderr);
+				goto error;
+			}
+			break;
+		case OPT_INCREMENTAL_RESULTS:
+			settings->incremental_results = true;
+			break;
+		case OPT_BINARY_RESULTS:
+			settings->binary_results = true;
+			break;
+		case OPT_RUNTIME_HISTORY:
+			free(settings->runtime_history);
+			settings->runtime_history = absolute_path(optarg);
+			break;
+		case OPT_SHARD:
+			if (sscanf(optarg, "%d/%d", &settings->shard_index,
+				   &settings->shard_count) != 2 ||
+			    settings->shard_count < 1 ||
+			    settings->shard_index < 1 ||
+			    settings->shard_index > settings->shard_count) {
+				usage("Shard must be given as k/N, with 1 <= k <= N", stderr);
+				goto error;
+			}
+			break;
+		case OPT_LONGEST_FIRST:
+			settings->longest_first = true;
+			break;
+		case OPT_SUBTEST_CACHE:
+			free(settings->subtest_cache);
+			settings->subtest_cache = absolute_path(optarg);
+			break;
+		case OPT_GROUP_COMMIT:
+			settings->group_commit = atoi(optarg);
+			if (settings->group_commit < 1) {
+				usage("Group commit interval must be at least 1 ms", stderr);
+				goto error;
+			}
+			break;
 		case '?':
 			usage(NULL, stderr);
 			goto error;
@@ -349,6 +440,16 @@ bool validate_settings(struct settings *settings)
 	close(fd);
 	close(dirfd);
 
+	if (settings->runtime_history && !readable_file(settings->runtime_history)) {
+		usage("Cannot open runtime history file", stderr);
+		return false;
+	}
+
+	if (settings->jobs > 1 && settings->use_watchdog) {
+		usage("Hardware watchdogs cannot be used with parallel execution", stderr);
+		return false;
+	}
+
 	return true;
 }
 
@@ -458,6 +559,17 @@ bool serialize_settings(struct settings *settings)
 	SERIALIZE_LINE(f, settings, overall_timeout, "%d");
 	SERIALIZE_LINE(f, settings, use_watchdog, "%d");
 	SERIALIZE_LINE(f, settings, piglit_style_dmesg, "%d");
+	SERIALIZE_LINE(f, settings, jobs, "%d");
+	SERIALIZE_LINE(f, settings, incremental_results, "%d");
+	SERIALIZE_LINE(f, settings, binary_results, "%d");
+	if (settings->runtime_history)
+		SERIALIZE_LINE(f, settings, runtime_history, "%s");
+	SERIALIZE_LINE(f, settings, shard_index, "%d");
+	SERIALIZE_LINE(f, settings, shard_count, "%d");
+	SERIALIZE_LINE(f, settings, longest_first, "%d");
+	if (settings->subtest_cache)
+		SERIALIZE_LINE(f, settings, subtest_cache, "%s");
+	SERIALIZE_LINE(f, settings, group_commit, "%d");
 	SERIALIZE_LINE(f, settings, test_root, "%s");
 	SERIALIZE_LINE(f, settings, results_path, "%s");
 
@@ -513,6 +625,15 @@ bool read_settings(struct settings *settings, int dirfd)
 		PARSE_LINE(settings, name, val, overall_timeout, numval);
 		PARSE_LINE(settings, name, val, use_watchdog, numval);
 		PARSE_LINE(settings, name, val, piglit_style_dmesg, numval);
+		PARSE_LINE(settings, name, val, jobs, numval);
+		PARSE_LINE(settings, name, val, incremental_results, numval);
+		PARSE_LINE(settings, name, val, binary_results, numval);
+		PARSE_LINE(settings, name, val, runtime_history, val ? strdup(val) : NULL);
+		PARSE_LINE(settings, name, val, shard_index, numval);
+		PARSE_LINE(settings, name, val, shard_count, numval);
+		PARSE_LINE(settings, name, val, longest_first, numval);
+		PARSE_LINE(settings, name, val, subtest_cache, val ? strdup(val) : NULL);
+		PARSE_LINE(settings, name, val, group_commit, numval);
 		PARSE_LINE(settings, name, val, test_root, val ? strdup(val) : NULL);
 		PARSE_LINE(settings, name, val, results_path, val ? strdup(val) : NULL);
 
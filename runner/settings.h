@@ -35,6 +35,17 @@ struct settings {
 	char *test_root;
 	char *results_path;
 	bool piglit_style_dmesg;
+	int jobs;
+	bool incremental_results;
+	bool binary_results;
+	char *runtime_history;
+	/* 1-based shard to run out of shard_count, 0 for no sharding */
+	int shard_index;
+	int shard_count;
+	bool longest_first;
+	char *subtest_cache;
+	/* Milliseconds, 0 for the text journal without group commit */
+	int group_commit;
 };
 
 /**
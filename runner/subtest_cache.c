@@ -0,0 +1,319 @@
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "subtest_cache.h"
+
+#define SUBTEST_CACHE_MAGIC "igt-subtest-cache"
+#define SUBTEST_CACHE_VERSION 1
+
+/* Build id notes are in the first pages, don't read more than this */
+#define MAX_NOTE_SIZE 65536
+
+void init_subtest_cache(struct subtest_cache *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+}
+
+void free_subtest_cache_entry(struct subtest_cache_entry *entry)
+{
+	size_t i;
+
+	free(entry->path);
+	free(entry->build_id);
+	for (i = 0; i < entry->num_subtests; i++)
+		free(entry->subtests[i]);
+	free(entry->subtests);
+
+	memset(entry, 0, sizeof(*entry));
+}
+
+void free_subtest_cache(struct subtest_cache *cache)
+{
+	size_t i;
+
+	for (i = 0; i < cache->size; i++)
+		free_subtest_cache_entry(&cache->entries[i]);
+	free(cache->entries);
+
+	init_subtest_cache(cache);
+}
+
+static void add_subtest(struct subtest_cache_entry *entry, char *subtest)
+{
+	entry->num_subtests++;
+	entry->subtests = realloc(entry->subtests,
+				  entry->num_subtests * sizeof(*entry->subtests));
+	entry->subtests[entry->num_subtests - 1] = subtest;
+}
+
+bool read_subtest_cache(struct subtest_cache *cache, const char *filename)
+{
+	struct subtest_cache_entry entry = {};
+	char *line = NULL;
+	size_t line_len = 0;
+	ssize_t len;
+	long subtests_left = 0;
+	int version;
+	FILE *f;
+
+	free_subtest_cache(cache);
+
+	if ((f = fopen(filename, "r")) == NULL)
+		return errno == ENOENT;
+
+	if (fscanf(f, SUBTEST_CACHE_MAGIC " %d\n", &version) != 1 ||
+	    version != SUBTEST_CACHE_VERSION) {
+		/* Written by some other version, start over */
+		fclose(f);
+		return true;
+	}
+
+	/*
+	 * Each binary is a line of 'path<TAB>mtime-sec mtime-nsec size
+	 * build-id count', where build-id is '-' for no build id and
+	 * count -1 for no subtests, followed by the subtests on their
+	 * own lines.
+	 */
+	while ((len = getline(&line, &line_len, f)) > 0) {
+		char build_id[256];
+		long long sec, nsec;
+		unsigned long long size;
+		char *tab;
+		long count;
+
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		if (subtests_left > 0) {
+			add_subtest(&entry, strdup(line));
+			if (--subtests_left == 0)
+				subtest_cache_store(cache, &entry);
+			continue;
+		}
+
+		if ((tab = strchr(line, '\t')) == NULL ||
+		    sscanf(tab + 1, "%lld %lld %llu %255s %ld",
+			   &sec, &nsec, &size, build_id, &count) != 5)
+			break;
+
+		memset(&entry, 0, sizeof(entry));
+		entry.path = strndup(line, tab - line);
+		entry.mtime_sec = sec;
+		entry.mtime_nsec = nsec;
+		entry.size = size;
+		entry.build_id = strdup(strcmp(build_id, "-") ? build_id : "");
+		entry.has_subtests = count >= 0;
+
+		if (count > 0)
+			subtests_left = count;
+		else
+			subtest_cache_store(cache, &entry);
+	}
+
+	/* Truncated file */
+	if (subtests_left > 0)
+		free_subtest_cache_entry(&entry);
+
+	free(line);
+	fclose(f);
+
+	cache->dirty = false;
+
+	return true;
+}
+
+bool write_subtest_cache(struct subtest_cache *cache, const char *filename)
+{
+	char *tmpname;
+	size_t i, k;
+	bool ok;
+	FILE *f;
+
+	asprintf(&tmpname, "%s.tmp", filename);
+
+	if ((f = fopen(tmpname, "w")) == NULL) {
+		fprintf(stderr, "Cannot write the subtest cache %s: %s\n",
+			tmpname, strerror(errno));
+		free(tmpname);
+		return false;
+	}
+
+	fprintf(f, SUBTEST_CACHE_MAGIC " %d\n", SUBTEST_CACHE_VERSION);
+
+	for (i = 0; i < cache->size; i++) {
+		struct subtest_cache_entry *entry = &cache->entries[i];
+
+		fprintf(f, "%s\t%lld %lld %llu %s %ld\n",
+			entry->path,
+			(long long)entry->mtime_sec,
+			(long long)entry->mtime_nsec,
+			(unsigned long long)entry->size,
+			entry->build_id[0] ? entry->build_id : "-",
+			entry->has_subtests ? (long)entry->num_subtests : -1L);
+
+		for (k = 0; k < entry->num_subtests; k++)
+			fprintf(f, "%s\n", entry->subtests[k]);
+	}
+
+	ok = !ferror(f);
+	ok = fclose(f) == 0 && ok;
+	ok = ok && rename(tmpname, filename) == 0;
+
+	if (!ok) {
+		fprintf(stderr, "Writing the subtest cache %s failed\n", filename);
+		unlink(tmpname);
+	} else {
+		cache->dirty = false;
+	}
+
+	free(tmpname);
+
+	return ok;
+}
+
+static char *build_id_from_notes(const char *notes, size_t size, size_t align)
+{
+	size_t offset = 0;
+
+	while (offset + sizeof(Elf64_Nhdr) <= size) {
+		const Elf64_Nhdr *nhdr = (const Elf64_Nhdr *)(notes + offset);
+		size_t name = offset + sizeof(*nhdr);
+		size_t desc = name + ((nhdr->n_namesz + align - 1) & ~(align - 1));
+
+		if (desc + nhdr->n_descsz > size)
+			break;
+
+		if (nhdr->n_type == NT_GNU_BUILD_ID &&
+		    nhdr->n_namesz == sizeof(ELF_NOTE_GNU) &&
+		    !memcmp(notes + name, ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU))) {
+			char *hex = malloc(2 * nhdr->n_descsz + 1);
+			size_t i;
+
+			for (i = 0; i < nhdr->n_descsz; i++)
+				sprintf(hex + 2 * i, "%02x", (unsigned char)notes[desc + i]);
+			hex[2 * nhdr->n_descsz] = '\0';
+
+			return hex;
+		}
+
+		offset = desc + ((nhdr->n_descsz + align - 1) & ~(align - 1));
+	}
+
+	return NULL;
+}
+
+/* Only 64-bit ELF binaries are looked at, others get no build id */
+static char *read_build_id(int fd)
+{
+	Elf64_Ehdr ehdr;
+	Elf64_Phdr phdr;
+	char *id = NULL;
+	int i;
+
+	if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr) ||
+	    memcmp(ehdr.e_ident, ELFMAG, SELFMAG) ||
+	    ehdr.e_ident[EI_CLASS] != ELFCLASS64 ||
+	    ehdr.e_phentsize != sizeof(phdr))
+		return strdup("");
+
+	for (i = 0; i < ehdr.e_phnum && !id; i++) {
+		char *notes;
+
+		if (pread(fd, &phdr, sizeof(phdr), ehdr.e_phoff + i * sizeof(phdr)) != sizeof(phdr))
+			break;
+
+		if (phdr.p_type != PT_NOTE || phdr.p_filesz > MAX_NOTE_SIZE)
+			continue;
+
+		notes = malloc(phdr.p_filesz);
+		if (pread(fd, notes, phdr.p_filesz, phdr.p_offset) == phdr.p_filesz)
+			id = build_id_from_notes(notes, phdr.p_filesz,
+						 phdr.p_align == 8 ? 8 : 4);
+		free(notes);
+	}
+
+	return id ?: strdup("");
+}
+
+bool subtest_cache_key(struct subtest_cache_entry *entry, const char *path)
+{
+	struct stat st;
+	int fd;
+
+	memset(entry, 0, sizeof(*entry));
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return false;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return false;
+	}
+
+	entry->path = strdup(path);
+	entry->mtime_sec = st.st_mtim.tv_sec;
+	entry->mtime_nsec = st.st_mtim.tv_nsec;
+	entry->size = st.st_size;
+	entry->build_id = read_build_id(fd);
+
+	close(fd);
+
+	return true;
+}
+
+static struct subtest_cache_entry *find_entry(struct subtest_cache *cache,
+					      const char *path)
+{
+	size_t i;
+
+	for (i = 0; i < cache->size; i++) {
+		if (!strcmp(cache->entries[i].path, path))
+			return &cache->entries[i];
+	}
+
+	return NULL;
+}
+
+struct subtest_cache_entry *subtest_cache_lookup(struct subtest_cache *cache,
+						 const struct subtest_cache_entry *key)
+{
+	struct subtest_cache_entry *entry = find_entry(cache, key->path);
+
+	if (entry &&
+	    entry->mtime_sec == key->mtime_sec &&
+	    entry->mtime_nsec == key->mtime_nsec &&
+	    entry->size == key->size &&
+	    !strcmp(entry->build_id, key->build_id)) {
+		cache->hits++;
+		return entry;
+	}
+
+	cache->misses++;
+	return NULL;
+}
+
+void subtest_cache_store(struct subtest_cache *cache,
+			 struct subtest_cache_entry *entry)
+{
+	struct subtest_cache_entry *old = find_entry(cache, entry->path);
+
+	if (old) {
+		free_subtest_cache_entry(old);
+	} else {
+		cache->size++;
+		cache->entries = realloc(cache->entries,
+					 cache->size * sizeof(*cache->entries));
+		old = &cache->entries[cache->size - 1];
+	}
+
+	*old = *entry;
+	memset(entry, 0, sizeof(*entry));
+	cache->dirty = true;
+}
@@ -0,0 +1,58 @@
+#ifndef RUNNER_SUBTEST_CACHE_H
+#define RUNNER_SUBTEST_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * On-disk cache of the subtest lists of test binaries, to avoid
+ * running every binary with --list-subtests when creating the job
+ * list. An entry is valid as long as the binary has the same
+ * modification time, size and build id as when it was listed.
+ */
+
+struct subtest_cache_entry {
+	char *path;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t size;
+	/* Hex string of the GNU build id, empty if the binary has none */
+	char *build_id;
+	/* False for binaries without subtests */
+	bool has_subtests;
+	char **subtests;
+	size_t num_subtests;
+};
+
+struct subtest_cache {
+	struct subtest_cache_entry *entries;
+	size_t size;
+	size_t hits;
+	size_t misses;
+	bool dirty;
+};
+
+void init_subtest_cache(struct subtest_cache *cache);
+void free_subtest_cache(struct subtest_cache *cache);
+void free_subtest_cache_entry(struct subtest_cache_entry *entry);
+
+/* A missing cache file leaves the cache empty and isn't an error */
+bool read_subtest_cache(struct subtest_cache *cache, const char *filename);
+bool write_subtest_cache(struct subtest_cache *cache, const char *filename);
+
+/* Fills the path and the validity key of an entry for the binary */
+bool subtest_cache_key(struct subtest_cache_entry *entry, const char *path);
+
+/*
+ * Returns the cached entry matching the key, counting a hit, or NULL
+ * counting a miss.
+ */
+struct subtest_cache_entry *subtest_cache_lookup(struct subtest_cache *cache,
+						 const struct subtest_cache_entry *key);
+
+/* Takes ownership of the entry, replacing any entry with the same path */
+void subtest_cache_store(struct subtest_cache *cache,
+			 struct subtest_cache_entry *entry);
+
+#endif
@@ -711,13 +711,15 @@ igt_main
 	}
 
 	igt_subtest("get_properties-sanity-non-atomic") {
-		if (display.is_atomic)
-			igt_assert_eq(drmSetClientCap(display.drm_fd, DRM_CLIENT_CAP_ATOMIC, 0), 0);
+		if (display.is_atomic) {
+			igt_assert_eq(igt_kms_cache_set_client_cap(display.drm_fd, DRM_CLIENT_CAP_ATOMIC, 0), 0);
+		}
 
 		get_prop_sanity(&display, false);
 
-		if (display.is_atomic)
-			igt_assert_eq(drmSetClientCap(display.drm_fd, DRM_CLIENT_CAP_ATOMIC, 1), 0);
+		if (display.is_atomic) {
+			igt_assert_eq(igt_kms_cache_set_client_cap(display.drm_fd, DRM_CLIENT_CAP_ATOMIC, 1), 0);
+		}
 	}
 
 	igt_fixture {
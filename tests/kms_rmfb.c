@@ -99,8 +99,8 @@ test_rmfb(struct rmfb_data *data, igt_output_t *output, enum pipe pipe, bool reo
 		close(data->drm_fd);
 
 		data->drm_fd = drm_open_driver_master(DRIVER_ANY);
-		drmSetClientCap(data->drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
-		drmSetClientCap(data->drm_fd, DRM_CLIENT_CAP_ATOMIC, 1);
+		igt_kms_cache_set_client_cap(data->drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+		igt_kms_cache_set_client_cap(data->drm_fd, DRM_CLIENT_CAP_ATOMIC, 1);
 
 		igt_pipe_refresh(&data->display, pipe, true);
 	} else {
@@ -0,0 +1,196 @@
+/*
+ * Copyright © 2015 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * Converts igt_trace files, as written with IGT_TRACE=<file>, to the Chrome
+ * trace event format for chrome://tracing or Perfetto.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "igt_trace.h"
+
+static bool first_event = true;
+
+static void print_string(const char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			printf("\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			printf("\\u%04x", *s);
+		else
+			putchar(*s);
+	}
+	putchar('"');
+}
+
+static void print_event(const char *ph, const char *name, uint32_t pid,
+			uint32_t tid, uint64_t timestamp)
+{
+	printf("%s\n{\"ph\":\"%s\",\"name\":", first_event ? "" : ",", ph);
+	print_string(name);
+	/* In microseconds */
+	printf(",\"pid\":%u,\"tid\":%u,\"ts\":%" PRIu64 ".%03u",
+	       pid, tid, timestamp / 1000, (unsigned)(timestamp % 1000));
+
+	first_event = false;
+}
+
+static int convert(const char *filename)
+{
+	struct igt_trace_header header;
+	char **names = NULL;
+	FILE *file;
+	uint32_t i, j;
+	int ret = 1;
+
+	file = fopen(filename, "r");
+	if (!file) {
+		perror(filename);
+		return 1;
+	}
+
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+	    memcmp(header.magic, IGT_TRACE_MAGIC, sizeof(header.magic)) ||
+	    header.version != IGT_TRACE_VERSION) {
+		fprintf(stderr, "%s: not an igt trace\n", filename);
+		goto out;
+	}
+
+	names = calloc(header.num_names, sizeof(*names));
+	if (header.num_names && !names)
+		goto out;
+
+	for (i = 0; i < header.num_names; i++) {
+		uint32_t len;
+
+		if (fread(&len, sizeof(len), 1, file) != 1 ||
+		    !(names[i] = calloc(len + 1, 1)) ||
+		    fread(names[i], 1, len, file) != len)
+			goto truncated;
+	}
+
+	for (i = 0; i < header.num_threads; i++) {
+		struct igt_trace_thread thread;
+		int depth = 0;
+
+		if (fread(&thread, sizeof(thread), 1, file) != 1)
+			goto truncated;
+
+		if (thread.dropped)
+			fprintf(stderr, "%s: %" PRIu64 " events of thread %u were dropped\n",
+				filename, thread.dropped, thread.tid);
+
+		for (j = 0; j < thread.num_events; j++) {
+			struct igt_trace_event ev;
+			const char *name;
+
+			if (fread(&ev, sizeof(ev), 1, file) != 1)
+				goto truncated;
+
+			if (ev.name >= header.num_names)
+				goto truncated;
+			name = names[ev.name];
+
+			switch (ev.type) {
+			case IGT_TRACE_BEGIN:
+				print_event("B", name, header.pid, thread.tid,
+					    ev.timestamp);
+				if (ev.value)
+					printf(",\"args\":{\"value\":\"0x%" PRIx64 "\"}",
+					       ev.value);
+				depth++;
+				break;
+			case IGT_TRACE_END:
+				/* The begin was overwritten in the ring */
+				if (!depth)
+					continue;
+
+				print_event("E", name, header.pid, thread.tid,
+					    ev.timestamp);
+				depth--;
+				break;
+			case IGT_TRACE_COUNTER:
+				print_event("C", name, header.pid, thread.tid,
+					    ev.timestamp);
+				printf(",\"args\":{\"value\":%" PRIu64 "}",
+				       ev.value);
+				break;
+			case IGT_TRACE_INSTANT:
+				print_event("i", name, header.pid, thread.tid,
+					    ev.timestamp);
+				printf(",\"s\":\"t\",\"args\":{\"value\":%" PRIu64 "}",
+				       ev.value);
+				break;
+			default:
+				continue;
+			}
+
+			putchar('}');
+		}
+	}
+
+	ret = 0;
+	goto out;
+
+truncated:
+	fprintf(stderr, "%s: truncated or corrupted trace\n", filename);
+out:
+	if (names)
+		for (i = 0; i < header.num_names; i++)
+			free(names[i]);
+	free(names);
+	fclose(file);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int i, ret = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <trace file>... > trace.json\n",
+			argv[0]);
+		return 1;
+	}
+
+	printf("{\"traceEvents\":[");
+
+	/* Forked children have their own files, merged as processes */
+	for (i = 1; i < argc; i++)
+		ret |= convert(argv[i]);
+
+	printf("\n]}\n");
+
+	return ret;
+}